@@ -0,0 +1,170 @@
+// Event backend benchmark: runs the echo server on epoll and on io_uring
+// (each in a forked child process) with the same reactor count and drives
+// both over loopback with the same ping-pong connections. Besides
+// requests/s it reports the server's CPU time per request, which is where
+// fewer syscalls show up even when the client is the bottleneck.
+//
+// usage: bench_backends [seconds=5] [connections=512] [client_threads=ncpu/2] [reactors=1]
+#include "tcpserver.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char MESSAGE[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde";
+static const size_t MESSAGE_LEN = sizeof(MESSAGE) - 1;
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static pid_t spawnServer(IOBackend backend, unsigned reactors, int port)
+{
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    Logger::setLevel(LogLevel::Warn);
+
+    ServerOptions options;
+    options.reactors = reactors;
+    options.backend = backend;
+    TCPServer *server = createserver(options);
+    if (!server->initialize(port, "127.0.0.1")) _exit(1);
+    server->start();
+    _exit(0);
+}
+
+// each client thread keeps its connections in lock-step: write one message on
+// every socket, then read every echo back
+static void clientLoop(int port, int connections, std::chrono::steady_clock::time_point deadline,
+                       std::atomic<unsigned long long> &completed)
+{
+    std::vector<int> fds;
+    for (int i = 0; i < connections; i++) {
+        int fd = connectTo(port);
+        if (fd >= 0) fds.push_back(fd);
+    }
+
+    unsigned long long done = 0;
+    char buffer[MESSAGE_LEN];
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (int fd : fds)
+            if (send(fd, MESSAGE, MESSAGE_LEN, MSG_NOSIGNAL) != (ssize_t)MESSAGE_LEN) goto out;
+
+        for (int fd : fds) {
+            size_t got = 0;
+            while (got < MESSAGE_LEN) {
+                ssize_t n = recv(fd, buffer + got, MESSAGE_LEN - got, 0);
+                if (n <= 0) goto out;
+                got += n;
+            }
+            done++;
+        }
+    }
+out:
+    completed += done;
+    for (int fd : fds) close(fd);
+}
+
+struct Result {
+    double rate;       // requests/s
+    double cpuPerReq;  // server user+system microseconds per request
+};
+
+static Result runOnce(IOBackend backend, unsigned reactors, int port, int seconds, int connections, int threads)
+{
+    pid_t pid = spawnServer(backend, reactors, port);
+
+    // wait until the listener is up
+    for (int i = 0; i < 200; i++) {
+        int fd = connectTo(port);
+        if (fd >= 0) {
+            close(fd);
+            break;
+        }
+        usleep(10000);
+    }
+
+    std::atomic<unsigned long long> completed(0);
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + std::chrono::seconds(seconds);
+
+    std::vector<std::thread> clients;
+    for (int t = 0; t < threads; t++) {
+        int share = connections / threads + (t < connections % threads ? 1 : 0);
+        clients.emplace_back(clientLoop, port, share, deadline, std::ref(completed));
+    }
+    for (auto &t : clients) t.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    struct rusage usage{};
+    kill(pid, SIGKILL);
+    wait4(pid, nullptr, 0, &usage);
+
+    double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                 (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    unsigned long long requests = completed.load();
+    Result result;
+    result.rate = requests / elapsed;
+    result.cpuPerReq = requests ? cpu * 1e6 / requests : 0;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned cpus = std::thread::hardware_concurrency();
+    if (cpus == 0) cpus = 1;
+
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int connections = argc > 2 ? atoi(argv[2]) : 512;
+    int threads = argc > 3 ? atoi(argv[3]) : (cpus > 1 ? cpus / 2 : 1);
+    unsigned reactors = argc > 4 ? (unsigned)atoi(argv[4]) : 1;
+    if (threads < 1) threads = 1;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::printf("%d connections, %d client threads, %u reactor(s), %ds per run\n", connections, threads,
+                reactors, seconds);
+    std::printf("%10s %14s %16s\n", "backend", "req/s", "server us/req");
+
+    const struct {
+        const char *name;
+        IOBackend backend;
+    } runs[] = {{"epoll", IOBackend::Epoll}, {"io_uring", IOBackend::IoUring}};
+
+    int port = 18200;
+    for (const auto &run : runs) {
+        Result result = runOnce(run.backend, reactors, port++, seconds, connections, threads);
+        std::printf("%10s %14.0f %16.2f\n", run.name, result.rate, result.cpuPerReq);
+        std::fflush(stdout);
+    }
+    return 0;
+}
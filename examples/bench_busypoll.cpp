@@ -0,0 +1,126 @@
+// Busy-poll benchmark: one ping-pong connection against the echo server
+// (forked per run) with the reactor blocking in the kernel and with
+// ServerOptions::busyPollMicros, on both backends. Reports round-trip
+// percentiles. Busy polling only pays off with a spare CPU for each reactor;
+// pass spin=1 to have the client poll its socket too.
+//
+// usage: bench_busypoll [round_trips=100000] [busy_poll_us=200] [spin=0]
+#include "tcpserver.h"
+#include "histogram.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static const char MESSAGE[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde";
+static const size_t MESSAGE_LEN = sizeof(MESSAGE) - 1;
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static pid_t spawnServer(IOBackend backend, unsigned busyPollMicros, int port)
+{
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    Logger::setLevel(LogLevel::Warn);
+
+    ServerOptions options;
+    options.backend = backend;
+    options.busyPollMicros = busyPollMicros;
+    TCPServer *server = createserver(options);
+    if (!server->initialize(port, "127.0.0.1")) _exit(1);
+    server->start();
+    _exit(0);
+}
+
+static bool roundTrip(int fd, bool spin)
+{
+    char buffer[MESSAGE_LEN];
+    if (send(fd, MESSAGE, MESSAGE_LEN, MSG_NOSIGNAL) != (ssize_t)MESSAGE_LEN) return false;
+    size_t got = 0;
+    while (got < MESSAGE_LEN) {
+        ssize_t n = recv(fd, buffer + got, MESSAGE_LEN - got, spin ? MSG_DONTWAIT : 0);
+        if (n > 0)
+            got += n;
+        else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;
+    }
+    return true;
+}
+
+static void runOnce(const char *name, IOBackend backend, unsigned busyPollMicros, int port, int trips, bool spin)
+{
+    pid_t pid = spawnServer(backend, busyPollMicros, port);
+
+    int fd = -1;
+    for (int i = 0; i < 200 && fd < 0; i++) {
+        fd = connectTo(port);
+        if (fd < 0) usleep(10000);
+    }
+
+    LatencyHistogram latency;
+    if (fd >= 0) {
+        // warm up caches, the connection and the reactor's event array
+        for (int i = 0; i < trips / 10 && roundTrip(fd, spin); i++) {
+        }
+        for (int i = 0; i < trips; i++) {
+            auto begin = std::chrono::steady_clock::now();
+            if (!roundTrip(fd, spin)) break;
+            latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count());
+        }
+        close(fd);
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    std::printf("%-22s %10.1f %10.1f %10.1f %10.1f\n", name, latency.percentile(50) / 1e3,
+                latency.percentile(99) / 1e3, latency.percentile(99.9) / 1e3, latency.max() / 1e3);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int trips = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned busyPoll = argc > 2 ? (unsigned)atoi(argv[2]) : 200;
+    bool spin = argc > 3 && atoi(argv[3]) != 0;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::printf("%d round trips of %zu bytes, busy poll %uus, client %s\n", trips, MESSAGE_LEN, busyPoll,
+                spin ? "spinning" : "blocking");
+    std::printf("%-22s %10s %10s %10s %10s\n", "reactor", "p50 us", "p99 us", "p99.9 us", "max us");
+
+    runOnce("epoll", IOBackend::Epoll, 0, 18500, trips, spin);
+    runOnce("epoll busy-poll", IOBackend::Epoll, busyPoll, 18501, trips, spin);
+    runOnce("io_uring", IOBackend::IoUring, 0, 18502, trips, spin);
+    runOnce("io_uring busy-poll", IOBackend::IoUring, busyPoll, 18503, trips, spin);
+    return 0;
+}
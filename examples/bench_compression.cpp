@@ -0,0 +1,160 @@
+// Compression benchmark: what each coding and level costs against what it
+// saves. Encodes a body whole with encodeBody() (as ResponseCompressor does
+// for in-memory bodies) and in 16 KiB pieces with a ContentEncoder (as for
+// streamed bodies), reporting the compressed share of the input, MB/s of
+// input and CPU nanoseconds per byte saved -- the number to weigh against
+// the bandwidth a level buys.
+//
+// usage: bench_compression [file...]   (default: generated JSON and HTML)
+#include "compression.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Input
+{
+    std::string name;
+    std::string body;
+};
+
+struct Setting
+{
+    ContentCoding coding;
+    int level;
+};
+
+static const Setting SETTINGS[] = {
+    {ContentCoding::Gzip, 1},   {ContentCoding::Gzip, 6},   {ContentCoding::Gzip, 9},
+    {ContentCoding::Deflate, 6}, {ContentCoding::Brotli, 1}, {ContentCoding::Brotli, 4},
+    {ContentCoding::Brotli, 5}, {ContentCoding::Brotli, 9}, {ContentCoding::Brotli, 11},
+};
+
+// an API response: an array of records with repetitive keys
+static std::string makeJson(size_t bytes)
+{
+    static const char *const CITIES[] = {"Lisbon", "Osaka", "Nairobi", "Quito", "Tallinn", "Perth"};
+    std::string out = "[";
+    unsigned seed = 12345;
+    for (unsigned i = 0; out.size() < bytes; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        char record[256];
+        snprintf(record, sizeof(record),
+                 "%s{\"id\":%u,\"name\":\"user%u\",\"city\":\"%s\",\"score\":%u.%02u,\"active\":%s,"
+                 "\"tags\":[\"a%u\",\"b%u\"]}",
+                 i ? "," : "", i, seed % 100000, CITIES[(seed >> 8) % 6], (seed >> 4) % 1000, seed % 100,
+                 (seed & 1) ? "true" : "false", (seed >> 12) % 50, (seed >> 16) % 50);
+        out += record;
+    }
+    return out + "]";
+}
+
+// a page of markup with some varied text
+static std::string makeHtml(size_t bytes)
+{
+    static const char *const WORDS[] = {"server", "reactor", "request", "header", "stream", "buffer",
+                                        "socket", "kernel",  "latency", "window", "chunk",  "worker"};
+    std::string out = "<!DOCTYPE html><html><head><title>Bench</title></head><body>\n";
+    unsigned seed = 777;
+    for (unsigned i = 0; out.size() < bytes; i++)
+    {
+        out += "<div class=\"item\"><h2>Item " + std::to_string(i) + "</h2><p>";
+        for (int w = 0; w < 24; w++)
+        {
+            seed = seed * 1103515245 + 12345;
+            out += WORDS[(seed >> 16) % 12];
+            out += ' ';
+        }
+        out += "</p><a href=\"/items/" + std::to_string(i) + "\">more</a></div>\n";
+    }
+    return out + "</body></html>\n";
+}
+
+static double cpuSeconds()
+{
+    return (double)std::clock() / CLOCKS_PER_SEC;
+}
+
+// repeat until at least half a second of CPU has gone by; returns seconds
+// of CPU per run and leaves one run's output size in `size`
+template <typename Encode>
+static double measure(Encode encode, size_t &size)
+{
+    double begin = cpuSeconds(), elapsed = 0;
+    unsigned runs = 0;
+    do
+    {
+        size = encode();
+        runs++;
+        elapsed = cpuSeconds() - begin;
+    } while (elapsed < 0.5);
+    return elapsed / runs;
+}
+
+static void report(const char *mode, const Input &input, const Setting &setting, size_t size, double seconds)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s-%d", contentCodingName(setting.coding), setting.level);
+    double saved = (double)input.body.size() - (double)size;
+    std::printf("%-8s %-10s %-6s %8.1f%% %10.1f %12.2f\n", input.name.c_str(), name, mode,
+                100.0 * size / input.body.size(), input.body.size() / seconds / 1e6,
+                saved > 0 ? seconds * 1e9 / saved : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Input> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file)
+        {
+            std::fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        std::ostringstream body;
+        body << file.rdbuf();
+        std::string name = argv[i];
+        inputs.push_back(Input{name.substr(name.rfind('/') + 1), body.str()});
+    }
+    if (inputs.empty())
+    {
+        inputs.push_back(Input{"json", makeJson(256 * 1024)});
+        inputs.push_back(Input{"html", makeHtml(256 * 1024)});
+    }
+
+    std::printf("%-8s %-10s %-6s %9s %10s %12s\n", "input", "coding", "mode", "size", "MB/s", "cpu ns/saved");
+    for (const Input &input : inputs)
+    {
+        std::printf("%-8s %zu bytes\n", input.name.c_str(), input.body.size());
+        for (const Setting &setting : SETTINGS)
+        {
+            if (!contentCodingAvailable(setting.coding)) continue;
+
+            size_t size = 0;
+            double seconds = measure([&] {
+                std::string out;
+                encodeBody(setting.coding, setting.level, input.body, out);
+                return out.size();
+            }, size);
+            report("whole", input, setting, size, seconds);
+
+            seconds = measure([&] {
+                std::unique_ptr<ContentEncoder> encoder = ContentEncoder::create(setting.coding, setting.level);
+                std::string out;
+                for (size_t at = 0; at < input.body.size(); at += 16384)
+                {
+                    size_t len = input.body.size() - at < 16384 ? input.body.size() - at : 16384;
+                    encoder->encode(input.body.data() + at, len, at + len == input.body.size(), out);
+                }
+                return out.size();
+            }, size);
+            report("stream", input, setting, size, seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Memory benchmark: opens N idle keep-alive connections to an HTTP server
+// (forked per backend) and reports the server's resident memory per
+// connection, right after connecting and again after one request on each.
+//
+// usage: bench_memory [connections=10000]
+#include "httpserver.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char REQUEST[] = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+
+// resident set of `pid` in KiB, -1 when unreadable
+static long residentKiB(pid_t pid)
+{
+    std::string path = "/proc/" + std::to_string(pid) + "/status";
+    FILE *status = std::fopen(path.c_str(), "r");
+    if (status == nullptr) return -1;
+    char line[256];
+    long kib = -1;
+    while (std::fgets(line, sizeof(line), status) != nullptr)
+        if (std::strncmp(line, "VmRSS:", 6) == 0) kib = std::atol(line + 6);
+    std::fclose(status);
+    return kib;
+}
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static pid_t spawnServer(IOBackend backend, int port)
+{
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    Logger::setLevel(LogLevel::Warn);
+
+    ServerOptions options;
+    options.backend = backend;
+    options.reactors = 1;
+    HttpServer server([](const HttpRequest &) { return HttpResponse::Builder().body("ok\n").build(); }, options);
+    if (!server.initialize(port, "127.0.0.1")) _exit(1);
+    server.start();
+    _exit(0);
+}
+
+// read one whole response (the body is 3 bytes) from every connection
+static bool readResponses(const std::vector<int> &fds)
+{
+    char buffer[512];
+    for (int fd : fds) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return false;
+    }
+    return true;
+}
+
+static void runOnce(const char *name, IOBackend backend, int port, unsigned connections)
+{
+    pid_t pid = spawnServer(backend, port);
+
+    int probe = -1;
+    for (int i = 0; i < 200 && probe < 0; i++) {
+        probe = connectTo(port);
+        if (probe < 0) usleep(10000);
+    }
+    if (probe >= 0) close(probe);
+    usleep(100000);
+    long base = residentKiB(pid);
+
+    std::vector<int> fds;
+    fds.reserve(connections);
+    for (unsigned i = 0; i < connections; i++) {
+        int fd = connectTo(port);
+        if (fd < 0) break;
+        fds.push_back(fd);
+    }
+    usleep(500000); // let the reactor accept the backlog
+    long idle = residentKiB(pid);
+
+    bool served = true;
+    for (int fd : fds)
+        served = served && send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL) == (ssize_t)(sizeof(REQUEST) - 1);
+    served = served && readResponses(fds);
+    usleep(200000);
+    long keptAlive = residentKiB(pid);
+
+    for (int fd : fds) close(fd);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    size_t n = fds.empty() ? 1 : fds.size();
+    std::printf("%-10s %8zu %10ld %14.0f %14.0f%s\n", name, fds.size(), base, (idle - base) * 1024.0 / n,
+                (keptAlive - base) * 1024.0 / n, served ? "" : "  (requests failed)");
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned connections = argc > 1 ? (unsigned)atoi(argv[1]) : 10000;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // the client and the forked server each hold one fd per connection
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < connections + 64) {
+        limit.rlim_cur = limit.rlim_max < connections + 64 ? limit.rlim_max : connections + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::printf("%-10s %8s %10s %14s %14s\n", "reactor", "conns", "base KiB", "idle B/conn", "served B/conn");
+    runOnce("epoll", IOBackend::Epoll, 18600, connections);
+    runOnce("io_uring", IOBackend::IoUring, 18601, connections);
+    return 0;
+}
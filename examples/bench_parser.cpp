@@ -0,0 +1,162 @@
+// Request parser microbenchmark: parses canned request heads whole, split
+// into small TCP-like segments and pipelined 16 deep, reporting ns/request
+// and heap allocations/request (counted by replacing global operator new).
+//
+// usage: bench_parser [iterations=1000000]
+#include "httprequest.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+static const char BROWSER_GET[] =
+    "GET /api/v1/orders?limit=50&cursor=eyJpZCI6MTIzNDV9 HTTP/1.1\r\n"
+    "Host: shop.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: cors\r\n"
+    "Sec-Fetch-Dest: empty\r\n"
+    "Referer: https://shop.example.com/orders\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Cookie: session=5f2b8c1e9d7a4f3b; theme=dark; _ga=GA1.1.1234567890.1700000000\r\n"
+    "\r\n";
+
+static const char CURL_GET[] =
+    "GET /health HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char JSON_POST[] =
+    "POST /api/v1/orders HTTP/1.1\r\n"
+    "Host: shop.example.com\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 45\r\n"
+    "\r\n"
+    "{\"sku\":\"A-1029\",\"quantity\":3,\"express\":false}";
+
+typedef std::chrono::steady_clock Clock;
+
+static void report(const char *name, size_t requests, size_t bytes, Clock::duration elapsed,
+                   unsigned long long allocs)
+{
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::printf("%-24s %9.1f ns/req %9.1f MB/s %8.3f allocs/req\n", name, ns / requests,
+                bytes / ns * 1e3, (double)allocs / requests);
+}
+
+static void wholeBuffer(const char *name, const std::string &input, size_t iterations)
+{
+    HttpRequestParser parser;
+    size_t headers = 0;
+
+    unsigned long long before = allocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        parser.reset();
+        if (parser.parse(input.data(), input.size()) != HttpRequestParser::Complete)
+        {
+            std::fprintf(stderr, "%s: parse failed (%d)\n", name, parser.errorStatus());
+            std::exit(1);
+        }
+        headers += parser.request().headerCount;
+    }
+    auto elapsed = Clock::now() - start;
+    report(name, iterations, input.size() * iterations, elapsed, allocations.load() - before);
+    if (headers == 0) std::exit(1);
+}
+
+// feed the request as it would arrive in `segment`-byte reads; the parser is
+// handed the growing prefix every time
+static void segmented(const char *name, const std::string &input, size_t segment, size_t iterations)
+{
+    HttpRequestParser parser;
+
+    unsigned long long before = allocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        parser.reset();
+        HttpRequestParser::Status status = HttpRequestParser::Incomplete;
+        for (size_t have = segment; status == HttpRequestParser::Incomplete; have += segment)
+        {
+            if (have > input.size()) have = input.size();
+            status = parser.parse(input.data(), have);
+        }
+        if (status != HttpRequestParser::Complete || parser.consumed() != input.size())
+        {
+            std::fprintf(stderr, "%s: segmented parse failed\n", name);
+            std::exit(1);
+        }
+    }
+    auto elapsed = Clock::now() - start;
+    report(name, iterations, input.size() * iterations, elapsed, allocations.load() - before);
+}
+
+static void pipelined(const char *name, const std::string &one, size_t depth, size_t iterations)
+{
+    std::string input;
+    for (size_t i = 0; i < depth; i++) input += one;
+
+    HttpRequestParser parser;
+    size_t rounds = iterations / depth;
+
+    unsigned long long before = allocations.load();
+    auto start = Clock::now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        size_t offset = 0, parsed = 0;
+        while (offset < input.size())
+        {
+            parser.reset();
+            if (parser.parse(input.data() + offset, input.size() - offset) != HttpRequestParser::Complete)
+            {
+                std::fprintf(stderr, "%s: pipelined parse failed\n", name);
+                std::exit(1);
+            }
+            offset += parser.consumed();
+            parsed++;
+        }
+        if (parsed != depth) std::exit(1);
+    }
+    auto elapsed = Clock::now() - start;
+    report(name, rounds * depth, input.size() * rounds, elapsed, allocations.load() - before);
+}
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::string browser(BROWSER_GET), curl(CURL_GET), post(JSON_POST);
+
+    wholeBuffer("curl GET", curl, iterations);
+    wholeBuffer("browser GET", browser, iterations);
+    wholeBuffer("JSON POST", post, iterations);
+    segmented("browser GET, 64B reads", browser, 64, iterations / 4);
+    segmented("browser GET, 1B reads", browser, 1, iterations / 64);
+    pipelined("curl GET x16 pipelined", curl, 16, iterations);
+    return 0;
+}
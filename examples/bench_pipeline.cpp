@@ -0,0 +1,187 @@
+// Pipelining benchmark: keep-alive connections that each send `depth`
+// requests in one write and read all the responses before the next batch,
+// as in TechEmpower plaintext. Runs the server in-process on one reactor,
+// epoll and io_uring, with handlers on the reactor thread and on a worker
+// pool, and reports throughput and the server's syscalls per request (recv
+// and send calls or completions, plus epoll_wait() / io_uring_enter()
+// returns) from its metrics.
+//
+// usage: bench_pipeline [seconds=3] [connections=32] [depth=16] [workers=4]
+#include "httpserver.h"
+#include "log.h"
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char REQUEST[] = "GET /plaintext HTTP/1.1\r\nHost: bench\r\n\r\n";
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// sum of every thread's value of counter `name` in a Metrics::render() text
+static uint64_t counter(const std::string &text, const std::string &name)
+{
+    uint64_t total = 0;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, name.size(), name) != 0 || line.size() <= name.size() || line[name.size()] != '{')
+            continue;
+        total += strtoull(line.c_str() + line.rfind(' ') + 1, nullptr, 10);
+    }
+    return total;
+}
+
+struct Totals
+{
+    uint64_t requests, recvs, sends, wakeups;
+
+    static Totals scrape()
+    {
+        std::string text = Metrics::render();
+        return Totals{counter(text, "http_requests_total"), counter(text, "tcp_recv_calls_total"),
+                      counter(text, "tcp_send_calls_total"), counter(text, "reactor_wakeups_total")};
+    }
+};
+
+// `depth` requests per write, then every response byte before the next
+static void clientLoop(int port, int depth, Clock::time_point deadline, std::atomic<uint64_t> &answered)
+{
+    int fd = connectTo(port);
+    if (fd < 0) return;
+
+    std::string batch;
+    for (int i = 0; i < depth; i++) batch += REQUEST;
+
+    // learn one response's length from the first batch of one
+    size_t responseLength = 0;
+    char chunk[65536];
+    std::string first;
+    if (send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL) != (ssize_t)sizeof(REQUEST) - 1) return;
+    while (responseLength == 0) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return;
+        first.append(chunk, n);
+        size_t end = first.find("\r\n\r\n");
+        const char *length = strstr(first.c_str(), "Content-Length: ");
+        if (end != std::string::npos && length != nullptr)
+            responseLength = end + 4 + strtoul(length + 16, nullptr, 10);
+    }
+
+    uint64_t done = 0;
+    while (Clock::now() < deadline) {
+        if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != (ssize_t)batch.size()) break;
+        size_t need = responseLength * depth;
+        while (need > 0) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                need = 0;
+                done = 0;
+                break;
+            }
+            need -= (size_t)n < need ? (size_t)n : need;
+        }
+        done += depth;
+    }
+    close(fd);
+    answered += done;
+}
+
+static void runOnce(const char *name, IOBackend backend, unsigned workers, int port, int seconds, int connections,
+                    int depth)
+{
+    ServerOptions options;
+    options.backend = backend;
+    HttpOptions http;
+    http.workers = workers;
+    http.maxPipelined = depth > 16 ? depth : 16;
+    HttpServer server([](const HttpRequest &) {
+        return HttpResponse::Builder().body("Hello, World!").build();
+    }, options, http);
+    if (!server.initialize(port, "127.0.0.1")) {
+        std::printf("%-18s %12s\n", name, "failed");
+        return;
+    }
+    std::thread serving([&server] { server.start(); });
+
+    Totals before = Totals::scrape();
+    std::atomic<uint64_t> answered(0);
+    auto begin = Clock::now();
+    auto deadline = begin + std::chrono::seconds(seconds);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; c++)
+        clients.emplace_back(clientLoop, port, depth, deadline, std::ref(answered));
+    for (auto &t : clients) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    Totals after = Totals::scrape();
+
+    server.stop();
+    serving.join();
+
+    double requests = (double)(after.requests - before.requests);
+    if (requests == 0) {
+        std::printf("%-18s %12s\n", name, "failed");
+        return;
+    }
+    double recvs = (after.recvs - before.recvs) / requests;
+    double sends = (after.sends - before.sends) / requests;
+    double wakeups = (after.wakeups - before.wakeups) / requests;
+    std::printf("%-18s %12.0f %10.3f %10.3f %10.3f %10.3f\n", name, answered.load() / elapsed, recvs, sends, wakeups,
+                recvs + sends + wakeups);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    int connections = argc > 2 ? atoi(argv[2]) : 32;
+    int depth = argc > 3 ? atoi(argv[3]) : 16;
+    unsigned workers = argc > 4 ? (unsigned)atoi(argv[4]) : 4;
+
+    signal(SIGPIPE, SIG_IGN);
+    Logger::setLevel(LogLevel::Warn);
+
+    std::printf("%d connections, %d requests per write, %ds per run\n", connections, depth, seconds);
+    std::printf("%-18s %12s %10s %10s %10s %10s\n", "server", "req/s", "recv/req", "send/req", "wake/req",
+                "sys/req");
+
+    char name[32];
+    snprintf(name, sizeof(name), "epoll %u workers", workers);
+    runOnce("epoll reactor", IOBackend::Epoll, 0, 18310, seconds, connections, depth);
+    runOnce(name, IOBackend::Epoll, workers, 18311, seconds, connections, depth);
+    snprintf(name, sizeof(name), "io_uring %u workers", workers);
+    runOnce("io_uring reactor", IOBackend::IoUring, 0, 18312, seconds, connections, depth);
+    runOnce(name, IOBackend::IoUring, workers, 18313, seconds, connections, depth);
+    return 0;
+}
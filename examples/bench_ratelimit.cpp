@@ -0,0 +1,96 @@
+// Rate limiter microbenchmark: ns per RateLimiter::allow() for one hot
+// client (always allowed, then always refused), for many clients spread
+// over the table, and from several threads at once, on the same client
+// bucket and on their own. The clock is read once per 1024 checks, as the
+// server passes in the time it already read for the parser.
+//
+// usage: bench_ratelimit [checks=20000000] [threads=4]
+#include "metrics.h"
+#include "ratelimit.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<unsigned long long> allowed(0);
+
+// `checks` calls from one thread, client addresses cycling through
+// `clients` starting at `first`; returns seconds
+static double run(RateLimiter &limiter, size_t checks, uint32_t first, uint32_t clients)
+{
+    auto begin = Clock::now();
+    unsigned long long passed = 0;
+    uint64_t now = Metrics::nowNanos();
+    uint32_t client = 0;
+    for (size_t i = 0; i < checks; i++)
+    {
+        if ((i & 1023) == 0) now = Metrics::nowNanos();
+        passed += limiter.allow(first + client, "/api/items", now);
+        if (++client == clients) client = 0;
+    }
+    allowed += passed;
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+static void report(const char *name, size_t checks, double seconds, unsigned threads = 1)
+{
+    std::printf("%-36s %8.1f ns/check %8.1f M checks/s\n", name, seconds * 1e9 * threads / checks,
+                checks / seconds / 1e6);
+    std::fflush(stdout);
+}
+
+static void parallel(const char *name, size_t checks, unsigned threads, bool shared)
+{
+    RateLimiter limiter(1e9, 1000, std::vector<RateLimitRule>(), 1 << 20);
+    std::vector<std::thread> pool;
+    std::vector<double> seconds(threads);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        pool.emplace_back([&, t] {
+            seconds[t] = run(limiter, checks / threads, shared ? 1 : (t + 1) << 20, shared ? 1 : 1000);
+        });
+    }
+    double longest = 0;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        pool[t].join();
+        if (seconds[t] > longest) longest = seconds[t];
+    }
+    report(name, checks, longest, threads);
+}
+
+int main(int argc, char **argv)
+{
+    size_t checks = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000000;
+    unsigned threads = argc > 2 ? (unsigned)atoi(argv[2]) : 4;
+
+    {
+        RateLimiter limiter(1e9, 1000);
+        report("one client, allowed", checks, run(limiter, checks, 1, 1));
+    }
+    {
+        RateLimiter limiter(1, 1);
+        report("one client, refused", checks, run(limiter, checks, 1, 1));
+    }
+    {
+        std::vector<RateLimitRule> routes = {{"/static/", 1e9, 1000, true}, {"/api/", 1e9, 1000, true}};
+        RateLimiter limiter(1e9, 1000, routes);
+        report("one client and its route", checks, run(limiter, checks, 1, 1));
+    }
+    {
+        RateLimiter limiter(1e9, 1000, std::vector<RateLimitRule>(), 1 << 20);
+        report("100k clients, 1M slots", checks, run(limiter, checks, 1, 100000));
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%u threads, one client", threads);
+    parallel(name, checks, threads, true);
+    snprintf(name, sizeof(name), "%u threads, 1k clients each", threads);
+    parallel(name, checks, threads, false);
+
+    std::printf("(%llu allowed)\n", allowed.load());
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Response serialization microbenchmark: formats canned responses as a fresh
+// string (serialize()) and in place into a connection's output queue, the
+// way the server writes them, reporting ns/response and heap
+// allocations/response (counted by replacing global operator new).
+//
+// usage: bench_response [iterations=2000000]
+#include "httpresponse.h"
+#include "outputbuffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+typedef std::chrono::steady_clock Clock;
+
+static void report(const char *name, size_t responses, size_t bytes, Clock::duration elapsed,
+                   unsigned long long allocs)
+{
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::printf("%-32s %9.1f ns/resp %9.1f MB/s %8.3f allocs/resp\n", name, ns / responses,
+                bytes / ns * 1e3, (double)allocs / responses);
+}
+
+static void asString(const char *name, const HttpResponse &response, size_t iterations)
+{
+    size_t bytes = 0;
+    unsigned long long before = allocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        bytes += response.serialize().size();
+    report(name, iterations, bytes, Clock::now() - start, allocations.load() - before);
+}
+
+// head and body written straight into the queue, which is drained every 16
+// responses as a socket send would
+static void inPlace(const char *name, const HttpResponse &response, size_t iterations)
+{
+    OutputBuffer output;
+    size_t bytes = 0;
+    unsigned long long before = allocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        char *out = output.prepare(response.headSize() + response.body.size());
+        char *end = out + response.serializeHead(out);
+        std::memcpy(end, response.body.data(), response.body.size());
+        output.commit(end + response.body.size());
+        if (i % 16 == 15)
+        {
+            bytes += output.size();
+            output.consume(output.size());
+        }
+    }
+    bytes += output.size();
+    report(name, iterations, bytes, Clock::now() - start, allocations.load() - before);
+}
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+
+    HttpResponse text = HttpResponse::Builder().body("Hello, world!\n").build();
+    HttpResponse json = HttpResponse::Builder()
+                            .status(201)
+                            .header("Content-Type", "application/json")
+                            .header("Location", "/api/v1/orders/12345")
+                            .header("Cache-Control", "no-store")
+                            .body("{\"id\":12345,\"status\":\"accepted\"}")
+                            .build();
+    // what StaticFiles builds: a static type and a shared header block
+    HttpResponse file = HttpResponse::Builder()
+                            .contentType("image/jpeg")
+                            .headerBlock(std::make_shared<const std::string>(
+                                "ETag: \"68b4795b-1eccc\"\r\nLast-Modified: Sun, 31 Aug 2025 16:33:31 GMT\r\n"
+                                "Accept-Ranges: bytes\r\n"))
+                            .build();
+    file.fileLength = 126156;
+    HttpResponse custom = HttpResponse::Builder().status(299, "Custom").version("HTTP/1.0").body("x").build();
+
+    asString("text 200, string", text, iterations);
+    inPlace("text 200, in place", text, iterations);
+    asString("JSON 201, string", json, iterations);
+    inPlace("JSON 201, in place", json, iterations);
+    asString("file head, string", file, iterations);
+    inPlace("file head, in place", file, iterations);
+    inPlace("custom status, in place", custom, iterations);
+    return 0;
+}
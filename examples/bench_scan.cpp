@@ -0,0 +1,129 @@
+// Header-scanning benchmark: parses a corpus of realistic request heads with
+// every scanning kernel the CPU supports (scalar, SSE4.2, AVX2) and reports
+// ns/request plus the speedup over the scalar kernels for each request.
+//
+// usage: bench_scan [iterations=200000]
+#include "httprequest.h"
+#include "httpscan.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Sample
+{
+    const char *name;
+    std::string head;
+};
+
+static std::string browserGet()
+{
+    return "GET /api/v1/orders?limit=50&cursor=eyJpZCI6MTIzNDV9 HTTP/1.1\r\n"
+           "Host: shop.example.com\r\n"
+           "Connection: keep-alive\r\n"
+           "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+           "Accept: application/json, text/plain, */*\r\n"
+           "sec-ch-ua-mobile: ?0\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+           "sec-ch-ua-platform: \"Linux\"\r\n"
+           "Sec-Fetch-Site: same-origin\r\n"
+           "Sec-Fetch-Mode: cors\r\n"
+           "Sec-Fetch-Dest: empty\r\n"
+           "Referer: https://shop.example.com/orders\r\n"
+           "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+           "Accept-Language: en-US,en;q=0.9\r\n"
+           "Cookie: session=5f2b8c1e9d7a4f3b; theme=dark; _ga=GA1.1.1234567890.1700000000\r\n"
+           "\r\n";
+}
+
+// analytics and A/B-testing cookies easily reach several KiB
+static std::string largeCookie()
+{
+    std::string cookie;
+    for (int i = 0; cookie.size() < 6000; i++)
+        cookie += "_exp" + std::to_string(i) + "=v2.6f3a9c1d0e7b4a58.1714060800.b4c2e1f0a9d8c7b6; ";
+    cookie.resize(cookie.size() - 2);
+
+    return "GET /dashboard HTTP/1.1\r\n"
+           "Host: app.example.com\r\n"
+           "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 14_4) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4 Safari/605.1.15\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+           "Cookie: " + cookie + "\r\n"
+           "\r\n";
+}
+
+// proxies and tracing stacks add dozens of short headers
+static std::string manyHeaders()
+{
+    std::string head = "POST /v2/events/ingest HTTP/1.1\r\nHost: ingest.example.com\r\n";
+    for (int i = 0; i < 40; i++)
+        head += "X-Forwarded-Meta-" + std::to_string(i) + ": region=eu-west-1;zone=b;hop=" + std::to_string(i) + "\r\n";
+    head += "traceparent: 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+    return head;
+}
+
+static std::string curlGet()
+{
+    return "GET /health HTTP/1.1\r\nHost: 127.0.0.1:8080\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n";
+}
+
+static double nsPerRequest(const std::string &head, size_t iterations)
+{
+    HttpRequestParser parser; // picks up the kernels selected last
+    size_t headers = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        parser.reset();
+        if (parser.parse(head.data(), head.size()) != HttpRequestParser::Complete)
+        {
+            std::fprintf(stderr, "parse failed (%d)\n", parser.errorStatus());
+            std::exit(1);
+        }
+        headers += parser.request().headerCount;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (headers == 0) std::exit(1);
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+    std::vector<Sample> corpus = {
+        {"curl GET", curlGet()},
+        {"browser GET", browserGet()},
+        {"6 KiB cookie", largeCookie()},
+        {"42 headers", manyHeaders()},
+    };
+
+    const char *kernels[] = {"scalar", "sse4.2", "avx2"};
+    std::printf("default kernels: %s\n\n", httpScanKernels().name);
+    std::printf("%-14s %7s", "request", "bytes");
+    for (const char *k : kernels) std::printf(" %18s", k);
+    std::printf("\n");
+
+    for (const Sample &sample : corpus)
+    {
+        std::printf("%-14s %7zu", sample.name, sample.head.size());
+        double scalar = 0;
+        for (const char *k : kernels)
+        {
+            if (!selectHttpScanKernels(k))
+            {
+                std::printf(" %18s", "n/a");
+                continue;
+            }
+            double ns = nsPerRequest(sample.head, iterations);
+            if (scalar == 0) scalar = ns;
+            std::printf(" %8.0fns (%4.2fx)", ns, scalar / ns);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
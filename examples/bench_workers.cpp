@@ -0,0 +1,176 @@
+// Worker pool benchmark: runs the HTTP server (in a forked child) with
+// handlers on the reactor thread and then on a worker pool, and drives it
+// with keep-alive connections where every `slow_every`-th request hits a
+// handler that burns CPU for a while. Reports the latency of the fast
+// requests, which on the reactor thread queue up behind the slow ones.
+//
+// usage: bench_workers [seconds=5] [connections=32] [slow_every=10] [slow_ms=5] [workers=4]
+#include "httpserver.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static pid_t spawnServer(unsigned workers, int slowMs, int port)
+{
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    Logger::setLevel(LogLevel::Warn);
+
+    HttpOptions http;
+    http.workers = workers;
+    HttpServer server([slowMs](const HttpRequest &request) {
+        if (request.path() == "/slow") {
+            // stands in for templating or compression
+            auto until = Clock::now() + std::chrono::milliseconds(slowMs);
+            while (Clock::now() < until) {
+            }
+        }
+        return HttpResponse::Builder().body("ok\n").build();
+    }, ServerOptions(), http);
+    if (!server.initialize(port, "127.0.0.1")) _exit(1);
+    server.start();
+    _exit(0);
+}
+
+// one full response: the head, then Content-Length bytes of body
+static bool readResponse(int fd, std::string &buffer)
+{
+    buffer.clear();
+    char chunk[4096];
+    size_t need = std::string::npos;
+    while (need == std::string::npos || buffer.size() < need) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        size_t end = buffer.find("\r\n\r\n");
+        if (need == std::string::npos && end != std::string::npos) {
+            const char *length = strstr(buffer.c_str(), "Content-Length: ");
+            need = end + 4 + (length ? strtoul(length + 16, nullptr, 10) : 0);
+        }
+    }
+    return true;
+}
+
+static void clientLoop(int port, int slowEvery, int offset, Clock::time_point deadline, std::mutex &lock,
+                       std::vector<double> &latencies)
+{
+    static const char FAST[] = "GET /fast HTTP/1.1\r\nHost: bench\r\n\r\n";
+    static const char SLOW[] = "GET /slow HTTP/1.1\r\nHost: bench\r\n\r\n";
+
+    int fd = connectTo(port);
+    if (fd < 0) return;
+
+    std::vector<double> local;
+    std::string buffer;
+    for (int i = offset; Clock::now() < deadline; i++) {
+        bool slow = slowEvery > 0 && i % slowEvery == 0;
+        const char *request = slow ? SLOW : FAST;
+        size_t len = slow ? sizeof(SLOW) - 1 : sizeof(FAST) - 1;
+
+        auto begin = Clock::now();
+        if (send(fd, request, len, MSG_NOSIGNAL) != (ssize_t)len) break;
+        if (!readResponse(fd, buffer)) break;
+        if (!slow) local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+    }
+    close(fd);
+
+    std::lock_guard<std::mutex> guard(lock);
+    latencies.insert(latencies.end(), local.begin(), local.end());
+}
+
+static void runOnce(const char *name, unsigned workers, int port, int seconds, int connections, int slowEvery,
+                    int slowMs)
+{
+    pid_t pid = spawnServer(workers, slowMs, port);
+
+    // wait until the listener is up
+    for (int i = 0; i < 200; i++) {
+        int fd = connectTo(port);
+        if (fd >= 0) {
+            close(fd);
+            break;
+        }
+        usleep(10000);
+    }
+
+    std::mutex lock;
+    std::vector<double> latencies;
+    auto begin = Clock::now();
+    auto deadline = begin + std::chrono::seconds(seconds);
+
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; c++)
+        clients.emplace_back(clientLoop, port, slowEvery, c, deadline, std::ref(lock), std::ref(latencies));
+    for (auto &t : clients) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    if (latencies.empty()) {
+        std::printf("%10s %12s\n", name, "failed");
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double q) { return latencies[(size_t)(q * (latencies.size() - 1))]; };
+    std::printf("%10s %12.0f %10.0f %10.0f %10.0f\n", name, latencies.size() / elapsed, at(0.5), at(0.99),
+                latencies.back());
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int connections = argc > 2 ? atoi(argv[2]) : 32;
+    int slowEvery = argc > 3 ? atoi(argv[3]) : 10;
+    int slowMs = argc > 4 ? atoi(argv[4]) : 5;
+    unsigned workers = argc > 5 ? (unsigned)atoi(argv[5]) : 4;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::printf("%d connections, 1 in %d requests takes %dms, %ds per run\n", connections, slowEvery, slowMs,
+                seconds);
+    std::printf("%10s %12s %10s %10s %10s\n", "handlers", "fast req/s", "p50 us", "p99 us", "max us");
+
+    runOnce("reactor", 0, 18300, seconds, connections, slowEvery, slowMs);
+    char name[32];
+    snprintf(name, sizeof(name), "%u workers", workers);
+    runOnce(name, workers, 18301, seconds, connections, slowEvery, slowMs);
+    return 0;
+}
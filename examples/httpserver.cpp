@@ -0,0 +1,44 @@
+#include "httpserver.h"
+#include "staticfiles.h"
+#include <signal.h>
+#include <iostream>
+#include <memory>
+#include <string>
+
+static HttpServer *running = nullptr;
+
+static void stopServer(int) {
+    if (running) running->stop();
+}
+
+// Serves the files of a directory (default ./assets) on 127.0.0.1:8080,
+// text-like ones compressed once and then from memory when clients accept it.
+// SIGTERM or SIGINT drains and exits. With a handoff socket path, starting
+// a second instance on the same path takes the listening sockets over and
+// drains this one, for restarts without refused connections.
+//
+// usage: httpserver [directory] [handoff_path]
+int main(int argc, char **argv) {
+    StaticFiles files(argc > 1 ? argv[1] : "assets");
+    files.precompress(std::make_shared<PrecompressedFiles>());
+
+    ServerOptions options;
+    if (argc > 2) options.handoffPath = argv[2];
+
+    HttpServer server([&files](const HttpRequest &request) {
+        return files.serve(request);
+    }, options);
+
+    if (!server.initialize(8080, "127.0.0.1")) {
+        std::cerr << "Server initialization failed!" << std::endl;
+        return -1;
+    }
+
+    running = &server;
+    signal(SIGTERM, stopServer);
+    signal(SIGINT, stopServer);
+
+    std::cout << "HTTP server started on 127.0.0.1:8080" << std::endl;
+    server.start();
+    return 0;
+}
@@ -0,0 +1,123 @@
+// HTTP load generator: keep-alive connections driven from a few epoll
+// threads, closed loop (fixed concurrency) by default or open loop with -R
+// (fixed request rate, latency measured from the scheduled send time).
+//
+// usage: loadgen [-c connections=100] [-t threads=1] [-d seconds=10]
+//                [-w warmup_seconds=0] [-R requests_per_second] [-P pipeline=1]
+//                [-m method=GET] [-H "Name: value"]... [url=http://127.0.0.1:8080/]
+#include "loadgen.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: loadgen [-c connections] [-t threads] [-d seconds] [-w warmup] [-R rate]\n"
+                 "               [-P pipeline] [-m method] [-H header]... [http://host:port/path]\n");
+    std::exit(2);
+}
+
+// http://host[:port][/path]
+static bool parseUrl(const std::string &url, std::string &host, int &port, std::string &path)
+{
+    std::string rest = url;
+    if (rest.compare(0, 7, "http://") == 0) rest = rest.substr(7);
+    size_t slash = rest.find('/');
+    path = slash == std::string::npos ? "/" : rest.substr(slash);
+    std::string authority = rest.substr(0, slash);
+    size_t colon = authority.find(':');
+    host = authority.substr(0, colon);
+    port = colon == std::string::npos ? 80 : atoi(authority.c_str() + colon + 1);
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+// thousands of connections need more descriptors than the usual soft limit
+static void raiseFileLimit(unsigned connections)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+    rlim_t wanted = connections + 64;
+    if (limit.rlim_cur >= wanted) return;
+    limit.rlim_cur = limit.rlim_max < wanted ? limit.rlim_max : wanted;
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+static std::string formatNs(uint64_t ns)
+{
+    char buf[32];
+    if (ns < 1000)
+        std::snprintf(buf, sizeof(buf), "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)
+        std::snprintf(buf, sizeof(buf), "%.2fus", ns / 1e3);
+    else if (ns < 1000000000)
+        std::snprintf(buf, sizeof(buf), "%.2fms", ns / 1e6);
+    else
+        std::snprintf(buf, sizeof(buf), "%.2fs", ns / 1e9);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    LoadOptions options;
+    std::string method = "GET";
+    std::vector<std::string> headers;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:w:R:P:m:H:h")) != -1) {
+        switch (opt) {
+        case 'c': options.connections = (unsigned)atoi(optarg); break;
+        case 't': options.threads = (unsigned)atoi(optarg); break;
+        case 'd': options.seconds = atof(optarg); break;
+        case 'w': options.warmup = atof(optarg); break;
+        case 'R': options.rate = atof(optarg); break;
+        case 'P': options.pipeline = (unsigned)atoi(optarg); break;
+        case 'm': method = optarg; break;
+        case 'H': headers.push_back(optarg); break;
+        default: usage();
+        }
+    }
+
+    std::string path;
+    if (!parseUrl(optind < argc ? argv[optind] : "http://127.0.0.1:8080/", options.host, options.port, path))
+        usage();
+
+    options.request = method + " " + path + " HTTP/1.1\r\nHost: " + options.host + ":" +
+                      std::to_string(options.port) + "\r\n";
+    for (const std::string &header : headers) options.request += header + "\r\n";
+    options.request += "\r\n";
+
+    raiseFileLimit(options.connections);
+
+    if (options.rate > 0)
+        std::printf("open loop at %.0f req/s, ", options.rate);
+    else
+        std::printf("closed loop, ");
+    std::printf("%u connections, %u threads, pipeline %u, %gs (+%gs warmup)\n", options.connections,
+                options.threads, options.pipeline, options.seconds, options.warmup);
+    std::fflush(stdout);
+
+    LoadResult result;
+    if (!runLoad(options, result)) {
+        std::fprintf(stderr, "cannot run against %s:%d with these options\n", options.host.c_str(), options.port);
+        return 1;
+    }
+
+    const LatencyHistogram &latency = result.latency;
+    std::printf("  requests   %llu (%.1f/s), %.2f MB/s read\n", (unsigned long long)result.requests,
+                result.requests / result.elapsed, result.bytesRead / result.elapsed / 1e6);
+    std::printf("  errors     %llu, HTTP 4xx/5xx %llu\n", (unsigned long long)result.errors,
+                (unsigned long long)result.httpErrors);
+    if (options.rate > 0)
+        std::printf("  unfinished %llu (latency counted up to the end)\n", (unsigned long long)result.unfinished);
+    std::printf("  latency    min %s  mean %s  max %s\n", formatNs(latency.min()).c_str(),
+                formatNs((uint64_t)latency.mean()).c_str(), formatNs(latency.max()).c_str());
+
+    const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99, 100};
+    for (double p : percentiles)
+        std::printf("  %9.3f%%  %s\n", p, formatNs(latency.percentile(p)).c_str());
+    return result.requests > 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include "admission.h"
+#include "metrics.h"
+#include <cstdio>
+#include <cstring>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const uint64_t SAMPLE_NANOS = 100 * 1000 * 1000;
+
+const char REJECTION[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Content-Length: 20\r\n"
+                         "Retry-After: 1\r\n"
+                         "Connection: close\r\n"
+                         "\r\n"
+                         "Service Unavailable\n";
+
+// resident set size in bytes, 0 when unknown
+size_t residentBytes()
+{
+#ifdef __linux__
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    unsigned long size = 0, pages = 0;
+    int fields = std::fscanf(statm, "%lu %lu", &size, &pages);
+    std::fclose(statm);
+    return fields == 2 ? (size_t)pages * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+Admission::Admission(size_t maxInFlight, size_t maxMemoryBytes)
+    : maxInFlight(maxInFlight), maxMemoryBytes(maxMemoryBytes), inFlight(0), resident(0), sampledAt(0) {}
+
+bool Admission::admit()
+{
+    if (maxInFlight != 0 && inFlight.load(std::memory_order_relaxed) >= maxInFlight)
+        return false;
+    if (maxMemoryBytes != 0 && overMemory())
+        return false;
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Admission::release()
+{
+    inFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+const char *Admission::rejection(size_t &length)
+{
+    length = sizeof(REJECTION) - 1;
+    return REJECTION;
+}
+
+// one thread wins the compare-exchange and reads /proc; the rest use the
+// last sample
+bool Admission::overMemory()
+{
+    uint64_t now = Metrics::nowNanos();
+    uint64_t last = sampledAt.load(std::memory_order_relaxed);
+    if (now - last >= SAMPLE_NANOS && sampledAt.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        resident.store(residentBytes(), std::memory_order_relaxed);
+    return resident.load(std::memory_order_relaxed) > maxMemoryBytes;
+}
@@ -0,0 +1,38 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Process-wide load shedding, shared by every connection of an HttpServer.
+// A request is admitted while the handlers running or queued stay under
+// `maxInFlight` and the process's resident memory under `maxMemoryBytes`
+// (0 turns either check off); otherwise it is answered with a canned 503
+// and its connection closed, which costs no handler, parser copy or
+// allocation. Resident memory is read from /proc at most every 100ms, on
+// whichever thread asks first; elsewhere than Linux only in-flight counts.
+class Admission
+{
+public:
+    Admission(size_t maxInFlight, size_t maxMemoryBytes);
+
+    // false when over a limit; otherwise call release() once the handler
+    // has returned
+    bool admit();
+    void release();
+
+    // the whole 503 response, Connection: close
+    static const char *rejection(size_t &length);
+
+private:
+    const size_t maxInFlight;
+    const size_t maxMemoryBytes;
+    std::atomic<size_t> inFlight;
+    std::atomic<size_t> resident;     // bytes, at the last sample
+    std::atomic<uint64_t> sampledAt;  // Metrics::nowNanos() of that sample
+
+    bool overMemory();
+};
+
+#endif
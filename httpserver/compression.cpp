@@ -0,0 +1,515 @@
+#include "compression.h"
+#include "metrics.h"
+#include "outputbuffer.h"
+#include <cstring>
+#include <utility>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const char *const CODING_NAMES[] = {"", "br", "gzip", "deflate"};
+
+// media types, before any parameters, that compress well
+const char *const COMPRESSIBLE_TYPES[] = {
+    "application/json",
+    "application/javascript",
+    "application/xml",
+    "application/xhtml+xml",
+    "application/wasm",
+    "image/svg+xml",
+};
+
+// zlib and brotli take their input in pieces no larger than this
+const size_t ENCODE_SLICE = 1u << 30;
+
+inline bool isOws(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+StringView trim(StringView text)
+{
+    size_t b = 0, e = text.size();
+    while (b < e && isOws(text[b])) b++;
+    while (e > b && isOws(text[e - 1])) e--;
+    return text.substr(b, e - b);
+}
+
+// "q=0.5" as thousandths; 1000 when there is no q parameter
+unsigned qValue(StringView params)
+{
+    size_t at = 0;
+    while (at < params.size())
+    {
+        size_t semi = params.find(';', at);
+        if (semi == std::string::npos) semi = params.size();
+        StringView param = trim(params.substr(at, semi - at));
+        at = semi + 1;
+        if (param.size() < 2 || (param[0] | 0x20) != 'q' || param[1] != '=') continue;
+
+        StringView value = param.substr(2);
+        if (value.empty() || (value[0] != '0' && value[0] != '1')) return 0;
+        unsigned q = (value[0] - '0') * 1000;
+        if (value.size() > 1 && value[1] == '.')
+        {
+            unsigned scale = 100;
+            for (size_t i = 2; i < value.size() && i < 5 && value[i] >= '0' && value[i] <= '9'; i++, scale /= 10)
+                q += (value[i] - '0') * scale;
+        }
+        return q > 1000 ? 1000 : q;
+    }
+    return 1000;
+}
+
+bool sameName(const std::string &a, const char *b)
+{
+    return StringView(a).equalsIgnoreCase(b);
+}
+
+// whether the comma-separated `list` names `token`, in any case
+bool listsToken(StringView list, const char *token)
+{
+    size_t at = 0;
+    while (at < list.size())
+    {
+        size_t comma = list.find(',', at);
+        if (comma == std::string::npos) comma = list.size();
+        if (trim(list.substr(at, comma - at)).equalsIgnoreCase(token)) return true;
+        at = comma + 1;
+    }
+    return false;
+}
+
+#ifdef HAVE_ZLIB
+class ZlibEncoder : public ContentEncoder
+{
+public:
+    ZlibEncoder(bool gzip, int level) : gzip(gzip), level(level)
+    {
+        std::memset(&stream, 0, sizeof(stream));
+        // 15 bits of window; +16 asks for the gzip wrapper, plain is zlib's
+        // own, which is what HTTP calls deflate
+        ready = deflateInit2(&stream, level, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~ZlibEncoder() override
+    {
+        if (ready) deflateEnd(&stream);
+    }
+
+    bool encode(const char *data, size_t len, bool last, std::string &out) override
+    {
+        if (!ready) return false;
+        do
+        {
+            size_t slice = len < ENCODE_SLICE ? len : ENCODE_SLICE;
+            if (!deflateSlice(data, slice, last && slice == len, out)) return false;
+            data += slice;
+            len -= slice;
+        } while (len != 0);
+        return true;
+    }
+
+    // for one body after another on the same stream
+    bool reset() { return ready && deflateReset(&stream) == Z_OK; }
+    size_t bound(size_t len) { return deflateBound(&stream, (uLong)len); }
+
+    const bool gzip;
+    const int level;
+
+private:
+    z_stream stream;
+    bool ready;
+
+    bool deflateSlice(const char *data, size_t len, bool last, std::string &out)
+    {
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = (uInt)len;
+        for (;;)
+        {
+            size_t used = out.size();
+            size_t room = out.capacity() - used;
+            if (room < 4096) room = 16384;
+            out.resize(used + room);
+            stream.next_out = reinterpret_cast<Bytef *>(&out[used]);
+            stream.avail_out = (uInt)room;
+            int rc = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+            out.resize(used + room - stream.avail_out);
+            if (rc == Z_STREAM_END) return true;
+            if (rc != Z_OK && rc != Z_BUF_ERROR) return false;
+            // everything taken and no more output waiting
+            if (!last && stream.avail_in == 0 && stream.avail_out != 0) return true;
+        }
+    }
+};
+#endif
+
+#ifdef HAVE_BROTLI
+class BrotliEncoder : public ContentEncoder
+{
+public:
+    explicit BrotliEncoder(int level) : state(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr))
+    {
+        if (state != nullptr) BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, (uint32_t)level);
+    }
+
+    ~BrotliEncoder() override
+    {
+        if (state != nullptr) BrotliEncoderDestroyInstance(state);
+    }
+
+    bool encode(const char *data, size_t len, bool last, std::string &out) override
+    {
+        if (state == nullptr) return false;
+        const uint8_t *next = reinterpret_cast<const uint8_t *>(data);
+        size_t available = len;
+        BrotliEncoderOperation op = last ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+        for (;;)
+        {
+            size_t room = 0;
+            if (!BrotliEncoderCompressStream(state, op, &available, &next, &room, nullptr, nullptr)) return false;
+            size_t produced = 0;
+            const uint8_t *output = BrotliEncoderTakeOutput(state, &produced);
+            out.append(reinterpret_cast<const char *>(output), produced);
+            if (available == 0 && !BrotliEncoderHasMoreOutput(state) && (!last || BrotliEncoderIsFinished(state)))
+                return true;
+        }
+    }
+
+private:
+    BrotliEncoderState *state;
+};
+#endif
+
+// FNV-1a over a file's bytes
+bool hashFile(const FileHandle &file, uint64_t size, uint64_t &hash)
+{
+#ifdef _WIN32
+    (void)file;
+    (void)size;
+    (void)hash;
+    return false;
+#else
+    hash = 14695981039346656037ull;
+    char buffer[65536];
+    uint64_t offset = 0;
+    while (offset < size)
+    {
+        ssize_t n = pread(file.fd(), buffer, sizeof(buffer), (off_t)offset);
+        if (n <= 0) return false;
+        for (ssize_t i = 0; i < n; i++) hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ull;
+        offset += (uint64_t)n;
+    }
+    return true;
+#endif
+}
+
+bool readFile(const FileHandle &file, uint64_t size, std::string &out)
+{
+#ifdef _WIN32
+    (void)file;
+    (void)size;
+    (void)out;
+    return false;
+#else
+    out.resize((size_t)size);
+    size_t done = 0;
+    while (done < out.size())
+    {
+        ssize_t n = pread(file.fd(), &out[done], out.size() - done, (off_t)done);
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+#endif
+}
+
+} // namespace
+
+const char *contentCodingName(ContentCoding coding)
+{
+    return coding < ContentCoding::Count ? CODING_NAMES[(unsigned)coding] : "";
+}
+
+bool contentCodingAvailable(ContentCoding coding)
+{
+    switch (coding)
+    {
+#ifdef HAVE_ZLIB
+    case ContentCoding::Gzip:
+    case ContentCoding::Deflate:
+        return true;
+#endif
+#ifdef HAVE_BROTLI
+    case ContentCoding::Brotli:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+ContentCoding negotiateContentCoding(StringView acceptEncoding)
+{
+    // q-values of the codings in CODING_NAMES order; -1 until listed
+    int listed[(unsigned)ContentCoding::Count] = {-1, -1, -1, -1};
+    int any = -1;
+    size_t at = 0;
+    while (at < acceptEncoding.size())
+    {
+        size_t comma = acceptEncoding.find(',', at);
+        if (comma == std::string::npos) comma = acceptEncoding.size();
+        StringView item = acceptEncoding.substr(at, comma - at);
+        at = comma + 1;
+
+        size_t semi = item.find(';');
+        StringView name = trim(item.substr(0, semi));
+        int q = (int)qValue(semi == std::string::npos ? StringView() : item.substr(semi + 1));
+        if (name == "*")
+        {
+            any = q;
+            continue;
+        }
+        if (name.equalsIgnoreCase("x-gzip")) name = "gzip";
+        for (unsigned c = 1; c < (unsigned)ContentCoding::Count; c++)
+        {
+            if (name.equalsIgnoreCase(CODING_NAMES[c])) listed[c] = q;
+        }
+    }
+
+    ContentCoding best = ContentCoding::Identity;
+    int bestQ = 0;
+    for (unsigned c = 1; c < (unsigned)ContentCoding::Count; c++)
+    {
+        int q = listed[c] >= 0 ? listed[c] : any;
+        if (q > bestQ && contentCodingAvailable((ContentCoding)c))
+        {
+            best = (ContentCoding)c;
+            bestQ = q;
+        }
+    }
+    return best;
+}
+
+bool compressibleType(StringView contentType)
+{
+    StringView type = trim(contentType.substr(0, contentType.find(';')));
+    if (type.size() >= 5 && type.substr(0, 5).equalsIgnoreCase("text/")) return true;
+    for (const char *compressible : COMPRESSIBLE_TYPES)
+    {
+        if (type.equalsIgnoreCase(compressible)) return true;
+    }
+    // structured syntax suffixes: application/ld+json, application/atom+xml
+    return (type.size() > 5 && type.substr(type.size() - 5).equalsIgnoreCase("+json")) ||
+           (type.size() > 4 && type.substr(type.size() - 4).equalsIgnoreCase("+xml"));
+}
+
+std::unique_ptr<ContentEncoder> ContentEncoder::create(ContentCoding coding, int level)
+{
+    switch (coding)
+    {
+#ifdef HAVE_ZLIB
+    case ContentCoding::Gzip:
+    case ContentCoding::Deflate:
+        return std::unique_ptr<ContentEncoder>(new ZlibEncoder(coding == ContentCoding::Gzip, level));
+#endif
+#ifdef HAVE_BROTLI
+    case ContentCoding::Brotli:
+        return std::unique_ptr<ContentEncoder>(new BrotliEncoder(level));
+#endif
+    default:
+        (void)level;
+        return nullptr;
+    }
+}
+
+bool encodeBody(ContentCoding coding, int level, StringView data, std::string &out)
+{
+    out.clear();
+    switch (coding)
+    {
+#ifdef HAVE_ZLIB
+    case ContentCoding::Gzip:
+    case ContentCoding::Deflate:
+    {
+        // a deflate stream holds a few hundred KiB of tables: keep one per
+        // thread and coding rather than set one up per response
+        static thread_local std::unique_ptr<ZlibEncoder> streams[2];
+        bool gzip = coding == ContentCoding::Gzip;
+        std::unique_ptr<ZlibEncoder> &encoder = streams[gzip ? 0 : 1];
+        if (!encoder || encoder->level != level || !encoder->reset()) encoder.reset(new ZlibEncoder(gzip, level));
+        out.reserve(encoder->bound(data.size()));
+        return encoder->encode(data.data(), data.size(), true, out);
+    }
+#endif
+#ifdef HAVE_BROTLI
+    case ContentCoding::Brotli:
+    {
+        size_t length = BrotliEncoderMaxCompressedSize(data.size());
+        if (length == 0) return false;
+        out.resize(length);
+        if (!BrotliEncoderCompress(level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+                                   reinterpret_cast<const uint8_t *>(data.data()), &length,
+                                   reinterpret_cast<uint8_t *>(&out[0])))
+            return false;
+        out.resize(length);
+        return true;
+    }
+#endif
+    default:
+        (void)level;
+        (void)data;
+        return false;
+    }
+}
+
+ResponseCompressor::ResponseCompressor(int gzipLevel, int brotliLevel, size_t minBytes)
+    : gzipLevel(gzipLevel), brotliLevel(brotliLevel), minBytes(minBytes) {}
+
+void ResponseCompressor::apply(const HttpRequest &request, HttpResponse &response) const
+{
+    if (response.statusCode < 200 || response.statusCode >= 300 || response.statusCode == 204 ||
+        response.statusCode == 206 || response.file)
+        return;
+    if (!response.producer && response.bodyBytes().size() < minBytes) return;
+    // StaticFiles' compressed copies say so in their preformatted lines
+    if (response.headerBlock && response.headerBlock->find("Content-Encoding:") != std::string::npos) return;
+
+    StringView type = response.contentType != nullptr ? StringView(response.contentType) : StringView();
+    std::pair<std::string, std::string> *vary = nullptr;
+    for (auto &h : response.headers)
+    {
+        if (sameName(h.first, "Content-Encoding")) return;
+        if (sameName(h.first, "Cache-Control") && h.second.find("no-transform") != std::string::npos) return;
+        if (sameName(h.first, "Content-Type")) type = h.second;
+        if (sameName(h.first, "Vary")) vary = &h;
+    }
+    // without a type the server sends text/plain
+    if (!type.empty() && !compressibleType(type)) return;
+
+    // caches must tell the encodings apart whichever one this request gets
+    if (vary == nullptr)
+        response.headers.emplace_back("Vary", "Accept-Encoding");
+    else if (!listsToken(vary->second, "*") && !listsToken(vary->second, "Accept-Encoding"))
+        vary->second += ", Accept-Encoding";
+
+    ContentCoding coding = negotiateContentCoding(request.header("Accept-Encoding"));
+    if (coding == ContentCoding::Identity) return;
+    int level = coding == ContentCoding::Brotli ? brotliLevel : gzipLevel;
+
+    if (response.producer)
+    {
+        std::unique_ptr<ContentEncoder> encoder = ContentEncoder::create(coding, level);
+        if (!encoder) return;
+        response.encoder = std::move(encoder);
+    }
+    else
+    {
+        const std::string &body = response.bodyBytes();
+        std::string encoded;
+        if (!encodeBody(coding, level, body, encoded) || encoded.size() >= body.size()) return;
+        Metrics::local().add(MetricCounter::CompressionSavedBytes, body.size() - encoded.size());
+        response.body = std::move(encoded);
+        response.sharedBody.reset();
+    }
+    response.headers.emplace_back("Content-Encoding", contentCodingName(coding));
+    Metrics::local().add(MetricCounter::HttpCompressed);
+}
+
+PrecompressedFiles::PrecompressedFiles(size_t maxBytes, int gzipLevel, int brotliLevel)
+    : maxBytes(maxBytes), gzipLevel(gzipLevel), brotliLevel(brotliLevel), used(0) {}
+
+size_t PrecompressedFiles::size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return used;
+}
+
+// the identity's content hash and size, reading the file the first time
+bool PrecompressedFiles::contentKey(const FileHandle &file, uint64_t size, const std::string &identity,
+                                    std::string &key)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = hashes.find(identity);
+        if (it != hashes.end())
+        {
+            key = it->second;
+            return true;
+        }
+    }
+
+    uint64_t hash;
+    if (!hashFile(file, size, hash)) return false;
+    char text[48];
+    snprintf(text, sizeof(text), "%016llx-%llx", (unsigned long long)hash, (unsigned long long)size);
+    key = text;
+
+    std::lock_guard<std::mutex> guard(lock);
+    // identities of edited files pile up; start over now and then
+    if (hashes.size() >= 65536) hashes.clear();
+    hashes[identity] = key;
+    return true;
+}
+
+std::shared_ptr<const std::string> PrecompressedFiles::get(const FileHandle &file, uint64_t size,
+                                                           const std::string &identity, ContentCoding coding)
+{
+    if (coding == ContentCoding::Identity || !contentCodingAvailable(coding) || size > maxBytes / 4) return nullptr;
+
+    std::string key;
+    if (!contentKey(file, size, identity, key)) return nullptr;
+    key += '/';
+    key += contentCodingName(coding);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = copies.find(key);
+        if (it != copies.end())
+        {
+            lru.splice(lru.begin(), lru, it->second.lru);
+            return it->second.body;
+        }
+    }
+
+    // compressed outside the lock; a racing thread may do the same file, and
+    // the second insert simply wins
+    std::string plain, encoded;
+    if (!readFile(file, size, plain)) return nullptr;
+    std::shared_ptr<const std::string> body;
+    if (encodeBody(coding, coding == ContentCoding::Brotli ? brotliLevel : gzipLevel, plain, encoded) &&
+        encoded.size() < plain.size())
+        body = std::make_shared<const std::string>(std::move(encoded));
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = copies.find(key);
+    if (it != copies.end())
+    {
+        used -= it->second.body ? it->second.body->size() : 0;
+        lru.erase(it->second.lru);
+        copies.erase(it);
+    }
+    lru.push_front(key);
+    Copy &copy = copies[key];
+    copy.body = body;
+    copy.lru = lru.begin();
+    used += body ? body->size() : 0;
+    while (used > maxBytes && !lru.empty())
+    {
+        auto victim = copies.find(lru.back());
+        used -= victim->second.body ? victim->second.body->size() : 0;
+        copies.erase(victim);
+        lru.pop_back();
+    }
+    return body;
+}
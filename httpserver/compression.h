@@ -0,0 +1,120 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "httprequest.h"
+#include "httpresponse.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class FileHandle;
+
+// Content codings for response bodies. gzip and deflate are built in when
+// zlib is found, br when the brotli encoder is.
+enum class ContentCoding : unsigned
+{
+    Identity,
+    Brotli,
+    Gzip,
+    Deflate,
+    Count
+};
+
+// "br", "gzip", "deflate"; "" for identity
+const char *contentCodingName(ContentCoding coding);
+bool contentCodingAvailable(ContentCoding coding);
+
+// The coding to answer with under `acceptEncoding` (RFC 9110 12.5.3): the
+// highest q-value among the built-in codings, br before gzip before deflate
+// on a tie; Identity when none is acceptable
+ContentCoding negotiateContentCoding(StringView acceptEncoding);
+
+// whether a body of this media type is worth compressing: text, JSON,
+// JavaScript, XML, SVG and WebAssembly. Already compressed formats are not
+bool compressibleType(StringView contentType);
+
+// Compresses one body in pieces, for streamed responses.
+class ContentEncoder
+{
+public:
+    // nullptr for Identity or a coding not built in. `level` is the coding's
+    // own scale: 1-9 for gzip and deflate, 0-11 for br
+    static std::unique_ptr<ContentEncoder> create(ContentCoding coding, int level);
+    virtual ~ContentEncoder() = default;
+
+    // take `len` more bytes and append whatever output is ready to `out`;
+    // `last` ends the stream. false on an encoder error
+    virtual bool encode(const char *data, size_t len, bool last, std::string &out) = 0;
+};
+
+// `data` compressed whole into `out`; false when the coding is not built in
+// or fails. zlib streams are kept per thread and reset between bodies
+bool encodeBody(ContentCoding coding, int level, StringView data, std::string &out);
+
+// What HttpServer applies to the responses of its handler, on the thread
+// the handler ran on (the worker pool, when there is one). A response of a
+// compressible type with at least `minBytes` of body in memory, or with a
+// producer, is encoded with the coding the request accepts (a producer's
+// windows by the connection, see HttpResponse::encoder); it gets
+// Content-Encoding and Vary: Accept-Encoding, and an in-memory body is left
+// as it was when compressing would not shrink it. Responses that already
+// have a Content-Encoding, carry Cache-Control: no-transform, are not 2xx
+// or are file slices (see PrecompressedFiles) are left alone.
+class ResponseCompressor
+{
+public:
+    ResponseCompressor(int gzipLevel, int brotliLevel, size_t minBytes);
+
+    void apply(const HttpRequest &request, HttpResponse &response) const;
+
+private:
+    const int gzipLevel;
+    const int brotliLevel;
+    const size_t minBytes;
+};
+
+// Compressed copies of static files, made on the first request that can
+// take them and kept for the next ones, so a hot asset is compressed once.
+// Copies are keyed by a hash of the file's bytes: a file that is touched,
+// renamed or served under two paths is hashed again (a read) but not
+// recompressed. At most `maxBytes` of copies are kept, least recently used
+// going first; files over a quarter of that, and copies that would not be
+// smaller, are served uncompressed. Safe to share between threads.
+class PrecompressedFiles
+{
+public:
+    PrecompressedFiles(size_t maxBytes = 64 * 1024 * 1024, int gzipLevel = 9, int brotliLevel = 9);
+
+    // the `coding` copy of the `size` bytes of `file`, whose identity
+    // (inode, mtime, size) is `identity`; nullptr when there is none to use
+    std::shared_ptr<const std::string> get(const FileHandle &file, uint64_t size, const std::string &identity,
+                                           ContentCoding coding);
+
+    // bytes of compressed copies held
+    size_t size() const;
+
+private:
+    struct Copy
+    {
+        std::shared_ptr<const std::string> body; // null: not worth compressing
+        std::list<std::string>::iterator lru;
+    };
+
+    const size_t maxBytes;
+    const int gzipLevel;
+    const int brotliLevel;
+
+    mutable std::mutex lock;
+    size_t used;
+    std::unordered_map<std::string, std::string> hashes; // identity -> content key
+    std::unordered_map<std::string, Copy> copies;        // content key + coding -> copy
+    std::list<std::string> lru;                          // copy keys, most recently used first
+
+    bool contentKey(const FileHandle &file, uint64_t size, const std::string &identity, std::string &key);
+};
+
+#endif
@@ -0,0 +1,814 @@
+#include "connection.h"
+#include "admission.h"
+#include "compression.h"
+#include "ratelimit.h"
+#include "ctpl_stl.h"
+#include "metrics.h"
+#include "responsecache.h"
+#include "slab.h"
+#include <cstring>
+#include <exception>
+#include <memory>
+
+namespace
+{
+
+// A request that outlives the receive buffer: its bytes copied out and
+// every view moved over to the copy. A chunked body is not among those
+// bytes but in the parser, which goes back to its pool: it gets a copy of
+// its own.
+struct OwnedRequest
+{
+    std::string raw;
+    std::string body;
+    HttpRequest request;
+
+    OwnedRequest(const HttpRequest &parsed, const char *data, size_t len) : raw(data, len), request(parsed)
+    {
+        rebase(request.method, data);
+        rebase(request.target, data);
+        const char *view = request.body.data();
+        if (view != nullptr && (view < data || view + request.body.size() > data + len))
+        {
+            body.assign(view, request.body.size());
+            request.body = StringView(body);
+        }
+        else
+            rebase(request.body, data);
+        for (size_t i = 0; i < request.headerCount; i++)
+        {
+            rebase(request.headers[i].name, data);
+            rebase(request.headers[i].value, data);
+        }
+    }
+
+    void rebase(StringView &view, const char *from)
+    {
+        if (view.data() != nullptr)
+            view = StringView(raw.data() + (view.data() - from), view.size());
+    }
+};
+
+// room for a chunk's size line and the CRLF after its data
+const size_t CHUNK_FRAMING = 2 * sizeof(size_t) + 4;
+
+const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+const char LAST_CHUNK[] = "0\r\n\r\n";
+
+HttpResponse internalError(const HttpRequest &request)
+{
+    return HttpResponse::Builder().status(500).body("Internal Server Error\n").keepAlive(request.keepAlive()).build();
+}
+
+// the connection's fate as the request left it; an HTTP/1.0 client cannot
+// take a chunked body, so a stream to one ends with the connection
+void settle(const HttpRequest &request, HttpResponse &response)
+{
+    if (!request.keepAlive() || (response.producer && request.versionMinor == 0))
+        response.keepAlive = false;
+}
+
+HttpResponse runHandler(const HttpHandler &handler, const HttpRequest &request)
+{
+    try
+    {
+        HttpResponse response = handler(request);
+        settle(request, response);
+        return response;
+    }
+    catch (const std::exception &)
+    {
+        return internalError(request);
+    }
+}
+
+// the chunk-size line for `len`, in hex
+char *chunkSize(char *out, size_t len)
+{
+    static const char HEX[] = "0123456789abcdef";
+    char digits[2 * sizeof(size_t)];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = HEX[len & 15];
+        len >>= 4;
+    } while (len != 0);
+    while (n != 0) *out++ = digits[--n];
+    *out++ = '\r';
+    *out++ = '\n';
+    return out;
+}
+
+} // namespace
+
+void HttpBodyWriter::write(const char *data, size_t len)
+{
+    if (len == 0) return;
+    total += len;
+    if (buffer != nullptr)
+    {
+        buffer->append(data, len);
+        return;
+    }
+    if (!chunked)
+    {
+        conn->send(data, len);
+        return;
+    }
+    char *out = conn->prepareSend(len + CHUNK_FRAMING);
+    char *end = chunkSize(out, len);
+    std::memcpy(end, data, len);
+    end += len;
+    *end++ = '\r';
+    *end++ = '\n';
+    conn->commitSend(end);
+}
+
+void HttpBodyWriter::write(std::string &&data)
+{
+    if (data.empty()) return;
+    total += data.size();
+    if (buffer != nullptr)
+    {
+        if (buffer->empty())
+            buffer->swap(data);
+        else
+            buffer->append(data);
+        return;
+    }
+    if (chunked)
+    {
+        char *out = conn->prepareSend(CHUNK_FRAMING);
+        conn->commitSend(chunkSize(out, data.size()));
+    }
+    conn->send(std::move(data));
+    if (chunked) conn->send("\r\n", 2);
+}
+
+// Per-request state, recycled between requests and connections.
+struct HttpConnection::Exchange
+{
+    HttpRequestParser parser;
+    Exchange *next = nullptr; // free list link while pooled
+};
+
+// The idle exchanges of one reactor thread, kept constructed (a reused one
+// costs a parser reset, not a 3KB zero fill). Grows to the most requests the
+// thread ever had open at once. Each thread's pool is leaked on purpose:
+// connections closed after their reactor thread has exited still return
+// their exchange to it.
+class HttpConnection::ExchangePool
+{
+public:
+    static ExchangePool &local()
+    {
+        static thread_local ExchangePool *pool = new ExchangePool();
+        return *pool;
+    }
+
+    Exchange *take()
+    {
+        if (idle == nullptr)
+            return slabs.create();
+        Exchange *exchange = idle;
+        idle = exchange->next;
+        return exchange;
+    }
+
+    void give(Exchange *exchange)
+    {
+        exchange->parser.reset();
+        exchange->next = idle;
+        idle = exchange;
+    }
+
+private:
+    SlabPool<Exchange, 16> slabs;
+    Exchange *idle = nullptr;
+};
+
+// A request whose body goes to a sink: the head, copied out of the receive
+// buffer, and where the body's framing is at.
+struct HttpConnection::Upload
+{
+    std::unique_ptr<HttpBodySink> sink;
+    OwnedRequest head;
+    HttpBodyDecoder decoder;
+
+    Upload(std::unique_ptr<HttpBodySink> sink, const HttpRequest &request, const char *raw, size_t headLength,
+           bool chunked)
+        : sink(std::move(sink)), head(request, raw, headLength)
+    {
+        decoder.reset(request.contentLength, chunked, 0);
+    }
+};
+
+struct HttpConnection::Stream
+{
+    HttpBodyProducer producer;
+    bool chunked;
+    bool keepAlive;
+    // with an encoder the producer writes a window into `plain`, which is
+    // encoded into `packed`; both keep their storage from window to window
+    std::shared_ptr<ContentEncoder> encoder;
+    std::string plain;
+    std::string packed;
+};
+
+// a window out on the worker pool to be encoded, with the stream's buffers
+struct HttpConnection::Window
+{
+    std::shared_ptr<ContentEncoder> encoder;
+    std::string plain;
+    std::string packed;
+    bool last;
+    bool encoded;
+};
+
+HttpConnection::HttpConnection(const HttpHandler *handler, ctpl::thread_pool *workers, Admission *admission,
+                               ResponseCache *cache, unsigned maxPipelined, const HttpStreamHandler *streamHandler,
+                               size_t streamWindow, RateLimiter *limiter)
+    : handler(handler), workers(workers), admission(admission), cache(cache), limiter(limiter),
+      maxPipelined(maxPipelined),
+      streamHandler(streamHandler && *streamHandler ? streamHandler : nullptr), streamWindow(streamWindow),
+      pool(&ExchangePool::local()), exchange(nullptr), delivered(0), delivering(false), lastRequest(false), firstByte(0),
+      parseNanos(0) {}
+
+HttpConnection::~HttpConnection()
+{
+    // an upload cut short still holds its admission
+    if (upload && admission != nullptr) admission->release();
+    finish();
+}
+
+HttpConnection::Exchange &HttpConnection::begin()
+{
+    if (exchange == nullptr)
+    {
+        exchange = pool->take();
+        exchange->parser.pauseAfterHead(streamHandler != nullptr);
+    }
+    return *exchange;
+}
+
+// the request is answered (or handed off): return its state
+void HttpConnection::finish()
+{
+    if (exchange == nullptr)
+        return;
+    pool->give(exchange);
+    exchange = nullptr;
+}
+
+size_t HttpConnection::onData(TCPConnection &conn, const char *data, size_t len)
+{
+    ThreadMetrics &metrics = Metrics::local();
+    uint64_t now = Metrics::nowNanos();
+
+    // requests out on the worker pool at once
+    size_t window = maxPipelined != 0 ? maxPipelined : 1;
+
+    size_t offset = 0;
+    unsigned answered = 0;
+    while (offset < len && !lastRequest && !stream && replies.size() < window)
+    {
+        if (upload)
+        {
+            size_t used = 0;
+            if (!receive(conn, data + offset, len - offset, used)) return len;
+            offset += used;
+            if (upload) break;
+            answered++;
+            continue;
+        }
+
+        if (maxPipelined != 0 && answered == maxPipelined)
+        {
+            // the rest waits until these responses are out
+            conn.pauseReading();
+            break;
+        }
+
+        if (firstByte == 0) firstByte = now;
+        HttpRequestParser &parser = begin().parser;
+        HttpRequestParser::Status status = parser.parse(data + offset, len - offset);
+        uint64_t parsed = Metrics::nowNanos();
+        parseNanos += parsed - now;
+        now = parsed;
+
+        if (status == HttpRequestParser::Incomplete) break;
+        if (status == HttpRequestParser::Invalid)
+        {
+            metrics.add(MetricCounter::HttpParseErrors);
+            fail(conn, parser.errorStatus());
+            return len;
+        }
+
+        const HttpRequest &request = parser.request();
+        if (status == HttpRequestParser::HeadComplete)
+        {
+            if (!replies.empty())
+            {
+                // a sink answers on this thread: after the replies ahead
+                parser.reset();
+                break;
+            }
+            if (limiter != nullptr && !limiter->allow(conn.peerAddress(), request.path(), now))
+            {
+                // the body is not read: close behind the 429
+                refuse(conn, request, false);
+                finish();
+                conn.close();
+                return len;
+            }
+            if (admission != nullptr && !admission->admit())
+            {
+                shed(conn);
+                return len;
+            }
+            std::unique_ptr<HttpBodySink> sink;
+            try
+            {
+                sink = (*streamHandler)(request);
+            }
+            catch (const std::exception &)
+            {
+                if (admission != nullptr) admission->release();
+                fail(conn, 500);
+                return len;
+            }
+            if (!sink)
+            {
+                // parsed again, the body is buffered
+                if (admission != nullptr) admission->release();
+                continue;
+            }
+
+            metrics.add(MetricCounter::HttpRequests);
+            metrics.record(MetricHistogram::ParseNanos, parseNanos);
+            parseNanos = 0;
+            size_t used = parser.headSize();
+            upload.reset(new Upload(std::move(sink), request, data + offset, used, parser.chunkedBody()));
+            if (request.versionMinor != 0 && request.header("Expect").equalsIgnoreCase("100-continue"))
+                conn.send(CONTINUE, sizeof(CONTINUE) - 1);
+            offset += used;
+            finish();
+            continue;
+        }
+
+        metrics.add(MetricCounter::HttpRequests);
+        metrics.record(MetricHistogram::ParseNanos, parseNanos);
+        parseNanos = 0;
+
+        size_t used = parser.consumed();
+        answered++;
+        if (limiter != nullptr && !parser.reportedHead() &&
+            !limiter->allow(conn.peerAddress(), request.path(), now))
+        {
+            bool keepAlive = request.keepAlive() && !conn.draining();
+            refuse(conn, request, keepAlive);
+            offset += used;
+            finish();
+            if (!keepAlive)
+            {
+                // behind replies still out: nothing more is read, and the
+                // 429 closes the connection once it is written
+                if (replies.empty())
+                {
+                    conn.close();
+                    return len;
+                }
+                lastRequest = true;
+            }
+            continue;
+        }
+        // a hit is written at once, so not past replies still out
+        if (cache != nullptr && replies.empty())
+        {
+            bool keepAlive = request.keepAlive() && !conn.draining();
+            if (cache->serve(conn, request, keepAlive))
+            {
+                metrics.record(MetricHistogram::FirstByteNanos, Metrics::nowNanos() - firstByte);
+                firstByte = 0;
+                offset += used;
+                finish();
+                if (!keepAlive)
+                {
+                    conn.close();
+                    return len;
+                }
+                continue;
+            }
+        }
+
+        if (admission != nullptr && !admission->admit())
+        {
+            shed(conn);
+            return len;
+        }
+        if (workers != nullptr)
+        {
+            // nothing after a request that closes the connection is read
+            lastRequest = !request.keepAlive();
+            offload(conn, request, data + offset, used);
+            offset += used;
+            finish();
+            continue;
+        }
+
+        HttpResponse response = runHandler(*handler, request);
+        if (admission != nullptr) admission->release();
+        if (cache != nullptr) cache->store(request, response);
+        if (conn.draining()) response.keepAlive = false;
+        uint64_t handled = Metrics::nowNanos();
+        metrics.record(MetricHistogram::HandlerNanos, handled - now);
+        now = handled;
+
+        write(conn, response, request.method == "HEAD");
+        metrics.record(MetricHistogram::FirstByteNanos, now - firstByte);
+        firstByte = 0;
+
+        offset += used;
+        finish();
+
+        if (!response.keepAlive && !stream)
+        {
+            conn.close();
+            return len;
+        }
+    }
+    return offset;
+}
+
+void HttpConnection::onWritable(TCPConnection &conn)
+{
+    if (stream) pump(conn);
+}
+
+bool HttpConnection::receive(TCPConnection &conn, const char *data, size_t len, size_t &used)
+{
+    Upload &current = *upload;
+    bool thrown = false;
+    try
+    {
+        used = current.decoder.feed(data, len, [&current](const char *piece, size_t n) {
+            return current.sink->write(piece, n);
+        });
+    }
+    catch (const std::exception &)
+    {
+        thrown = true;
+    }
+    if (!thrown && !current.decoder.done() && !current.decoder.stopped() && !current.decoder.failed())
+        return true;
+
+    if (admission != nullptr) admission->release();
+    if (current.decoder.failed())
+    {
+        Metrics::local().add(MetricCounter::HttpParseErrors);
+        int status = current.decoder.errorStatus();
+        upload.reset();
+        fail(conn, status);
+        return false;
+    }
+
+    const HttpRequest &request = current.head.request;
+    HttpResponse response = internalError(request);
+    if (!thrown)
+    {
+        try
+        {
+            response = current.sink->finish(request);
+            settle(request, response);
+        }
+        catch (const std::exception &)
+        {
+            response = internalError(request);
+        }
+    }
+    // whatever is left of the body is unread, so the next request cannot be
+    // found
+    if (!current.decoder.done() || conn.draining()) response.keepAlive = false;
+    bool headOnly = request.method == "HEAD";
+    upload.reset();
+
+    write(conn, response, headOnly);
+    Metrics::local().record(MetricHistogram::FirstByteNanos, Metrics::nowNanos() - firstByte);
+    firstByte = 0;
+    if (!response.keepAlive && !stream)
+    {
+        conn.close();
+        return false;
+    }
+    return true;
+}
+
+// Runs the producer until a window's worth is queued, then waits for it to
+// be written. The head is already out, so a producer that throws can only
+// end the body early, by closing the connection.
+void HttpConnection::pump(TCPConnection &conn)
+{
+    if (stream->encoder)
+    {
+        encode(conn);
+        return;
+    }
+
+    HttpBodyWriter writer(conn, stream->chunked);
+    bool more = true;
+    try
+    {
+        while (more && writer.written() < streamWindow)
+            more = stream->producer(writer);
+    }
+    catch (const std::exception &)
+    {
+        stream.reset();
+        conn.close();
+        return;
+    }
+    if (more)
+    {
+        conn.awaitWritable();
+        return;
+    }
+    endStream(conn);
+}
+
+// A window is made on the reactor thread and encoded on the worker pool, if
+// there is one, so a slow coding holds up no other connection. The
+// connection is held meanwhile, and reading stays paused.
+void HttpConnection::encode(TCPConnection &conn)
+{
+    Stream &current = *stream;
+    current.plain.clear();
+    HttpBodyWriter collect(current.plain);
+    bool more = true;
+    try
+    {
+        while (more && current.plain.size() < streamWindow)
+            more = current.producer(collect);
+    }
+    catch (const std::exception &)
+    {
+        stream.reset();
+        conn.close();
+        return;
+    }
+
+    if (workers == nullptr)
+    {
+        current.packed.clear();
+        bool encoded = current.encoder->encode(current.plain.data(), current.plain.size(), !more, current.packed);
+        queueWindow(conn, encoded, more);
+        return;
+    }
+
+    std::shared_ptr<Window> window = std::make_shared<Window>();
+    window->encoder = current.encoder;
+    window->plain.swap(current.plain);
+    window->packed.swap(current.packed);
+    window->last = !more;
+    window->encoded = false;
+    CompletionQueue *queue = &conn.completions();
+    uint64_t id = conn.id();
+    conn.hold();
+    workers->push([window, queue, id](int) {
+        window->packed.clear();
+        window->encoded =
+            window->encoder->encode(window->plain.data(), window->plain.size(), window->last, window->packed);
+        queue->post(id, [window](TCPConnection &conn) {
+            HttpConnection &http = *static_cast<HttpConnection *>(conn.context());
+            if (!http.stream) return;
+            http.stream->plain.swap(window->plain);
+            http.stream->packed.swap(window->packed);
+            http.queueWindow(conn, window->encoded, !window->last);
+        });
+    });
+}
+
+// queue an encoded window; the bytes are copied out, so `packed` keeps its
+// storage for the next one
+void HttpConnection::queueWindow(TCPConnection &conn, bool encoded, bool more)
+{
+    if (!encoded)
+    {
+        stream.reset();
+        conn.close();
+        return;
+    }
+    HttpBodyWriter writer(conn, stream->chunked);
+    writer.write(stream->packed.data(), stream->packed.size());
+    // an encoder may hold everything back for now: the next window then
+    // follows at once
+    if (more)
+        conn.awaitWritable();
+    else
+        endStream(conn);
+}
+
+void HttpConnection::endStream(TCPConnection &conn)
+{
+    if (stream->chunked)
+        conn.send(LAST_CHUNK, sizeof(LAST_CHUNK) - 1);
+    bool keepAlive = stream->keepAlive;
+    stream.reset();
+    if (!keepAlive)
+        conn.close();
+    else
+        deliver(conn);
+}
+
+// Run the handler on the worker pool. The connection is held so a peer EOF
+// cannot close it before the response has been written. The request's
+// reply slot keeps its place in line whatever order the pool finishes in.
+void HttpConnection::offload(TCPConnection &conn, const HttpRequest &request, const char *raw, size_t len)
+{
+    std::shared_ptr<OwnedRequest> owned = std::make_shared<OwnedRequest>(request, raw, len);
+    const HttpHandler *handler = this->handler;
+    Admission *admission = this->admission;
+    ResponseCache *cache = this->cache;
+    CompletionQueue *queue = &conn.completions();
+    uint64_t id = conn.id();
+    uint64_t sequence = delivered + replies.size();
+
+    replies.push_back(Reply{HttpResponse(), firstByte, request.method == "HEAD", false});
+    firstByte = 0;
+    conn.hold();
+    Metrics::local().add(MetricGauge::HttpInFlight, 1);
+    workers->push([owned, handler, admission, cache, queue, id, sequence](int) {
+        uint64_t start = Metrics::nowNanos();
+        std::shared_ptr<HttpResponse> response = std::make_shared<HttpResponse>(runHandler(*handler, owned->request));
+        Metrics::local().record(MetricHistogram::HandlerNanos, Metrics::nowNanos() - start);
+        // released here rather than in complete(), which never runs for a
+        // connection closed meanwhile
+        Metrics::local().add(MetricGauge::HttpInFlight, -1);
+        if (admission != nullptr) admission->release();
+        if (cache != nullptr) cache->store(owned->request, *response);
+        queue->post(id, [response, sequence](TCPConnection &conn) {
+            static_cast<HttpConnection *>(conn.context())->complete(conn, sequence, *response);
+        });
+    });
+}
+
+// back on the reactor thread with a response from the pool
+void HttpConnection::complete(TCPConnection &conn, uint64_t sequence, HttpResponse &response)
+{
+    // a reply after one that closed the connection is dropped
+    if (sequence < delivered || sequence - delivered >= replies.size())
+        return;
+
+    Reply &reply = replies[sequence - delivered];
+    reply.response = std::move(response);
+    reply.ready = true;
+    deliver(conn);
+}
+
+// Write the replies that are back, in request order, up to the first one
+// still out. They all land in the output queue the reactor flushes once
+// after this batch of completions.
+void HttpConnection::deliver(TCPConnection &conn)
+{
+    // a stream that ends within the write() below calls back in here
+    if (delivering) return;
+    delivering = true;
+    ThreadMetrics &metrics = Metrics::local();
+    size_t done = 0;
+    bool closed = false;
+    while (done < replies.size() && replies[done].ready && !stream)
+    {
+        Reply &reply = replies[done++];
+        HttpResponse &response = reply.response;
+        if (conn.draining()) response.keepAlive = false;
+        write(conn, response, reply.headOnly);
+        metrics.record(MetricHistogram::FirstByteNanos, Metrics::nowNanos() - reply.firstByte);
+        if (!response.keepAlive)
+        {
+            // a stream closes the connection itself once it ends
+            if (!stream) conn.close();
+            closed = true;
+            break;
+        }
+    }
+    delivering = false;
+    if (closed)
+    {
+        delivered += replies.size();
+        replies.clear();
+        return;
+    }
+    delivered += done;
+    replies.erase(replies.begin(), replies.begin() + done);
+}
+
+// The head is serialized straight into the connection's output chunk and a
+// small body copied in behind it, so a steady stream of keep-alive responses
+// allocates nothing here. A larger body is moved in as a chunk of its own, or
+// a shared one queued as it is. A
+// produced body starts with its first window; reading waits until it ends.
+void HttpConnection::write(TCPConnection &conn, HttpResponse &response, bool headOnly)
+{
+    if (response.producer && !headOnly)
+    {
+        char *out = conn.prepareSend(response.headSize());
+        conn.commitSend(out + response.serializeHead(out));
+        stream.reset(new Stream{std::move(response.producer), response.keepAlive, response.keepAlive,
+                                std::move(response.encoder), std::string(), std::string()});
+        conn.pauseReading();
+        pump(conn);
+        return;
+    }
+
+    const std::string &body = response.bodyBytes();
+    bool inlineBody = !headOnly && !response.file && body.size() <= INLINE_BODY;
+    char *out = conn.prepareSend(response.headSize() + (inlineBody ? body.size() : 0));
+    char *end = out + response.serializeHead(out);
+    if (inlineBody)
+    {
+        std::memcpy(end, body.data(), body.size());
+        end += body.size();
+    }
+    conn.commitSend(end);
+    if (headOnly || inlineBody)
+        return;
+    if (response.file)
+        conn.sendFile(response.file, response.fileOffset, response.fileLength);
+    else if (response.sharedBody)
+        conn.send(response.sharedBody);
+    else
+        conn.send(std::move(response.body));
+}
+
+// the stream cannot be resynchronised after a malformed request: answer
+// with the parser's status and drop the connection, behind the replies
+// still out on the worker pool
+void HttpConnection::fail(TCPConnection &conn, int status)
+{
+    HttpResponse response = HttpResponse::Builder()
+                                .status(status)
+                                .body(std::string(httpReasonPhrase(status)) + "\n")
+                                .keepAlive(false)
+                                .build();
+    if (!replies.empty())
+    {
+        replies.push_back(Reply{std::move(response), firstByte, false, true});
+        firstByte = 0;
+        lastRequest = true;
+        return;
+    }
+    write(conn, response, false);
+    conn.close();
+}
+
+// over a rate limit: the canned 429, or the same behind the replies still
+// out on the worker pool
+void HttpConnection::refuse(TCPConnection &conn, const HttpRequest &request, bool keepAlive)
+{
+    Metrics::local().add(MetricCounter::HttpRateLimited);
+    bool head = request.method == "HEAD";
+    if (replies.empty())
+    {
+        size_t length;
+        const char *rejection = RateLimiter::rejection(keepAlive, head, length);
+        conn.send(rejection, length);
+    }
+    else
+    {
+        HttpResponse response = HttpResponse::Builder()
+                                    .status(429)
+                                    .header("Retry-After", "1")
+                                    .body("Too Many Requests\n")
+                                    .keepAlive(keepAlive)
+                                    .build();
+        replies.push_back(Reply{std::move(response), firstByte, head, true});
+    }
+    firstByte = 0;
+}
+
+// over an admission limit: the canned 503, without a handler or a Date, or
+// the same behind the replies still out on the worker pool; either way the
+// connection closes after it
+void HttpConnection::shed(TCPConnection &conn)
+{
+    Metrics::local().add(MetricCounter::HttpShed);
+    if (!replies.empty())
+    {
+        HttpResponse response = HttpResponse::Builder()
+                                    .status(503)
+                                    .header("Retry-After", "1")
+                                    .body("Service Unavailable\n")
+                                    .keepAlive(false)
+                                    .build();
+        replies.push_back(Reply{std::move(response), firstByte, false, true});
+        finish();
+        firstByte = 0;
+        lastRequest = true;
+        return;
+    }
+    size_t length;
+    const char *rejection = Admission::rejection(length);
+    conn.send(rejection, length);
+    finish();
+    firstByte = 0;
+    conn.close();
+}
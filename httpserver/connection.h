@@ -0,0 +1,183 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "tcpserver.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// application callback: one response per request. The request views into
+// the receive buffer and is only valid during the call
+typedef std::function<HttpResponse(const HttpRequest &)> HttpHandler;
+
+// Takes a request body as it arrives instead of buffered whole. write() is
+// given the decoded body a piece at a time; returning false gives up on the
+// rest, which is then never read, and the connection is closed after the
+// response. finish() makes the response once the body is over or given up
+// on; `request` is the head, with an empty body. A malformed body is
+// answered 400 without finish(). Both run on the connection's reactor
+// thread.
+class HttpBodySink
+{
+public:
+    virtual bool write(const char *data, size_t len) = 0;
+    virtual HttpResponse finish(const HttpRequest &request) = 0;
+    virtual ~HttpBodySink() = default;
+};
+
+// asked once the head of a request with a body is in: a sink streams the
+// body, nullptr leaves it buffered for the HttpHandler as usual. The
+// request's views are only valid during the call
+typedef std::function<std::unique_ptr<HttpBodySink>(const HttpRequest &)> HttpStreamHandler;
+
+// What an HttpBodyProducer writes through: each piece is queued at once,
+// framed as a chunk when the response is chunked. Empty pieces are dropped,
+// since an empty chunk would end the body.
+class HttpBodyWriter
+{
+public:
+    // collects the body in `buffer` instead, a window to be encoded
+    explicit HttpBodyWriter(std::string &buffer) : conn(nullptr), buffer(&buffer), chunked(false), total(0) {}
+
+    void write(const char *data, size_t len);
+    void write(StringView data) { write(data.data(), data.size()); }
+    // a large piece is queued without a copy
+    void write(std::string &&data);
+
+    // body bytes written through this writer so far
+    size_t written() const { return total; }
+
+private:
+    friend class HttpConnection;
+
+    TCPConnection *conn;
+    std::string *buffer;
+    bool chunked;
+    size_t total;
+
+    HttpBodyWriter(TCPConnection &conn, bool chunked) : conn(&conn), buffer(nullptr), chunked(chunked), total(0) {}
+};
+
+namespace ctpl
+{
+class thread_pool;
+}
+class Admission;
+class RateLimiter;
+class ResponseCache;
+
+// HTTP state of one client connection: feeds received bytes to the parser,
+// runs the handler for every complete request and queues the responses.
+//
+// With a worker pool the handler runs there instead, on a copy of the
+// request, and the response comes back through the reactor's
+// CompletionQueue. Every complete request of a batch of pipelined input is
+// handed to the pool at once, up to `maxPipelined` per connection (one when
+// it is 0), and the responses are written in request order as they come
+// back, however the pool finishes them. The requests after one that closes
+// the connection are not read; when a handler closes it, the responses
+// already made behind it are dropped.
+//
+// A request the ResponseCache can answer is answered from it, on the reactor
+// thread even with a worker pool, and skips admission control.
+//
+// With a `streamHandler`, a request body can go to an HttpBodySink as it
+// arrives rather than be buffered. A response with a producer is made
+// `streamWindow` bytes at a time: the next window once the last one has been
+// written, with reading paused meanwhile. With an encoder, each window is
+// compressed on the worker pool when there is one.
+//
+// At most `maxPipelined` requests are answered per batch of input; the
+// connection then stops reading until their responses are written. With an
+// Admission, a request over its limits is answered 503 and the connection
+// closed before the handler sees it. With a RateLimiter, a request over its
+// client's or route's rate is answered 429, ahead of the cache, the
+// Admission and the handler; the connection stays open unless the request
+// had a body still unread.
+//
+// The parser is per-request state: it is taken from the reactor thread's
+// pool when a request starts and returned once the request is answered, so
+// an idle keep-alive connection holds a few dozen bytes rather than a parser
+// sized for 64 headers.
+class HttpConnection : public ConnectionContext
+{
+public:
+    // call on the reactor thread that owns the connection
+    explicit HttpConnection(const HttpHandler *handler, ctpl::thread_pool *workers = nullptr,
+                            Admission *admission = nullptr, ResponseCache *cache = nullptr,
+                            unsigned maxPipelined = 0, const HttpStreamHandler *streamHandler = nullptr,
+                            size_t streamWindow = 64 * 1024, RateLimiter *limiter = nullptr);
+    ~HttpConnection() override;
+
+    // returns the bytes of `data` taken by complete requests
+    size_t onData(TCPConnection &conn, const char *data, size_t len);
+    // the last window of a streamed response has been written
+    void onWritable(TCPConnection &conn);
+
+private:
+    // bodies up to this size are copied behind the head, larger ones queued
+    // on their own
+    static const size_t INLINE_BODY = 4096;
+
+    struct Exchange;
+    class ExchangePool;
+    struct Upload;
+    struct Stream;
+    struct Window;
+
+    // a request out on the worker pool, and its response once it is back
+    struct Reply
+    {
+        HttpResponse response;
+        uint64_t firstByte;
+        bool headOnly;
+        bool ready;
+    };
+
+    const HttpHandler *handler;
+    ctpl::thread_pool *workers;
+    Admission *admission;
+    ResponseCache *cache;
+    RateLimiter *limiter;
+    unsigned maxPipelined;
+    const HttpStreamHandler *streamHandler;
+    size_t streamWindow;
+    ExchangePool *pool;
+    Exchange *exchange; // the request being parsed or answered; null between requests
+    // requests out on the worker pool, oldest first, and how many replies
+    // have been written before the first of them
+    std::vector<Reply> replies;
+    uint64_t delivered;
+    bool delivering; // deliver() is writing; a stream ending inside it leaves the rest to it
+    bool lastRequest; // one that closes the connection went to the pool
+    std::unique_ptr<Upload> upload; // a request body going to a sink
+    std::unique_ptr<Stream> stream; // a response body being produced
+    // metrics of the request being parsed or served
+    uint64_t firstByte;  // Metrics::nowNanos() when its first bytes were read; 0 before
+    uint64_t parseNanos; // parser time so far
+
+    Exchange &begin();
+    void finish();
+    void offload(TCPConnection &conn, const HttpRequest &request, const char *raw, size_t len);
+    // hands the upload `len` bytes and answers it once its body is over;
+    // false when the connection was closed
+    bool receive(TCPConnection &conn, const char *data, size_t len, size_t &used);
+    // the next window of the streamed response
+    void pump(TCPConnection &conn);
+    // the same through the stream's encoder; queueWindow() sends what it made
+    void encode(TCPConnection &conn);
+    void queueWindow(TCPConnection &conn, bool encoded, bool more);
+    void endStream(TCPConnection &conn);
+    void complete(TCPConnection &conn, uint64_t sequence, HttpResponse &response);
+    void deliver(TCPConnection &conn);
+    // queues the response; a large body is moved out of it
+    void write(TCPConnection &conn, HttpResponse &response, bool headOnly);
+    void fail(TCPConnection &conn, int status);
+    void shed(TCPConnection &conn);
+    void refuse(TCPConnection &conn, const HttpRequest &request, bool keepAlive);
+};
+
+#endif
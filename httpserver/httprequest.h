@@ -0,0 +1,201 @@
+#ifndef HTTPREQUEST_H
+#define HTTPREQUEST_H
+
+#include "stringview.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct HttpScanKernels;
+
+struct HttpHeader
+{
+    StringView name;
+    StringView value;
+};
+
+// One parsed request. Every field is a view into the receive buffer the
+// parser was fed, so nothing here allocates; copy out with str() whatever
+// has to outlive the buffer.
+class HttpRequest
+{
+public:
+    static const size_t MAX_HEADERS = 64;
+
+    StringView method;
+    StringView target; // path + query, as sent
+    int versionMinor;  // HTTP/1.<versionMinor>
+    HttpHeader headers[MAX_HEADERS];
+    size_t headerCount;
+    StringView body;
+    uint64_t contentLength;
+
+    HttpRequest() : versionMinor(1), headerCount(0), contentLength(0) {}
+
+    // case-insensitive lookup of the first header named `name`; empty view
+    // when it is absent
+    StringView header(StringView name) const;
+    bool hasHeader(StringView name) const;
+
+    StringView path() const;
+    StringView query() const;
+
+    // HTTP/1.1 defaults to keep-alive unless `Connection: close`; HTTP/1.0
+    // needs an explicit `Connection: keep-alive`
+    bool keepAlive() const;
+};
+
+// Incremental decoder of a request body framed by Content-Length or by the
+// chunked transfer coding. Fed the body in pieces of any size, it hands the
+// payload to a sink as it goes and keeps only a few counters in between, so
+// the body never has to be in memory whole. Chunk extensions and trailer
+// fields are read and dropped.
+class HttpBodyDecoder
+{
+public:
+    // the next bytes of payload; false stops decoding
+    typedef std::function<bool(const char *data, size_t len)> Sink;
+
+    HttpBodyDecoder() { reset(0, false, 0); }
+
+    // a body of `length` bytes, or a chunked one of at most `maxLength`
+    // decoded bytes (0 for no limit)
+    void reset(uint64_t length, bool chunked, uint64_t maxLength);
+    // decode from the start of `data`; returns the bytes used, which stop
+    // short of `len` at the end of the body, on an error, or once `sink`
+    // has returned false
+    size_t feed(const char *data, size_t len, const Sink &sink);
+
+    bool done() const { return state == Done; }
+    bool failed() const { return state == Error; }
+    bool stopped() const { return state == Stopped; }
+    // status code to answer with once failed()
+    int errorStatus() const { return errorCode; }
+    uint64_t decoded() const { return total; }
+
+private:
+    enum State
+    {
+        Fixed,     // Content-Length payload
+        Size,      // chunk-size hex digits
+        Extension, // the rest of the chunk-size line
+        Data,
+        DataEnd,   // the CRLF after a chunk's data
+        Trailer,
+        Done,
+        Error,
+        Stopped
+    };
+
+    State state;
+    uint64_t remaining; // of the Content-Length body or the current chunk
+    uint64_t total;
+    uint64_t maxLength;
+    size_t digits;      // in the chunk-size read so far
+    size_t lineLength;  // of the extension or trailer line being read
+    size_t trailerSize;
+    int errorCode;
+
+    size_t fail(size_t used, int status);
+    // the chunk-size line is over: the chunk's data, or the trailer
+    void startChunk();
+};
+
+// Incremental HTTP/1.1 request parser.
+//
+// Feed it every unconsumed byte of the stream, starting at the first byte of
+// the current request, each time more data arrives. Progress is kept as
+// offsets, so the buffer may grow or move between calls and nothing already
+// parsed is scanned again. After Complete, request() views into the last
+// buffer passed and consumed() tells how many bytes belong to the request;
+// drop those, reset(), and parse again for the next pipelined request.
+//
+// A chunked body is decoded into the parser's own buffer as it arrives and
+// request().body views that; the encoded bytes stay in the stream until the
+// request is complete. With pauseAfterHead(true), a request with a body
+// first returns HeadComplete once its head is parsed, so the caller can take
+// the body over as it arrives (see HttpBodyDecoder); parsing again instead
+// buffers it as usual.
+class HttpRequestParser
+{
+public:
+    enum State
+    {
+        RequestLine,
+        Headers,
+        Body,
+        Done,
+        Error
+    };
+
+    enum Status
+    {
+        Incomplete,
+        Complete,
+        Invalid,
+        HeadComplete
+    };
+
+    static const size_t DEFAULT_MAX_HEAD_SIZE = 8192;
+    static const uint64_t DEFAULT_MAX_BODY_SIZE = 1 << 20;
+
+    HttpRequestParser();
+
+    Status parse(const char *data, size_t len);
+    void reset();
+
+    State state() const { return current; }
+    const HttpRequest &request() const { return req; }
+    size_t consumed() const { return headLength + bodyLength; }
+    // after HeadComplete: the head's length and how its body is framed
+    size_t headSize() const { return headLength; }
+    bool chunkedBody() const { return chunked; }
+
+    // status code to answer with once parse() returned Invalid
+    int errorStatus() const { return errorCode; }
+
+    void setLimits(size_t maxHeadSize, uint64_t maxBodySize);
+    void pauseAfterHead(bool enabled) { pauseHead = enabled; }
+    // the request came back as HeadComplete before it did as Complete
+    bool reportedHead() const { return headReported; }
+
+private:
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    const HttpScanKernels *scan;
+    State current;
+    size_t pos;        // start of the line being parsed
+    size_t scanned;    // bytes of that line already searched for LF
+    size_t headLength; // request line + headers + blank line
+    size_t bodyLength; // as framed on the wire; known once Complete
+    size_t bodyScanned; // end of the chunked body decoded so far
+    bool chunked;
+    bool pauseHead;
+    bool headReported;
+    int errorCode;
+
+    Span method;
+    Span target;
+    Span names[HttpRequest::MAX_HEADERS];
+    Span values[HttpRequest::MAX_HEADERS];
+    HttpRequest req;
+
+    size_t maxHeadSize;
+    uint64_t maxBodySize;
+    HttpBodyDecoder decoder;
+    std::string decodedBody;
+
+    // the helpers return 0 on success, otherwise the status to answer with
+    Status fail(int status);
+    int parseRequestLine(const char *data, size_t begin, size_t end);
+    int parseHeaderLine(const char *data, size_t begin, size_t end);
+    int finishHead(const char *data);
+    void materialize(const char *data, StringView body);
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include "httpresponse.h"
+#include "stringview.h"
+#include "outputbuffer.h"
+#include <cstring>
+#include <ctime>
+
+// every status code with a known reason phrase
+#define HTTP_STATUSES(X)                         \
+    X(100, "Continue")                           \
+    X(200, "OK")                                 \
+    X(201, "Created")                            \
+    X(202, "Accepted")                           \
+    X(204, "No Content")                         \
+    X(206, "Partial Content")                    \
+    X(301, "Moved Permanently")                  \
+    X(302, "Found")                              \
+    X(304, "Not Modified")                       \
+    X(400, "Bad Request")                        \
+    X(401, "Unauthorized")                       \
+    X(403, "Forbidden")                          \
+    X(404, "Not Found")                          \
+    X(405, "Method Not Allowed")                 \
+    X(408, "Request Timeout")                    \
+    X(411, "Length Required")                    \
+    X(413, "Content Too Large")                  \
+    X(414, "URI Too Long")                       \
+    X(416, "Range Not Satisfiable")              \
+    X(429, "Too Many Requests")                  \
+    X(431, "Request Header Fields Too Large")    \
+    X(500, "Internal Server Error")              \
+    X(501, "Not Implemented")                    \
+    X(503, "Service Unavailable")                \
+    X(505, "HTTP Version Not Supported")
+
+const char *httpReasonPhrase(int code)
+{
+    switch (code)
+    {
+#define REASON_CASE(code, reason)                \
+    case code: return reason;
+        HTTP_STATUSES(REASON_CASE)
+#undef REASON_CASE
+    default: return "Unknown";
+    }
+}
+
+HttpResponse::HttpResponse()
+    : statusCode(200), reason("OK"), version("HTTP/1.1"), contentType(nullptr), keepAlive(true), fileOffset(0),
+      fileLength(0) {}
+
+bool HttpResponse::hasHeader(const std::string &name) const
+{
+    for (const auto &h : headers)
+    {
+        if (StringView(h.first).equalsIgnoreCase(name)) return true;
+    }
+    return false;
+}
+
+namespace
+{
+
+const char DEFAULT_CONTENT_TYPE[] = "Content-Type: text/plain; charset=utf-8\r\n";
+const char CONTENT_TYPE[] = "Content-Type: ";
+const char CONTENT_LENGTH[] = "Content-Length: ";
+const char CHUNKED[] = "Transfer-Encoding: chunked\r\n";
+const char KEEP_ALIVE[] = "Connection: keep-alive\r\n";
+const char CLOSE[] = "Connection: close\r\n";
+
+struct StatusLine
+{
+    const char *text;
+    size_t len;
+};
+
+// the whole HTTP/1.1 status line of a standard code and reason
+StatusLine standardStatusLine(int code)
+{
+    switch (code)
+    {
+#define STATUS_LINE_CASE(code, reason)           \
+    case code: return {"HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1};
+        HTTP_STATUSES(STATUS_LINE_CASE)
+#undef STATUS_LINE_CASE
+    default: return {nullptr, 0};
+    }
+}
+
+const char DAYS[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+const char MONTHS[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+inline char *putTwoDigits(char *out, unsigned value)
+{
+    out[0] = (char)('0' + value / 10);
+    out[1] = (char)('0' + value % 10);
+    return out + 2;
+}
+
+// IMF-fixdate, 29 bytes; strftime would follow the locale
+char *putDate(char *out, time_t t)
+{
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    std::memcpy(out, DAYS[tm.tm_wday], 3);
+    out[3] = ',';
+    out[4] = ' ';
+    out = putTwoDigits(out + 5, (unsigned)tm.tm_mday);
+    *out++ = ' ';
+    std::memcpy(out, MONTHS[tm.tm_mon], 3);
+    out[3] = ' ';
+    unsigned year = (unsigned)(tm.tm_year + 1900) % 10000;
+    out = putTwoDigits(out + 4, year / 100);
+    out = putTwoDigits(out, year % 100);
+    *out++ = ' ';
+    out = putTwoDigits(out, (unsigned)tm.tm_hour);
+    *out++ = ':';
+    out = putTwoDigits(out, (unsigned)tm.tm_min);
+    *out++ = ':';
+    out = putTwoDigits(out, (unsigned)tm.tm_sec);
+    std::memcpy(out, " GMT", 4);
+    return out + 4;
+}
+
+inline char *put(char *out, const char *data, size_t len)
+{
+    std::memcpy(out, data, len);
+    return out + len;
+}
+
+inline char *put(char *out, const std::string &s) { return put(out, s.data(), s.size()); }
+
+template <size_t N>
+inline char *putLiteral(char *out, const char (&literal)[N])
+{
+    return put(out, literal, N - 1);
+}
+
+const char DIGIT_PAIRS[] = "00010203040506070809"
+                           "10111213141516171819"
+                           "20212223242526272829"
+                           "30313233343536373839"
+                           "40414243444546474849"
+                           "50515253545556575859"
+                           "60616263646566676869"
+                           "70717273747576777879"
+                           "80818283848586878889"
+                           "90919293949596979899";
+
+// two digits per division, written backwards into a stack buffer
+inline char *putDecimal(char *out, uint64_t value)
+{
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100)
+    {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10)
+    {
+        unsigned pair = (unsigned)value * 2;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+    size_t n = (size_t)(digits + sizeof(digits) - p);
+    return put(out, p, n);
+}
+
+} // namespace
+
+std::string httpDate(time_t t)
+{
+    char buf[29];
+    return std::string(buf, (size_t)(putDate(buf, t) - buf));
+}
+
+const char *httpDateLine()
+{
+    struct DateLine
+    {
+        time_t second = -1;
+        char text[HTTP_DATE_LINE];
+    };
+    static thread_local DateLine cached;
+    time_t now = time(nullptr);
+    if (now != cached.second)
+    {
+        std::memcpy(cached.text, "Date: ", 6);
+        char *end = putDate(cached.text + 6, now);
+        end[0] = '\r';
+        end[1] = '\n';
+        cached.second = now;
+    }
+    return cached.text;
+}
+
+size_t HttpResponse::headSize() const
+{
+    size_t size = version.size() + reason.size() + 16; // status line: 11 digits with sign, spaces, CRLF
+    for (const auto &h : headers) size += h.first.size() + h.second.size() + 4;
+    if (contentType != nullptr) size += sizeof(CONTENT_TYPE) + std::strlen(contentType) + 2;
+    if (headerBlock) size += headerBlock->size();
+    size += sizeof(DEFAULT_CONTENT_TYPE) + sizeof(CONTENT_LENGTH) + sizeof(CHUNKED) + 22;
+    size += HTTP_DATE_LINE + sizeof(KEEP_ALIVE) + 2;
+    return size;
+}
+
+size_t HttpResponse::serializeHead(char *out) const
+{
+    char *p = out + serializeFields(out);
+    p = put(p, httpDateLine(), HTTP_DATE_LINE);
+    p = keepAlive ? putLiteral(p, KEEP_ALIVE) : putLiteral(p, CLOSE);
+    p = putLiteral(p, "\r\n");
+    return (size_t)(p - out);
+}
+
+size_t HttpResponse::serializeFields(char *out) const
+{
+    char *p = out;
+    StatusLine standard = standardStatusLine(statusCode);
+    if (standard.text != nullptr && version == "HTTP/1.1" && reason == httpReasonPhrase(statusCode))
+    {
+        p = put(p, standard.text, standard.len);
+    }
+    else
+    {
+        p = put(p, version);
+        *p++ = ' ';
+        if (statusCode < 0)
+        {
+            *p++ = '-';
+            p = putDecimal(p, (uint64_t)-(int64_t)statusCode);
+        }
+        else
+        {
+            p = putDecimal(p, (uint64_t)statusCode);
+        }
+        *p++ = ' ';
+        p = put(p, reason);
+        p = putLiteral(p, "\r\n");
+    }
+
+    for (const auto &h : headers)
+    {
+        p = put(p, h.first);
+        p = putLiteral(p, ": ");
+        p = put(p, h.second);
+        p = putLiteral(p, "\r\n");
+    }
+    if (headerBlock) p = put(p, *headerBlock);
+
+    // 1xx, 204 and 304 never carry a body
+    bool bodyless = statusCode < 200 || statusCode == 204 || statusCode == 304;
+    if (!bodyless)
+    {
+        if (contentType != nullptr)
+        {
+            p = putLiteral(p, CONTENT_TYPE);
+            p = put(p, contentType, std::strlen(contentType));
+            p = putLiteral(p, "\r\n");
+        }
+        else if (headers.empty() || !hasHeader("Content-Type"))
+        {
+            p = putLiteral(p, DEFAULT_CONTENT_TYPE);
+        }
+        if (!producer)
+        {
+            p = putLiteral(p, CONTENT_LENGTH);
+            p = putDecimal(p, contentLength());
+            p = putLiteral(p, "\r\n");
+        }
+        else if (keepAlive)
+        {
+            p = putLiteral(p, CHUNKED);
+        }
+    }
+    return (size_t)(p - out);
+}
+
+std::string HttpResponse::serializeHead() const
+{
+    std::string out(headSize(), '\0');
+    out.resize(serializeHead(&out[0]));
+    return out;
+}
+
+std::string HttpResponse::serialize() const
+{
+    std::string out = serializeHead();
+    out += bodyBytes();
+    return out;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::status(int code, const std::string &reason)
+{
+    response.statusCode = code;
+    response.reason = reason.empty() ? httpReasonPhrase(code) : reason;
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::version(const std::string &version)
+{
+    response.version = version;
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::header(const std::string &name, const std::string &value)
+{
+    response.headers.emplace_back(name, value);
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::contentType(const char *type)
+{
+    response.contentType = type;
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::headerBlock(std::shared_ptr<const std::string> lines)
+{
+    response.headerBlock = std::move(lines);
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::body(std::string body)
+{
+    response.body = std::move(body);
+    response.sharedBody.reset();
+    response.file.reset();
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::body(std::shared_ptr<const std::string> body)
+{
+    response.sharedBody = std::move(body);
+    response.body.clear();
+    response.file.reset();
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::file(const std::shared_ptr<FileHandle> &file, uint64_t offset,
+                                                   uint64_t length)
+{
+    response.file = file;
+    response.fileOffset = offset;
+    response.fileLength = length;
+    response.body.clear();
+    response.sharedBody.reset();
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::stream(HttpBodyProducer producer)
+{
+    response.producer = std::move(producer);
+    return *this;
+}
+
+HttpResponse::Builder &HttpResponse::Builder::keepAlive(bool keepAlive)
+{
+    response.keepAlive = keepAlive;
+    return *this;
+}
+
+HttpResponse HttpResponse::Builder::build()
+{
+    return std::move(response);
+}
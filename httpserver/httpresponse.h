@@ -0,0 +1,113 @@
+#ifndef HTTPRESPONSE_H
+#define HTTPRESPONSE_H
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ContentEncoder;
+class FileHandle;
+class HttpBodyWriter;
+
+// Makes a streamed response body a piece at a time: write some of it and
+// return true to be called again, or return false once the body is
+// complete. Every call should write something; it is called until a window
+// is queued, then again when that has been sent. Runs on the connection's
+// reactor thread
+typedef std::function<bool(HttpBodyWriter &)> HttpBodyProducer;
+
+// reason phrase for a status code ("OK", "Not Found", ...)
+const char *httpReasonPhrase(int code);
+
+// `t` as an HTTP date: "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string httpDate(time_t t);
+
+// "Date: <now>\r\n", HTTP_DATE_LINE bytes, reformatted only when the second
+// changes; every thread keeps its own copy
+const size_t HTTP_DATE_LINE = 37;
+const char *httpDateLine();
+
+class HttpResponse
+{
+public:
+    class Builder;
+
+    int statusCode;
+    std::string reason;
+    std::string version;
+    std::vector<std::pair<std::string, std::string>> headers;
+    // Content-Type value with static lifetime (a literal), written without
+    // building a header pair; nullptr leaves it to `headers`, or text/plain
+    const char *contentType;
+    // preformatted header lines ("Name: value\r\n" each) written as is: a
+    // cache builds them once and shares them between responses. Must not
+    // hold Content-Type, Content-Length, Connection or Date
+    std::shared_ptr<const std::string> headerBlock;
+    std::string body;
+    // when set, the body instead of `body`: bytes shared with a cache
+    // (StaticFiles' compressed copies), queued for sending without a copy
+    std::shared_ptr<const std::string> sharedBody;
+    bool keepAlive;
+
+    // when set, the body is `fileLength` bytes of `file` from `fileOffset`
+    // and is sent with sendfile() instead of `body`
+    std::shared_ptr<FileHandle> file;
+    uint64_t fileOffset;
+    uint64_t fileLength;
+
+    // when set, the body is whatever `producer` writes, sent as it is made:
+    // chunked on a keep-alive connection, otherwise delimited by closing it
+    HttpBodyProducer producer;
+    // when set with a producer, what it writes is sent through this encoder
+    // (ResponseCompressor), a window at a time
+    std::shared_ptr<ContentEncoder> encoder;
+
+    HttpResponse();
+
+    uint64_t contentLength() const { return file ? fileLength : bodyBytes().size(); }
+    // the in-memory body, owned or shared
+    const std::string &bodyBytes() const { return sharedBody ? *sharedBody : body; }
+    bool hasHeader(const std::string &name) const;
+
+    // status line and headers up to the blank line; Date, Content-Length
+    // (or Transfer-Encoding for a stream), Connection and a default
+    // Content-Type are added. Common status lines are precomputed and the
+    // Date line is formatted once per second per thread
+    std::string serializeHead() const;
+    // the same into `out`, which holds at least headSize() bytes; returns
+    // the length written
+    size_t serializeHead(char *out) const;
+    // the head up to the Date line: status line and every header but Date
+    // and Connection, so the bytes stay valid for any later response
+    size_t serializeFields(char *out) const;
+    // upper bound of the serialized head's length
+    size_t headSize() const;
+    // head + in-memory body, one contiguous string ready for send()
+    std::string serialize() const;
+};
+
+class HttpResponse::Builder
+{
+public:
+    // an empty reason uses the standard phrase for `code`
+    Builder &status(int code, const std::string &reason = "");
+    Builder &version(const std::string &version);
+    Builder &header(const std::string &name, const std::string &value);
+    Builder &contentType(const char *type);
+    Builder &headerBlock(std::shared_ptr<const std::string> lines);
+    Builder &body(std::string body);
+    Builder &body(std::shared_ptr<const std::string> body);
+    Builder &file(const std::shared_ptr<FileHandle> &file, uint64_t offset, uint64_t length);
+    Builder &stream(HttpBodyProducer producer);
+    Builder &keepAlive(bool keepAlive);
+    HttpResponse build();
+
+private:
+    HttpResponse response;
+};
+
+#endif
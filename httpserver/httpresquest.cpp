@@ -0,0 +1,436 @@
+#include "httprequest.h"
+#include "httpscan.h"
+#include <cstring>
+
+static inline bool isOws(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// true when the comma separated `list` contains `token` (case-insensitive)
+static bool hasToken(StringView list, StringView token)
+{
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+
+        size_t b = start, e = comma;
+        while (b < e && isOws(list[b])) b++;
+        while (e > b && isOws(list[e - 1])) e--;
+        if (list.substr(b, e - b).equalsIgnoreCase(token)) return true;
+
+        start = comma + 1;
+    }
+    return false;
+}
+
+StringView HttpRequest::header(StringView name) const
+{
+    for (size_t i = 0; i < headerCount; i++)
+    {
+        if (headers[i].name.equalsIgnoreCase(name)) return headers[i].value;
+    }
+    return StringView();
+}
+
+bool HttpRequest::hasHeader(StringView name) const
+{
+    for (size_t i = 0; i < headerCount; i++)
+    {
+        if (headers[i].name.equalsIgnoreCase(name)) return true;
+    }
+    return false;
+}
+
+StringView HttpRequest::path() const
+{
+    size_t q = target.find('?');
+    return q == std::string::npos ? target : target.substr(0, q);
+}
+
+StringView HttpRequest::query() const
+{
+    size_t q = target.find('?');
+    return q == std::string::npos ? StringView() : target.substr(q + 1);
+}
+
+bool HttpRequest::keepAlive() const
+{
+    StringView connection = header("Connection");
+    if (versionMinor >= 1) return !hasToken(connection, "close");
+    return hasToken(connection, "keep-alive");
+}
+
+// chunk extensions are skipped, but not without end
+static const size_t MAX_CHUNK_LINE = 4096;
+static const size_t MAX_TRAILER_SIZE = 8192;
+
+static inline int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+void HttpBodyDecoder::reset(uint64_t length, bool chunked, uint64_t max)
+{
+    state = chunked ? Size : (length == 0 ? Done : Fixed);
+    remaining = chunked ? 0 : length;
+    total = 0;
+    maxLength = max;
+    digits = 0;
+    lineLength = 0;
+    trailerSize = 0;
+    errorCode = 0;
+}
+
+size_t HttpBodyDecoder::fail(size_t used, int status)
+{
+    state = Error;
+    errorCode = status;
+    return used;
+}
+
+void HttpBodyDecoder::startChunk()
+{
+    state = remaining == 0 ? Trailer : Data;
+    lineLength = 0;
+}
+
+size_t HttpBodyDecoder::feed(const char *data, size_t len, const Sink &sink)
+{
+    size_t p = 0;
+    while (p < len)
+    {
+        char c = data[p];
+        switch (state)
+        {
+        case Fixed:
+        case Data:
+        {
+            size_t n = remaining < len - p ? static_cast<size_t>(remaining) : len - p;
+            remaining -= n;
+            total += n;
+            p += n;
+            if (remaining == 0) state = state == Fixed ? Done : DataEnd;
+            if (!sink(data + p - n, n))
+            {
+                if (state != Done) state = Stopped;
+                return p;
+            }
+            break;
+        }
+
+        case Size:
+        {
+            int digit = hexDigit(c);
+            if (digit >= 0)
+            {
+                if (remaining > (UINT64_MAX >> 4)) return fail(p, 413);
+                remaining = remaining << 4 | static_cast<unsigned>(digit);
+                digits++;
+                p++;
+                break;
+            }
+            if (digits == 0 || (c != ';' && c != '\r' && c != '\n' && !isOws(c))) return fail(p, 400);
+            if (maxLength != 0 && remaining > maxLength - total) return fail(p, 413);
+            state = Extension;
+            lineLength = 0;
+            break; // the terminator is read as part of the extension
+        }
+
+        case Extension:
+            p++;
+            if (c == '\n')
+            {
+                digits = 0;
+                startChunk();
+            }
+            else if (++lineLength > MAX_CHUNK_LINE)
+            {
+                return fail(p, 400);
+            }
+            break;
+
+        case DataEnd:
+            // CRLF, or a bare LF as the head parser also takes
+            p++;
+            if (c == '\n')
+            {
+                state = Size;
+                lineLength = 0;
+            }
+            else if (c == '\r' && lineLength == 0)
+            {
+                lineLength = 1;
+            }
+            else
+            {
+                return fail(p, 400);
+            }
+            break;
+
+        case Trailer:
+            // field lines up to an empty one; a CR alone leaves it empty
+            p++;
+            if (++trailerSize > MAX_TRAILER_SIZE) return fail(p, 431);
+            if (c == '\n')
+            {
+                if (lineLength == 0)
+                {
+                    state = Done;
+                    return p;
+                }
+                lineLength = 0;
+            }
+            else if (c != '\r')
+            {
+                lineLength++;
+            }
+            break;
+
+        case Done:
+        case Error:
+        case Stopped:
+            return p;
+        }
+        if (state == Done || state == Stopped) break;
+    }
+    return p;
+}
+
+HttpRequestParser::HttpRequestParser()
+    : scan(&httpScanKernels()), pauseHead(false), maxHeadSize(DEFAULT_MAX_HEAD_SIZE), maxBodySize(DEFAULT_MAX_BODY_SIZE)
+{
+    reset();
+}
+
+void HttpRequestParser::reset()
+{
+    current = RequestLine;
+    pos = 0;
+    scanned = 0;
+    headLength = 0;
+    bodyLength = 0;
+    bodyScanned = 0;
+    chunked = false;
+    headReported = false;
+    errorCode = 0;
+    req.headerCount = 0;
+    req.contentLength = 0;
+    // one large upload should not pin its buffer for the connection's life
+    if (decodedBody.capacity() > 64 * 1024) std::string().swap(decodedBody);
+    else decodedBody.clear();
+}
+
+void HttpRequestParser::setLimits(size_t maxHead, uint64_t maxBody)
+{
+    maxHeadSize = maxHead;
+    maxBodySize = maxBody;
+}
+
+HttpRequestParser::Status HttpRequestParser::fail(int status)
+{
+    current = Error;
+    errorCode = status;
+    return Invalid;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse(const char *data, size_t len)
+{
+    if (current == Done) return Complete;
+    if (current == Error) return Invalid;
+
+    while (current == RequestLine || current == Headers)
+    {
+        const char *nl = scan->findLineFeed(data + scanned, data + len);
+        if (nl == data + len)
+        {
+            scanned = len;
+            if (len > maxHeadSize) return fail(current == RequestLine ? 414 : 431);
+            return Incomplete;
+        }
+
+        size_t next = nl - data + 1;
+        if (next > maxHeadSize) return fail(current == RequestLine ? 414 : 431);
+
+        size_t end = next - 1;
+        if (end > pos && data[end - 1] == '\r') end--;
+
+        int status = 0;
+        if (current == RequestLine)
+        {
+            // tolerate stray CRLFs between pipelined requests (RFC 9112 2.2)
+            if (end > pos)
+            {
+                status = parseRequestLine(data, pos, end);
+                current = Headers;
+            }
+        }
+        else if (end == pos)
+        {
+            headLength = next;
+            status = finishHead(data);
+            current = Body;
+        }
+        else
+        {
+            status = parseHeaderLine(data, pos, end);
+        }
+        if (status != 0) return fail(status);
+
+        pos = scanned = next;
+    }
+
+    if (pauseHead && !headReported && (chunked || req.contentLength != 0))
+    {
+        headReported = true;
+        materialize(data, StringView());
+        return HeadComplete;
+    }
+
+    if (chunked)
+    {
+        if (bodyScanned == 0)
+        {
+            bodyScanned = headLength;
+            decoder.reset(0, true, maxBodySize);
+        }
+        bodyScanned += decoder.feed(data + bodyScanned, len - bodyScanned, [this](const char *piece, size_t n) {
+            decodedBody.append(piece, n);
+            return true;
+        });
+        if (decoder.failed()) return fail(decoder.errorStatus());
+        if (!decoder.done())
+        {
+            // the encoded body waits in the stream until it is whole, so the
+            // framing may not outgrow the payload by much
+            if (bodyScanned - headLength > decodedBody.size() * 2 + maxHeadSize) return fail(413);
+            return Incomplete;
+        }
+        bodyLength = bodyScanned - headLength;
+        req.contentLength = decodedBody.size();
+        current = Done;
+        materialize(data, StringView(decodedBody));
+        return Complete;
+    }
+
+    if (req.contentLength > maxBodySize) return fail(413);
+    if (len - headLength < req.contentLength) return Incomplete;
+
+    bodyLength = static_cast<size_t>(req.contentLength);
+    current = Done;
+    materialize(data, StringView(data + headLength, bodyLength));
+    return Complete;
+}
+
+int HttpRequestParser::parseRequestLine(const char *data, size_t begin, size_t end)
+{
+    // method SP
+    size_t p = scan->findNonToken(data + begin, data + end) - data;
+    if (p == begin || p == end || data[p] != ' ') return 400;
+    method.offset = static_cast<uint32_t>(begin);
+    method.length = static_cast<uint32_t>(p - begin);
+
+    // request-target SP
+    size_t t = ++p;
+    const char *sp = static_cast<const char *>(std::memchr(data + t, ' ', end - t));
+    if (sp == nullptr || sp == data + t) return 400;
+    p = sp - data;
+    if (scan->findCtl(data + t, sp) != sp) return 400;
+    target.offset = static_cast<uint32_t>(t);
+    target.length = static_cast<uint32_t>(p - t);
+
+    // HTTP-version
+    p++;
+    if (end - p != 8 || std::memcmp(data + p, "HTTP/", 5) != 0) return 400;
+    char major = data[p + 5], minor = data[p + 7];
+    if (major < '0' || major > '9' || data[p + 6] != '.' || minor < '0' || minor > '9') return 400;
+    if (major != '1') return 505;
+    req.versionMinor = minor - '0';
+
+    return 0;
+}
+
+int HttpRequestParser::parseHeaderLine(const char *data, size_t begin, size_t end)
+{
+    // obsolete line folding is rejected (RFC 9112 5.2)
+    if (isOws(data[begin])) return 400;
+    if (req.headerCount == HttpRequest::MAX_HEADERS) return 431;
+
+    size_t p = scan->findNonToken(data + begin, data + end) - data;
+    if (p == begin || p == end || data[p] != ':') return 400;
+    size_t nameEnd = p++;
+
+    while (p < end && isOws(data[p])) p++;
+    size_t valueBegin = p;
+    if (scan->findCtl(data + valueBegin, data + end) != data + end) return 400;
+    size_t valueEnd = end;
+    while (valueEnd > valueBegin && isOws(data[valueEnd - 1])) valueEnd--;
+
+    Span &name = names[req.headerCount];
+    Span &value = values[req.headerCount];
+    name.offset = static_cast<uint32_t>(begin);
+    name.length = static_cast<uint32_t>(nameEnd - begin);
+    value.offset = static_cast<uint32_t>(valueBegin);
+    value.length = static_cast<uint32_t>(valueEnd - valueBegin);
+    req.headerCount++;
+
+    return 0;
+}
+
+int HttpRequestParser::finishHead(const char *data)
+{
+    bool haveLength = false;
+    uint64_t length = 0;
+
+    for (size_t i = 0; i < req.headerCount; i++)
+    {
+        StringView name(data + names[i].offset, names[i].length);
+        StringView value(data + values[i].offset, values[i].length);
+
+        if (name.size() == 17 && name.equalsIgnoreCase("Transfer-Encoding"))
+        {
+            // chunked is the only coding taken, and only once; HTTP/1.0 has
+            // no transfer codings at all (RFC 9112 6.1)
+            if (!value.equalsIgnoreCase("chunked")) return 501;
+            if (chunked || req.versionMinor == 0) return 400;
+            chunked = true;
+            continue;
+        }
+        if (name.size() != 14 || !name.equalsIgnoreCase("Content-Length")) continue;
+
+        if (value.empty()) return 400;
+        uint64_t parsed = 0;
+        for (char c : value)
+        {
+            if (c < '0' || c > '9') return 400;
+            if (parsed > (UINT64_MAX - 9) / 10) return 413;
+            parsed = parsed * 10 + (c - '0');
+        }
+        // repeated Content-Length is only fine when every copy agrees
+        if (haveLength && parsed != length) return 400;
+        haveLength = true;
+        length = parsed;
+    }
+
+    // both framings at once is how requests get smuggled
+    if (chunked && haveLength) return 400;
+    req.contentLength = length;
+    return 0;
+}
+
+void HttpRequestParser::materialize(const char *data, StringView body)
+{
+    req.method = StringView(data + method.offset, method.length);
+    req.target = StringView(data + target.offset, target.length);
+    for (size_t i = 0; i < req.headerCount; i++)
+    {
+        req.headers[i].name = StringView(data + names[i].offset, names[i].length);
+        req.headers[i].value = StringView(data + values[i].offset, values[i].length);
+    }
+    req.body = body;
+}
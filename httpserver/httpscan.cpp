@@ -0,0 +1,231 @@
+#include "httpscan.h"
+#include <atomic>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HTTPSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// RFC 9110 tchar: ALPHA / DIGIT / "!#$%&'*+-.^_`|~"
+static const unsigned char TCHAR[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static inline bool isCtl(unsigned char c)
+{
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+/* ---- scalar ---------------------------------------------------------- */
+
+static const char *scalarFindLineFeed(const char *p, const char *end)
+{
+    const void *hit = std::memchr(p, '\n', end - p);
+    return hit ? static_cast<const char *>(hit) : end;
+}
+
+static const char *scalarFindNonToken(const char *p, const char *end)
+{
+    while (end - p >= 4)
+    {
+        if (!TCHAR[(unsigned char)p[0]]) return p;
+        if (!TCHAR[(unsigned char)p[1]]) return p + 1;
+        if (!TCHAR[(unsigned char)p[2]]) return p + 2;
+        if (!TCHAR[(unsigned char)p[3]]) return p + 3;
+        p += 4;
+    }
+    while (p < end && TCHAR[(unsigned char)*p]) p++;
+    return p;
+}
+
+static const char *scalarFindCtl(const char *p, const char *end)
+{
+    while (p < end && !isCtl((unsigned char)*p)) p++;
+    return p;
+}
+
+static const HttpScanKernels SCALAR = {"scalar", scalarFindLineFeed, scalarFindNonToken, scalarFindCtl};
+
+#ifdef HTTPSCAN_X86
+
+/* ---- SSE4.2: PCMPESTRI range matching -------------------------------- */
+
+// byte ranges (pairs) that end a token. "{\xff" also covers '|' and '~',
+// which are tchars, so a hit there is re-checked against the table
+static const char TOKEN_STOP_RANGES[16] = {'\x00', ' ', '"', '"', '(', ')', ',', ',',
+                                           '/', '/', ':', '@', '[', ']', '{', '\xff'};
+static const char CTL_RANGES[16] = {'\x00', '\x08', '\x0a', '\x1f', '\x7f', '\x7f'};
+
+__attribute__((target("sse4.2")))
+static const char *sse42FindLineFeed(const char *p, const char *end)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return scalarFindLineFeed(p, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char *sse42FindNonToken(const char *p, const char *end)
+{
+    const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i *>(TOKEN_STOP_RANGES));
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int i = _mm_cmpestri(ranges, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (i == 16)
+        {
+            p += 16;
+            continue;
+        }
+        p += i;
+        if (!TCHAR[(unsigned char)*p]) return p;
+        p++;
+    }
+    return scalarFindNonToken(p, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char *sse42FindCtl(const char *p, const char *end)
+{
+    const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i *>(CTL_RANGES));
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int i = _mm_cmpestri(ranges, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (i != 16) return p + i;
+    }
+    return scalarFindCtl(p, end);
+}
+
+static const HttpScanKernels SSE42 = {"sse4.2", sse42FindLineFeed, sse42FindNonToken, sse42FindCtl};
+
+/* ---- AVX2: 32 bytes per step ----------------------------------------- */
+
+// The tails fall back to the SSE/scalar kernels, which are not VEX encoded;
+// clear the upper YMM halves first or every call pays the AVX-SSE transition
+// (GCC does not insert VZEROUPPER before a tail call).
+
+__attribute__((target("avx2")))
+static const char *avx2FindLineFeed(const char *p, const char *end)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return scalarFindLineFeed(p, end);
+}
+
+// tchar classification by nibble lookup: every tchar has its high nibble in
+// 2..7, so LO[c & 15] holds one bit per such high nibble and HI[c >> 4]
+// selects it; a byte is a tchar when the AND is non-zero
+__attribute__((target("avx2")))
+static const char *avx2FindNonToken(const char *p, const char *end)
+{
+    const __m256i lo = _mm256_setr_epi8(
+        0x3a, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3e, 0x3e, 0x3d, 0x15, 0x34, 0x15, 0x3d, 0x1c,
+        0x3a, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3e, 0x3e, 0x3d, 0x15, 0x34, 0x15, 0x3d, 0x1c);
+    const __m256i hi = _mm256_setr_epi8(
+        0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i stop = _mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(stop);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return scalarFindNonToken(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2FindCtl(const char *p, const char *end)
+{
+    const __m256i limit = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        // unsigned v <= 0x1f, minus HTAB, plus DEL
+        __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v);
+        low = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), low);
+        __m256i ctl = _mm256_or_si256(low, _mm256_cmpeq_epi8(v, del));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(ctl);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return sse42FindCtl(p, end);
+}
+
+static const HttpScanKernels AVX2 = {"avx2", avx2FindLineFeed, avx2FindNonToken, avx2FindCtl};
+
+#endif // HTTPSCAN_X86
+
+static const HttpScanKernels *detect()
+{
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return &SSE42;
+#endif
+    return &SCALAR;
+}
+
+static std::atomic<const HttpScanKernels *> active(nullptr);
+
+const HttpScanKernels &httpScanKernels()
+{
+    const HttpScanKernels *kernels = active.load(std::memory_order_acquire);
+    if (kernels == nullptr)
+    {
+        kernels = detect();
+        active.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+bool selectHttpScanKernels(const char *name)
+{
+    const HttpScanKernels *kernels = nullptr;
+    if (std::strcmp(name, SCALAR.name) == 0) kernels = &SCALAR;
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();
+    if (std::strcmp(name, SSE42.name) == 0 && __builtin_cpu_supports("sse4.2")) kernels = &SSE42;
+    if (std::strcmp(name, AVX2.name) == 0 && __builtin_cpu_supports("avx2")) kernels = &AVX2;
+#endif
+    if (kernels == nullptr) return false;
+    active.store(kernels, std::memory_order_release);
+    return true;
+}
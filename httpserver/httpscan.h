@@ -0,0 +1,27 @@
+#ifndef HTTPSCAN_H
+#define HTTPSCAN_H
+
+// Byte-scanning kernels behind the request parser. Each search returns the
+// first matching byte in [p, end), or `end` when there is none.
+//
+// The table is picked once at startup from the CPU (AVX2, then SSE4.2, then
+// a portable scalar version), the way picohttpparser does it.
+struct HttpScanKernels
+{
+    const char *name;
+    // first '\n'
+    const char *(*findLineFeed)(const char *p, const char *end);
+    // first byte that is not an RFC 9110 tchar (method, header name)
+    const char *(*findNonToken)(const char *p, const char *end);
+    // first control byte other than HTAB (request target, header value)
+    const char *(*findCtl)(const char *p, const char *end);
+};
+
+// the kernels in use
+const HttpScanKernels &httpScanKernels();
+
+// force "scalar", "sse4.2" or "avx2"; false when the CPU (or the compiler)
+// does not support it. Only parsers constructed afterwards pick it up.
+bool selectHttpScanKernels(const char *name);
+
+#endif
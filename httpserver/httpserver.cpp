@@ -0,0 +1,88 @@
+#include "httpserver.h"
+#include "ctpl_stl.h"
+#include "metrics.h"
+
+HttpServer::HttpServer(HttpHandler handler, const ServerOptions &options, const HttpOptions &http)
+    : handler(std::move(handler)), maxPipelined(http.maxPipelined), streamHandler(http.streamHandler),
+      streamWindow(http.streamWindow), server(createserver(options))
+{
+    if (http.maxInFlight != 0 || http.maxMemoryBytes != 0)
+        admission.reset(new Admission(http.maxInFlight, http.maxMemoryBytes));
+    if (http.rateLimit > 0 || !http.rateLimitRoutes.empty())
+        limiter.reset(new RateLimiter(http.rateLimit, http.rateBurst, http.rateLimitRoutes, http.rateLimitSlots));
+    if (http.cacheBytes != 0)
+        cache.reset(new ResponseCache(http.cacheBytes, http.cacheTtlMs, http.cacheVary));
+    if (http.workers != 0)
+        workers.reset(new ctpl::thread_pool((int)http.workers));
+
+    if (!http.metricsPath.empty())
+    {
+        HttpHandler application = std::move(this->handler);
+        std::string path = http.metricsPath;
+        this->handler = [application, path](const HttpRequest &request) {
+            if (request.path() != StringView(path))
+                return application(request);
+            if (request.method != "GET" && request.method != "HEAD")
+                return HttpResponse::Builder().status(405).header("Allow", "GET, HEAD").build();
+            return HttpResponse::Builder()
+                .header("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+                .header("Cache-Control", "no-store")
+                .body(Metrics::render())
+                .build();
+        };
+    }
+
+    // after the metrics endpoint, so that a scrape is compressed too; on the
+    // thread the handler runs on, which keeps it off the reactor with workers
+    if (http.compress)
+    {
+        HttpHandler application = std::move(this->handler);
+        ResponseCompressor compressor(http.gzipLevel, http.brotliLevel, http.compressMinBytes);
+        this->handler = [application, compressor](const HttpRequest &request) {
+            HttpResponse response = application(request);
+            compressor.apply(request, response);
+            return response;
+        };
+    }
+
+    server->setHandler(this);
+}
+
+// the pool's last responses are posted to the reactors' queues, so it
+// finishes before the server goes away
+HttpServer::~HttpServer()
+{
+    workers.reset();
+}
+
+bool HttpServer::initialize(int port, const std::string &ipAddress)
+{
+    return server->initialize(port, ipAddress);
+}
+
+void HttpServer::start()
+{
+    server->start();
+}
+
+void HttpServer::stop()
+{
+    server->stop();
+}
+
+void HttpServer::onConnect(TCPConnection &conn)
+{
+    conn.setContext(std::unique_ptr<ConnectionContext>(new HttpConnection(&handler, workers.get(), admission.get(), cache.get(),
+                                                                             maxPipelined, &streamHandler, streamWindow,
+                                                                             limiter.get())));
+}
+
+size_t HttpServer::onData(TCPConnection &conn, const char *data, size_t len)
+{
+    return static_cast<HttpConnection *>(conn.context())->onData(conn, data, len);
+}
+
+void HttpServer::onWritable(TCPConnection &conn)
+{
+    static_cast<HttpConnection *>(conn.context())->onWritable(conn);
+}
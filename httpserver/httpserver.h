@@ -0,0 +1,102 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include "admission.h"
+#include "compression.h"
+#include "connection.h"
+#include "ratelimit.h"
+#include "responsecache.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HttpOptions
+{
+    // 0 runs the handler on the connection's reactor thread; otherwise on a
+    // pool of this many threads, for handlers slow enough (templating,
+    // compression, blocking calls) to stall every other connection of the
+    // reactor. Linux only
+    unsigned workers = 0;
+    // GET here returns the server's metrics in the Prometheus text format
+    // instead of calling the handler; empty turns the endpoint off
+    std::string metricsPath = "/metrics";
+    // requests answered per batch of pipelined input; past it the
+    // connection stops reading until those responses are written, so a
+    // client that pipelines without reading gets no further ahead. 0 turns
+    // it off
+    unsigned maxPipelined = 16;
+    // Load shedding: past this many requests in handlers (running or queued
+    // for the worker pool), or this much resident memory, new requests get
+    // a canned 503 and their connection is closed. 0 turns either off
+    size_t maxInFlight = 0;
+    size_t maxMemoryBytes = 0;
+    // Rate limiting: every client address may make rateLimit requests a
+    // second on average, in bursts of up to rateBurst, and requests under a
+    // rateLimitRoutes prefix are charged to that route's bucket too. Over
+    // either, a request gets a canned 429 before the cache, the limits
+    // above or the handler see it; see RateLimiter. rateLimitSlots buckets
+    // are tracked at once. A rateLimit of 0 and no routes turns it off
+    double rateLimit = 0;
+    unsigned rateBurst = 20;
+    std::vector<RateLimitRule> rateLimitRoutes;
+    size_t rateLimitSlots = 65536;
+    // Response cache budget in bytes, 0 for none: GET responses the
+    // handler allows to be reused are kept serialized for cacheTtlMs and
+    // answer later requests for the same target (and values of the
+    // cacheVary headers) without calling it; see ResponseCache
+    size_t cacheBytes = 0;
+    unsigned cacheTtlMs = 10000;
+    std::vector<std::string> cacheVary = {"Accept-Encoding"};
+    // Streaming: asked for every request with a body, before any of it is
+    // read; a sink it returns takes the body as it arrives, so an upload
+    // needs no more memory than a read's worth (see HttpBodySink). Unset,
+    // bodies are buffered up to the parser's limit
+    HttpStreamHandler streamHandler;
+    // a response with a producer is made this many bytes at a time, each
+    // window once the last one has been written
+    size_t streamWindow = 64 * 1024;
+    // Compression: handler responses of a compressible type (text, JSON,
+    // JavaScript, XML, SVG) are sent br, gzip or deflate as the request's
+    // Accept-Encoding allows, in-memory bodies from compressMinBytes up and
+    // streamed bodies as they are produced; see ResponseCompressor. Levels
+    // are each coding's own: 1-9 for gzip and deflate, 0-11 for br. Files
+    // come from StaticFiles, which has its own precompressed copies
+    bool compress = false;
+    size_t compressMinBytes = 256;
+    int gzipLevel = 6;
+    int brotliLevel = 5;
+};
+
+// HTTP/1.1 on top of the TCP reactors: every connection gets an
+// HttpConnection and every complete request goes to `handler`.
+class HttpServer : public ConnectionHandler
+{
+public:
+    explicit HttpServer(HttpHandler handler, const ServerOptions &options = ServerOptions(),
+                        const HttpOptions &http = HttpOptions());
+    ~HttpServer();
+
+    bool initialize(int port, const std::string &ipAddress = "127.0.0.1");
+    // serve until stop()
+    void start();
+    // finish in-flight requests, answering them with Connection: close,
+    // then make start() return; see TCPServer::stop()
+    void stop();
+
+    void onConnect(TCPConnection &conn) override;
+    size_t onData(TCPConnection &conn, const char *data, size_t len) override;
+    void onWritable(TCPConnection &conn) override;
+
+private:
+    HttpHandler handler;
+    unsigned maxPipelined;
+    HttpStreamHandler streamHandler;
+    size_t streamWindow;
+    std::unique_ptr<Admission> admission; // null when both limits are off
+    std::unique_ptr<RateLimiter> limiter;
+    std::unique_ptr<ResponseCache> cache;
+    std::unique_ptr<ctpl::thread_pool> workers;
+    std::unique_ptr<TCPServer> server;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "ratelimit.h"
+
+namespace
+{
+
+#define TOO_MANY_HEAD                                                                                                  \
+    "HTTP/1.1 429 Too Many Requests\r\n"                                                                               \
+    "Content-Type: text/plain\r\n"                                                                                     \
+    "Content-Length: 18\r\n"                                                                                           \
+    "Retry-After: 1\r\n"
+#define TOO_MANY_BODY "Too Many Requests\n"
+
+// by [keepAlive][headOnly]
+const char *const REJECTIONS[2][2] = {
+    {TOO_MANY_HEAD "Connection: close\r\n\r\n" TOO_MANY_BODY, TOO_MANY_HEAD "Connection: close\r\n\r\n"},
+    {TOO_MANY_HEAD "Connection: keep-alive\r\n\r\n" TOO_MANY_BODY, TOO_MANY_HEAD "Connection: keep-alive\r\n\r\n"},
+};
+
+#undef TOO_MANY_HEAD
+#undef TOO_MANY_BODY
+
+// the low word of a key: 1 for a client's own bucket, 2 + i for route i,
+// with the top bit set when the route's bucket is shared
+const uint64_t CLIENT_BUCKET = 1;
+const uint64_t SHARED_BUCKET = 0x80000000u;
+
+// splitmix64's finalizer: spreads client addresses that differ only in
+// their last octet over the whole table
+inline uint64_t mix(uint64_t key)
+{
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+    return key ^ (key >> 31);
+}
+
+// take a token from the bucket whose theoretical arrival time is `due`
+inline bool take(std::atomic<uint64_t> &due, uint64_t interval, uint64_t window, uint64_t now)
+{
+    uint64_t current = due.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        uint64_t next = (current > now ? current : now) + interval;
+        if (next - now > window) return false;
+        if (due.compare_exchange_weak(current, next, std::memory_order_relaxed)) return true;
+    }
+}
+
+} // namespace
+
+RateLimiter::RateLimiter(double rate, unsigned burst, const std::vector<RateLimitRule> &routes, size_t slots)
+    : client(limitOf(rate, burst))
+{
+    for (const RateLimitRule &rule : routes)
+        this->routes.push_back(Route{rule.prefix, limitOf(rule.rate, rule.burst), rule.perClient});
+
+    size_t size = PROBE;
+    while (size < slots) size <<= 1;
+    this->slots.reset(new Slot[size]);
+    for (size_t i = 0; i < size; i++)
+    {
+        this->slots[i].key.store(0, std::memory_order_relaxed);
+        this->slots[i].due.store(0, std::memory_order_relaxed);
+    }
+    mask = size - 1;
+}
+
+RateLimiter::Limit RateLimiter::limitOf(double rate, unsigned burst)
+{
+    if (rate <= 0) return Limit{0, 0};
+    uint64_t interval = (uint64_t)(1e9 / rate);
+    if (interval == 0) interval = 1;
+    return Limit{interval, interval * (burst != 0 ? burst : 1)};
+}
+
+const char *RateLimiter::rejection(bool keepAlive, bool headOnly, size_t &length)
+{
+    const char *response = REJECTIONS[keepAlive][headOnly];
+    length = std::char_traits<char>::length(response);
+    return response;
+}
+
+bool RateLimiter::allow(uint32_t address, StringView path, uint64_t now)
+{
+    if (client.interval != 0 && !charge((uint64_t)address << 32 | CLIENT_BUCKET, client, now)) return false;
+
+    for (size_t i = 0; i < routes.size(); i++)
+    {
+        const Route &route = routes[i];
+        if (!path.startsWith(route.prefix)) continue;
+        if (route.limit.interval == 0) return true;
+        uint64_t key = route.perClient ? (uint64_t)address << 32 | (2 + i) : SHARED_BUCKET | (2 + i);
+        return charge(key, route.limit, now);
+    }
+    return true;
+}
+
+// Find the key's slot among its probes, or claim an empty one or one whose
+// bucket has refilled; lost claims are retried once
+bool RateLimiter::charge(uint64_t key, const Limit &limit, uint64_t now)
+{
+    size_t start = (size_t)mix(key) & mask;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        Slot *free = nullptr;
+        uint64_t freeKey = 0;
+        for (unsigned i = 0; i < PROBE; i++)
+        {
+            Slot &slot = slots[(start + i) & mask];
+            uint64_t held = slot.key.load(std::memory_order_acquire);
+            if (held == key) return take(slot.due, limit.interval, limit.window, now);
+            if (free == nullptr && (held == 0 || slot.due.load(std::memory_order_relaxed) <= now))
+            {
+                free = &slot;
+                freeKey = held;
+            }
+            // keys are never removed, only replaced: none lies past an empty slot
+            if (held == 0) break;
+        }
+        if (free == nullptr) return true;
+        if (free->key.compare_exchange_strong(freeKey, key, std::memory_order_acq_rel) || freeKey == key)
+            return take(free->due, limit.interval, limit.window, now);
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include "stringview.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A limit on the requests whose path starts with `prefix`: `rate` a second
+// on average, with bursts of up to `burst` at once. Per client address, or
+// shared by every client when `perClient` is false
+struct RateLimitRule
+{
+    std::string prefix;
+    double rate;
+    unsigned burst;
+    bool perClient;
+};
+
+// Token buckets per client address, and per client and route (or per route)
+// for the `routes` a request's path falls under, the first matching rule
+// applying. A request is allowed when every bucket it is charged to has a
+// token left; it takes one from each as it is checked.
+//
+// A bucket is one 64-bit word: the time its next token would be due were
+// it empty, "theoretical arrival time" as in GCRA, the token bucket kept
+// without a refill step. A request moves it one interval (1/rate) later,
+// and is refused when that puts it more than `burst` intervals ahead of
+// now. Buckets live in an open-addressed table of `slots` (rounded up to a
+// power of two) probed linearly over PROBE slots; keys and times are
+// atomics updated with compare-exchange, so checks from every reactor
+// thread take no lock. A bucket whose time has passed is full, the same as
+// one never seen: its slot is taken over by the next key that needs one,
+// which is all the eviction there is. With no free or full bucket among its
+// probes, a new client is let through uncounted. Races can charge one
+// request to the wrong bucket, never more.
+class RateLimiter
+{
+public:
+    static const unsigned PROBE = 8;
+
+    // `rate` 0 leaves clients unlimited outside `routes`; a `burst` of 0
+    // is taken as 1
+    RateLimiter(double rate, unsigned burst, const std::vector<RateLimitRule> &routes = std::vector<RateLimitRule>(),
+                size_t slots = 65536);
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    // whether the client at `address` (IPv4, network byte order) may make a
+    // request for `path` at `now` (Metrics::nowNanos()). Safe from any thread
+    bool allow(uint32_t address, StringView path, uint64_t now);
+
+    // the whole canned 429, with or without its body, keeping the connection
+    // or closing it
+    static const char *rejection(bool keepAlive, bool headOnly, size_t &length);
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> key; // 0: never used
+        std::atomic<uint64_t> due; // the bucket's theoretical arrival time
+    };
+
+    // interval and burst window in nanoseconds
+    struct Limit
+    {
+        uint64_t interval;
+        uint64_t window;
+    };
+
+    struct Route
+    {
+        std::string prefix;
+        Limit limit;
+        bool perClient;
+    };
+
+    Limit client;
+    std::vector<Route> routes;
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    static Limit limitOf(double rate, unsigned burst);
+    bool charge(uint64_t key, const Limit &limit, uint64_t now);
+};
+
+#endif
@@ -0,0 +1,434 @@
+#include "responsecache.h"
+#include "metrics.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace
+{
+
+const char KEEP_ALIVE[] = "Connection: keep-alive\r\n\r\n";
+const char CLOSE[] = "Connection: close\r\n\r\n";
+
+// Announcement slots, shared by every cache: a thread takes one on its
+// first lookup and gives it back when it exits. Leaked on purpose, like the
+// exchange pools, so threads outliving main() can still give theirs back.
+class ReaderSlots
+{
+public:
+    static unsigned local()
+    {
+        static thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<unsigned> free;
+        unsigned next = 0;
+    };
+
+    struct Holder
+    {
+        unsigned index;
+
+        Holder()
+        {
+            Registry &registry = instance();
+            std::lock_guard<std::mutex> guard(registry.lock);
+            if (registry.free.empty())
+            {
+                index = registry.next++;
+            }
+            else
+            {
+                index = registry.free.back();
+                registry.free.pop_back();
+            }
+        }
+
+        ~Holder()
+        {
+            Registry &registry = instance();
+            std::lock_guard<std::mutex> guard(registry.lock);
+            registry.free.push_back(index);
+        }
+    };
+
+    static Registry &instance()
+    {
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+};
+
+bool sameName(const std::string &a, StringView b)
+{
+    return StringView(a).equalsIgnoreCase(b);
+}
+
+StringView trim(StringView s)
+{
+    size_t begin = 0, end = s.size();
+    while (begin < end && (s[begin] == ' ' || s[begin] == '\t')) begin++;
+    while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t')) end--;
+    return s.substr(begin, end - begin);
+}
+
+// Cache-Control, one directive at a time: false for one that forbids
+// storing, and a max-age sets `ttl`. Ages past 2^31 seconds count as 2^31
+// (RFC 9111, 1.2.2), so neither the parse nor the nanoseconds overflow.
+bool cacheControl(StringView value, uint64_t &ttl)
+{
+    const uint64_t MAX_SECONDS = 1ull << 31;
+    while (!value.empty())
+    {
+        size_t comma = value.find(',');
+        if (comma == std::string::npos) comma = value.size();
+        StringView directive = trim(value.substr(0, comma));
+        value = comma < value.size() ? value.substr(comma + 1) : StringView();
+
+        size_t equals = directive.find('=');
+        StringView name = trim(directive.substr(0, equals));
+        if (name.equalsIgnoreCase("no-store") || name.equalsIgnoreCase("no-cache") || name.equalsIgnoreCase("private"))
+            return false;
+        if (!name.equalsIgnoreCase("max-age")) continue;
+
+        StringView digits = equals == std::string::npos ? StringView() : trim(directive.substr(equals + 1));
+        if (digits.empty()) return false;
+        uint64_t seconds = 0;
+        for (size_t i = 0; i < digits.size(); i++)
+        {
+            if (digits[i] < '0' || digits[i] > '9') return false;
+            seconds = std::min(seconds * 10 + (uint64_t)(digits[i] - '0'), MAX_SECONDS);
+        }
+        ttl = seconds * 1000000000ull;
+    }
+    return true;
+}
+
+inline uint64_t fnv1a(uint64_t hash, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+// target, then "\n" and the value of each vary header; neither can hold a
+// newline, so the joined form is unambiguous
+struct ResponseCache::Key
+{
+    StringView parts[1 + MAX_VARY];
+    size_t count;
+    size_t length;
+    uint64_t hash;
+
+    Key(const HttpRequest &request, const std::vector<std::string> &vary) : count(0), length(0)
+    {
+        parts[count++] = request.target;
+        for (const std::string &name : vary) parts[count++] = request.header(name);
+
+        hash = 14695981039346656037ull;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i != 0) hash = fnv1a(hash, "\n", 1);
+            hash = fnv1a(hash, parts[i].data(), parts[i].size());
+            length += parts[i].size() + (i != 0);
+        }
+    }
+
+    bool matches(const std::string &key) const
+    {
+        if (key.size() != length) return false;
+        const char *p = key.data();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i != 0 && *p++ != '\n') return false;
+            if (!parts[i].empty() && std::memcmp(p, parts[i].data(), parts[i].size()) != 0) return false;
+            p += parts[i].size();
+        }
+        return true;
+    }
+
+    std::string str() const
+    {
+        std::string joined;
+        joined.reserve(length);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i != 0) joined += '\n';
+            if (!parts[i].empty()) joined.append(parts[i].data(), parts[i].size());
+        }
+        return joined;
+    }
+};
+
+// Immutable once linked, but for the reference bit.
+struct ResponseCache::Entry
+{
+    uint64_t hash;
+    std::string key;
+    uint64_t expires;     // Metrics::nowNanos()
+    size_t fieldsLength;  // head up to the Date line; the body follows
+    std::string bytes;
+    size_t slot;          // index in `clock`, kept by the writer
+    std::atomic<bool> referenced;
+    std::atomic<Entry *> next;
+
+    Entry() : hash(0), expires(0), fieldsLength(0), slot(0), referenced(false), next(nullptr) {}
+
+    size_t size() const { return sizeof(Entry) + key.size() + bytes.size(); }
+};
+
+ResponseCache::ResponseCache(size_t maxBytes, unsigned ttlMs, const std::vector<std::string> &vary)
+    : maxBytes(maxBytes), ttlNanos((uint64_t)ttlMs * 1000000), varyCookie(false), readers(new Reader[READERS]),
+      epoch(1), used(0), hand(0)
+{
+    for (const std::string &name : vary)
+    {
+        if (this->vary.size() == MAX_VARY) break;
+        this->vary.push_back(name);
+        varyCookie |= sameName(name, "Cookie");
+    }
+
+    // about one bucket per KiB of budget
+    size_t count = 1024;
+    while (count < maxBytes / 1024 && count < (1u << 20)) count *= 2;
+    buckets.reset(new std::atomic<Entry *>[count]);
+    for (size_t i = 0; i < count; i++) buckets[i].store(nullptr, std::memory_order_relaxed);
+    mask = count - 1;
+    for (unsigned i = 0; i < READERS; i++) readers[i].epoch.store(0, std::memory_order_relaxed);
+}
+
+// no lookup may be running any more
+ResponseCache::~ResponseCache()
+{
+    Metrics::local().add(MetricGauge::CacheBytes, -(int64_t)used.load());
+    for (Entry *entry : clock) delete entry;
+    for (const Retired &r : retired) delete r.entry;
+}
+
+bool ResponseCache::bypass(const HttpRequest &request) const
+{
+    // the stored response is a full 200: conditional and range requests go
+    // to the handler, which can answer them with a 304 or a 206
+    return request.hasHeader("Authorization") || (!varyCookie && request.hasHeader("Cookie")) ||
+           request.hasHeader("Range") || request.hasHeader("If-None-Match") || request.hasHeader("If-Modified-Since");
+}
+
+// whether every header a Vary value names is part of the key
+bool ResponseCache::keyedBy(StringView names) const
+{
+    while (!names.empty())
+    {
+        size_t comma = names.find(',');
+        if (comma == std::string::npos) comma = names.size();
+        StringView name = trim(names.substr(0, comma));
+        names = comma < names.size() ? names.substr(comma + 1) : StringView();
+        if (name.empty()) continue;
+        bool keyed = false;
+        for (const std::string &v : vary) keyed |= sameName(v, name);
+        if (!keyed) return false;
+    }
+    return true;
+}
+
+uint64_t ResponseCache::lifetime(const HttpResponse &response) const
+{
+    if (response.statusCode != 200 || response.file || response.producer) return 0;
+
+    uint64_t ttl = ttlNanos;
+    for (const auto &h : response.headers)
+    {
+        if (sameName("Set-Cookie", h.first)) return 0;
+        if (sameName("Cache-Control", h.first))
+        {
+            if (!cacheControl(h.second, ttl)) return 0;
+        }
+        else if (sameName("Vary", h.first) && !keyedBy(h.second))
+            return 0;
+    }
+
+    // preformatted lines can vary too (StaticFiles' compressed copies)
+    if (response.headerBlock)
+    {
+        StringView lines(*response.headerBlock);
+        size_t at = 0;
+        while (at < lines.size())
+        {
+            size_t end = lines.find('\n', at);
+            if (end == std::string::npos) end = lines.size();
+            StringView line = lines.substr(at, end > at && lines[end - 1] == '\r' ? end - at - 1 : end - at);
+            at = end + 1;
+            if (line.size() > 5 && line.substr(0, 5).equalsIgnoreCase("Vary:") && !keyedBy(line.substr(5)))
+                return 0;
+        }
+    }
+    return ttl;
+}
+
+ResponseCache::Entry *ResponseCache::find(const Key &key) const
+{
+    Entry *entry = buckets[key.hash & mask].load(std::memory_order_acquire);
+    while (entry != nullptr && (entry->hash != key.hash || !key.matches(entry->key)))
+        entry = entry->next.load(std::memory_order_acquire);
+    return entry;
+}
+
+bool ResponseCache::serve(TCPConnection &conn, const HttpRequest &request, bool keepAlive)
+{
+    bool head = request.method == "HEAD";
+    if ((!head && request.method != "GET") || bypass(request)) return false;
+    unsigned slot = ReaderSlots::local();
+    if (slot >= READERS) return false;
+
+    Key key(request, vary);
+    uint64_t now = Metrics::nowNanos();
+
+    // announce the epoch before touching any entry; the fence pairs with
+    // the one in reclaim()
+    std::atomic<uint64_t> &announced = readers[slot].epoch;
+    announced.store(epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    Entry *entry = find(key);
+    bool hit = entry != nullptr && entry->expires > now;
+    if (hit)
+    {
+        if (!entry->referenced.load(std::memory_order_relaxed))
+            entry->referenced.store(true, std::memory_order_relaxed);
+
+        size_t body = head ? 0 : entry->bytes.size() - entry->fieldsLength;
+        const char *connection = keepAlive ? KEEP_ALIVE : CLOSE;
+        size_t connectionLength = keepAlive ? sizeof(KEEP_ALIVE) - 1 : sizeof(CLOSE) - 1;
+        char *p = conn.prepareSend(entry->fieldsLength + HTTP_DATE_LINE + connectionLength + body);
+        std::memcpy(p, entry->bytes.data(), entry->fieldsLength);
+        p += entry->fieldsLength;
+        std::memcpy(p, httpDateLine(), HTTP_DATE_LINE);
+        p += HTTP_DATE_LINE;
+        std::memcpy(p, connection, connectionLength);
+        p += connectionLength;
+        std::memcpy(p, entry->bytes.data() + entry->fieldsLength, body);
+        conn.commitSend(p + body);
+    }
+    announced.store(0, std::memory_order_release);
+
+    Metrics::local().add(hit ? MetricCounter::CacheHits : MetricCounter::CacheMisses);
+    return hit;
+}
+
+void ResponseCache::store(const HttpRequest &request, const HttpResponse &response)
+{
+    if (request.method != "GET" || bypass(request)) return;
+    uint64_t ttl = lifetime(response);
+    if (ttl == 0) return;
+
+    // serialized outside the lock
+    Key key(request, vary);
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->hash = key.hash;
+    entry->key = key.str();
+    const std::string &body = response.bodyBytes();
+    entry->bytes.resize(response.headSize() + body.size());
+    entry->fieldsLength = response.serializeFields(&entry->bytes[0]);
+    std::memcpy(&entry->bytes[entry->fieldsLength], body.data(), body.size());
+    entry->bytes.resize(entry->fieldsLength + body.size());
+    entry->bytes.shrink_to_fit();
+    // one response never takes more than an eighth of the budget
+    if (entry->size() > maxBytes / 8) return;
+
+    std::lock_guard<std::mutex> guard(writer);
+    uint64_t now = Metrics::nowNanos();
+    entry->expires = now + ttl;
+    link(entry.release());
+    evict(now);
+    reclaim();
+}
+
+// publish `entry` at the head of its bucket, replacing an older answer
+// under the same key
+void ResponseCache::link(Entry *entry)
+{
+    std::atomic<Entry *> &bucket = buckets[entry->hash & mask];
+    for (Entry *old = bucket.load(std::memory_order_relaxed); old != nullptr;
+         old = old->next.load(std::memory_order_relaxed))
+    {
+        if (old->hash == entry->hash && old->key == entry->key)
+        {
+            unlink(old);
+            break;
+        }
+    }
+    entry->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bucket.store(entry, std::memory_order_release);
+
+    entry->slot = clock.size();
+    clock.push_back(entry);
+    used.fetch_add(entry->size(), std::memory_order_relaxed);
+    Metrics::local().add(MetricGauge::CacheBytes, (int64_t)entry->size());
+}
+
+// Take `entry` out of its chain and the clock. Readers already on it still
+// follow its unchanged `next`; it is freed by reclaim()
+void ResponseCache::unlink(Entry *entry)
+{
+    std::atomic<Entry *> *link = &buckets[entry->hash & mask];
+    while (link->load(std::memory_order_relaxed) != entry) link = &link->load(std::memory_order_relaxed)->next;
+    link->store(entry->next.load(std::memory_order_relaxed), std::memory_order_release);
+
+    Entry *last = clock.back();
+    clock[entry->slot] = last;
+    last->slot = entry->slot;
+    clock.pop_back();
+
+    used.fetch_sub(entry->size(), std::memory_order_relaxed);
+    Metrics::local().add(MetricGauge::CacheBytes, -(int64_t)entry->size());
+    retired.push_back(Retired{entry, epoch.load(std::memory_order_relaxed)});
+}
+
+// CLOCK: an entry hit since the hand last passed gets another round, an
+// unreferenced or expired one goes
+void ResponseCache::evict(uint64_t now)
+{
+    ThreadMetrics &metrics = Metrics::local();
+    while (used.load(std::memory_order_relaxed) > maxBytes && !clock.empty())
+    {
+        if (hand >= clock.size()) hand = 0;
+        Entry *entry = clock[hand];
+        if (entry->expires > now && entry->referenced.exchange(false, std::memory_order_relaxed))
+        {
+            hand++;
+            continue;
+        }
+        unlink(entry); // the last entry moves into the hand's slot
+        metrics.add(MetricCounter::CacheEvictions);
+    }
+}
+
+// Free what no reader can reach any more. An entry retired in epoch R may
+// still be held by a reader that announced R or earlier; a reader that
+// announced later loaded the epoch after it was unlinked.
+void ResponseCache::reclaim()
+{
+    if (retired.empty()) return;
+    epoch.fetch_add(1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t oldest = UINT64_MAX;
+    for (unsigned i = 0; i < READERS; i++)
+    {
+        uint64_t announced = readers[i].epoch.load(std::memory_order_relaxed);
+        if (announced != 0 && announced < oldest) oldest = announced;
+    }
+
+    auto end = std::partition(retired.begin(), retired.end(), [oldest](const Retired &r) { return r.epoch >= oldest; });
+    for (auto it = end; it != retired.end(); ++it) delete it->entry;
+    retired.erase(end, retired.end());
+}
@@ -0,0 +1,105 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "tcpserver.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Whole responses to GET, kept serialized so that a hit costs a few
+// memcpy()s into the connection's output: the stored status line and
+// headers, a fresh Date and Connection line, then the stored body.
+//
+// Entries are keyed by target and by the values of the `vary` request
+// headers (at most MAX_VARY); HEAD is answered from the GET entry. Only 200
+// responses with an in-memory body are stored, and none with Set-Cookie, a
+// Cache-Control of no-store, no-cache or private, or a Vary naming a header
+// outside `vary`. A max-age in Cache-Control replaces the default time to
+// live. Requests with Authorization, Range, If-None-Match or
+// If-Modified-Since, or with Cookie when it is not in `vary`, bypass the
+// cache both ways.
+//
+// Lookups take no lock. A bucket is a chain of immutable entries linked by
+// atomic pointers. An entry unlinked by a store or an eviction is freed once
+// no reader can still be looking at it: a reader announces the epoch it
+// started in, in a slot of its own thread, and the writer frees only what it
+// retired before every announced epoch (epoch-based reclamation). Stores
+// take a mutex and evict with CLOCK: a hit sets the entry's reference bit,
+// and the hand passes over a referenced entry once, clearing the bit, until
+// the cache is back under `maxBytes`. Expired entries are misses until the
+// hand or a fresh store drops them.
+class ResponseCache
+{
+public:
+    static const size_t MAX_VARY = 8;
+
+    ResponseCache(size_t maxBytes, unsigned ttlMs, const std::vector<std::string> &vary = std::vector<std::string>());
+    ~ResponseCache();
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    // queue the cached answer to `request` on `conn`; false on a miss and
+    // for requests the cache does not take. Safe from any thread
+    bool serve(TCPConnection &conn, const HttpRequest &request, bool keepAlive);
+    // keep `response` for later requests like `request`, when it may be
+    // reused. Call before the body is moved out of it
+    void store(const HttpRequest &request, const HttpResponse &response);
+
+    // bytes held, entries and their keys included
+    size_t size() const { return used.load(std::memory_order_relaxed); }
+
+private:
+    // one per thread that ever read; a thread past them bypasses the cache
+    static const unsigned READERS = 256;
+
+    struct Entry;
+    struct Key;
+
+    // an announced epoch, 0 outside a lookup; padded to its own cache line
+    struct Reader
+    {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    struct Retired
+    {
+        Entry *entry;
+        uint64_t epoch; // the global epoch when it was unlinked
+    };
+
+    const size_t maxBytes;
+    const uint64_t ttlNanos;
+    std::vector<std::string> vary;
+    bool varyCookie;
+
+    std::unique_ptr<std::atomic<Entry *>[]> buckets;
+    size_t mask;
+    std::unique_ptr<Reader[]> readers;
+    std::atomic<uint64_t> epoch;
+    std::atomic<size_t> used;
+
+    // stores and evictions
+    std::mutex writer;
+    std::vector<Entry *> clock; // every linked entry, in no particular order
+    size_t hand;
+    std::vector<Retired> retired;
+
+    bool bypass(const HttpRequest &request) const;
+    // how long `response` may be reused; 0 when it may not be stored
+    uint64_t lifetime(const HttpResponse &response) const;
+    bool keyedBy(StringView varyNames) const;
+    Entry *find(const Key &key) const;
+    void link(Entry *entry);
+    void unlink(Entry *entry);
+    void evict(uint64_t now);
+    void reclaim();
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "router.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+
+const char *const METHOD_NAMES[] = {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+// ((first byte >> 1) + 5 * length) & 15 is distinct for every name above
+inline unsigned methodHash(const char *name, size_t len) { return ((unsigned char)name[0] / 2 + 5 * len) & 15; }
+
+struct MethodTable
+{
+    HttpMethod slots[16];
+
+    MethodTable()
+    {
+        for (HttpMethod &slot : slots) slot = HttpMethod::Count;
+        for (unsigned m = 0; m < (unsigned)HttpMethod::Count; m++)
+            slots[methodHash(METHOD_NAMES[m], std::strlen(METHOD_NAMES[m]))] = (HttpMethod)m;
+    }
+};
+
+const MethodTable METHOD_TABLE;
+
+size_t commonPrefix(const std::string &a, const std::string &b)
+{
+    size_t n = 0, limit = std::min(a.size(), b.size());
+    while (n < limit && a[n] == b[n]) n++;
+    return n;
+}
+
+HttpResponse errorResponse(int status)
+{
+    return HttpResponse::Builder().status(status).body(std::string(httpReasonPhrase(status)) + "\n").build();
+}
+
+} // namespace
+
+HttpMethod parseHttpMethod(StringView method)
+{
+    if (method.empty()) return HttpMethod::Count;
+    HttpMethod candidate = METHOD_TABLE.slots[methodHash(method.data(), method.size())];
+    if (candidate != HttpMethod::Count && method == METHOD_NAMES[(unsigned)candidate]) return candidate;
+    return HttpMethod::Count;
+}
+
+const char *httpMethodName(HttpMethod method)
+{
+    return method < HttpMethod::Count ? METHOD_NAMES[(unsigned)method] : "";
+}
+
+StringView RouteParams::get(StringView name) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (names[i] == name) return values[i];
+    }
+    return StringView();
+}
+
+struct Router::Node
+{
+    std::string label;                           // literal prefix; empty for the root and placeholders
+    std::vector<std::unique_ptr<Node>> children; // literal children, by first byte
+    std::unique_ptr<Node> param;
+    std::unique_ptr<Node> wildcard;
+    std::string name;       // placeholder name
+    bool terminal = false;  // some pattern ends here
+    uint32_t handlers[METHODS];
+
+    Node()
+    {
+        for (uint32_t &handler : handlers) handler = NONE;
+    }
+
+    // the node reached by `text` below this one, splitting an edge when it
+    // ends halfway along a label
+    Node *literal(const std::string &text)
+    {
+        if (text.empty()) return this;
+        auto it = std::lower_bound(children.begin(), children.end(), text[0],
+                                   [](const std::unique_ptr<Node> &child, char c) { return child->label[0] < c; });
+        if (it == children.end() || (*it)->label[0] != text[0])
+        {
+            it = children.insert(it, std::unique_ptr<Node>(new Node()));
+            (*it)->label = text;
+            return it->get();
+        }
+
+        Node *child = it->get();
+        size_t shared = commonPrefix(child->label, text);
+        if (shared < child->label.size())
+        {
+            std::unique_ptr<Node> split(new Node());
+            split->label = child->label.substr(0, shared);
+            child->label.erase(0, shared);
+            split->children.push_back(std::move(*it));
+            *it = std::move(split);
+            child = it->get();
+        }
+        return child->literal(text.substr(shared));
+    }
+
+    // the ":name" or "*name" child; nullptr when another name holds the spot
+    static Node *placeholder(std::unique_ptr<Node> &slot, const std::string &name)
+    {
+        if (!slot)
+        {
+            slot.reset(new Node());
+            slot->name = name;
+        }
+        return slot->name == name ? slot.get() : nullptr;
+    }
+};
+
+Router::Router() : root(new Node())
+{
+    flatten();
+}
+
+Router::~Router() = default;
+
+bool Router::add(HttpMethod method, const std::string &pattern, RouteHandler handler)
+{
+    if (method >= HttpMethod::Count || !handler || pattern.empty() || pattern[0] != '/') return false;
+
+    Node *node = root.get();
+    size_t params = 0;
+    size_t pos = 0;
+    while (pos < pattern.size())
+    {
+        size_t mark = pattern.find_first_of(":*", pos);
+        if (mark == std::string::npos) mark = pattern.size();
+        node = node->literal(pattern.substr(pos, mark - pos));
+        if (mark == pattern.size()) break;
+
+        // a placeholder spans a whole segment
+        if (pattern[mark - 1] != '/') return false;
+        size_t end = pattern.find('/', mark);
+        if (end == std::string::npos) end = pattern.size();
+        std::string name = pattern.substr(mark + 1, end - mark - 1);
+        if (name.empty() || name.find_first_of(":*") != std::string::npos || ++params > RouteParams::MAX)
+            return false;
+
+        if (pattern[mark] == '*')
+        {
+            if (end != pattern.size()) return false;
+            node = Node::placeholder(node->wildcard, name);
+        }
+        else
+        {
+            node = Node::placeholder(node->param, name);
+        }
+        if (node == nullptr) return false;
+        pos = end;
+    }
+
+    uint32_t &slot = node->handlers[(unsigned)method];
+    if (slot != NONE) return false;
+    slot = (uint32_t)handlers.size();
+    handlers.push_back(std::move(handler));
+    node->terminal = true;
+    flatten();
+    return true;
+}
+
+bool Router::add(StringView method, const std::string &pattern, RouteHandler handler)
+{
+    return add(parseHttpMethod(method), pattern, std::move(handler));
+}
+
+bool Router::add(const Route *routes, size_t count)
+{
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
+        ok = add(routes[i].method, routes[i].pattern, routes[i].handler) && ok;
+    return ok;
+}
+
+// rebuilt on every add(): registration is a startup cost, and lookups only
+// ever see the flat form
+void Router::flatten()
+{
+    nodes.clear();
+    firsts.clear();
+    labels.clear();
+    endpoints.clear();
+    nodes.emplace_back();
+    firsts.push_back('\0');
+    place(*root, 0);
+}
+
+// fill nodes[slot] from `node`, then lay out its children
+void Router::place(const Node &node, uint32_t slot)
+{
+    FlatNode flat;
+    flat.label = (uint32_t)labels.size();
+    flat.labelLength = (uint32_t)node.label.size();
+    labels += node.label;
+    flat.name = (uint32_t)labels.size();
+    flat.nameLength = (uint32_t)node.name.size();
+    labels += node.name;
+    flat.endpoint = NONE;
+    if (node.terminal)
+    {
+        Endpoint endpoint;
+        std::copy(node.handlers, node.handlers + METHODS, endpoint.handlers);
+        flat.endpoint = (uint32_t)endpoints.size();
+        endpoints.push_back(endpoint);
+    }
+
+    // literal children side by side, so one scan of `firsts` picks the edge
+    flat.firstChild = (uint32_t)nodes.size();
+    flat.childCount = (uint32_t)node.children.size();
+    for (const auto &child : node.children)
+    {
+        nodes.emplace_back();
+        firsts.push_back(child->label[0]);
+    }
+    flat.param = NONE;
+    flat.wildcard = NONE;
+    if (node.param)
+    {
+        flat.param = (uint32_t)nodes.size();
+        nodes.emplace_back();
+        firsts.push_back('\0');
+    }
+    if (node.wildcard)
+    {
+        flat.wildcard = (uint32_t)nodes.size();
+        nodes.emplace_back();
+        firsts.push_back('\0');
+    }
+    nodes[slot] = flat;
+
+    for (uint32_t i = 0; i < flat.childCount; i++) place(*node.children[i], flat.firstChild + i);
+    if (node.param) place(*node.param, flat.param);
+    if (node.wildcard) place(*node.wildcard, flat.wildcard);
+}
+
+// `rest` is the path left after the node's own label or segment. Literal
+// edges are followed in a loop; only a node that also has a placeholder
+// child recurses, to come back to it when the literal branch dead-ends. So
+// does a pattern that ends here without a handler for `method`
+bool Router::match(uint32_t index, StringView rest, HttpMethod method, RouteParams &params, uint32_t &handler) const
+{
+    for (;;)
+    {
+        const FlatNode &node = nodes[index];
+        if (rest.empty())
+        {
+            if (node.endpoint != NONE)
+            {
+                handler = handlerFor(endpoints[node.endpoint], method);
+                if (handler != NONE) return true;
+            }
+            break;
+        }
+
+        uint32_t child = NONE;
+        const char *first = firsts.data() + node.firstChild;
+        for (uint32_t i = 0; i < node.childCount; i++)
+        {
+            if (first[i] == rest[0])
+            {
+                child = node.firstChild + i;
+                break;
+            }
+        }
+        if (child != NONE)
+        {
+            const FlatNode &next = nodes[child];
+            const char *label = labels.data() + next.label;
+            size_t length = next.labelLength;
+            bool prefix = length <= rest.size();
+            for (size_t i = 1; prefix && i < length; i++) prefix = label[i] == rest[i];
+            if (prefix)
+            {
+                if (node.param == NONE && node.wildcard == NONE)
+                {
+                    index = child;
+                    rest = rest.substr(length);
+                    continue;
+                }
+                if (match(child, rest.substr(length), method, params, handler)) return true;
+            }
+        }
+
+        if (node.param != NONE && rest[0] != '/')
+        {
+            size_t end = rest.find('/');
+            if (end == std::string::npos) end = rest.size();
+            const FlatNode &param = nodes[node.param];
+            size_t mark = params.count;
+            params.names[mark] = StringView(labels.data() + param.name, param.nameLength);
+            params.values[mark] = rest.substr(0, end);
+            params.count++;
+            if (match(node.param, rest.substr(end), method, params, handler)) return true;
+            params.count = mark;
+        }
+        break;
+    }
+
+    const FlatNode &node = nodes[index];
+    if (node.wildcard != NONE)
+    {
+        const FlatNode &wildcard = nodes[node.wildcard];
+        handler = handlerFor(endpoints[wildcard.endpoint], method);
+        if (handler == NONE) return false;
+        params.names[params.count] = StringView(labels.data() + wildcard.name, wildcard.nameLength);
+        params.values[params.count] = rest;
+        params.count++;
+        return true;
+    }
+    return false;
+}
+
+uint32_t Router::handlerFor(const Endpoint &endpoint, HttpMethod method)
+{
+    if (method >= HttpMethod::Count) return NONE;
+    uint32_t handler = endpoint.handlers[(unsigned)method];
+    if (handler == NONE && method == HttpMethod::Head) handler = endpoint.handlers[(unsigned)HttpMethod::Get];
+    return handler;
+}
+
+const RouteHandler *Router::find(HttpMethod method, StringView path, RouteParams &params) const
+{
+    params.count = 0;
+    uint32_t handler = NONE;
+    if (method >= HttpMethod::Count || !match(0, path, method, params, handler)) return nullptr;
+    return &handlers[handler];
+}
+
+HttpResponse Router::route(const HttpRequest &request) const
+{
+    RouteParams params;
+    StringView path = request.path();
+    if (const RouteHandler *handler = find(parseHttpMethod(request.method), path, params))
+        return (*handler)(request, params);
+
+    // every method some pattern would take the path for; none is a 404
+    std::string allow;
+    for (unsigned m = 0; m < METHODS; m++)
+    {
+        if (find((HttpMethod)m, path, params) == nullptr) continue;
+        if (!allow.empty()) allow += ", ";
+        allow += METHOD_NAMES[m];
+    }
+    if (allow.empty()) return errorResponse(404);
+    HttpResponse response = errorResponse(405);
+    response.headers.emplace_back("Allow", allow);
+    return response;
+}
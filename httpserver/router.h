@@ -0,0 +1,163 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "httprequest.h"
+#include "httpresponse.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class HttpMethod : uint8_t
+{
+    Get,
+    Head,
+    Post,
+    Put,
+    Delete,
+    Connect,
+    Options,
+    Trace,
+    Patch,
+    Count // also what parseHttpMethod() returns for anything else
+};
+
+// one probe of a perfect hash over the nine standard methods, then a single
+// compare
+HttpMethod parseHttpMethod(StringView method);
+const char *httpMethodName(HttpMethod method);
+
+// Path parameters of a matched route, as views into the request target
+// (values) and the router (names). Valid while both are.
+class RouteParams
+{
+public:
+    static const size_t MAX = 8;
+
+    RouteParams() : count(0) {}
+
+    // value of the parameter called `name`, empty when the route has none
+    StringView get(StringView name) const;
+    StringView operator[](StringView name) const { return get(name); }
+
+    size_t size() const { return count; }
+    StringView name(size_t i) const { return names[i]; }
+    StringView value(size_t i) const { return values[i]; }
+
+private:
+    friend class Router;
+
+    StringView names[MAX];
+    StringView values[MAX];
+    size_t count;
+};
+
+typedef std::function<HttpResponse(const HttpRequest &, const RouteParams &)> RouteHandler;
+
+// A route known at compile time. A constexpr array of these registers a
+// whole table in one add() call:
+//
+//     static HttpResponse getUser(const HttpRequest &, const RouteParams &);
+//     static constexpr Route ROUTES[] = {
+//         {HttpMethod::Get, "/users/:id", getUser},
+//         {HttpMethod::Get, "/static/*path", getStatic},
+//     };
+//     router.add(ROUTES);
+struct Route
+{
+    HttpMethod method;
+    const char *pattern;
+    HttpResponse (*handler)(const HttpRequest &, const RouteParams &);
+};
+
+// Dispatches requests on method and path through a compressed radix tree.
+//
+// Patterns are literal paths with two kinds of placeholder:
+//   :name   one whole path segment, "/users/:id" matches "/users/42"
+//   *name   the rest of the path, last only, "/static/*path" matches
+//           "/static/css/site.css" (and "/static/", with an empty value)
+// A literal segment wins over a parameter, which wins over a wildcard; the
+// match backtracks when the preferred branch dead-ends, and a pattern with
+// no handler for the request's method is a dead end. A HEAD request falls
+// back to the GET handler.
+//
+// Registration rebuilds a flat copy of the tree: nodes in one array with
+// each node's literal children next to each other and their first bytes in
+// a separate array, so a lookup touches a few cache lines per path segment
+// whatever the number of routes. Register every route before the server
+// starts; route() is then safe to call from every reactor and worker.
+class Router
+{
+public:
+    Router();
+    ~Router();
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    // false for a malformed pattern, a parameter named differently from
+    // one already at the same position, more than RouteParams::MAX
+    // parameters, or a method and pattern registered twice
+    bool add(HttpMethod method, const std::string &pattern, RouteHandler handler);
+    bool add(StringView method, const std::string &pattern, RouteHandler handler);
+    bool add(const Route *routes, size_t count);
+    template <size_t N>
+    bool add(const Route (&routes)[N])
+    {
+        return add(routes, N);
+    }
+
+    // the handler's response; 404 when no pattern matches the path, 405
+    // with an Allow header when patterns do but none for this method
+    HttpResponse route(const HttpRequest &request) const;
+    HttpResponse operator()(const HttpRequest &request) const { return route(request); }
+
+    // the handler for `method` on `path` and its parameters; nullptr when
+    // there is none
+    const RouteHandler *find(HttpMethod method, StringView path, RouteParams &params) const;
+
+private:
+    static const unsigned METHODS = (unsigned)HttpMethod::Count;
+    static const uint32_t NONE = UINT32_MAX;
+
+    // the tree as routes are added
+    struct Node;
+
+    // the tree as route() walks it
+    struct FlatNode
+    {
+        uint32_t label;       // offset of the literal prefix in `labels`
+        uint32_t labelLength;
+        uint32_t firstChild;  // literal children: nodes[firstChild, +childCount)
+        uint32_t childCount;
+        uint32_t param;       // ":name" child, or NONE
+        uint32_t wildcard;    // "*name" child, or NONE
+        uint32_t name;        // a placeholder's name, in `labels`
+        uint32_t nameLength;
+        uint32_t endpoint;    // handlers of a pattern ending here, or NONE
+    };
+
+    struct Endpoint
+    {
+        uint32_t handlers[METHODS]; // index in `handlers`, or NONE
+    };
+
+    std::unique_ptr<Node> root;
+    std::vector<RouteHandler> handlers;
+
+    std::vector<FlatNode> nodes;
+    std::vector<char> firsts; // first label byte of nodes[i]
+    std::string labels;
+    std::vector<Endpoint> endpoints;
+
+    void flatten();
+    void place(const Node &node, uint32_t slot);
+    // the handler for `method` on the best pattern `rest` matches from
+    // nodes[index] that has one
+    bool match(uint32_t index, StringView rest, HttpMethod method, RouteParams &params, uint32_t &handler) const;
+    // the GET handler stands in for a missing HEAD one
+    static uint32_t handlerFor(const Endpoint &endpoint, HttpMethod method);
+};
+
+#endif
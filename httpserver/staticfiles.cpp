@@ -0,0 +1,374 @@
+#include "staticfiles.h"
+#include "metrics.h"
+#include "outputbuffer.h"
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+struct MimeType
+{
+    const char *extension;
+    const char *type;
+};
+
+const MimeType MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"pdf", "application/pdf"},
+    {"wasm", "application/wasm"},
+};
+
+const char *contentTypeFor(const std::string &path)
+{
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+    {
+        StringView extension = StringView(path).substr(dot + 1);
+        for (const MimeType &mime : MIME_TYPES)
+        {
+            if (extension.equalsIgnoreCase(mime.extension)) return mime.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// percent-decode a URL path and make sure it stays below the root: no NUL,
+// no ".." segment. Returns false for anything that could escape
+bool sanitizePath(StringView path, std::string &out)
+{
+    out.clear();
+    if (path.empty() || path[0] != '/') return false;
+
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        char c = path[i];
+        if (c == '%')
+        {
+            if (i + 2 >= path.size()) return false;
+            int hi = hexValue(path[i + 1]), lo = hexValue(path[i + 2]);
+            if (hi < 0 || lo < 0) return false;
+            c = static_cast<char>(hi * 16 + lo);
+            i += 2;
+        }
+        if (c == '\0' || c == '\\') return false;
+        out += c;
+    }
+
+    // reject "." and ".." segments, collapse empty ones, compacting in place
+    bool directory = out.back() == '/';
+    size_t length = 0, start = 0;
+    while (start <= out.size())
+    {
+        size_t end = out.find('/', start);
+        if (end == std::string::npos) end = out.size();
+        StringView segment = StringView(out).substr(start, end - start);
+        if (segment == ".." || segment == ".") return false;
+        if (!segment.empty())
+        {
+            out[length++] = '/';
+            std::memmove(&out[length], segment.data(), segment.size());
+            length += segment.size();
+        }
+        start = end + 1;
+    }
+    out.resize(length);
+    if (directory) out += "/index.html";
+    return !out.empty();
+}
+
+bool parseNumber(StringView text, uint64_t &value)
+{
+    if (text.empty() || text.size() > 19) return false;
+    value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+enum RangeResult
+{
+    RangeNone,          // absent or not understood: send the whole file
+    RangeOk,
+    RangeUnsatisfiable
+};
+
+// a single "bytes=first-last", "bytes=first-" or "bytes=-suffix"; multiple
+// ranges are answered with the full body, which RFC 9110 allows
+RangeResult parseRange(StringView value, uint64_t size, uint64_t &offset, uint64_t &length)
+{
+    if (!value.startsWith("bytes=")) return RangeNone;
+    StringView spec = value.substr(6);
+    if (spec.find(',') != std::string::npos) return RangeNone;
+
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) return RangeNone;
+    StringView first = spec.substr(0, dash), last = spec.substr(dash + 1);
+
+    uint64_t a = 0, b = 0;
+    if (first.empty())
+    {
+        if (!parseNumber(last, b)) return RangeNone;
+        if (b == 0 || size == 0) return RangeUnsatisfiable;
+        if (b > size) b = size;
+        offset = size - b;
+        length = b;
+        return RangeOk;
+    }
+
+    if (!parseNumber(first, a)) return RangeNone;
+    if (last.empty())
+        b = size - 1;
+    else if (!parseNumber(last, b) || b < a)
+        return RangeNone;
+
+    if (a >= size) return RangeUnsatisfiable;
+    if (b >= size) b = size - 1;
+    offset = a;
+    length = b - a + 1;
+    return RangeOk;
+}
+
+// ETag lists are compared weakly, as If-None-Match requires
+bool etagMatches(StringView list, const std::string &etag)
+{
+    if (list == "*") return true;
+    size_t start = 0;
+    while (start < list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        StringView tag = list.substr(start, end - start);
+        while (!tag.empty() && (tag[0] == ' ' || tag[0] == '\t')) tag = tag.substr(1);
+        while (!tag.empty() && (tag[tag.size() - 1] == ' ' || tag[tag.size() - 1] == '\t'))
+            tag = tag.substr(0, tag.size() - 1);
+        if (tag.startsWith("W/")) tag = tag.substr(2);
+        if (tag == etag) return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+HttpResponse errorResponse(int status)
+{
+    return HttpResponse::Builder().status(status).body(std::string(httpReasonPhrase(status)) + "\n").build();
+}
+
+} // namespace
+
+StaticFiles::StaticFiles(const std::string &root, size_t maxEntries, std::chrono::milliseconds revalidate)
+    : root(root), maxEntries(maxEntries ? maxEntries : 1), revalidate(revalidate), compressMinBytes(0)
+{
+    while (this->root.size() > 1 && this->root.back() == '/') this->root.pop_back();
+}
+
+void StaticFiles::precompress(std::shared_ptr<PrecompressedFiles> copies, uint64_t minBytes)
+{
+    compressed = std::move(copies);
+    compressMinBytes = minBytes;
+}
+
+std::shared_ptr<StaticFiles::Entry> StaticFiles::load(const std::string &relative)
+{
+    std::string full = root + relative;
+    int fd = ::open(full.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    std::shared_ptr<FileHandle> file = std::make_shared<FileHandle>(fd);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return nullptr;
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->file = file;
+    entry->size = static_cast<uint64_t>(st.st_size);
+    entry->inode = static_cast<uint64_t>(st.st_ino);
+    entry->mtime = st.st_mtime;
+    entry->contentType = contentTypeFor(relative);
+    entry->compressible = compressed && entry->size >= compressMinBytes && compressibleType(entry->contentType);
+
+    std::string lastModified = "Last-Modified: " + httpDate(st.st_mtime) + "\r\nAccept-Ranges: bytes\r\n";
+    for (unsigned c = 0; c < (unsigned)ContentCoding::Count; c++)
+    {
+        ContentCoding coding = (ContentCoding)c;
+        if (coding != ContentCoding::Identity && (!entry->compressible || !contentCodingAvailable(coding))) continue;
+
+        char etag[80];
+        snprintf(etag, sizeof(etag), "\"%llx-%llx%s%s\"", static_cast<unsigned long long>(st.st_mtime),
+                 static_cast<unsigned long long>(st.st_size), coding == ContentCoding::Identity ? "" : "-",
+                 contentCodingName(coding));
+        std::string lines = std::string("ETag: ") + etag + "\r\n" + lastModified;
+        if (coding != ContentCoding::Identity)
+            lines += std::string("Content-Encoding: ") + contentCodingName(coding) + "\r\n";
+        if (entry->compressible) lines += "Vary: Accept-Encoding\r\n";
+        entry->variants[c].etag = etag;
+        entry->variants[c].headerBlock = std::make_shared<const std::string>(std::move(lines));
+    }
+    if (entry->compressible) entry->identity = std::to_string(entry->inode) + entry->variants[0].etag;
+    entry->checked = std::chrono::steady_clock::now();
+    return entry;
+}
+
+std::shared_ptr<const StaticFiles::Entry> StaticFiles::lookup(const std::string &relative)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<Entry> stale;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(relative);
+        if (it != entries.end())
+        {
+            std::shared_ptr<Entry> entry = it->second;
+            lru.splice(lru.begin(), lru, entry->lru);
+            if (now - entry->checked < revalidate) return entry;
+            // this thread revalidates; the others go on serving the entry
+            // meanwhile rather than queue behind the stat()
+            entry->checked = now;
+            stale = std::move(entry);
+        }
+    }
+
+    if (stale)
+    {
+        // still the same file? one stat() per revalidation period, unlocked
+        struct stat st;
+        std::string full = root + relative;
+        if (stat(full.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_ino) == stale->inode &&
+            st.st_mtime == stale->mtime && static_cast<uint64_t>(st.st_size) == stale->size)
+            return stale;
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(relative);
+        if (it != entries.end() && it->second == stale)
+        {
+            lru.erase(stale->lru);
+            entries.erase(it);
+        }
+    }
+
+    // open outside the lock; a racing thread may load the same file, the
+    // second insert simply wins
+    std::shared_ptr<Entry> entry = load(relative);
+    if (!entry) return nullptr;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find(relative);
+    if (it != entries.end())
+    {
+        lru.erase(it->second->lru);
+        entries.erase(it);
+    }
+    lru.push_front(relative);
+    entry->lru = lru.begin();
+    entries[relative] = entry;
+    while (entries.size() > maxEntries)
+    {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    return entry;
+}
+
+HttpResponse StaticFiles::serve(const HttpRequest &request, StringView path)
+{
+    bool head = request.method == "HEAD";
+    if (request.method != "GET" && !head)
+    {
+        HttpResponse response = errorResponse(405);
+        response.headers.emplace_back("Allow", "GET, HEAD");
+        return response;
+    }
+
+    std::string relative;
+    if (!sanitizePath(path, relative)) return errorResponse(404);
+
+    std::shared_ptr<const Entry> entry = lookup(relative);
+    if (!entry) return errorResponse(404);
+
+    HttpResponse::Builder builder;
+    builder.contentType(entry->contentType);
+
+    StringView range = request.header("Range");
+    StringView ifNoneMatch = request.header("If-None-Match");
+    ContentCoding coding = ContentCoding::Identity;
+    if (entry->compressible && range.empty()) coding = negotiateContentCoding(request.header("Accept-Encoding"));
+    if (coding != ContentCoding::Identity)
+    {
+        const Variant &variant = entry->variants[(unsigned)coding];
+        builder.headerBlock(variant.headerBlock);
+        if (!ifNoneMatch.empty() && etagMatches(ifNoneMatch, variant.etag)) return builder.status(304).build();
+
+        std::shared_ptr<const std::string> copy = compressed->get(*entry->file, entry->size, entry->identity, coding);
+        if (copy)
+        {
+            if (!head)
+            {
+                ThreadMetrics &metrics = Metrics::local();
+                metrics.add(MetricCounter::HttpCompressed);
+                metrics.add(MetricCounter::CompressionSavedBytes, entry->size - copy->size());
+            }
+            return builder.body(copy).build();
+        }
+        // not worth compressing after all
+    }
+
+    const Variant &plain = entry->variants[(unsigned)ContentCoding::Identity];
+    builder.headerBlock(plain.headerBlock);
+    if (!ifNoneMatch.empty() && etagMatches(ifNoneMatch, plain.etag)) return builder.status(304).build();
+
+    uint64_t offset = 0, length = entry->size;
+    StringView ifRange = request.header("If-Range");
+    if (!range.empty() && (ifRange.empty() || ifRange == plain.etag))
+    {
+        switch (parseRange(range, entry->size, offset, length))
+        {
+        case RangeOk:
+            builder.status(206).header("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                                                            std::to_string(offset + length - 1) + "/" +
+                                                            std::to_string(entry->size));
+            break;
+        case RangeUnsatisfiable:
+            return builder.status(416)
+                .header("Content-Range", "bytes */" + std::to_string(entry->size))
+                .body("")
+                .build();
+        case RangeNone:
+            offset = 0;
+            length = entry->size;
+            break;
+        }
+    }
+
+    // an empty file has nothing for sendfile to stream
+    if (length == 0) return builder.body("").build();
+    return builder.file(entry->file, offset, length).build();
+}
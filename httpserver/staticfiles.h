@@ -0,0 +1,81 @@
+#ifndef STATICFILES_H
+#define STATICFILES_H
+
+#include "compression.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Serves the files below a root directory. Bodies go out with sendfile()
+// from descriptors kept open in an LRU cache together with their stat
+// results, so a hot file costs neither open() nor fstat() per request.
+// Handles GET/HEAD, ETag/If-None-Match and single byte ranges. Safe to share
+// between reactor threads.
+//
+// With precompress(), text-like files are also served br, gzip or deflate
+// as Accept-Encoding allows, from copies compressed once and kept in memory
+// (see PrecompressedFiles). Each coding is its own representation with its
+// own ETag ("mtime-size-br"), and every response for such a file carries
+// Vary: Accept-Encoding. Range requests get the uncompressed file.
+class StaticFiles
+{
+public:
+    // entries are re-stat()ed at most once per `revalidate` to notice edits
+    explicit StaticFiles(const std::string &root, size_t maxEntries = 1024,
+                         std::chrono::milliseconds revalidate = std::chrono::milliseconds(1000));
+
+    // `path` is the URL path relative to the root ("/img1.jpeg")
+    HttpResponse serve(const HttpRequest &request, StringView path);
+    HttpResponse serve(const HttpRequest &request) { return serve(request, request.path()); }
+
+    // serve compressed copies from `copies` of files of a compressible type
+    // and at least `minBytes` long. Call before serving
+    void precompress(std::shared_ptr<PrecompressedFiles> copies, uint64_t minBytes = 1024);
+
+private:
+    // the file as sent with one content coding
+    struct Variant
+    {
+        std::string etag;
+        // "ETag", "Last-Modified" and "Accept-Ranges" lines, plus
+        // "Content-Encoding" and "Vary" as they apply, formatted once
+        std::shared_ptr<const std::string> headerBlock;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<FileHandle> file;
+        uint64_t size;
+        uint64_t inode;
+        time_t mtime;
+        const char *contentType;
+        // by ContentCoding; only Identity unless the file is compressible
+        Variant variants[(unsigned)ContentCoding::Count];
+        bool compressible;
+        std::string identity; // for PrecompressedFiles: inode, mtime, size
+        std::chrono::steady_clock::time_point checked;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::string root;
+    size_t maxEntries;
+    std::chrono::milliseconds revalidate;
+    std::shared_ptr<PrecompressedFiles> compressed;
+    uint64_t compressMinBytes;
+
+    std::mutex lock;
+    std::list<std::string> lru; // most recently used first
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+
+    std::shared_ptr<const Entry> lookup(const std::string &relative);
+    std::shared_ptr<Entry> load(const std::string &relative);
+};
+
+#endif
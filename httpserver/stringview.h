@@ -0,0 +1,71 @@
+#ifndef STRINGVIEW_H
+#define STRINGVIEW_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// Non-owning (pointer, length) view, standing in for std::string_view
+// (C++17). Request fields point straight into the connection's receive
+// buffer and stay valid only while that buffer is untouched.
+class StringView
+{
+public:
+    StringView() : ptr(nullptr), len(0) {}
+    StringView(const char *data, size_t size) : ptr(data), len(size) {}
+    StringView(const char *cstr) : ptr(cstr), len(std::strlen(cstr)) {}
+    StringView(const std::string &str) : ptr(str.data()), len(str.size()) {}
+
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const char *begin() const { return ptr; }
+    const char *end() const { return ptr + len; }
+    char operator[](size_t i) const { return ptr[i]; }
+
+    StringView substr(size_t pos, size_t count = std::string::npos) const
+    {
+        if (pos > len) pos = len;
+        if (count > len - pos) count = len - pos;
+        return StringView(ptr + pos, count);
+    }
+
+    size_t find(char c, size_t from = 0) const
+    {
+        if (from >= len) return std::string::npos;
+        const void *hit = std::memchr(ptr + from, c, len - from);
+        return hit ? static_cast<const char *>(hit) - ptr : std::string::npos;
+    }
+
+    bool startsWith(StringView prefix) const
+    {
+        return prefix.len <= len && std::memcmp(ptr, prefix.ptr, prefix.len) == 0;
+    }
+
+    // ASCII case-insensitive comparison, as header names require
+    bool equalsIgnoreCase(StringView other) const
+    {
+        if (len != other.len) return false;
+        for (size_t i = 0; i < len; i++)
+        {
+            unsigned char a = ptr[i], b = other.ptr[i];
+            if (a != b && (a | 0x20) != (b | 0x20)) return false;
+            if (a != b && ((a | 0x20) < 'a' || (a | 0x20) > 'z')) return false;
+        }
+        return true;
+    }
+
+    std::string str() const { return std::string(ptr, len); }
+
+    friend bool operator==(StringView a, StringView b)
+    {
+        return a.len == b.len && (a.len == 0 || std::memcmp(a.ptr, b.ptr, a.len) == 0);
+    }
+    friend bool operator!=(StringView a, StringView b) { return !(a == b); }
+
+private:
+    const char *ptr;
+    size_t len;
+};
+
+#endif
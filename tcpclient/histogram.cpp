@@ -0,0 +1,91 @@
+#include "histogram.h"
+#include <cmath>
+
+static unsigned highestBit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    unsigned bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram(uint64_t highest)
+    : highest(highest), counts(indexOf(highest) + 1), total(0), minimum(UINT64_MAX), maximum(0), sum(0) {}
+
+// Values below 2 << SUB_BITS get a counter each. Above that every power of
+// two is split into 1 << SUB_BITS equal buckets, so a bucket is never wider
+// than 1/1024 of the values it holds.
+size_t LatencyHistogram::indexOf(uint64_t value)
+{
+    const uint64_t linear = 2ull << SUB_BITS;
+    if (value < linear) return (size_t)value;
+    unsigned shift = highestBit(value) - SUB_BITS;
+    return ((size_t)(shift + 1) << SUB_BITS) + (size_t)((value >> shift) - (1ull << SUB_BITS));
+}
+
+uint64_t LatencyHistogram::highestEquivalent(size_t index)
+{
+    const size_t linear = 2u << SUB_BITS;
+    if (index < linear) return index;
+    unsigned shift = (unsigned)(index >> SUB_BITS) - 1;
+    uint64_t sub = (index & ((1u << SUB_BITS) - 1)) + (1ull << SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    if (value > highest) value = highest;
+    counts[indexOf(value)]++;
+    total++;
+    sum += (double)value;
+    if (value < minimum) minimum = value;
+    if (value > maximum) maximum = value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < other.counts.size(); i++)
+    {
+        if (other.counts[i] == 0) continue;
+        if (i < counts.size())
+            counts[i] += other.counts[i];
+        else
+            counts.back() += other.counts[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    if (other.total && other.minimum < minimum) minimum = other.minimum;
+    if (other.maximum > maximum) maximum = other.maximum;
+}
+
+void LatencyHistogram::reset()
+{
+    counts.assign(counts.size(), 0);
+    total = 0;
+    minimum = UINT64_MAX;
+    maximum = 0;
+    sum = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const
+{
+    if (total == 0) return 0;
+    if (percentile > 100) percentile = 100;
+    uint64_t target = (uint64_t)std::ceil(percentile / 100 * (double)total);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            uint64_t value = highestEquivalent(i);
+            return value < maximum ? value : maximum;
+        }
+    }
+    return maximum;
+}
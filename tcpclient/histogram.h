@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// HDR-style latency histogram. Values are kept with three significant
+// digits (relative error below 1/1024) over the whole range, in a fixed
+// array of counters: recording is one increment, and histograms filled by
+// different threads merge by adding counts.
+class LatencyHistogram
+{
+public:
+    // values above `highest` are recorded as `highest`
+    explicit LatencyHistogram(uint64_t highest = 60ull * 1000 * 1000 * 1000);
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? minimum : 0; }
+    uint64_t max() const { return maximum; }
+    double mean() const { return total ? sum / total : 0; }
+    // the value `percentile`% of the recorded values are at or below, to
+    // the histogram's precision
+    uint64_t percentile(double percentile) const;
+
+private:
+    static const unsigned SUB_BITS = 10; // linear sub-buckets per power of two: 1 << SUB_BITS
+
+    uint64_t highest;
+    std::vector<uint64_t> counts;
+    uint64_t total, minimum, maximum;
+    double sum;
+
+    static size_t indexOf(uint64_t value);
+    static uint64_t highestEquivalent(size_t index);
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,504 @@
+#include "../loadgen.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+bool startsWithIgnoreCase(const char *s, const char *end, const char *prefix)
+{
+    for (; *prefix; s++, prefix++)
+    {
+        if (s == end || tolower((unsigned char)*s) != *prefix) return false;
+    }
+    return true;
+}
+
+bool containsIgnoreCase(const char *s, const char *end, const char *word)
+{
+    size_t len = strlen(word);
+    for (; s + len <= end; s++)
+    {
+        if (startsWithIgnoreCase(s, end, word)) return true;
+    }
+    return false;
+}
+
+// Length of the complete response at the start of `data`: 0 while more
+// bytes are needed, -1 when it cannot be framed (no Content-Length and not
+// chunked, or a broken chunk size).
+long frameResponse(const char *data, size_t len, int &status, bool &close)
+{
+    const char *end = data + len;
+    const char *headEnd = static_cast<const char *>(memmem(data, len, "\r\n\r\n", 4));
+    if (headEnd == nullptr) return 0;
+    if (len < 12 || memcmp(data, "HTTP/1.", 7) != 0) return -1;
+    status = atoi(data + 9);
+
+    long long length = -1;
+    bool chunked = false;
+    close = data[7] == '0';
+    for (const char *line = static_cast<const char *>(memchr(data, '\n', len)) + 1; line < headEnd + 2;)
+    {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        if (startsWithIgnoreCase(line, eol, "content-length:"))
+            length = atoll(line + 15);
+        else if (startsWithIgnoreCase(line, eol, "transfer-encoding:"))
+            chunked = containsIgnoreCase(line, eol, "chunked");
+        else if (startsWithIgnoreCase(line, eol, "connection:"))
+            close = containsIgnoreCase(line, eol, "close");
+        line = eol + 1;
+    }
+
+    size_t pos = headEnd + 4 - data;
+    if (status < 200 || status == 204 || status == 304) return (long)pos;
+    if (!chunked)
+    {
+        if (length < 0) return -1;
+        return pos + length <= len ? (long)(pos + length) : 0;
+    }
+
+    while (true)
+    {
+        const char *eol = static_cast<const char *>(memmem(data + pos, len - pos, "\r\n", 2));
+        if (eol == nullptr) return 0;
+        char *digitsEnd;
+        unsigned long size = strtoul(data + pos, &digitsEnd, 16);
+        if (digitsEnd == data + pos) return -1;
+        pos = eol + 2 - data;
+        if (size == 0)
+        {
+            // optional trailers, then an empty line
+            if (len - pos >= 2 && memcmp(data + pos, "\r\n", 2) == 0) return (long)(pos + 2);
+            const char *trailersEnd = static_cast<const char *>(memmem(data + pos, len - pos, "\r\n\r\n", 4));
+            return trailersEnd ? (long)(trailersEnd + 4 - data) : 0;
+        }
+        pos += size + 2;
+        if (pos > len) return 0;
+    }
+}
+
+struct LoadConnection
+{
+    int fd = -1;
+    bool connected = false;
+    bool ready = false;  // on the thread's ready list
+    bool broken = false; // on the thread's broken list, reconnected after the batch
+    std::string input;
+    std::string output;
+    size_t sent = 0;                // bytes of `output` written
+    bool writeArmed = false;        // EPOLLOUT is in the interest set
+    std::deque<uint64_t> starts;    // start time of every request in flight
+};
+
+class LoadThread
+{
+public:
+    LoadThread(const LoadOptions &options, const sockaddr_in &address, unsigned connections, double rate,
+               uint64_t measureFrom, uint64_t end)
+        : options(options), address(address), connections(connections), measureFrom(measureFrom), end(end),
+          interval(rate > 0 ? (uint64_t)(1e9 / rate) : 0), epoll_fd(-1), timer_fd(-1) {}
+
+    void run();
+
+    LoadResult result;
+
+private:
+    const LoadOptions &options;
+    sockaddr_in address;
+    std::vector<LoadConnection> connections;
+    uint64_t measureFrom, end;
+    uint64_t interval; // ns between scheduled sends; 0 in the closed loop
+    uint64_t nextDue;
+    std::deque<uint64_t> backlog;       // scheduled sends no connection was free for
+    std::vector<LoadConnection *> readyList; // connections that can take another request
+    std::vector<LoadConnection *> brokenList;
+    int epoll_fd, timer_fd;
+
+    void open(LoadConnection &conn);
+    void fail(LoadConnection &conn);
+    void reconnect(LoadConnection &conn);
+    void onConnected(LoadConnection &conn);
+    void onReadable(LoadConnection &conn);
+    void flush(LoadConnection &conn);
+    void send(LoadConnection &conn, uint64_t start);
+    void markReady(LoadConnection &conn);
+    void issueDue(uint64_t now);
+    void armTimer();
+    void recordUnfinished();
+    void setInterest(LoadConnection &conn, bool wantWrite);
+};
+
+void LoadThread::open(LoadConnection &conn)
+{
+    conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn.fd < 0)
+    {
+        result.errors++;
+        return;
+    }
+    int one = 1;
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(conn.fd, (const sockaddr *)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+    {
+        result.errors++;
+        ::close(conn.fd);
+        conn.fd = -1;
+        return;
+    }
+
+    // writable once the handshake is done
+    epoll_event ev{};
+    ev.events = EPOLLOUT;
+    ev.data.ptr = &conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &ev);
+    conn.writeArmed = true;
+}
+
+// Sends can fail deep inside response handling (a response frees a
+// connection that takes the next scheduled request), so a failed connection
+// is only marked there and reconnected once the event batch is done.
+void LoadThread::fail(LoadConnection &conn)
+{
+    if (conn.broken) return;
+    conn.broken = true;
+    brokenList.push_back(&conn);
+}
+
+// the server closed the connection or sent garbage: whatever was in flight
+// is lost, start over on a fresh connection
+void LoadThread::reconnect(LoadConnection &conn)
+{
+    bool wasConnected = conn.connected;
+    result.errors += wasConnected ? conn.starts.size() : 1;
+    ::close(conn.fd);
+    conn.fd = -1;
+    conn.connected = false;
+    conn.broken = false;
+    conn.input.clear();
+    conn.output.clear();
+    conn.sent = 0;
+    conn.writeArmed = false;
+    conn.starts.clear();
+    // a refused connect is not retried, that would only spin
+    if (wasConnected) open(conn);
+}
+
+void LoadThread::setInterest(LoadConnection &conn, bool wantWrite)
+{
+    if (conn.writeArmed == wantWrite) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = &conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.writeArmed = wantWrite;
+}
+
+void LoadThread::onConnected(LoadConnection &conn)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error != 0)
+    {
+        fail(conn);
+        return;
+    }
+    conn.connected = true;
+    setInterest(conn, false);
+
+    if (interval != 0)
+    {
+        markReady(conn);
+        return;
+    }
+    uint64_t now = nowNs();
+    for (unsigned i = 0; i < options.pipeline; i++) send(conn, now);
+}
+
+void LoadThread::send(LoadConnection &conn, uint64_t start)
+{
+    conn.starts.push_back(start);
+    conn.output += options.request;
+    flush(conn);
+}
+
+void LoadThread::flush(LoadConnection &conn)
+{
+    while (conn.sent < conn.output.size())
+    {
+        ssize_t n = ::send(conn.fd, conn.output.data() + conn.sent, conn.output.size() - conn.sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                setInterest(conn, true);
+                return;
+            }
+            fail(conn);
+            return;
+        }
+        conn.sent += n;
+    }
+    conn.output.clear();
+    conn.sent = 0;
+    setInterest(conn, false);
+}
+
+void LoadThread::onReadable(LoadConnection &conn)
+{
+    char buffer[64 * 1024];
+    bool eof = false;
+    while (true)
+    {
+        ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            conn.input.append(buffer, n);
+            if ((size_t)n < sizeof(buffer)) break;
+        }
+        else
+        {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) eof = true;
+            break;
+        }
+    }
+
+    size_t offset = 0;
+    bool closeAfter = false;
+    while (offset < conn.input.size() && !closeAfter)
+    {
+        int status = 0;
+        long length = frameResponse(conn.input.data() + offset, conn.input.size() - offset, status, closeAfter);
+        if (length == 0) break;
+        if (length < 0 || conn.starts.empty())
+        {
+            fail(conn);
+            return;
+        }
+        offset += length;
+
+        uint64_t now = nowNs();
+        uint64_t start = conn.starts.front();
+        conn.starts.pop_front();
+        if (now >= measureFrom && now < end)
+        {
+            result.requests++;
+            result.bytesRead += length;
+            if (status >= 400) result.httpErrors++;
+            result.latency.record(now - start);
+        }
+
+        if (closeAfter || now >= end) continue;
+        if (interval == 0)
+            send(conn, now);
+        else
+            markReady(conn);
+        if (conn.broken) return;
+    }
+    conn.input.erase(0, offset);
+
+    if (closeAfter || eof) fail(conn);
+}
+
+void LoadThread::markReady(LoadConnection &conn)
+{
+    if (!conn.ready)
+    {
+        conn.ready = true;
+        readyList.push_back(&conn);
+    }
+    issueDue(nowNs());
+}
+
+// queue every send the schedule has reached and hand the queue out to free
+// connections; a send keeps its scheduled time however long it waits
+void LoadThread::issueDue(uint64_t now)
+{
+    if (interval == 0) return;
+    for (; nextDue <= now && nextDue < end; nextDue += interval) backlog.push_back(nextDue);
+
+    while (!backlog.empty() && !readyList.empty())
+    {
+        LoadConnection &conn = *readyList.back();
+        if (!conn.connected || conn.broken || conn.starts.size() >= options.pipeline)
+        {
+            readyList.pop_back();
+            conn.ready = false;
+            continue;
+        }
+        send(conn, backlog.front());
+        backlog.pop_front();
+    }
+}
+
+void LoadThread::armTimer()
+{
+    struct itimerspec spec{};
+    spec.it_value.tv_sec = nextDue / 1000000000ull;
+    spec.it_value.tv_nsec = nextDue % 1000000000ull;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+// Requests the schedule sent, or should have, that are unanswered when the
+// run ends would otherwise drop out of the latency distribution just when
+// the server falls furthest behind. They count as answered at the end.
+void LoadThread::recordUnfinished()
+{
+    for (; nextDue < end; nextDue += interval) backlog.push_back(nextDue);
+    for (LoadConnection &conn : connections)
+    {
+        for (uint64_t start : conn.starts) backlog.push_back(start);
+        conn.starts.clear();
+    }
+    for (uint64_t start : backlog)
+    {
+        result.unfinished++;
+        result.latency.record(end - start);
+    }
+    backlog.clear();
+}
+
+void LoadThread::run()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+        result.errors += connections.size();
+        return;
+    }
+    if (interval != 0)
+    {
+        // fires at the next scheduled send, to the nanosecond
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        nextDue = nowNs();
+    }
+
+    for (LoadConnection &conn : connections) open(conn);
+
+    epoll_event events[256];
+    while (true)
+    {
+        uint64_t now = nowNs();
+        if (now >= end) break;
+        if (interval != 0)
+        {
+            issueDue(now);
+            armTimer();
+        }
+
+        int timeout = (int)((end - now) / 1000000) + 1;
+        int n = epoll_wait(epoll_fd, events, 256, timeout < 100 ? timeout : 100);
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == nullptr)
+            {
+                uint64_t expirations;
+                ssize_t drained = read(timer_fd, &expirations, sizeof(expirations));
+                (void)drained;
+                continue;
+            }
+
+            LoadConnection &conn = *static_cast<LoadConnection *>(events[i].data.ptr);
+            if (conn.fd < 0 || conn.broken) continue;
+            if (!conn.connected)
+            {
+                if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) onConnected(conn);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) onReadable(conn);
+            if (!conn.broken && conn.writeArmed && (events[i].events & EPOLLOUT)) flush(conn);
+        }
+
+        for (LoadConnection *conn : brokenList) reconnect(*conn);
+        brokenList.clear();
+    }
+    if (interval != 0) recordUnfinished();
+
+    for (LoadConnection &conn : connections)
+    {
+        if (conn.fd >= 0) ::close(conn.fd);
+    }
+    if (timer_fd >= 0) ::close(timer_fd);
+    ::close(epoll_fd);
+}
+
+bool resolve(const std::string &host, int port, sockaddr_in &address)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || found == nullptr) return false;
+    address = *reinterpret_cast<sockaddr_in *>(found->ai_addr);
+    address.sin_port = htons(port);
+    freeaddrinfo(found);
+    return true;
+}
+
+} // namespace
+
+bool runLoad(const LoadOptions &options, LoadResult &result)
+{
+    if (options.connections == 0 || options.threads == 0 || options.pipeline == 0 || options.request.empty())
+        return false;
+
+    sockaddr_in address{};
+    if (!resolve(options.host, options.port, address)) return false;
+
+    unsigned threads = options.threads < options.connections ? options.threads : options.connections;
+    if (options.rate / threads > 1e9) return false;
+    uint64_t begin = nowNs();
+    uint64_t measureFrom = begin + (uint64_t)(options.warmup * 1e9);
+    uint64_t end = measureFrom + (uint64_t)(options.seconds * 1e9);
+
+    std::vector<std::unique_ptr<LoadThread>> loads;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        unsigned share = options.connections / threads + (t < options.connections % threads ? 1 : 0);
+        loads.emplace_back(new LoadThread(options, address, share, options.rate / threads, measureFrom, end));
+    }
+
+    std::vector<std::thread> running;
+    for (auto &load : loads) running.emplace_back(&LoadThread::run, load.get());
+    for (auto &thread : running) thread.join();
+
+    result = LoadResult();
+    for (auto &load : loads)
+    {
+        result.requests += load->result.requests;
+        result.httpErrors += load->result.httpErrors;
+        result.errors += load->result.errors;
+        result.bytesRead += load->result.bytesRead;
+        result.unfinished += load->result.unfinished;
+        result.latency.merge(load->result.latency);
+    }
+    result.elapsed = options.seconds;
+    return true;
+}
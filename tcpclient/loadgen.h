@@ -0,0 +1,52 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include "histogram.h"
+#include <cstdint>
+#include <string>
+
+struct LoadOptions
+{
+    std::string host = "127.0.0.1"; // name or IPv4 address
+    int port = 8080;
+    unsigned connections = 100; // keep-alive connections over all threads
+    unsigned threads = 1;       // epoll loops; connections are split evenly
+    double seconds = 10;        // measured time
+    double warmup = 0;          // seconds of load before measuring starts
+    // 0: closed loop, every connection sends its next request as soon as
+    // the previous response is in. Otherwise requests/s over all threads,
+    // sent on a fixed schedule whether or not responses keep up
+    double rate = 0;
+    unsigned pipeline = 1; // requests in flight per connection
+    std::string request;   // bytes of one request, e.g. "GET / HTTP/1.1\r\nHost: x\r\n\r\n"
+};
+
+struct LoadResult
+{
+    uint64_t requests = 0;   // responses completed while measuring
+    uint64_t httpErrors = 0; // of those, status 4xx/5xx
+    uint64_t errors = 0;     // failed connects, requests lost to resets or malformed responses
+    uint64_t bytesRead = 0;  // response bytes, head and body
+    // open loop: scheduled requests still unanswered at the end, in flight
+    // or waiting for a connection; each is in `latency` as the time from
+    // its scheduled start to the end
+    uint64_t unfinished = 0;
+    double elapsed = 0;         // seconds measured
+    LatencyHistogram latency;   // nanoseconds
+};
+
+// HTTP load generator (Linux only).
+//
+// Each thread drives its share of the connections from one epoll loop. In
+// the open-loop mode a request's latency is measured from the moment the
+// schedule said it should be sent, not from when a connection was free to
+// send it, so a server stall shows up in every request it delays instead
+// of only in the one that hit it (no coordinated omission).
+//
+// Returns false when the address cannot be resolved or the options make
+// no sense (among them a rate above 10^9 requests/s per thread, which
+// leaves no nanosecond between sends); connection failures are counted in
+// `result.errors`.
+bool runLoad(const LoadOptions &options, LoadResult &result);
+
+#endif // LOADGEN_H
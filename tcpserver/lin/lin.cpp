@@ -1,273 +1,380 @@
 #include "lin.h"
-#include <iostream>
+#include "log.h"
+#ifdef HAVE_IO_URING
+#include "uring.h"
+#endif
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <unistd.h>
+#include <cassert>
 #include <cstring>
 #include <cerrno>
-#include <fcntl.h>
-#include <unordered_map>
 using namespace std;
 
-LinServer::LinServer() : server_fd(-1), epoll_fd(-1) {}
-
-bool LinServer::initialize(int port, const std::string &ip_address)
+// used when no handler was set: send every byte straight back
+class EchoHandler : public ConnectionHandler
 {
-    cout << "initializing the server ..." << endl;
-    struct sockaddr_in address;
-    int opt = 1;
-
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0)
+public:
+    size_t onData(TCPConnection &conn, const char *data, size_t len) override
     {
-        cerr << "Socket creation failed: " << strerror(errno) << endl;
-        return false;
+        conn.send(data, len);
+        return len;
     }
+};
 
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
-        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
-    {
-        cerr << "setsockopt failed: " << strerror(errno) << endl;
-        close(server_fd);
-        return false;
-    }
+static EchoHandler echoHandler;
+
+// the most descriptors one SCM_RIGHTS message carries (SCM_MAX_FD)
+static const unsigned MAX_HANDOFF = 253;
+// what a successor sends once its reactors run
+static const char HANDOFF_ACK = 'R';
 
-    epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1)
+LinServer::LinServer() : predecessor_fd(-1), handoff_fd(-1) {}
+
+LinServer::LinServer(const ServerOptions &options) : options(options), predecessor_fd(-1), handoff_fd(-1) {}
+
+static bool handoffAddress(const std::string &path, struct sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
     {
-        cerr << "Epoll creation failed: " << strerror(errno) << endl;
-        close(server_fd);
+        LOG_ERROR("handoff_path_too_long", LogField("path", path));
         return false;
     }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
 
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
+// a listening TCP socket bound to exactly `address`
+static bool listensOn(int fd, const sockaddr_in &address)
+{
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+    struct sockaddr_in bound;
+    socklen_t boundLen = sizeof(bound);
+    return getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == 0 && listening &&
+           getsockname(fd, (struct sockaddr *)&bound, &boundLen) == 0 && bound.sin_family == AF_INET &&
+           bound.sin_port == address.sin_port && bound.sin_addr.s_addr == address.sin_addr.s_addr;
+}
 
-    if (ip_address == "0.0.0.0")
-    {
-        address.sin_addr.s_addr = INADDR_ANY;
-    }
-    else
+// The predecessor answers a connection with the number of its listeners
+// and the descriptors themselves. They stay open in both processes and
+// share one accept queue, so nothing queued is lost while it drains.
+std::vector<int> LinServer::inheritListeners(const sockaddr_in &address)
+{
+    std::vector<int> fds;
+    struct sockaddr_un unixAddress;
+    if (!handoffAddress(options.handoffPath, unixAddress))
+        return fds;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return fds;
+    if (connect(fd, (struct sockaddr *)&unixAddress, sizeof(unixAddress)) < 0)
     {
-        if (inet_pton(AF_INET, ip_address.c_str(), &address.sin_addr) <= 0)
-        {
-            cerr << "Invalid IP address: " << ip_address << endl;
-            close(server_fd);
-            return false;
-        }
+        // nothing to take over: a first start, or a stale path
+        close(fd);
+        return fds;
     }
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    // a predecessor that accepted but never answers must not hang us
+    struct timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint32_t count = 0;
+    struct iovec iov = {&count, sizeof(count)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
     {
-        cerr << "Bind failed: " << strerror(errno) << endl;
-        close(server_fd);
-        return false;
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), received, received + n);
     }
 
-    if (listen(server_fd, SOMAXCONN) < 0)
+    bool valid = got == (ssize_t)sizeof(count) && count == fds.size() && !fds.empty() &&
+                 !(msg.msg_flags & MSG_CTRUNC);
+    for (size_t i = 0; valid && i < fds.size(); i++)
+        valid = listensOn(fds[i], address);
+    if (!valid)
     {
-        cerr << "Listen failed: " << strerror(errno) << endl;
-        close(server_fd);
-        return false;
+        // leaving the predecessor without an answer keeps it serving
+        LOG_WARN("handoff_rejected", LogField("path", options.handoffPath), LogField("received", fds.size()));
+        for (int received : fds)
+            close(received);
+        fds.clear();
+        close(fd);
+        return fds;
     }
 
-    cout << "Server initialized successfully on " << ip_address << ":" << port << endl;
-    return true;
+    predecessor_fd = fd;
+    LOG_INFO("handoff_received", LogField("path", options.handoffPath), LogField("listeners", fds.size()));
+    return fds;
 }
 
-bool LinServer::setSocketNonBlocking(int sockfd)
+// Take the handoff path over. A socket file left there is either stale or
+// belongs to the predecessor, which no longer needs to be found by path.
+bool LinServer::listenForHandoff()
 {
-    int flags = fcntl(sockfd, F_GETFL, 0);
-    if (flags == -1)
+    struct sockaddr_un address;
+    if (!handoffAddress(options.handoffPath, address))
+        return false;
+
+    handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (handoff_fd < 0)
     {
-        cerr << "fcntl get failed: " << strerror(errno) << endl;
+        LOG_ERROR("socket_failed", LogField("error", strerror(errno)));
         return false;
     }
-
-    if (fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+    unlink(address.sun_path);
+    if (bind(handoff_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(handoff_fd, 4) < 0)
     {
-        cerr << "fcntl set failed: " << strerror(errno) << endl;
+        LOG_ERROR("handoff_listen_failed", LogField("path", options.handoffPath), LogField("error", strerror(errno)));
+        close(handoff_fd);
+        handoff_fd = -1;
         return false;
     }
-
     return true;
 }
 
-
-void LinServer::handleRecv(int client_fd)
+void LinServer::serveHandoff()
 {
-    const int BUFFER_SIZE = 1024;
-    char buffer[BUFFER_SIZE];
-
     while (true)
     {
-        int byteRead = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
-        if (byteRead > 0)
+        int peer = accept4(handoff_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (peer < 0)
         {
-            buffer[byteRead] = '\0';
-            cout << "Received (" << byteRead << " bytes) from fd " << client_fd << ": " << buffer << endl;
-
-            // Echo back -> put into buffer
-            sendBuffers[client_fd] += buffer;
-
-            // Enable EPOLLOUT so handleSend() can flush it
-            struct epoll_event ev;
-            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-            ev.data.fd = client_fd;
-            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev);
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return; // stop() shut the listener down
         }
-        else if (byteRead == 0)
+
+        // initialize() keeps a handoff within one message
+        uint32_t count = (uint32_t)listeners.size();
+        assert(count <= MAX_HANDOFF);
+        struct iovec iov = {&count, sizeof(count)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF)];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), listeners.data(), sizeof(int) * count);
+
+        // then wait for the successor to run, to give up, or for stop()
+        char ack = 0;
+        bool handedOff = false;
+        if (sendmsg(peer, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(count))
         {
-            cout << "Client disconnected (fd " << client_fd << ")" << endl;
-            close(client_fd);
-            sendBuffers.erase(client_fd);
-            break;
+            struct pollfd fds[2] = {{peer, POLLIN, 0}, {handoff_fd, POLLIN, 0}};
+            while (poll(fds, 2, -1) < 0 && errno == EINTR) {}
+            handedOff = (fds[0].revents & POLLIN) && recv(peer, &ack, 1, 0) == 1 && ack == HANDOFF_ACK;
         }
-        else
+        close(peer);
+
+        if (handedOff)
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                break; // No more data
-            }
-            else
-            {
-                cerr << "Recv failed: " << strerror(errno) << endl;
-                close(client_fd);
-                sendBuffers.erase(client_fd);
-                break;
-            }
+            LOG_INFO("handed_off", LogField("path", options.handoffPath), LogField("listeners", count));
+            stop();
+            return;
         }
     }
 }
 
-void LinServer::handleSend(int client_fd)
+bool LinServer::initialize(int port, const std::string &ip_address)
 {
-    auto it = sendBuffers.find(client_fd);
-    if (it == sendBuffers.end() || it->second.empty())
-        return;
+    // sendfile() has no MSG_NOSIGNAL: a client that resets in the middle of
+    // a file would otherwise kill the process
+    signal(SIGPIPE, SIG_IGN);
 
-    std::string &msg = it->second;
-    
-    ssize_t bytesSent = send(client_fd, msg.c_str(), msg.size(), 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
 
-    if (bytesSent > 0)
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+
+    if (ip_address == "0.0.0.0")
     {
-        msg.erase(0, bytesSent);
-        cout << "Sent " << bytesSent << " bytes to fd " << client_fd << endl;
+        address.sin_addr.s_addr = INADDR_ANY;
     }
-    else if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    else
     {
-        return; // try again later
+        if (inet_pton(AF_INET, ip_address.c_str(), &address.sin_addr) <= 0)
+        {
+            LOG_ERROR("invalid_address", LogField("address", ip_address));
+            return false;
+        }
     }
-    else
+
+    unsigned count = options.reactors;
+    if (count == 0)
     {
-        cerr << "Send failed: " << strerror(errno) << endl;
-        close(client_fd);
-        sendBuffers.erase(client_fd);
-        return;
+        count = std::thread::hardware_concurrency();
+        if (count == 0)
+            count = 1;
     }
 
-    // If buffer empty, disable EPOLLOUT
-    if (msg.empty())
+    // all listeners go to a successor in one SCM_RIGHTS message
+    if (!options.handoffPath.empty() && count > MAX_HANDOFF)
     {
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = client_fd;
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev);
+        LOG_WARN("reactors_clamped", LogField("reactors", count), LogField("max", MAX_HANDOFF));
+        count = MAX_HANDOFF;
     }
-}
 
-void LinServer::handleError(int client_fd)
-{
-    int error = 0;
-    socklen_t len = sizeof(error);
-    if (getsockopt(client_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+    bool uring = false;
+    if (options.backend == IOBackend::IoUring)
     {
-        cerr << "getsockopt failed for fd " << client_fd << ": " << strerror(errno) << endl;
+#ifdef HAVE_IO_URING
+        uring = UringReactor::supported();
+#endif
+        if (!uring)
+            LOG_WARN("io_uring_unavailable", LogField("fallback", "epoll"));
     }
-    else
+
+    // every inherited listener needs a reactor: closing one would reset
+    // the connections in its accept queue. inheritListeners() takes no more
+    // than MAX_HANDOFF
+    std::vector<int> inherited;
+    if (!options.handoffPath.empty())
+        inherited = inheritListeners(address);
+    if (inherited.size() > count)
+        count = (unsigned)inherited.size();
+
+    reactors.clear();
+    listeners.clear();
+    for (unsigned i = 0; i < count; i++)
     {
-        cerr << "Socket error on fd " << client_fd << ": " << strerror(error) << endl;
+        std::unique_ptr<Reactor> reactor;
+#ifdef HAVE_IO_URING
+        if (uring)
+            reactor.reset(new UringReactor(i, options));
+        else
+#endif
+            reactor.reset(new LinReactor(i, options));
+        if (!reactor->open(address, i < inherited.size() ? inherited[i] : -1))
+        {
+            for (size_t j = i + 1; j < inherited.size(); j++)
+                close(inherited[j]);
+            reactors.clear();
+            return false;
+        }
+        listeners.push_back(reactor->listener());
+        reactors.push_back(std::move(reactor));
     }
 
-    close(client_fd);
-    sendBuffers.erase(client_fd);
+    LOG_INFO("listening", LogField("address", ip_address), LogField("port", port), LogField("reactors", count),
+             LogField("backend", uring ? "io_uring" : "epoll"), LogField("inherited", inherited.size()));
+    return true;
 }
 
-void LinServer::epollLoop()
+void LinServer::runReactor(size_t index)
 {
-    const int MAX_EVENTS = 10;
-    struct epoll_event events[MAX_EVENTS];
-
-    while (true)
+    if (options.pinThreads)
     {
-        int event_count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        if (event_count < 0)
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus > 0)
         {
-            cerr << "epoll_wait error: " << strerror(errno) << endl;
-            continue;
-        }
-
-        for (int i = 0; i < event_count; i++)
-        {
-            int fd = events[i].data.fd;
-
-            if (events[i].events & EPOLLIN)
-            {
-                handleRecv(fd);
-            }
-            if (events[i].events & EPOLLOUT)
-            {
-                handleSend(fd);
-            }
-            if (events[i].events & (EPOLLERR | EPOLLHUP))
-            {
-                handleError(fd);
-            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(index % cpus, &set);
+            int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (rc != 0)
+                LOG_WARN("pin_thread_failed", LogField("reactor", index), LogField("error", strerror(rc)));
         }
     }
+
+    reactors[index]->run();
 }
 
 void LinServer::start()
 {
-    epollThread = std::thread(&LinServer::epollLoop, this);
+    if (reactors.empty())
+    {
+        LOG_ERROR("start_before_initialize");
+        return;
+    }
 
-    struct sockaddr_in client_address;
-    socklen_t addrlen = sizeof(client_address);
+    for (auto &reactor : reactors)
+        reactor->setHandler(handler ? handler : &echoHandler);
 
-    while (true)
+    for (size_t i = 1; i < reactors.size(); i++)
+        reactorThreads.emplace_back(&LinServer::runReactor, this, i);
+
+    if (!options.handoffPath.empty())
     {
-        int client_socket = accept(server_fd, (struct sockaddr *)&client_address, &addrlen);
-        if (client_socket < 0)
+        // the other reactors are up and reactor 0 is about to be: the
+        // predecessor can stop accepting
+        if (predecessor_fd != -1)
         {
-            cerr << "Accept failed: " << strerror(errno) << endl;
-            continue;
+            if (send(predecessor_fd, &HANDOFF_ACK, 1, MSG_NOSIGNAL) != 1)
+                LOG_WARN("handoff_ack_failed", LogField("error", strerror(errno)));
+            close(predecessor_fd);
+            predecessor_fd = -1;
         }
+        if (listenForHandoff())
+            handoffThread = std::thread(&LinServer::serveHandoff, this);
+    }
 
-        setSocketNonBlocking(client_socket);
+    // the calling thread drives reactor 0
+    runReactor(0);
 
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLET; // only listen for read initially
-        ev.data.fd = client_socket;
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) == -1)
-        {
-            cerr << "epoll_ctl add failed: " << strerror(errno) << endl;
-            close(client_socket);
-        }
-
-        cout << "New client connected, fd = " << client_socket << endl;
+    for (auto &t : reactorThreads)
+        if (t.joinable()) t.join();
+    reactorThreads.clear();
+    if (handoffThread.joinable()) handoffThread.join();
+    if (handoff_fd != -1)
+    {
+        close(handoff_fd);
+        handoff_fd = -1;
     }
+    LOG_INFO("stopped", LogField("connections_accepted", acceptedConnections()));
 }
 
-LinServer::~LinServer()
+void LinServer::stop()
 {
-    if (server_fd != -1) close(server_fd);
-    if (epoll_fd != -1) close(epoll_fd);
-    if (epollThread.joinable()) epollThread.join();
+    uint64_t deadline = monotonicNanos() + (uint64_t)options.drainTimeoutMs * 1000000;
+    // wakes serveHandoff(), which then exits
+    if (handoff_fd != -1)
+        shutdown(handoff_fd, SHUT_RDWR);
+    for (auto &reactor : reactors)
+        reactor->stop(deadline);
 }
 
+unsigned long long LinServer::acceptedConnections() const
+{
+    unsigned long long total = 0;
+    for (auto &reactor : reactors)
+        total += reactor->acceptedConnections();
+    return total;
+}
 
-
-
-
+LinServer::~LinServer()
+{
+    for (auto &t : reactorThreads)
+        if (t.joinable()) t.join();
+    if (handoffThread.joinable()) handoffThread.join();
+    if (predecessor_fd != -1) close(predecessor_fd);
+    if (handoff_fd != -1) close(handoff_fd);
+}
@@ -2,28 +2,39 @@
 #define LINSERVER_H
 
 #include "./tcpserver.h"
-#include <iostream>
+#include "reactor.h"
+#include <memory>
 #include <thread>
-#include <unordered_map>
+#include <vector>
 
 class LinServer : public TCPServer {
 private:
-    int server_fd;
-    int epoll_fd;
-    std::thread epollThread;
+    ServerOptions options;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::vector<std::thread> reactorThreads;
 
-    void epollLoop();
-    bool setSocketNonBlocking(int sockfd);
+    // hot restart (ServerOptions::handoffPath)
+    std::vector<int> listeners; // the reactors' listening sockets, handed to a successor
+    int predecessor_fd;         // the server the listeners came from, told to drain by start()
+    int handoff_fd;             // UNIX listener a successor connects to
+    std::thread handoffThread;
 
-    void handleRecv(int client_socket);
-    void handleSend(int client_socket);
-    void handleError(int client_socket);
-    std::unordered_map<int, std::string> sendBuffers;
+    void runReactor(size_t index);
+    // the listening sockets of a server on handoffPath bound to `address`,
+    // none when there is no such server
+    std::vector<int> inheritListeners(const sockaddr_in &address);
+    bool listenForHandoff();
+    // runs on handoffThread: give the listeners to the first successor that
+    // takes them, then stop
+    void serveHandoff();
 
 public:
     LinServer();
+    explicit LinServer(const ServerOptions &options);
     bool initialize(int port, const std::string &ipAddress = "127.0.0.1") override;
     void start() override;
+    void stop() override;
+    unsigned long long acceptedConnections() const override;
     virtual ~LinServer();
 };
 
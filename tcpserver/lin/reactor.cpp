@@ -0,0 +1,754 @@
+#include "reactor.h"
+#include "log.h"
+#include "metrics.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+using namespace std;
+
+// one recv() takes up to this much; a large request body needs a syscall
+// per 64 KiB instead of per KiB
+static const size_t RECV_BUFFER_SIZE = 64 * 1024;
+
+ReactorQueue::~ReactorQueue()
+{
+    if (event_fd != -1) close(event_fd);
+}
+
+bool ReactorQueue::open()
+{
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0)
+    {
+        LOG_ERROR("eventfd_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+void ReactorQueue::post(uint64_t id, std::function<void(TCPConnection &)> task)
+{
+    bool notify;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(Task{id, std::move(task)});
+        notify = !signalled;
+        signalled = true;
+    }
+    // one write per batch: the reactor takes every queued task per wakeup
+    if (notify)
+    {
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            LOG_ERROR("eventfd_write_failed", LogField("error", strerror(errno)));
+    }
+}
+
+void ReactorQueue::wake()
+{
+    uint64_t one = 1;
+    ssize_t ignored = write(event_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void ReactorQueue::take(std::vector<Task> &out)
+{
+    uint64_t count;
+    if (read(event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        LOG_ERROR("eventfd_read_failed", LogField("error", strerror(errno)));
+
+    std::lock_guard<std::mutex> guard(lock);
+    out.swap(tasks);
+    signalled = false;
+}
+
+LinReactor::LinReactor(int id, const ServerOptions &options)
+    : id(id), options(options), listen_fd(-1), epoll_fd(-1), acceptPending(false), accepted(0), handler(nullptr),
+      serial(0), metrics(nullptr), recvBuffer(RECV_BUFFER_SIZE), timeouts(options), stopDeadline(0),
+      draining(false) {}
+
+uint64_t monotonicNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void resetOnClose(int fd)
+{
+    struct linger reset;
+    reset.l_onoff = 1;
+    reset.l_linger = 0;
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+}
+
+uint64_t ConnectionTimeouts::monotonicMillis()
+{
+    return monotonicNanos() / 1000000;
+}
+
+ConnectionTimeouts::ConnectionTimeouts(const ServerOptions &options)
+    : idleMs(options.idleTimeoutMs), requestMs(options.requestTimeoutMs), writeMs(options.writeTimeoutMs),
+      wheel(monotonicMillis()), nowMs(monotonicMillis()) {}
+
+// Pending output is what the connection waits on first, then a worker, then
+// the rest of a request. The timer restarts when that changes or when the
+// connection made progress of that kind: a request consumed, enough of a
+// partial one received, or some output sent.
+void ConnectionTimeouts::update(Deadline &deadline, uint64_t id, bool outputPending, bool held, bool inputPending,
+                                bool restart)
+{
+    Timeout kind = outputPending ? Timeout::Write
+                 : held          ? Timeout::None
+                 : inputPending  ? Timeout::Request
+                                 : Timeout::Idle;
+    restart = restart || kind != deadline.kind;
+    unsigned limit = 0;
+    switch (kind)
+    {
+    case Timeout::Idle:
+        restart = restart || deadline.consumed;
+        limit = idleMs;
+        break;
+    case Timeout::Request:
+        restart = restart || deadline.consumed || deadline.received >= REQUEST_PROGRESS_BYTES;
+        limit = requestMs;
+        break;
+    case Timeout::Write:
+        restart = restart || deadline.sent;
+        limit = writeMs;
+        break;
+    case Timeout::None:
+        break;
+    }
+    deadline.kind = kind;
+    deadline.consumed = deadline.sent = false;
+    if (!restart)
+        return;
+
+    deadline.received = 0;
+    if (limit == 0)
+    {
+        wheel.cancel(deadline.timer);
+        return;
+    }
+    deadline.timer.id = id;
+    wheel.schedule(deadline.timer, nowMs + limit);
+}
+
+void ConnectionTimeouts::cancel(Deadline &deadline)
+{
+    wheel.cancel(deadline.timer);
+}
+
+void ConnectionTimeouts::drain()
+{
+    if (idleMs == 0 || idleMs > DRAIN_IDLE_MS)
+        idleMs = DRAIN_IDLE_MS;
+}
+
+int openListener(const sockaddr_in &address, const ServerOptions &options)
+{
+    int opt = 1;
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        LOG_ERROR("socket_failed", LogField("error", strerror(errno)));
+        return -1;
+    }
+
+    // every reactor binds the same address; the kernel spreads incoming
+    // connections over the listeners of the SO_REUSEPORT group
+    if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        LOG_ERROR("setsockopt_failed", LogField("error", strerror(errno)));
+        close(listen_fd);
+        return -1;
+    }
+
+    // accepted sockets inherit it: a response head and the file slice sent
+    // right after it must not wait out the client's delayed ACK
+    setsockopt(listen_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+#ifdef SO_BUSY_POLL
+    // lets recv and epoll poll the device queue instead of waiting for the
+    // interrupt; raising it is privileged, so this is best effort
+    if (options.busyPollMicros != 0)
+    {
+        int usecs = (int)options.busyPollMicros;
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0)
+            LOG_INFO("busy_poll_socket_unavailable", LogField("error", strerror(errno)));
+    }
+#endif
+
+    if (bind(listen_fd, (const struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        LOG_ERROR("bind_failed", LogField("error", strerror(errno)));
+        close(listen_fd);
+        return -1;
+    }
+
+    if (listen(listen_fd, SOMAXCONN) < 0)
+    {
+        LOG_ERROR("listen_failed", LogField("error", strerror(errno)));
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+bool LinReactor::open(const sockaddr_in &address, int listener)
+{
+    listen_fd = listener >= 0 ? listener : openListener(address, options);
+    if (listen_fd < 0)
+        return false;
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1)
+    {
+        LOG_ERROR("epoll_create_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1)
+    {
+        LOG_ERROR("epoll_ctl_failed", LogField("fd", listen_fd), LogField("error", strerror(errno)));
+        return false;
+    }
+
+    if (!queue.open())
+        return false;
+    ev.events = EPOLLIN;
+    ev.data.fd = queue.fd();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, queue.fd(), &ev) == -1)
+    {
+        LOG_ERROR("epoll_ctl_failed", LogField("fd", queue.fd()), LogField("error", strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+void LinReactor::closeClient(int client_fd)
+{
+    LinConnection *conn = connections.remove(client_fd);
+    if (conn == nullptr)
+        return;
+
+    handler->onClose(*conn);
+    timeouts.cancel(conn->deadline);
+    close(client_fd);
+    connectionPool.destroy(conn);
+    metrics->add(MetricCounter::Closes);
+    metrics->add(MetricGauge::OpenConnections, -1);
+}
+
+// Offer the pending input to the protocol handler again and drop what it
+// consumed.
+void LinReactor::dispatch(LinConnection &conn)
+{
+    if (conn.input.empty() || conn.stopped || conn.readingPaused())
+        return;
+
+    size_t used = handler->onData(conn, conn.input.data(), conn.input.size());
+    consumeInput(conn.input, used);
+    conn.deadline.consumed |= used != 0;
+}
+
+void LinReactor::stop(uint64_t deadlineNanos)
+{
+    uint64_t serving = 0;
+    stopDeadline.compare_exchange_strong(serving, deadlineNanos != 0 ? deadlineNanos : 1);
+    queue.wake();
+}
+
+// The first step closes the listener and marks every connection draining:
+// the HTTP layer answers the next request on it with Connection: close, and
+// one that stays idle for DRAIN_IDLE_MS is closed. Closing idle keep-alive
+// connections right away would race requests already on their way.
+// Whatever is left at the deadline is closed as is.
+bool LinReactor::drain()
+{
+    if (!draining)
+    {
+        draining = true;
+        acceptPending = false;
+        if (listen_fd != -1)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+            close(listen_fd);
+            listen_fd = -1;
+        }
+        LOG_INFO("draining", LogField("reactor", id), LogField("connections", connections.size()));
+
+        timeouts.drain();
+        connections.forEach([this](LinConnection *conn) {
+            conn->drain();
+            timeouts.update(conn->deadline, conn->connectionId, !conn->output.empty(), conn->held(),
+                            !conn->input.empty(), true);
+        });
+    }
+
+    if (connections.size() != 0 && monotonicNanos() >= stopDeadline.load(std::memory_order_relaxed))
+    {
+        LOG_WARN("drain_deadline", LogField("reactor", id), LogField("connections", connections.size()));
+        std::vector<int> left;
+        connections.forEach([&left](LinConnection *conn) { left.push_back(conn->socket); });
+        for (int fd : left)
+            closeClient(fd);
+    }
+    return connections.size() == 0;
+}
+
+// A timer ran out: close the connection it belongs to, unless that closed
+// already and the fd was reused.
+void LinReactor::expire(uint64_t id)
+{
+    LinConnection *conn = connections.find(connectionFd(id));
+    if (conn == nullptr || conn->connectionId != id)
+        return;
+
+    LOG_DEBUG("timeout", LogField("fd", conn->socket), LogField("kind", (int)conn->deadline.kind));
+    metrics->add(MetricCounter::Timeouts);
+    if (conn->deadline.kind == Timeout::Write)
+        resetOnClose(conn->socket);
+    closeClient(conn->socket);
+}
+
+// Write as much of the queue as the socket takes: memory chunks go out with
+// one sendmsg() per IOV_BATCH chunks, file slices with sendfile(). EPOLLOUT
+// stays armed only while bytes remain, and the connection's timer is re-aimed
+// at what it waits on now. Returns false when the connection was closed.
+bool LinReactor::flush(LinConnection &conn)
+{
+    const size_t IOV_BATCH = 64;
+    int client_fd = conn.socket;
+    OutputBuffer &out = conn.output;
+
+    for (;;)
+    {
+        while (!out.empty())
+        {
+            uint64_t offset;
+            size_t length;
+            const FileHandle *file = out.frontFile(offset, length);
+            ssize_t bytesSent;
+            size_t bytes;
+
+            if (file != nullptr)
+            {
+                off_t position = offset;
+                bytes = length;
+                bytesSent = sendfile(client_fd, file->fd(), &position, length);
+                if (bytesSent == 0)
+                {
+                    LOG_WARN("sendfile_eof", LogField("fd", client_fd));
+                    closeClient(client_fd);
+                    return false;
+                }
+            }
+            else
+            {
+                struct iovec iov[IOV_BATCH];
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iov;
+                msg.msg_iovlen = out.gather(iov, IOV_BATCH, bytes);
+                bytesSent = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+            }
+            metrics->add(MetricCounter::SendCalls);
+
+            if (bytesSent > 0)
+            {
+                out.consume(bytesSent);
+                conn.deadline.sent = true;
+                metrics->add(MetricCounter::BytesOut, bytesSent);
+                LOG_DEBUG("sent", LogField("fd", client_fd), LogField("bytes", bytesSent));
+                if ((size_t)bytesSent < bytes)
+                {
+                    metrics->add(MetricCounter::PartialWrites);
+                    if (file == nullptr)
+                        break; // short write: the socket buffer is full
+                }
+            }
+            else if (bytesSent == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break; // try again on EPOLLOUT
+            }
+            else
+            {
+                LOG_WARN("send_failed", LogField("fd", client_fd), LogField("error", strerror(errno)));
+                closeClient(client_fd);
+                return false;
+            }
+        }
+
+        if (!out.empty())
+            break;
+        // everything is written: a producer makes its next window, and a
+        // paused connection takes its pending input again; either may queue
+        // more
+        if (conn.awaitingWritable() && !conn.stopped)
+        {
+            conn.cancelAwaitWritable();
+            handler->onWritable(conn);
+        }
+        else if (conn.readingPaused())
+        {
+            conn.resumeReading();
+        }
+        else
+        {
+            break;
+        }
+        dispatch(conn);
+        backlogged(conn, options.maxQueuedBytes);
+    }
+
+    if (out.empty() && conn.closing && !conn.held())
+    {
+        closeClient(client_fd);
+        return false;
+    }
+
+    watch(conn, !out.empty());
+    timeouts.update(conn.deadline, conn.connectionId, !out.empty(), conn.held(), !conn.input.empty());
+    return true;
+}
+
+void LinReactor::watch(LinConnection &conn, bool wantWrite)
+{
+    bool wantRead = !conn.readingPaused();
+    if (wantWrite == conn.writeArmed && wantRead == conn.readArmed)
+        return;
+
+    struct epoll_event ev;
+    ev.events = EPOLLET | (wantRead ? (uint32_t)EPOLLIN : 0u) | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.fd = conn.socket;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.socket, &ev);
+    if (wantWrite && !conn.writeArmed)
+        metrics->add(MetricCounter::WriteArms);
+    if (!wantRead && conn.readArmed)
+        metrics->add(MetricCounter::ReadPauses);
+    conn.writeArmed = wantWrite;
+    conn.readArmed = wantRead;
+}
+
+void LinReactor::handleAccept()
+{
+    unsigned batch = 0;
+    acceptPending = false;
+
+    while (true)
+    {
+        if (options.acceptBatch != 0 && batch == options.acceptBatch)
+        {
+            // leave the rest for the next loop iteration
+            acceptPending = true;
+            break;
+        }
+
+        struct sockaddr_in client_address;
+        socklen_t addrlen = sizeof(client_address);
+
+        int client_socket = accept4(listen_fd, (struct sockaddr *)&client_address, &addrlen,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_WARN("accept_failed", LogField("error", strerror(errno)));
+            break;
+        }
+        batch++;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET; // only listen for read initially
+        ev.data.fd = client_socket;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) == -1)
+        {
+            LOG_WARN("epoll_ctl_failed", LogField("fd", client_socket), LogField("error", strerror(errno)));
+            close(client_socket);
+            continue;
+        }
+
+        LinConnection *conn =
+            connectionPool.create(client_socket, makeConnectionId(++serial, client_socket), queue);
+        conn->peer = client_address.sin_addr.s_addr;
+        connections.insert(client_socket, conn);
+        metrics->add(MetricCounter::Accepts);
+        metrics->add(MetricGauge::OpenConnections, 1);
+        handler->onConnect(*conn);
+        timeouts.update(conn->deadline, conn->connectionId, false, false, false);
+        LOG_DEBUG("connected", LogField("fd", client_socket), LogField("reactor", id));
+    }
+
+    accepted.fetch_add(batch, std::memory_order_relaxed);
+}
+
+void LinReactor::handleRecv(int client_fd)
+{
+    LinConnection *found = connections.find(client_fd);
+    if (found == nullptr)
+        return;
+    LinConnection &conn = *found;
+
+    bool drained = false; // recv() found the socket empty, or at EOF
+    while (!drained)
+    {
+        // backpressure: what is left stays in the socket until the output
+        // drains
+        while (!backlogged(conn, options.maxQueuedBytes))
+        {
+            ssize_t byteRead = recv(client_fd, recvBuffer.data(), recvBuffer.size(), 0);
+            metrics->add(MetricCounter::RecvCalls);
+            if (byteRead > 0)
+            {
+                metrics->add(MetricCounter::BytesIn, byteRead);
+                LOG_DEBUG("received", LogField("fd", client_fd), LogField("bytes", byteRead));
+
+                if (conn.stopped)
+                    continue; // no more requests are served; discard
+                deliverInput(*handler, conn, recvBuffer.data(), (size_t)byteRead);
+            }
+            else if (byteRead == 0)
+            {
+                // what came with the FIN has been served; close once it is written
+                LOG_DEBUG("disconnected", LogField("fd", client_fd));
+                conn.closing = true;
+                drained = true;
+                break;
+            }
+            else
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    drained = true;
+                    break; // No more data
+                }
+                else if (errno != EINTR)
+                {
+                    LOG_WARN("recv_failed", LogField("fd", client_fd), LogField("error", strerror(errno)));
+                    closeClient(client_fd);
+                    return;
+                }
+            }
+        }
+
+        // write the replies right away; EPOLLOUT is only armed if they don't fit
+        if (!conn.writeArmed)
+        {
+            if (!flush(conn))
+                return;
+        }
+        else
+        {
+            watch(conn, true);
+            timeouts.update(conn.deadline, conn.connectionId, true, conn.held(), !conn.input.empty());
+        }
+
+        // a pause that flush() ended left EPOLLIN armed with the socket
+        // unread, and no new edge will report it: read on
+        if (conn.readingPaused())
+            break;
+    }
+}
+
+void LinReactor::handleSend(int client_fd)
+{
+    LinConnection *conn = connections.find(client_fd);
+    if (conn == nullptr)
+        return;
+
+    flush(*conn);
+}
+
+// Run what other threads handed back, then flush each connection they
+// touched once. Tasks for connections closed in the meantime are dropped.
+void LinReactor::runPosted()
+{
+    std::vector<ReactorQueue::Task> tasks;
+    queue.take(tasks);
+    metrics->add(MetricCounter::PostedTasks, tasks.size());
+
+    std::vector<uint64_t> touched;
+    for (auto &task : tasks)
+    {
+        LinConnection *found = connections.find(connectionFd(task.connection));
+        if (found == nullptr || found->connectionId != task.connection)
+            continue;
+        LinConnection &conn = *found;
+
+        conn.releaseHold();
+        task.run(conn);
+        if (!conn.posted)
+        {
+            conn.posted = true;
+            touched.push_back(conn.connectionId);
+        }
+    }
+
+    // every task of a connection has run: one dispatch and one flush for
+    // all of them
+    for (uint64_t connection : touched)
+    {
+        LinConnection *found = connections.find(connectionFd(connection));
+        if (found == nullptr || found->connectionId != connection)
+            continue;
+        LinConnection &conn = *found;
+
+        conn.posted = false;
+        dispatch(conn);
+        backlogged(conn, options.maxQueuedBytes);
+        if (!conn.writeArmed)
+        {
+            flush(conn);
+        }
+        else
+        {
+            watch(conn, true);
+            timeouts.update(conn.deadline, conn.connectionId, true, conn.held(), !conn.input.empty());
+        }
+    }
+}
+
+void LinReactor::handleError(int client_fd)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+    {
+        LOG_WARN("getsockopt_failed", LogField("fd", client_fd), LogField("error", strerror(errno)));
+    }
+    else
+    {
+        LOG_WARN("socket_error", LogField("fd", client_fd), LogField("error", strerror(error)));
+    }
+
+    closeClient(client_fd);
+}
+
+void LinReactor::run()
+{
+    // one wait hands out at most events.size() ready fds; the array doubles
+    // each time a wait fills it, so under load a syscall covers many
+    std::vector<struct epoll_event> events(options.maxEvents < 64 ? options.maxEvents : 64);
+    if (events.empty())
+        events.resize(1);
+    const uint64_t busyPollNanos = (uint64_t)options.busyPollMicros * 1000;
+    uint64_t lastActive = 0;
+
+    Metrics::nameThread("reactor" + std::to_string(id));
+    metrics = &Metrics::local();
+
+    while (true)
+    {
+        if (stopDeadline.load(std::memory_order_relaxed) != 0 && drain())
+            break;
+
+        // don't block while connections are still waiting in the accept
+        // queue, or while busy polling after recent activity; otherwise
+        // sleep until the next connection timer (or drain deadline) at most
+        int timeout = -1;
+        if (acceptPending)
+            timeout = 0;
+        else if (busyPollNanos != 0 && monotonicNanos() - lastActive < busyPollNanos)
+            timeout = 0;
+        int timerWait = timeouts.nextTimeout();
+        uint64_t now = monotonicNanos(), deadline = stopDeadline.load(std::memory_order_relaxed);
+        if (draining && deadline > now)
+        {
+            int left = (int)((deadline - now + 999999) / 1000000);
+            if (timerWait < 0 || left < timerWait)
+                timerWait = left;
+        }
+        bool timerDue = timerWait >= 0 && (timeout < 0 || timerWait <= timeout);
+        if (timerDue)
+            timeout = timerWait;
+
+        int event_count = epoll_wait(epoll_fd, events.data(), (int)events.size(), timeout);
+        timeouts.advance([this](uint64_t connection) { expire(connection); });
+        if (event_count < 0)
+        {
+            if (errno != EINTR)
+                LOG_ERROR("epoll_wait_failed", LogField("error", strerror(errno)));
+            continue;
+        }
+        if (event_count == 0 && !acceptPending)
+        {
+            // a busy poll that found nothing, or a timer wakeup
+            if (!timerDue)
+                metrics->add(MetricCounter::IdlePolls);
+            continue;
+        }
+        if (busyPollNanos != 0)
+            lastActive = monotonicNanos();
+        if ((size_t)event_count == events.size() && events.size() < options.maxEvents)
+            events.resize(events.size() * 2 < options.maxEvents ? events.size() * 2 : options.maxEvents);
+        metrics->add(MetricCounter::Wakeups);
+        metrics->add(MetricCounter::Events, event_count);
+        metrics->record(MetricHistogram::EventsPerWait, event_count);
+
+        bool listenerReady = false;
+        for (int i = 0; i < event_count; i++)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == listen_fd)
+            {
+                listenerReady = true;
+                continue;
+            }
+            if (fd == queue.fd())
+            {
+                runPosted();
+                continue;
+            }
+
+            // an earlier handler in this batch may already have closed the fd
+            if (events[i].events & EPOLLIN)
+            {
+                handleRecv(fd);
+            }
+            if ((events[i].events & EPOLLOUT) && connections.find(fd))
+            {
+                handleSend(fd);
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && connections.find(fd))
+            {
+                handleError(fd);
+            }
+        }
+
+        // accept after serving the ready clients, at most one batch per round
+        if (listenerReady || acceptPending)
+            handleAccept();
+    }
+}
+
+LinReactor::~LinReactor()
+{
+    connections.forEach([this](LinConnection *conn) {
+        close(conn->socket);
+        connectionPool.destroy(conn);
+    });
+    if (listen_fd != -1) close(listen_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+}
@@ -0,0 +1,332 @@
+#ifndef LINREACTOR_H
+#define LINREACTOR_H
+
+#include "./tcpserver.h"
+#include "outputbuffer.h"
+#include "metrics.h"
+#include "slab.h"
+#include "timerwheel.h"
+#include <netinet/in.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Tasks posted to one reactor from other threads. The reactor polls fd(),
+// an eventfd that is signalled when the queue goes from empty to non-empty.
+class ReactorQueue : public CompletionQueue
+{
+public:
+    struct Task
+    {
+        uint64_t connection;
+        std::function<void(TCPConnection &)> run;
+    };
+
+    ReactorQueue() : event_fd(-1), signalled(false) {}
+    ~ReactorQueue() override;
+    bool open();
+    int fd() const { return event_fd; }
+
+    void post(uint64_t id, std::function<void(TCPConnection &)> task) override;
+    // signal the eventfd without a task; async-signal-safe
+    void wake();
+    // move everything posted so far into `out` and reset the eventfd
+    void take(std::vector<Task> &out);
+
+private:
+    int event_fd;
+    std::mutex lock;
+    std::vector<Task> tasks;
+    bool signalled;
+};
+
+// connection ids pair the fd (low half, for the table lookup) with a
+// per-reactor serial, so a task for a closed connection never reaches a
+// newer one that reuses its fd
+inline uint64_t makeConnectionId(uint32_t serial, int fd) { return ((uint64_t)serial << 32) | (uint32_t)fd; }
+inline int connectionFd(uint64_t id) { return (int)(uint32_t)id; }
+
+// Which of ServerOptions' timeouts a connection is under.
+enum class Timeout : unsigned char
+{
+    None,    // waiting on another thread (held)
+    Idle,    // nothing pending
+    Request, // part of a request received, not consumed by the handler
+    Write    // output queued
+};
+
+// A connection's timer and what happened since it was last set.
+struct Deadline
+{
+    TimerWheel::Timer timer;
+    Timeout kind = Timeout::None;
+    bool consumed = false; // the handler took input
+    bool sent = false;     // the socket took output
+    size_t received = 0;   // bytes read
+};
+
+// The idle, request and write timeouts of one reactor's connections, on a
+// timing wheel: a connection's single timer is re-aimed (O(1)) whenever its
+// state changes or it makes progress, and only timers that actually fire
+// are ever visited.
+class ConnectionTimeouts
+{
+public:
+    // a partial request earns another requestTimeoutMs per this many bytes,
+    // so a slow upload survives while a trickled header does not
+    static const size_t REQUEST_PROGRESS_BYTES = 16 * 1024;
+
+    // while draining, a connection this quiet is closed: a client that has
+    // not sent for a while is unlikely to be sending as it goes
+    static const unsigned DRAIN_IDLE_MS = 1000;
+
+    explicit ConnectionTimeouts(const ServerOptions &options);
+
+    // re-aim the timer of connection `id` after an event; `restart` also
+    // restarts it when nothing progressed
+    void update(Deadline &deadline, uint64_t id, bool outputPending, bool held, bool inputPending,
+                bool restart = false);
+    void cancel(Deadline &deadline);
+    // cut the idle timeout to DRAIN_IDLE_MS for timers set from now on
+    void drain();
+
+    // read the clock and run `expire(id)` for every connection out of time
+    template <class F>
+    void advance(F expire)
+    {
+        nowMs = monotonicMillis();
+        wheel.advance(nowMs, expire);
+    }
+
+    // ms until the next timer may fire, -1 when none is armed
+    int nextTimeout() const { return wheel.nextTimeout(monotonicMillis()); }
+
+private:
+    unsigned idleMs, requestMs, writeMs;
+    TimerWheel wheel;
+    uint64_t nowMs; // as of the last advance(); good enough for deadlines
+
+    static uint64_t monotonicMillis();
+};
+
+// Bytes a connection keeps for a partial request are copied out of the
+// shared receive buffer into its own `input`; storage a burst grew past
+// INPUT_KEEP is given back once most of it has been consumed, so memory
+// follows active connections, not total ones.
+const size_t INPUT_KEEP = 4096;
+
+inline void consumeInput(std::string &input, size_t used)
+{
+    input.erase(0, used);
+    if (input.capacity() > INPUT_KEEP && input.size() * 4 < input.capacity())
+        input.shrink_to_fit();
+}
+
+// Offer `len` freshly received bytes, still in the reactor's receive buffer,
+// to the handler: parsed in place when nothing is pending, otherwise after
+// the pending bytes. While reading is paused they only join the pending
+// input (an io_uring recv can complete after its cancel was queued).
+template <class Connection>
+void deliverInput(ConnectionHandler &handler, Connection &conn, const char *data, size_t len)
+{
+    conn.deadline.received += len;
+    if (conn.readingPaused())
+    {
+        conn.input.append(data, len);
+        return;
+    }
+    if (conn.input.empty())
+    {
+        size_t used = handler.onData(conn, data, len);
+        if (used < len)
+            conn.input.assign(data + used, len - used);
+        conn.deadline.consumed |= used != 0;
+        return;
+    }
+
+    conn.input.append(data, len);
+    size_t used = handler.onData(conn, conn.input.data(), conn.input.size());
+    consumeInput(conn.input, used);
+    conn.deadline.consumed |= used != 0;
+}
+
+// Backpressure: pause a connection with `limit` or more bytes of output
+// queued (ServerOptions::maxQueuedBytes, 0 for none); true when reading is
+// paused, by this or by the handler.
+template <class Connection>
+bool backlogged(Connection &conn, size_t limit)
+{
+    if (limit != 0 && conn.output.size() >= limit)
+        conn.pauseReading();
+    return conn.readingPaused();
+}
+
+// A reactor's connections indexed by fd. The kernel hands out the lowest
+// free descriptor, so the array stays dense and a lookup is one load; it
+// grows to the highest fd this reactor has seen and never shrinks.
+template <class T>
+class ConnectionTable
+{
+public:
+    T *find(int fd) const { return (size_t)fd < slots.size() ? slots[fd] : nullptr; }
+
+    void insert(int fd, T *conn)
+    {
+        if ((size_t)fd >= slots.size())
+            slots.resize((size_t)fd + 1 > slots.size() * 2 ? (size_t)fd + 1 : slots.size() * 2, nullptr);
+        slots[fd] = conn;
+        count++;
+    }
+
+    T *remove(int fd)
+    {
+        T *conn = find(fd);
+        if (conn != nullptr)
+        {
+            slots[fd] = nullptr;
+            count--;
+        }
+        return conn;
+    }
+
+    size_t size() const { return count; }
+
+    template <class F>
+    void forEach(F f) const
+    {
+        for (T *conn : slots)
+            if (conn != nullptr) f(conn);
+    }
+
+private:
+    std::vector<T *> slots;
+    size_t count = 0;
+};
+
+class LinConnection : public TCPConnection
+{
+public:
+    LinConnection(int fd, uint64_t id, ReactorQueue &queue) : socket(fd), connectionId(id), queue(queue) {}
+
+    int fd() const override { return socket; }
+    uint64_t id() const override { return connectionId; }
+    CompletionQueue &completions() override { return queue; }
+    uint32_t peerAddress() override { return peer; }
+    void send(const char *data, size_t len) override { output.append(data, len); }
+    void send(std::string &&data) override { output.append(std::move(data)); }
+    void send(const std::shared_ptr<const std::string> &data) override { output.append(data); }
+    char *prepareSend(size_t maxLen) override { return output.prepare(maxLen); }
+    void commitSend(char *end) override { output.commit(end); }
+    void sendFile(const std::shared_ptr<FileHandle> &file, uint64_t offset, size_t length) override
+    {
+        output.appendFile(file, offset, length);
+    }
+    void close() override { closing = stopped = true; }
+
+    int socket;
+    OutputBuffer output;
+    std::string input;       // received bytes the handler has not consumed
+    bool writeArmed = false; // EPOLLOUT is in the interest set
+    bool readArmed = true;   // EPOLLIN is; dropped while reading is paused
+    bool closing = false;    // close once output drains
+    bool stopped = false;    // close() was called: no more onData()
+    bool posted = false;     // has tasks in the runPosted() batch being run
+    uint32_t peer = 0;       // from accept4()
+    Deadline deadline;
+    uint64_t connectionId;
+    ReactorQueue &queue;
+};
+
+// One event loop of the Linux server. Every reactor owns its own
+// SO_REUSEPORT listener, event queue and connection table, so nothing on the
+// hot path is shared with the other reactors.
+class Reactor
+{
+public:
+    // accept on `listener` when one is given (inherited from the previous
+    // process on a hot restart), otherwise on a new listener for `address`
+    virtual bool open(const sockaddr_in &address, int listener = -1) = 0;
+    virtual void setHandler(ConnectionHandler *handler) = 0;
+    // serve connections on the calling thread until stop() has drained them
+    virtual void run() = 0;
+    // from any thread: stop accepting and close every connection once it is
+    // idle or CLOCK_MONOTONIC passes `deadlineNanos`
+    virtual void stop(uint64_t deadlineNanos) = 0;
+    // the listening socket; closed by the drain
+    virtual int listener() const = 0;
+    virtual unsigned long long acceptedConnections() const = 0;
+    virtual ~Reactor() = default;
+};
+
+// non-blocking listening socket in the SO_REUSEPORT group of `address`,
+// -1 on failure. Accepted sockets inherit its TCP_NODELAY and, in latency
+// mode, SO_BUSY_POLL
+int openListener(const sockaddr_in &address, const ServerOptions &options);
+
+// make close() reset the connection and drop unsent data instead of
+// letting the kernel keep draining it to a client that stopped reading
+void resetOnClose(int fd);
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t monotonicNanos();
+
+// Readiness-based reactor: an edge-triggered epoll set, recv()/sendmsg()
+// per operation.
+class LinReactor : public Reactor
+{
+private:
+    int id;
+    ServerOptions options;
+    int listen_fd;
+    int epoll_fd;
+    // set when handleAccept() stopped at the batch cap with connections still
+    // queued; the edge-triggered listener will not report them again
+    bool acceptPending;
+    std::atomic<unsigned long long> accepted;
+    ConnectionHandler *handler;
+    ReactorQueue queue;
+    uint32_t serial; // connection ids handed out so far
+    ThreadMetrics *metrics; // the reactor thread's block, set by run()
+
+    // lent to whichever connection is being read; the reactor reads one
+    // socket at a time, so one buffer is the whole pool
+    std::vector<char> recvBuffer;
+    ConnectionTimeouts timeouts;
+
+    // set by stop(): when the drain must end; 0 while serving
+    std::atomic<uint64_t> stopDeadline;
+    bool draining; // the listener is closed; idle connections time out early
+
+    void closeClient(int client_socket);
+    void expire(uint64_t id);
+    // one drain step; true once no connection is left
+    bool drain();
+    void runPosted();
+    bool flush(LinConnection &conn);
+    void dispatch(LinConnection &conn);
+    // make the epoll interest follow the connection's paused reads and
+    // pending output
+    void watch(LinConnection &conn, bool wantWrite);
+
+    void handleAccept();
+    void handleRecv(int client_socket);
+    void handleSend(int client_socket);
+    void handleError(int client_socket);
+    ConnectionTable<LinConnection> connections;
+    SlabPool<LinConnection> connectionPool;
+
+public:
+    LinReactor(int id, const ServerOptions &options);
+    bool open(const sockaddr_in &address, int listener = -1) override;
+    void setHandler(ConnectionHandler *handler) override { this->handler = handler; }
+    void run() override;
+    void stop(uint64_t deadlineNanos) override;
+    int listener() const override { return listen_fd; }
+    unsigned long long acceptedConnections() const override { return accepted.load(std::memory_order_relaxed); }
+    ~LinReactor() override;
+};
+
+#endif
@@ -0,0 +1,791 @@
+#include "uring.h"
+#include "log.h"
+#include "metrics.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+using namespace std;
+
+// no liburing: the three io_uring syscalls are all this needs
+static int uringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg = nullptr,
+                      size_t argSize = 0)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int uringRegister(int fd, unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+static const unsigned SQ_ENTRIES = 1024;
+// multishot operations can post many completions per submission
+static const unsigned CQ_ENTRIES = SQ_ENTRIES * 8;
+// The ring is created on the initializing thread but only ever entered by the
+// reactor's, which enables it. DEFER_TASKRUN (6.1+) runs completion work only
+// inside our io_uring_enter() calls instead of interrupting the loop; it also
+// dates the kernel after multishot accept (5.19), buffer rings (5.19) and
+// multishot recv (6.0), so a ring that sets up with it has all of them.
+static const unsigned SETUP_FLAGS = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER |
+                                    IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+
+static const unsigned BUF_COUNT = 512; // power of two; 8 MiB of receive buffers per reactor
+static const unsigned BUF_SIZE = 16 * 1024;
+static const unsigned short BUF_GROUP = 0;
+
+static inline uint64_t userData(int fd, int op) { return ((uint64_t)fd << 8) | (uint64_t)op; }
+
+bool UringReactor::supported()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = SETUP_FLAGS;
+    params.cq_entries = CQ_ENTRIES;
+    int fd = uringSetup(SQ_ENTRIES, &params);
+    if (fd < 0)
+        return false;
+    close(fd);
+    return true;
+}
+
+uint32_t UringConnection::peerAddress()
+{
+    if (!peerKnown)
+    {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        if (getpeername(socket, (struct sockaddr *)&address, &length) == 0 && address.sin_family == AF_INET)
+            peer = address.sin_addr.s_addr;
+        peerKnown = true;
+    }
+    return peer;
+}
+
+UringReactor::UringReactor(int id, const ServerOptions &options)
+    : id(id), options(options), listen_fd(-1), ring_fd(-1), accepted(0), handler(nullptr), serial(0),
+      metrics(nullptr), timeouts(options), stopDeadline(0), draining(false),
+      sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr), sqEntries(0), sqes(nullptr), toSubmit(0),
+      cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr),
+      sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0), sqesSize(0),
+      bufRing(nullptr), bufBase(nullptr), bufRingSize(0), bufTail(0) {}
+
+bool UringReactor::setupRing()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = SETUP_FLAGS;
+    params.cq_entries = CQ_ENTRIES;
+
+    ring_fd = uringSetup(SQ_ENTRIES, &params);
+    if (ring_fd < 0)
+    {
+        LOG_ERROR("io_uring_setup_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring_mmap_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+    if (single)
+    {
+        cqRing = sqRing;
+    }
+    else
+    {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+        {
+            LOG_ERROR("io_uring_mmap_failed", LogField("error", strerror(errno)));
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqeMap == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring_mmap_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe *>(sqeMap);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Register a provided buffer ring: the kernel picks a free buffer for each
+// recv completion, so idle connections pin no receive memory at all.
+bool UringReactor::setupBuffers()
+{
+    bufRingSize = BUF_COUNT * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring_mmap_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+    bufRing = static_cast<struct io_uring_buf_ring *>(ring);
+    bufBase = new char[(size_t)BUF_COUNT * BUF_SIZE];
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (uringRegister(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOG_ERROR("io_uring_register_failed", LogField("error", strerror(errno)));
+        return false;
+    }
+
+    for (unsigned i = 0; i < BUF_COUNT; i++)
+        returnBuffer((unsigned short)i);
+    return true;
+}
+
+bool UringReactor::open(const sockaddr_in &address, int listener)
+{
+    listen_fd = listener >= 0 ? listener : openListener(address, options);
+    if (listen_fd < 0)
+        return false;
+
+    return setupRing() && setupBuffers() && queue.open();
+}
+
+// Next free SQE, already counted for the next submit. The kernel reads the
+// queue only inside io_uring_enter(), so publishing the tail before the
+// caller fills the entry is safe.
+struct io_uring_sqe *UringReactor::getSqe()
+{
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+    {
+        submit(0);
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+            return nullptr;
+    }
+
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    return sqe;
+}
+
+// One syscall submits everything queued and, with `waitFor`, blocks for
+// that many completions, or until `timeoutMs` passes (EXT_ARG, 5.11+, so
+// the wait needs no timeout SQE).
+int UringReactor::submit(unsigned waitFor, bool reap, int timeoutMs)
+{
+    unsigned flags = waitFor || reap ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    int ret;
+    if (waitFor != 0 && timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        ret = uringEnter(ring_fd, toSubmit, waitFor, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    else
+    {
+        ret = uringEnter(ring_fd, toSubmit, waitFor, flags);
+    }
+    if (ret < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME)
+            LOG_ERROR("io_uring_enter_failed", LogField("error", strerror(errno)));
+        return -1;
+    }
+    toSubmit -= min((unsigned)ret, toSubmit);
+    return ret;
+}
+
+void UringReactor::returnBuffer(unsigned short bid)
+{
+    // not bufRing->bufs: the uapi flexible array sits behind an empty struct,
+    // which has size 1 in C++ and shifts it by 8 bytes
+    struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(bufRing) + (bufTail & (BUF_COUNT - 1));
+    buf->addr = (uint64_t)(uintptr_t)(bufBase + (size_t)bid * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = bid;
+    bufTail++;
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+}
+
+void UringReactor::armAccept()
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_ERROR("io_uring_sq_full", LogField("op", "accept"));
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData(listen_fd, OpAccept);
+}
+
+// multishot poll on the ReactorQueue eventfd
+void UringReactor::armWake()
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_ERROR("io_uring_sq_full", LogField("op", "wake"));
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = queue.fd();
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = userData(queue.fd(), OpWake);
+}
+
+void UringReactor::armRecv(UringConnection &conn)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+    {
+        kill(conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = userData(conn.socket, OpRecv);
+    conn.recvArmed = true;
+}
+
+void UringReactor::cancelRecv(UringConnection &conn)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+        return; // the shutdown() in kill() ends it anyway
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData(conn.socket, OpRecv);
+    sqe->user_data = userData(conn.socket, OpCancel);
+}
+
+void UringReactor::dispatch(UringConnection &conn)
+{
+    if (conn.input.empty() || conn.stopped || conn.readingPaused())
+        return;
+
+    size_t used = handler->onData(conn, conn.input.data(), conn.input.size());
+    consumeInput(conn.input, used);
+    conn.deadline.consumed |= used != 0;
+}
+
+// The recv ends with -ECANCELED; completions already on their way only add
+// to the pending input.
+void UringReactor::throttle(UringConnection &conn)
+{
+    if (!backlogged(conn, options.maxQueuedBytes) || !conn.recvArmed || conn.throttled)
+        return;
+    cancelRecv(conn);
+    conn.throttled = true;
+    metrics->add(MetricCounter::ReadPauses);
+}
+
+void UringReactor::handleAccept(const struct io_uring_cqe &cqe)
+{
+    // the multishot accept stops on errors; put it back
+    if (!(cqe.flags & IORING_CQE_F_MORE) && !draining)
+        armAccept();
+
+    if (cqe.res < 0)
+    {
+        if (cqe.res != -EAGAIN && cqe.res != -ECONNABORTED && cqe.res != -EINTR && cqe.res != -ECANCELED)
+            LOG_WARN("accept_failed", LogField("error", strerror(-cqe.res)));
+        return;
+    }
+
+    int client_socket = cqe.res;
+    UringConnection *conn =
+        connectionPool.create(client_socket, makeConnectionId(++serial, client_socket), queue);
+    connections.insert(client_socket, conn);
+    accepted.fetch_add(1, std::memory_order_relaxed);
+    metrics->add(MetricCounter::Accepts);
+    metrics->add(MetricGauge::OpenConnections, 1);
+    LOG_DEBUG("connected", LogField("fd", client_socket), LogField("reactor", id));
+
+    handler->onConnect(*conn);
+    // accepted while the cancel was in flight
+    if (draining)
+        conn->drain();
+    timeouts.update(conn->deadline, conn->connectionId, false, false, false);
+    armRecv(*conn);
+}
+
+// Hand the handler everything received so far. When nothing is left over
+// from earlier reads it sees the ring buffer itself, and only what it does
+// not consume is copied out.
+void UringReactor::handleRecv(UringConnection &conn, const struct io_uring_cqe &cqe)
+{
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        conn.recvArmed = false;
+
+    metrics->add(MetricCounter::RecvCalls);
+    if (cqe.res > 0)
+        metrics->add(MetricCounter::BytesIn, cqe.res);
+
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = (unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe.res > 0 && !conn.dead && !conn.stopped)
+            deliverInput(*handler, conn, bufBase + (size_t)bid * BUF_SIZE, (size_t)cqe.res);
+        returnBuffer(bid);
+    }
+    if (!conn.recvArmed)
+        conn.throttled = false;
+
+    if (conn.dead)
+    {
+        release(conn);
+        return;
+    }
+
+    if (cqe.res == 0)
+    {
+        // serve what came with the FIN, then close once it is written
+        LOG_DEBUG("disconnected", LogField("fd", conn.socket));
+        conn.closing = true;
+    }
+    else if (cqe.res == -ENOBUFS)
+    {
+        // every ring buffer was in use; buffers are back once this batch
+        // of completions is handled
+        starved.push_back(conn.socket);
+        return;
+    }
+    else if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED)
+    {
+        LOG_WARN("recv_failed", LogField("fd", conn.socket), LogField("error", strerror(-cqe.res)));
+        kill(conn);
+        return;
+    }
+    else if (!conn.recvArmed && !conn.readingPaused())
+    {
+        // also after a pause whose cancel landed once reading had resumed
+        armRecv(conn);
+    }
+
+    throttle(conn);
+    flush(conn);
+}
+
+// Queue the next write unless one is in flight: memory chunks go out as one
+// sendmsg() over up to IOV_BATCH iovecs, file slices with a non-blocking
+// sendfile() from the loop (io_uring has no sendfile), waiting for POLLOUT
+// when the socket is full. Closes once everything is written after close(),
+// otherwise re-aims the connection's timer at what it waits on now.
+void UringReactor::flush(UringConnection &conn)
+{
+    if (conn.dead)
+        return;
+
+    OutputBuffer &out = conn.output;
+    if (out.empty() && conn.awaitingWritable() && !conn.stopped)
+    {
+        // everything is written: the producer's next window
+        conn.cancelAwaitWritable();
+        handler->onWritable(conn);
+        dispatch(conn);
+        throttle(conn);
+    }
+    if (out.empty() && conn.readingPaused())
+    {
+        // everything is written: take the pending input again and read on
+        conn.resumeReading();
+        dispatch(conn);
+        throttle(conn);
+        if (!conn.readingPaused() && !conn.recvArmed && !conn.closing)
+            armRecv(conn);
+    }
+
+    while (!conn.writing && !out.empty())
+    {
+        uint64_t offset;
+        size_t length;
+        const FileHandle *file = out.frontFile(offset, length);
+        if (file != nullptr)
+        {
+            off_t position = offset;
+            ssize_t bytesSent = sendfile(conn.socket, file->fd(), &position, length);
+            metrics->add(MetricCounter::SendCalls);
+            if (bytesSent > 0)
+            {
+                out.consume(bytesSent);
+                conn.deadline.sent = true;
+                metrics->add(MetricCounter::BytesOut, bytesSent);
+                if ((size_t)bytesSent < length)
+                    metrics->add(MetricCounter::PartialWrites);
+                continue;
+            }
+            if (bytesSent == -1 && errno == EINTR)
+                continue;
+            if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                struct io_uring_sqe *sqe = getSqe();
+                if (sqe == nullptr)
+                    break;
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = conn.socket;
+                sqe->poll32_events = POLLOUT;
+                sqe->user_data = userData(conn.socket, OpPoll);
+                conn.writing = true;
+                metrics->add(MetricCounter::WriteArms);
+                break;
+            }
+            if (bytesSent == 0)
+                LOG_WARN("sendfile_eof", LogField("fd", conn.socket));
+            else
+                LOG_WARN("send_failed", LogField("fd", conn.socket), LogField("error", strerror(errno)));
+            kill(conn);
+            return;
+        }
+
+        struct io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+            break;
+        SendBatch *batch = sendBatches.create();
+        memset(&batch->msg, 0, sizeof(batch->msg));
+        batch->msg.msg_iov = batch->iov;
+        batch->msg.msg_iovlen = out.gather(batch->iov, SendBatch::IOV_BATCH, conn.sendBytes);
+        conn.batch = batch;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn.socket;
+        sqe->addr = (uint64_t)(uintptr_t)&batch->msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData(conn.socket, OpSend);
+        // the kernel reads the gathered chunks until the completion arrives
+        out.seal();
+        conn.writing = true;
+    }
+
+    if (out.empty() && conn.closing && !conn.held())
+    {
+        kill(conn);
+        return;
+    }
+    timeouts.update(conn.deadline, conn.connectionId, !out.empty(), conn.held(), !conn.input.empty());
+}
+
+// Run what other threads handed back, then offer each connection they
+// touched its pending input again and flush it, once. Tasks for connections
+// closed in the meantime are dropped.
+void UringReactor::runPosted()
+{
+    std::vector<ReactorQueue::Task> tasks;
+    queue.take(tasks);
+    metrics->add(MetricCounter::PostedTasks, tasks.size());
+
+    std::vector<uint64_t> touched;
+    for (auto &task : tasks)
+    {
+        UringConnection *found = connections.find(connectionFd(task.connection));
+        if (found == nullptr || found->connectionId != task.connection || found->dead)
+            continue;
+        UringConnection &conn = *found;
+
+        conn.releaseHold();
+        task.run(conn);
+        if (!conn.posted)
+        {
+            conn.posted = true;
+            touched.push_back(conn.connectionId);
+        }
+    }
+
+    // every task of a connection has run: one dispatch and one sendmsg for
+    // all of them
+    for (uint64_t connection : touched)
+    {
+        UringConnection *found = connections.find(connectionFd(connection));
+        if (found == nullptr || found->connectionId != connection || found->dead)
+            continue;
+        UringConnection &conn = *found;
+
+        conn.posted = false;
+        dispatch(conn);
+        throttle(conn);
+        flush(conn);
+    }
+}
+
+void UringReactor::handleSend(UringConnection &conn, int op, int res)
+{
+    conn.writing = false;
+    sendBatches.destroy(conn.batch);
+    conn.batch = nullptr;
+    if (conn.dead)
+    {
+        release(conn);
+        return;
+    }
+
+    if (op == OpSend)
+        metrics->add(MetricCounter::SendCalls);
+    if (op == OpSend && res > 0)
+    {
+        conn.output.consume(res);
+        conn.deadline.sent = true;
+        metrics->add(MetricCounter::BytesOut, res);
+        if ((size_t)res < conn.sendBytes)
+            metrics->add(MetricCounter::PartialWrites);
+    }
+    else if (res < 0 && res != -EAGAIN && res != -EINTR)
+    {
+        LOG_WARN("send_failed", LogField("fd", conn.socket), LogField("error", strerror(-res)));
+        kill(conn);
+        return;
+    }
+    flush(conn);
+}
+
+// Close for good: the handler is told now, the socket is shut down so any
+// recv or send still in flight completes, and the descriptor and state are
+// freed by release() once they have.
+void UringReactor::kill(UringConnection &conn)
+{
+    if (conn.dead)
+        return;
+    conn.dead = true;
+    handler->onClose(conn);
+    timeouts.cancel(conn.deadline);
+    metrics->add(MetricCounter::Closes);
+    metrics->add(MetricGauge::OpenConnections, -1);
+    shutdown(conn.socket, SHUT_RDWR);
+    if (conn.recvArmed)
+        cancelRecv(conn);
+    release(conn);
+}
+
+void UringReactor::release(UringConnection &conn)
+{
+    if (!conn.dead || conn.recvArmed || conn.writing)
+        return;
+    close(conn.socket);
+    connections.remove(conn.socket);
+    connectionPool.destroy(&conn);
+}
+
+// A timer ran out: close the connection it belongs to, unless that closed
+// already and the fd was reused.
+void UringReactor::expire(uint64_t id)
+{
+    UringConnection *conn = connections.find(connectionFd(id));
+    if (conn == nullptr || conn->connectionId != id || conn->dead)
+        return;
+
+    LOG_DEBUG("timeout", LogField("fd", conn->socket), LogField("kind", (int)conn->deadline.kind));
+    metrics->add(MetricCounter::Timeouts);
+    if (conn->deadline.kind == Timeout::Write)
+        resetOnClose(conn->socket);
+    kill(*conn);
+}
+
+void UringReactor::stop(uint64_t deadlineNanos)
+{
+    uint64_t serving = 0;
+    stopDeadline.compare_exchange_strong(serving, deadlineNanos != 0 ? deadlineNanos : 1);
+    queue.wake();
+}
+
+// As LinReactor::drain(): cancel the multishot accept, mark every
+// connection draining and kill whatever is left at the deadline. Killed
+// connections stay in the table until their last operation completes.
+bool UringReactor::drain()
+{
+    if (!draining)
+    {
+        draining = true;
+        struct io_uring_sqe *sqe = getSqe();
+        if (sqe != nullptr)
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = userData(listen_fd, OpAccept);
+            sqe->user_data = userData(listen_fd, OpCancel);
+        }
+        // the cancel only needs the user_data; the kernel drops its
+        // reference to the socket when the accept completes
+        close(listen_fd);
+        listen_fd = -1;
+        LOG_INFO("draining", LogField("reactor", id), LogField("connections", connections.size()));
+
+        timeouts.drain();
+        connections.forEach([this](UringConnection *conn) {
+            conn->drain();
+            if (!conn->dead)
+                timeouts.update(conn->deadline, conn->connectionId, !conn->output.empty(), conn->held(),
+                                !conn->input.empty(), true);
+        });
+    }
+
+    if (connections.size() != 0 && monotonicNanos() >= stopDeadline.load(std::memory_order_relaxed))
+    {
+        std::vector<UringConnection *> left;
+        connections.forEach([&left](UringConnection *conn) {
+            if (!conn->dead) left.push_back(conn);
+        });
+        if (!left.empty())
+            LOG_WARN("drain_deadline", LogField("reactor", id), LogField("connections", left.size()));
+        for (UringConnection *conn : left)
+            kill(*conn);
+    }
+    return connections.size() == 0;
+}
+
+void UringReactor::run()
+{
+    if (uringRegister(ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0)
+    {
+        LOG_ERROR("io_uring_enable_failed", LogField("error", strerror(errno)));
+        return;
+    }
+    Metrics::nameThread("reactor" + std::to_string(id));
+    metrics = &Metrics::local();
+    armAccept();
+    armWake();
+
+    const uint64_t busyPollNanos = (uint64_t)options.busyPollMicros * 1000;
+    uint64_t lastActive = 0;
+
+    while (true)
+    {
+        if (stopDeadline.load(std::memory_order_relaxed) != 0 && drain())
+            break;
+
+        // busy polling still enters the kernel: with DEFER_TASKRUN
+        // completions are only posted from io_uring_enter(GETEVENTS). A
+        // blocking wait ends at the next connection timer (or drain
+        // deadline)
+        bool spin = busyPollNanos != 0 && monotonicNanos() - lastActive < busyPollNanos;
+        int timerWait = timeouts.nextTimeout();
+        uint64_t now = monotonicNanos(), deadline = stopDeadline.load(std::memory_order_relaxed);
+        if (draining && deadline > now)
+        {
+            int left = (int)((deadline - now + 999999) / 1000000);
+            if (timerWait < 0 || left < timerWait)
+                timerWait = left;
+        }
+        submit(spin ? 0 : 1, spin, timerWait);
+        timeouts.advance([this](uint64_t connection) { expire(connection); });
+
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            // a busy poll that found nothing, or a timer wakeup
+            if (spin)
+                metrics->add(MetricCounter::IdlePolls);
+            continue;
+        }
+        if (busyPollNanos != 0)
+            lastActive = monotonicNanos();
+        metrics->add(MetricCounter::Wakeups);
+        metrics->add(MetricCounter::Events, tail - head);
+        metrics->record(MetricHistogram::EventsPerWait, tail - head);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe cqe = cqes[head & *cqMask];
+            int op = (int)(cqe.user_data & 0xff);
+            int fd = (int)(cqe.user_data >> 8);
+
+            if (op == OpAccept)
+            {
+                handleAccept(cqe);
+                continue;
+            }
+            if (op == OpCancel)
+                continue;
+            if (op == OpWake)
+            {
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    armWake();
+                runPosted();
+                continue;
+            }
+
+            UringConnection *conn = connections.find(fd);
+            if (conn == nullptr)
+            {
+                if (cqe.flags & IORING_CQE_F_BUFFER)
+                    returnBuffer((unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                continue;
+            }
+
+            if (op == OpRecv)
+                handleRecv(*conn, cqe);
+            else
+                handleSend(*conn, op, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        // recvs that ran out of buffers go back now that they are returned
+        for (int fd : starved)
+        {
+            UringConnection *conn = connections.find(fd);
+            if (conn != nullptr && !conn->dead && !conn->recvArmed && !conn->readingPaused())
+                armRecv(*conn);
+        }
+        starved.clear();
+    }
+}
+
+UringReactor::~UringReactor()
+{
+    connections.forEach([this](UringConnection *conn) {
+        close(conn->socket);
+        connectionPool.destroy(conn);
+    });
+    if (listen_fd != -1) close(listen_fd);
+    if (sqes != nullptr) munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (ring_fd != -1) close(ring_fd);
+    // the ring is gone, the kernel no longer references the buffers
+    if (bufRing != nullptr) munmap(bufRing, bufRingSize);
+    delete[] bufBase;
+}
@@ -0,0 +1,164 @@
+#ifndef LINURING_H
+#define LINURING_H
+
+#include "reactor.h"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+// what an in-flight sendmsg points the kernel at
+struct SendBatch
+{
+    static const size_t IOV_BATCH = 64;
+
+    struct msghdr msg;
+    struct iovec iov[IOV_BATCH];
+};
+
+class UringConnection : public TCPConnection
+{
+public:
+
+    UringConnection(int fd, uint64_t id, ReactorQueue &queue) : socket(fd), connectionId(id), queue(queue) {}
+
+    int fd() const override { return socket; }
+    uint64_t id() const override { return connectionId; }
+    CompletionQueue &completions() override { return queue; }
+    // asked of the socket the first time: the multishot accept has nowhere
+    // to put one address per connection
+    uint32_t peerAddress() override;
+    void send(const char *data, size_t len) override { output.append(data, len); }
+    void send(std::string &&data) override { output.append(std::move(data)); }
+    void send(const std::shared_ptr<const std::string> &data) override { output.append(data); }
+    char *prepareSend(size_t maxLen) override { return output.prepare(maxLen); }
+    void commitSend(char *end) override { output.commit(end); }
+    void sendFile(const std::shared_ptr<FileHandle> &file, uint64_t offset, size_t length) override
+    {
+        output.appendFile(file, offset, length);
+    }
+    void close() override { closing = stopped = true; }
+
+    int socket;
+    OutputBuffer output;
+    std::string input;        // received bytes the handler has not consumed
+    bool closing = false;     // close once output drains
+    bool stopped = false;     // close() was called: no more onData()
+    bool posted = false;      // has tasks in the runPosted() batch being run
+    bool dead = false;        // shut down; freed when no operation is in flight
+    bool recvArmed = false;   // a multishot recv is active
+    bool throttled = false;   // its cancel is queued because reading paused
+    bool writing = false;     // a sendmsg or POLLOUT wait is in flight
+    size_t sendBytes = 0;     // bytes the in-flight sendmsg covers
+    // the in-flight sendmsg's header and iovecs (into `output`), taken from
+    // the reactor's pool only while it is in flight
+    SendBatch *batch = nullptr;
+    uint32_t peer = 0;
+    bool peerKnown = false;
+    Deadline deadline;
+    uint64_t connectionId;
+    ReactorQueue &queue;
+};
+
+// Completion-based reactor on io_uring: one multishot accept, a multishot
+// recv per connection filling buffers from a provided buffer ring, and
+// sendmsg submissions, all queued while completions are handled and
+// submitted together by the single io_uring_enter() that also waits for the
+// next batch.
+class UringReactor : public Reactor
+{
+public:
+    // whether this kernel has everything the reactor uses (io_uring with
+    // multishot accept/recv and buffer rings); otherwise use epoll
+    static bool supported();
+
+    UringReactor(int id, const ServerOptions &options);
+    // false when the listener or the ring cannot be set up
+    bool open(const sockaddr_in &address, int listener = -1) override;
+    void setHandler(ConnectionHandler *handler) override { this->handler = handler; }
+    void run() override;
+    void stop(uint64_t deadlineNanos) override;
+    int listener() const override { return listen_fd; }
+    unsigned long long acceptedConnections() const override { return accepted.load(std::memory_order_relaxed); }
+    ~UringReactor() override;
+
+private:
+    // completion kinds, kept in the low byte of user_data above the fd
+    enum Op
+    {
+        OpAccept = 1,
+        OpRecv,
+        OpSend,
+        OpPoll,
+        OpCancel,
+        OpWake // the ReactorQueue eventfd became readable
+    };
+
+    int id;
+    ServerOptions options;
+    int listen_fd;
+    int ring_fd;
+    std::atomic<unsigned long long> accepted;
+    ConnectionHandler *handler;
+    ConnectionTable<UringConnection> connections;
+    SlabPool<UringConnection> connectionPool;
+    SlabPool<SendBatch> sendBatches;
+    std::vector<int> starved; // recvs stopped by -ENOBUFS, re-armed after the batch
+    ReactorQueue queue;
+    uint32_t serial; // connection ids handed out so far
+    ThreadMetrics *metrics; // the reactor thread's block, set by run()
+    ConnectionTimeouts timeouts;
+
+    // set by stop(): when the drain must end; 0 while serving
+    std::atomic<uint64_t> stopDeadline;
+    bool draining; // the accept is cancelled; idle connections time out early
+
+    // submission queue
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned sqEntries;
+    struct io_uring_sqe *sqes;
+    unsigned toSubmit; // SQEs queued since the last io_uring_enter()
+
+    // completion queue
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+
+    // provided buffer ring the multishot recvs fill
+    struct io_uring_buf_ring *bufRing;
+    char *bufBase;
+    size_t bufRingSize;
+    unsigned short bufTail;
+
+    bool setupRing();
+    bool setupBuffers();
+    struct io_uring_sqe *getSqe();
+    // reap: run deferred completions even when not waiting for any;
+    // timeoutMs: stop waiting after this long, -1 for no limit
+    int submit(unsigned waitFor, bool reap = false, int timeoutMs = -1);
+    void returnBuffer(unsigned short bid);
+
+    void armAccept();
+    void armWake();
+    void runPosted();
+    void armRecv(UringConnection &conn);
+    void cancelRecv(UringConnection &conn);
+    // offer the pending input to the handler again
+    void dispatch(UringConnection &conn);
+    // cancel the recv of a connection whose reading is paused
+    void throttle(UringConnection &conn);
+
+    void handleAccept(const struct io_uring_cqe &cqe);
+    void handleRecv(UringConnection &conn, const struct io_uring_cqe &cqe);
+    void handleSend(UringConnection &conn, int op, int res);
+    void flush(UringConnection &conn);
+    void kill(UringConnection &conn);
+    void release(UringConnection &conn);
+    void expire(uint64_t id);
+    // one drain step; true once every connection has been released
+    bool drain();
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include "log.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<LogLevel> Logger::threshold(LogLevel::Info);
+
+namespace
+{
+
+const size_t MAX_FIELDS = 8;
+const size_t TEXT_SIZE = 160; // string values of one record, truncated beyond
+const size_t RING_SIZE = 512; // records per logging thread
+
+struct LogRecord
+{
+    long long nanos; // since the epoch
+    LogLevel level;
+    unsigned char count;
+    const char *event;
+    LogField fields[MAX_FIELDS];
+    char text[TEXT_SIZE]; // string field values point in here
+};
+
+// single producer (the owning thread), single consumer (the writer)
+struct LogRing
+{
+    LogRecord records[RING_SIZE];
+    std::atomic<size_t> head{0}; // next record the writer formats
+    std::atomic<size_t> tail{0}; // next slot the owner fills
+    std::atomic<bool> orphaned{false};
+};
+
+class LogWriter
+{
+public:
+    LogWriter() : format(LogFormat::KeyValue), out(stderr), stopping(false), droppedRecords(0), reportedDrops(0)
+    {
+        worker = std::thread(&LogWriter::run, this);
+    }
+
+    ~LogWriter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    std::shared_ptr<LogRing> addRing()
+    {
+        std::shared_ptr<LogRing> ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> guard(lock);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void flush()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        unsigned long long target = ++flushRequested;
+        wake.notify_one();
+        flushed.wait(guard, [&] { return flushDone >= target || stopping; });
+    }
+
+    std::atomic<LogFormat> format;
+    std::atomic<FILE *> out;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned long long> droppedRecords;
+
+private:
+    std::mutex lock;
+    std::condition_variable wake, flushed;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    unsigned long long flushRequested = 0, flushDone = 0;
+    unsigned long long reportedDrops; // writer thread only
+    std::thread worker;
+
+    void run()
+    {
+        std::vector<std::shared_ptr<LogRing>> snapshot;
+        while (true)
+        {
+            bool stop;
+            unsigned long long requested;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                // producers never signal: polling keeps log() syscall-free
+                wake.wait_for(guard, std::chrono::milliseconds(20),
+                              [&] { return stopping.load() || flushRequested != flushDone; });
+                stop = stopping;
+                requested = flushRequested;
+                snapshot = rings;
+            }
+
+            drain(snapshot);
+
+            std::lock_guard<std::mutex> guard(lock);
+            // forget rings whose thread has exited once they are empty
+            for (size_t i = 0; i < rings.size();)
+            {
+                LogRing &ring = *rings[i];
+                if (ring.orphaned && ring.head.load() == ring.tail.load())
+                {
+                    rings[i] = rings.back();
+                    rings.pop_back();
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            flushDone = requested;
+            flushed.notify_all();
+            if (stop)
+                return;
+        }
+    }
+
+    void drain(const std::vector<std::shared_ptr<LogRing>> &snapshot)
+    {
+        std::string batch;
+        for (const auto &ring : snapshot)
+        {
+            size_t head = ring->head.load(std::memory_order_relaxed);
+            size_t tail = ring->tail.load(std::memory_order_acquire);
+            for (; head != tail; head++)
+                formatRecord(ring->records[head % RING_SIZE], batch);
+            ring->head.store(head, std::memory_order_release);
+        }
+
+        unsigned long long drops = droppedRecords.load(std::memory_order_relaxed);
+        if (drops != reportedDrops)
+        {
+            unsigned long long lost = drops - reportedDrops;
+            reportedDrops = drops;
+            LogRecord record;
+            record.nanos = now();
+            record.level = LogLevel::Warn;
+            record.event = "log_records_dropped";
+            record.count = 1;
+            record.fields[0] = LogField("count", lost);
+            formatRecord(record, batch);
+        }
+
+        if (!batch.empty())
+        {
+            FILE *stream = out.load();
+            fwrite(batch.data(), 1, batch.size(), stream);
+            fflush(stream);
+        }
+    }
+
+    static const char *levelName(LogLevel level)
+    {
+        switch (level)
+        {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warn: return "warn";
+        case LogLevel::Error: return "error";
+        default: return "off";
+        }
+    }
+
+    static void appendTime(long long nanos, std::string &out)
+    {
+        time_t seconds = (time_t)(nanos / 1000000000);
+        struct tm tm;
+#ifdef _WIN32
+        gmtime_s(&tm, &seconds);
+#else
+        gmtime_r(&seconds, &tm);
+#endif
+        char buf[40];
+        size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+        n += snprintf(buf + n, sizeof(buf) - n, ".%06dZ", (int)(nanos % 1000000000 / 1000));
+        out.append(buf, n);
+    }
+
+    static bool needsQuotes(const char *s, size_t len)
+    {
+        if (len == 0) return true;
+        for (size_t i = 0; i < len; i++)
+        {
+            unsigned char c = s[i];
+            if (c <= ' ' || c == '"' || c == '=' || c == '\\' || c >= 0x7f) return true;
+        }
+        return false;
+    }
+
+    static void appendQuoted(const char *s, size_t len, std::string &out)
+    {
+        out += '"';
+        for (size_t i = 0; i < len; i++)
+        {
+            unsigned char c = s[i];
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += (char)c;
+            }
+            else if (c == '\n')
+            {
+                out += "\\n";
+            }
+            else if (c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out += (char)c;
+            }
+        }
+        out += '"';
+    }
+
+    static void appendValue(const LogField &field, bool json, std::string &out)
+    {
+        char buf[32];
+        switch (field.type)
+        {
+        case LogField::Int:
+            out.append(buf, snprintf(buf, sizeof(buf), "%lld", field.i));
+            break;
+        case LogField::Uint:
+            out.append(buf, snprintf(buf, sizeof(buf), "%llu", field.u));
+            break;
+        case LogField::Float:
+            out.append(buf, snprintf(buf, sizeof(buf), "%g", field.f));
+            break;
+        case LogField::Bool:
+            out += field.b ? "true" : "false";
+            break;
+        case LogField::Str:
+            if (json || needsQuotes(field.s.ptr, field.s.len))
+                appendQuoted(field.s.ptr, field.s.len, out);
+            else
+                out.append(field.s.ptr, field.s.len);
+            break;
+        }
+    }
+
+    void formatRecord(const LogRecord &record, std::string &out)
+    {
+        if (format.load(std::memory_order_relaxed) == LogFormat::Json)
+        {
+            out += "{\"ts\":\"";
+            appendTime(record.nanos, out);
+            out += "\",\"level\":\"";
+            out += levelName(record.level);
+            out += "\",\"event\":";
+            appendQuoted(record.event, strlen(record.event), out);
+            for (unsigned i = 0; i < record.count; i++)
+            {
+                out += ",\"";
+                out += record.fields[i].key;
+                out += "\":";
+                appendValue(record.fields[i], true, out);
+            }
+            out += "}\n";
+        }
+        else
+        {
+            out += "ts=";
+            appendTime(record.nanos, out);
+            out += " level=";
+            out += levelName(record.level);
+            out += " event=";
+            out += record.event;
+            for (unsigned i = 0; i < record.count; i++)
+            {
+                out += ' ';
+                out += record.fields[i].key;
+                out += '=';
+                appendValue(record.fields[i], false, out);
+            }
+            out += '\n';
+        }
+    }
+
+public:
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+};
+
+LogWriter &writer()
+{
+    static LogWriter instance;
+    return instance;
+}
+
+// the calling thread's ring, registered on first use
+struct ThreadRing
+{
+    std::shared_ptr<LogRing> ring;
+    ThreadRing() : ring(writer().addRing()) {}
+    ~ThreadRing() { ring->orphaned = true; }
+};
+
+LogRing &threadRing()
+{
+    static thread_local ThreadRing local;
+    return *local.ring;
+}
+
+} // namespace
+
+void Logger::setFormat(LogFormat format)
+{
+    writer().format = format;
+}
+
+void Logger::setOutput(FILE *out)
+{
+    writer().out = out;
+}
+
+void Logger::log(LogLevel level, const char *event, std::initializer_list<LogField> fields)
+{
+    LogRing &ring = threadRing();
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail - ring.head.load(std::memory_order_acquire) == RING_SIZE)
+    {
+        writer().droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord &record = ring.records[tail % RING_SIZE];
+    record.nanos = LogWriter::now();
+    record.level = level;
+    record.event = event;
+    record.count = 0;
+
+    size_t used = 0;
+    for (const LogField &field : fields)
+    {
+        if (record.count == MAX_FIELDS)
+            break;
+        LogField &copy = record.fields[record.count++];
+        copy = field;
+        if (field.type == LogField::Str)
+        {
+            size_t len = field.s.len < TEXT_SIZE - used ? field.s.len : TEXT_SIZE - used;
+            memcpy(record.text + used, field.s.ptr, len);
+            copy.s.ptr = record.text + used;
+            copy.s.len = len;
+            used += len;
+        }
+    }
+
+    ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+void Logger::flush()
+{
+    writer().flush();
+}
+
+unsigned long long Logger::dropped()
+{
+    return writer().droppedRecords.load(std::memory_order_relaxed);
+}
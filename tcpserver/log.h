@@ -0,0 +1,123 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+
+enum class LogLevel : unsigned char
+{
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+enum class LogFormat
+{
+    KeyValue, // ts=... level=info event=listening port=8080
+    Json      // {"ts":"...","level":"info","event":"listening","port":8080}
+};
+
+// One key/value pair of a log line. Keys must be string literals; string
+// values are copied into the record, so temporaries are fine.
+struct LogField
+{
+    enum Type : unsigned char
+    {
+        Int,
+        Uint,
+        Float,
+        Bool,
+        Str
+    };
+
+    const char *key;
+    Type type;
+    union
+    {
+        long long i;
+        unsigned long long u;
+        double f;
+        bool b;
+        struct
+        {
+            const char *ptr;
+            size_t len;
+        } s;
+    };
+
+    LogField() : key(""), type(Int) { i = 0; }
+    LogField(const char *key, int v) : key(key), type(Int) { i = v; }
+    LogField(const char *key, long v) : key(key), type(Int) { i = v; }
+    LogField(const char *key, long long v) : key(key), type(Int) { i = v; }
+    LogField(const char *key, unsigned v) : key(key), type(Uint) { u = v; }
+    LogField(const char *key, unsigned long v) : key(key), type(Uint) { u = v; }
+    LogField(const char *key, unsigned long long v) : key(key), type(Uint) { u = v; }
+    LogField(const char *key, double v) : key(key), type(Float) { f = v; }
+    LogField(const char *key, bool v) : key(key), type(Bool) { b = v; }
+    LogField(const char *key, const char *v) : key(key), type(Str) { s.ptr = v ? v : ""; s.len = std::char_traits<char>::length(s.ptr); }
+    LogField(const char *key, const char *v, size_t len) : key(key), type(Str) { s.ptr = v; s.len = len; }
+    LogField(const char *key, const std::string &v) : key(key), type(Str) { s.ptr = v.data(); s.len = v.size(); }
+};
+
+// Asynchronous structured logger.
+//
+// Each logging thread owns a lock-free single-producer ring of fixed-size
+// records; log() only copies the fields into the next slot, so it neither
+// allocates nor makes a syscall (the timestamp comes from the vDSO). A
+// background thread drains every ring, formats the lines and writes them in
+// batches. When a ring is full the record is dropped and counted, the
+// caller never waits.
+class Logger
+{
+public:
+    static void setLevel(LogLevel level) { threshold.store(level, std::memory_order_relaxed); }
+    static LogLevel level() { return threshold.load(std::memory_order_relaxed); }
+    static bool enabled(LogLevel level) { return level >= threshold.load(std::memory_order_relaxed); }
+
+    // takes effect from the next batch the writer drains
+    static void setFormat(LogFormat format);
+    // default stderr; the stream is only touched by the writer thread
+    static void setOutput(FILE *out);
+
+    static void log(LogLevel level, const char *event, std::initializer_list<LogField> fields);
+
+    // write out everything logged so far before returning
+    static void flush();
+    // records lost to full rings
+    static unsigned long long dropped();
+
+private:
+    static std::atomic<LogLevel> threshold;
+};
+
+// Debug logs compile to nothing unless LOG_MIN_LEVEL is 0 (the default in
+// Debug builds); the other levels are filtered at runtime by setLevel().
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+#define LOG_AT(lvl, event, ...)                          \
+    do                                                   \
+    {                                                    \
+        if (Logger::enabled(lvl))                        \
+            Logger::log(lvl, event, {__VA_ARGS__});      \
+    } while (0)
+
+#if LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(event, ...) LOG_AT(LogLevel::Debug, event, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(event, ...) \
+    do                        \
+    {                         \
+    } while (0)
+#endif
+#define LOG_INFO(event, ...) LOG_AT(LogLevel::Info, event, ##__VA_ARGS__)
+#define LOG_WARN(event, ...) LOG_AT(LogLevel::Warn, event, ##__VA_ARGS__)
+#define LOG_ERROR(event, ...) LOG_AT(LogLevel::Error, event, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,279 @@
+#include "metrics.h"
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+struct Description
+{
+    const char *name;
+    const char *help;
+};
+
+const Description COUNTERS[] = {
+    {"tcp_accepted_connections_total", "Connections accepted."},
+    {"tcp_closed_connections_total", "Connections closed."},
+    {"tcp_timeouts_total", "Connections closed by an idle, request or write timeout."},
+    {"tcp_received_bytes_total", "Bytes received from clients."},
+    {"tcp_sent_bytes_total", "Bytes sent to clients."},
+    {"tcp_recv_calls_total", "recv() calls or io_uring recv completions."},
+    {"tcp_send_calls_total", "sendmsg()/sendfile() calls or io_uring send completions."},
+    {"tcp_partial_writes_total", "Sends the socket took only part of."},
+    {"tcp_write_arms_total", "Times a full socket made the reactor wait for writability."},
+    {"tcp_read_pauses_total", "Times a connection stopped being read until its queued output was written."},
+    {"reactor_wakeups_total", "epoll_wait() or io_uring_enter() returns."},
+    {"reactor_idle_polls_total", "Busy-poll waits that found nothing."},
+    {"reactor_events_total", "Readiness events or completions handled."},
+    {"reactor_posted_tasks_total", "Tasks run from the completion queue."},
+    {"http_requests_total", "Requests parsed."},
+    {"http_parse_errors_total", "Malformed requests answered with an error."},
+    {"http_shed_requests_total", "Requests answered 503 because the server was over its in-flight or memory limit."},
+    {"http_rate_limited_requests_total", "Requests answered 429 because their client or route was over its rate."},
+    {"http_cache_hits_total", "Requests answered from the response cache."},
+    {"http_cache_misses_total", "Cacheable requests the response cache could not answer."},
+    {"http_cache_evictions_total", "Responses dropped from the cache for its byte budget or their age."},
+    {"http_compressed_responses_total", "Responses sent with a Content-Encoding."},
+    {"http_compression_saved_bytes_total", "Body bytes not sent thanks to compression, streamed bodies excepted."},
+};
+
+struct GaugeDescription
+{
+    const char *name;
+    const char *help;
+    // false for one moved up on one thread and down on another: only the
+    // sum over every thread means anything
+    bool perThread;
+};
+
+const GaugeDescription GAUGES[] = {
+    {"tcp_open_connections", "Connections currently open.", true},
+    {"http_worker_requests", "Requests currently on the worker pool.", false},
+    {"http_cache_bytes", "Bytes held by the response cache.", false},
+};
+
+struct HistogramDescription
+{
+    const char *name;
+    const char *help;
+    double scale; // recorded unit to exposed unit
+};
+
+const HistogramDescription HISTOGRAMS[] = {
+    {"reactor_events_per_wait", "Events or completions per epoll_wait() / io_uring_enter().", 1},
+    {"http_parse_seconds", "Parser time per request.", 1e-9},
+    {"http_handler_seconds", "Handler time per request.", 1e-9},
+    {"http_first_byte_seconds", "First request byte read to response queued for the socket.", 1e-9},
+};
+
+static_assert(sizeof(COUNTERS) / sizeof(COUNTERS[0]) == (size_t)MetricCounter::Count, "describe every counter");
+static_assert(sizeof(GAUGES) / sizeof(GAUGES[0]) == (size_t)MetricGauge::Count, "describe every gauge");
+static_assert(sizeof(HISTOGRAMS) / sizeof(HISTOGRAMS[0]) == (size_t)MetricHistogram::Count,
+              "describe every histogram");
+
+struct Registry
+{
+    std::mutex lock;
+    // blocks outlive their threads so nothing they counted is lost
+    std::vector<std::unique_ptr<ThreadMetrics>> blocks;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ThreadMetrics *addBlock()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.blocks.emplace_back(new ThreadMetrics());
+    return r.blocks.back().get();
+}
+
+void appendHeader(std::string &out, const char *name, const char *help, const char *type)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendNumber(std::string &out, double value)
+{
+    char buf[32];
+    out.append(buf, snprintf(buf, sizeof(buf), "%.9g", value));
+}
+
+void appendInteger(std::string &out, long long value)
+{
+    char buf[24];
+    out.append(buf, snprintf(buf, sizeof(buf), "%lld", value));
+}
+
+} // namespace
+
+ThreadMetrics::ThreadMetrics() : label("other")
+{
+    for (auto &c : counters) c.store(0, std::memory_order_relaxed);
+    for (auto &g : gauges) g.store(0, std::memory_order_relaxed);
+    for (auto &h : histograms)
+    {
+        for (auto &c : h.counts) c.store(0, std::memory_order_relaxed);
+        h.sum.store(0, std::memory_order_relaxed);
+    }
+}
+
+ThreadMetrics &Metrics::local()
+{
+    static thread_local ThreadMetrics *block = addBlock();
+    return *block;
+}
+
+void Metrics::nameThread(const std::string &label)
+{
+    ThreadMetrics &block = local();
+    std::lock_guard<std::mutex> guard(registry().lock);
+    block.label = label;
+}
+
+uint64_t Metrics::nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string Metrics::render()
+{
+    const unsigned COUNTERS_N = (unsigned)MetricCounter::Count;
+    const unsigned GAUGES_N = (unsigned)MetricGauge::Count;
+    const unsigned HISTOGRAMS_N = (unsigned)MetricHistogram::Count;
+
+    std::map<std::string, std::vector<uint64_t>> counters, gauges;
+    std::vector<uint64_t> totals(GAUGES_N);
+    std::vector<uint64_t> buckets(HISTOGRAMS_N * ThreadMetrics::BUCKETS), sums(HISTOGRAMS_N);
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        for (const auto &block : r.blocks)
+        {
+            std::vector<uint64_t> &c = counters[block->label];
+            std::vector<uint64_t> &g = gauges[block->label];
+            c.resize(COUNTERS_N);
+            g.resize(GAUGES_N);
+            for (unsigned i = 0; i < COUNTERS_N; i++) c[i] += block->counters[i].load(std::memory_order_relaxed);
+            for (unsigned i = 0; i < GAUGES_N; i++)
+            {
+                uint64_t value = block->gauges[i].load(std::memory_order_relaxed);
+                g[i] += GAUGES[i].perThread ? value : 0;
+                totals[i] += value;
+            }
+            for (unsigned h = 0; h < HISTOGRAMS_N; h++)
+            {
+                const ThreadMetrics::Buckets &src = block->histograms[h];
+                for (unsigned b = 0; b < ThreadMetrics::BUCKETS; b++)
+                    buckets[h * ThreadMetrics::BUCKETS + b] += src.counts[b].load(std::memory_order_relaxed);
+                sums[h] += src.sum.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // threads that only record histograms (worker pools) add nothing here
+    for (auto it = counters.begin(); it != counters.end();)
+    {
+        const std::vector<uint64_t> &g = gauges[it->first];
+        bool idle = true;
+        for (uint64_t v : it->second) idle = idle && v == 0;
+        for (uint64_t v : g) idle = idle && v == 0;
+        if (idle)
+        {
+            gauges.erase(it->first);
+            it = counters.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    std::string out;
+    out.reserve(16384);
+
+    for (unsigned i = 0; i < COUNTERS_N; i++)
+    {
+        appendHeader(out, COUNTERS[i].name, COUNTERS[i].help, "counter");
+        for (const auto &entry : counters)
+        {
+            out += COUNTERS[i].name;
+            out += "{thread=\"" + entry.first + "\"} ";
+            appendInteger(out, (long long)entry.second[i]);
+            out += '\n';
+        }
+    }
+
+    for (unsigned i = 0; i < GAUGES_N; i++)
+    {
+        appendHeader(out, GAUGES[i].name, GAUGES[i].help, "gauge");
+        if (!GAUGES[i].perThread)
+        {
+            out += GAUGES[i].name;
+            out += ' ';
+            appendInteger(out, (long long)totals[i]);
+            out += '\n';
+            continue;
+        }
+        for (const auto &entry : gauges)
+        {
+            out += GAUGES[i].name;
+            out += "{thread=\"" + entry.first + "\"} ";
+            appendInteger(out, (long long)entry.second[i]);
+            out += '\n';
+        }
+    }
+
+    for (unsigned h = 0; h < HISTOGRAMS_N; h++)
+    {
+        const HistogramDescription &d = HISTOGRAMS[h];
+        appendHeader(out, d.name, d.help, "histogram");
+
+        // the last bucket also holds everything larger, so it is only +Inf
+        uint64_t cumulative = 0;
+        for (unsigned b = 0; b + 1 < ThreadMetrics::BUCKETS; b++)
+        {
+            cumulative += buckets[h * ThreadMetrics::BUCKETS + b];
+            out += d.name;
+            out += "_bucket{le=\"";
+            // bucket b holds values up to 2^b - 1 of the recorded unit
+            appendNumber(out, ((b == 0 ? 0.0 : (double)((1ull << b) - 1))) * d.scale);
+            out += "\"} ";
+            appendInteger(out, (long long)cumulative);
+            out += '\n';
+        }
+        cumulative += buckets[h * ThreadMetrics::BUCKETS + ThreadMetrics::BUCKETS - 1];
+        out += d.name;
+        out += "_bucket{le=\"+Inf\"} ";
+        appendInteger(out, (long long)cumulative);
+        out += '\n';
+
+        out += d.name;
+        out += "_sum ";
+        appendNumber(out, (double)sums[h] * d.scale);
+        out += '\n';
+        out += d.name;
+        out += "_count ";
+        appendInteger(out, (long long)cumulative);
+        out += '\n';
+    }
+    return out;
+}
@@ -0,0 +1,131 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+enum class MetricCounter : unsigned
+{
+    Accepts,       // connections accepted
+    Closes,        // connections closed
+    Timeouts,      // of those, closed by an idle, request or write timeout
+    BytesIn,
+    BytesOut,
+    RecvCalls,     // recv() calls / recv completions
+    SendCalls,     // sendmsg() and sendfile() calls / send completions
+    PartialWrites, // sends the socket took only part of
+    WriteArms,     // EPOLLOUT armed (POLLOUT polls on io_uring) for a full socket
+    ReadPauses,    // connections that stopped being read until their output drained
+    Wakeups,       // epoll_wait() / io_uring_enter() returns
+    IdlePolls,     // busy-poll waits that found nothing (not in Wakeups)
+    Events,        // events / completions handled
+    PostedTasks,   // CompletionQueue tasks run
+    HttpRequests,
+    HttpParseErrors,
+    HttpShed,      // requests answered 503 by admission control
+    HttpRateLimited, // requests answered 429 by the rate limiter
+    CacheHits,     // requests answered from the response cache
+    CacheMisses,   // cacheable requests the handler had to answer
+    CacheEvictions,
+    HttpCompressed,        // responses sent with a Content-Encoding
+    CompressionSavedBytes, // body bytes compression kept off the wire
+    Count
+};
+
+enum class MetricGauge : unsigned
+{
+    OpenConnections,
+    HttpInFlight, // requests out on the worker pool
+    CacheBytes,   // held by the response cache
+    Count
+};
+
+enum class MetricHistogram : unsigned
+{
+    EventsPerWait,
+    ParseNanos,     // parser time per request, over every call that fed it
+    HandlerNanos,
+    FirstByteNanos, // first request byte read to response queued for the socket
+    Count
+};
+
+// The metrics one thread updates. Only the owning thread writes, so every
+// update is a relaxed load and store (no locked instruction); scrapes on
+// other threads read values at most a few updates old.
+class ThreadMetrics
+{
+public:
+    static const unsigned BUCKETS = 40; // bucket i: values below 2^i
+
+    ThreadMetrics();
+
+    void add(MetricCounter counter, uint64_t n = 1) { bump(counters[(unsigned)counter], n); }
+    void add(MetricGauge gauge, int64_t delta) { bump(gauges[(unsigned)gauge], (uint64_t)delta); }
+    void record(MetricHistogram histogram, uint64_t value)
+    {
+        Buckets &h = histograms[(unsigned)histogram];
+        unsigned bucket = bucketOf(value);
+        bump(h.counts[bucket < BUCKETS ? bucket : BUCKETS - 1], 1);
+        bump(h.sum, value);
+    }
+
+private:
+    friend class Metrics;
+
+    struct Buckets
+    {
+        std::atomic<uint64_t> counts[BUCKETS];
+        std::atomic<uint64_t> sum;
+    };
+
+    static unsigned bucketOf(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long bit;
+        return _BitScanReverse64(&bit, value) ? bit + 1 : 0;
+#else
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+#endif
+    }
+
+    static void bump(std::atomic<uint64_t> &value, uint64_t n)
+    {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // blocks are heap allocated next to each other; the padding keeps two
+    // threads' hot counters off a shared cache line without relying on
+    // over-aligned new (C++17)
+    char padBefore[64];
+    std::atomic<uint64_t> counters[(unsigned)MetricCounter::Count];
+    std::atomic<uint64_t> gauges[(unsigned)MetricGauge::Count]; // two's complement deltas
+    Buckets histograms[(unsigned)MetricHistogram::Count];
+    std::string label;
+    char padAfter[64];
+};
+
+// Server-wide metrics: one ThreadMetrics block per thread that records
+// anything, summed when scraped.
+class Metrics
+{
+public:
+    // the calling thread's block, created on first use; cache the reference
+    // on hot paths
+    static ThreadMetrics &local();
+    // `thread` label of the calling thread's counters (e.g. reactor0); call
+    // before the thread records anything. Unnamed threads share "other"
+    static void nameThread(const std::string &label);
+
+    static uint64_t nowNanos();
+
+    // every counter and gauge per thread label (a gauge updated from more
+    // than one thread as one sum), every histogram summed over all threads,
+    // in the Prometheus text exposition format
+    static std::string render();
+};
+
+#endif
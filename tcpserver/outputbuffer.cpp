@@ -0,0 +1,235 @@
+#include "outputbuffer.h"
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define close _close
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// Storage of sent chunks, shared by every buffer on the thread: a
+// connection with nothing queued holds none, and the next response of any
+// connection reuses it instead of calling malloc.
+class ChunkStash
+{
+public:
+    static const size_t LIMIT = 64;
+
+    // give `data` the storage of a stashed chunk, if there is one
+    void take(std::string &data)
+    {
+        if (chunks.empty()) return;
+        data.swap(chunks.back());
+        chunks.pop_back();
+    }
+
+    void give(std::string &data)
+    {
+        if (chunks.size() == LIMIT) return;
+        data.clear();
+        chunks.emplace_back();
+        chunks.back().swap(data);
+    }
+
+private:
+    std::vector<std::string> chunks;
+};
+
+thread_local ChunkStash stash;
+
+} // namespace
+
+FileHandle::~FileHandle()
+{
+    if (descriptor >= 0) close(descriptor);
+}
+
+OutputBuffer::OutputBuffer() : head(0), frontOffset(0), total(0), sealedChunks(0) {}
+
+// true when `len` more bytes can be copied into the tail memory chunk
+bool OutputBuffer::tailTakes(size_t len) const
+{
+    return chunks.size() - head > sealedChunks && !chunks.back().file && !chunks.back().shared &&
+           chunks.back().data.size() + len <= CHUNK_SIZE;
+}
+
+OutputBuffer::Chunk &OutputBuffer::pushChunk()
+{
+    // slide the queue down rather than growing past the sent chunks
+    if (head != 0 && chunks.size() == chunks.capacity())
+    {
+        chunks.erase(chunks.begin(), chunks.begin() + head);
+        head = 0;
+    }
+    chunks.emplace_back();
+    return chunks.back();
+}
+
+void OutputBuffer::popChunk()
+{
+    // keep the storage for the next response, unless a large body grew it
+    // well past the usual size
+    Chunk &front = chunks[head];
+    size_t capacity = front.data.capacity();
+    if (!front.file && capacity >= CHUNK_SIZE && capacity <= 2 * CHUNK_SIZE)
+        stash.give(front.data);
+    front = Chunk();
+    if (++head == chunks.size())
+    {
+        chunks.clear();
+        head = 0;
+    }
+}
+
+void OutputBuffer::append(const char *data, size_t len)
+{
+    if (len == 0) return;
+
+    if (tailTakes(len))
+    {
+        chunks.back().data.append(data, len);
+    }
+    else
+    {
+        Chunk &chunk = pushChunk();
+        stash.take(chunk.data);
+        chunk.data.reserve(len < CHUNK_SIZE ? CHUNK_SIZE : len);
+        chunk.data.append(data, len);
+    }
+    total += len;
+}
+
+void OutputBuffer::append(std::string &&chunk)
+{
+    // a small owned chunk is cheaper to copy than to queue on its own. It
+    // also keeps every queued chunk on the heap: the vector may move chunks
+    // while a sealed send points into them, and only a heap string's bytes
+    // stay put when it is moved
+    if (chunk.size() < 256)
+    {
+        append(chunk.data(), chunk.size());
+        return;
+    }
+
+    total += chunk.size();
+    pushChunk().data = std::move(chunk);
+}
+
+void OutputBuffer::append(const std::shared_ptr<const std::string> &shared)
+{
+    if (shared->size() < 256)
+    {
+        append(shared->data(), shared->size());
+        return;
+    }
+
+    total += shared->size();
+    pushChunk().shared = shared;
+}
+
+char *OutputBuffer::prepare(size_t maxLen)
+{
+    if (!tailTakes(maxLen))
+    {
+        Chunk &chunk = pushChunk();
+        stash.take(chunk.data);
+        chunk.data.reserve(maxLen < CHUNK_SIZE ? CHUNK_SIZE : maxLen);
+    }
+    std::string &data = chunks.back().data;
+    size_t used = data.size();
+    data.resize(used + maxLen);
+    total += maxLen;
+    return &data[used];
+}
+
+void OutputBuffer::commit(char *end)
+{
+    std::string &data = chunks.back().data;
+    size_t unused = (size_t)(data.data() + data.size() - end);
+    data.resize(data.size() - unused);
+    total -= unused;
+}
+
+void OutputBuffer::appendFile(const std::shared_ptr<FileHandle> &file, uint64_t offset, size_t length)
+{
+    if (length == 0) return;
+
+    Chunk &chunk = pushChunk();
+    chunk.file = file;
+    chunk.fileOffset = offset;
+    chunk.fileLength = length;
+    total += length;
+}
+
+const FileHandle *OutputBuffer::frontFile(uint64_t &offset, size_t &length) const
+{
+    if (chunks.size() == head || !chunks[head].file) return nullptr;
+    offset = chunks[head].fileOffset;
+    length = chunks[head].fileLength;
+    return chunks[head].file.get();
+}
+
+#ifndef _WIN32
+size_t OutputBuffer::gather(struct iovec *iov, size_t max, size_t &bytes) const
+{
+    size_t count = 0;
+    bytes = 0;
+    for (size_t i = head; i < chunks.size() && count < max; i++)
+    {
+        const Chunk &chunk = chunks[i];
+        if (chunk.file) break;
+
+        const std::string &data = chunk.bytes();
+        size_t offset = (i == head) ? frontOffset : 0;
+        if (data.size() == offset) continue;
+
+        iov[count].iov_base = const_cast<char *>(data.data() + offset);
+        iov[count].iov_len = data.size() - offset;
+        bytes += iov[count].iov_len;
+        count++;
+    }
+    return count;
+}
+#endif
+
+void OutputBuffer::consume(size_t len)
+{
+    sealedChunks = 0;
+    if (len > total) len = total;
+    total -= len;
+
+    while (len > 0)
+    {
+        Chunk &front = chunks[head];
+        size_t available = front.size() - (front.file ? 0 : frontOffset);
+        if (len < available)
+        {
+            if (front.file)
+            {
+                front.fileOffset += len;
+                front.fileLength -= len;
+            }
+            else
+            {
+                frontOffset += len;
+            }
+            return;
+        }
+        len -= available;
+        frontOffset = 0;
+        popChunk();
+    }
+}
+
+void OutputBuffer::clear()
+{
+    while (chunks.size() != head) popChunk();
+    frontOffset = 0;
+    sealedChunks = 0;
+    total = 0;
+}
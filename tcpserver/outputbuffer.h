@@ -0,0 +1,106 @@
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+// An open file descriptor shared between a file cache and the send queues
+// streaming it; closed when the last reference goes away.
+class FileHandle
+{
+public:
+    explicit FileHandle(int fd) : descriptor(fd) {}
+    ~FileHandle();
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+
+    int fd() const { return descriptor; }
+
+private:
+    int descriptor;
+};
+
+// Per-connection output queue made of owned chunks. Small writes are copied
+// into the tail chunk, whole chunks (a serialized response, a file slice, a
+// body shared with a cache) can be queued without copying, and sent bytes are dropped by advancing
+// an offset into the front chunk -- nothing is ever memmoved. Binary safe.
+// The storage of sent chunks goes to a per-thread stash for the next
+// append() on any connection, so an idle connection holds no output memory.
+// Use a buffer on one thread only.
+class OutputBuffer
+{
+public:
+    // writes smaller than this are coalesced into the tail chunk
+    static const size_t CHUNK_SIZE = 16 * 1024;
+
+    OutputBuffer();
+
+    void append(const char *data, size_t len);
+    void append(const std::string &data) { append(data.data(), data.size()); }
+    void append(std::string &&chunk);
+    // queue bytes held elsewhere as they are, keeping them alive until sent
+    void append(const std::shared_ptr<const std::string> &shared);
+    // queue `length` bytes of `file` starting at `offset`; they are written
+    // straight from the page cache (sendfile) when they reach the front
+    void appendFile(const std::shared_ptr<FileHandle> &file, uint64_t offset, size_t length);
+    // room for up to `maxLen` bytes at the end of the queue, to be written in
+    // place and closed by commit(end) with the end of what was written. No
+    // other call may come in between
+    char *prepare(size_t maxLen);
+    void commit(char *end);
+
+    bool empty() const { return total == 0; }
+    size_t size() const { return total; }
+
+    // the front chunk when it is a file slice, nullptr when it is memory
+    const FileHandle *frontFile(uint64_t &offset, size_t &length) const;
+
+#ifndef _WIN32
+    // fill up to `max` iovecs with the memory chunks at the front, stopping
+    // at the first file slice, for a single writev()/sendmsg(); `bytes`
+    // receives their total length
+    size_t gather(struct iovec *iov, size_t max, size_t &bytes) const;
+#endif
+
+    // stop coalescing into the chunks queued so far, for as long as an
+    // asynchronous send holds iovecs into them; the next consume() lifts it
+    void seal() { sealedChunks = chunks.size() - head; }
+
+    // drop `len` sent bytes from the front
+    void consume(size_t len);
+    void clear();
+
+private:
+    struct Chunk
+    {
+        std::string data; // memory chunk (unused for a file or shared slice)
+        std::shared_ptr<const std::string> shared;
+        std::shared_ptr<FileHandle> file;
+        uint64_t fileOffset = 0;
+        size_t fileLength = 0;
+
+        const std::string &bytes() const { return shared ? *shared : data; }
+        size_t size() const { return file ? fileLength : bytes().size(); }
+    };
+
+    // a queue: chunks[head] is the front. A vector rather than a deque so an
+    // idle connection allocates nothing and a busy one reuses its capacity
+    std::vector<Chunk> chunks;
+    size_t head;
+    size_t frontOffset; // sent bytes of a front memory chunk
+    size_t total;
+    size_t sealedChunks; // leading chunks append() must not grow
+
+    bool tailTakes(size_t len) const;
+    Chunk &pushChunk();
+    void popChunk();
+};
+
+#endif
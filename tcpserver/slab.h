@@ -0,0 +1,88 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Objects of one type carved out of fixed-size slabs and recycled through a
+// free list, so creating and destroying them costs no malloc once the pool
+// has grown to the high-water mark. Slabs are only returned when the pool
+// is destroyed. Not thread-safe: one pool per reactor thread.
+template <class T, size_t PER_SLAB = 64>
+class SlabPool
+{
+public:
+    SlabPool() : freeSlots(nullptr), live(0) {}
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    template <class... Args>
+    T *create(Args &&...args)
+    {
+        void *slot = allocate();
+        try
+        {
+            return new (slot) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            deallocate(slot);
+            throw;
+        }
+    }
+
+    void destroy(T *object)
+    {
+        if (object == nullptr) return;
+        object->~T();
+        deallocate(object);
+    }
+
+    // objects created and not yet destroyed
+    size_t size() const { return live; }
+    // slots allocated so far
+    size_t capacity() const { return slabs.size() * PER_SLAB; }
+
+private:
+    union Slot
+    {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    Slot *freeSlots;
+    size_t live;
+    std::vector<std::unique_ptr<Slot[]>> slabs;
+
+    void *allocate()
+    {
+        if (freeSlots == nullptr)
+        {
+            Slot *slab = new Slot[PER_SLAB];
+            slabs.emplace_back(slab);
+            for (size_t i = PER_SLAB; i-- > 0;)
+            {
+                slab[i].next = freeSlots;
+                freeSlots = &slab[i];
+            }
+        }
+        Slot *slot = freeSlots;
+        freeSlots = slot->next;
+        live++;
+        return slot;
+    }
+
+    void deallocate(void *object)
+    {
+        Slot *slot = static_cast<Slot *>(object);
+        slot->next = freeSlots;
+        freeSlots = slot;
+        live--;
+    }
+};
+
+#endif
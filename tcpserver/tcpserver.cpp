@@ -2,23 +2,29 @@
 
 #ifdef PLATFORM_WINDOWS
 #include "win/win.h"
-#elif defined(PLATFORM_LINUX) 
+#elif defined(PLATFORM_LINUX)
 #include "lin/lin.h"
 #elif defined(PLATFORM_MAC)
 #include "mac/mac.h"
 #endif
 
 TCPServer *createserver()
+{
+    return createserver(ServerOptions());
+}
+
+TCPServer *createserver(const ServerOptions &options)
 {
 
 #ifdef PLATFORM_WINDOWS
+    (void)options; // single WSAPoll loop only
     return new WinServer();
-#elif defined(PLATFORM_LINUX) 
-    return new LinServer();
+#elif defined(PLATFORM_LINUX)
+    return new LinServer(options);
 #elif defined(PLATFORM_MAC)
+    (void)options; // single kqueue loop only
     return new MacServer();
 #endif
 
 }
 
-
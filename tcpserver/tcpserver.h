@@ -1,19 +1,186 @@
 #ifndef TCPSERVER_H
 #define TCPSERVER_H
 
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<memory>
 #include<string>
 
+class FileHandle;
+
+enum class IOBackend{
+    Epoll,
+    IoUring
+};
+
+struct ServerOptions{
+    // number of event loops; each one owns a SO_REUSEPORT listener, an epoll
+    // set and its connection table. 0 means one per online CPU
+    unsigned reactors = 1;
+    // pin reactor i to CPU (i mod online CPUs)
+    bool pinThreads = true;
+    // max connections accepted per listener wakeup before the reactor goes
+    // back to serving its clients, 0 means drain until EAGAIN
+    unsigned acceptBatch = 0;
+    // Linux event interface. IoUring needs kernel 6.1+ and falls back to
+    // Epoll when the kernel (or the build's headers) cannot provide it
+    IOBackend backend = IOBackend::Epoll;
+    // cap of the epoll_wait() event array, which starts small and doubles
+    // whenever one wait fills it
+    unsigned maxEvents = 4096;
+    // Latency mode: once events stop, keep polling without blocking for this
+    // many microseconds before sleeping in the kernel, and ask for
+    // SO_BUSY_POLL on client sockets (needs CAP_NET_ADMIN). Burns a CPU per
+    // reactor to save the wakeup latency. 0 turns it off
+    unsigned busyPollMicros = 0;
+    // Connection timeouts in milliseconds, 0 disables one. A connection is
+    // closed after idleTimeoutMs with nothing to do between requests; after
+    // requestTimeoutMs with a request partly received, plus another
+    // requestTimeoutMs for every further 16 KiB of it (so a slow upload
+    // survives and a trickled header does not); and after writeTimeoutMs
+    // with a response queued that the client does not read
+    unsigned idleTimeoutMs = 60000;
+    unsigned requestTimeoutMs = 10000;
+    unsigned writeTimeoutMs = 30000;
+    // how long stop() lets connections finish what they are doing before
+    // closing them anyway
+    unsigned drainTimeoutMs = 10000;
+    // Backpressure: a connection with this many bytes of output queued
+    // (file slices count at their length) is not read, nor offered the
+    // input it has already, until all of it has been written. A client that
+    // sends without reading then stalls in its own socket buffer instead of
+    // growing the server's memory. 0 turns it off
+    size_t maxQueuedBytes = 1024 * 1024;
+    // Hot restart: path of a UNIX socket. initialize() first asks a server
+    // listening on it for its listening sockets (SCM_RIGHTS) and accepts on
+    // those, so no connection is refused during a deploy; start() then
+    // tells the old server to drain and takes the path over for the next
+    // restart. Empty turns it off. A server with a handoff path runs at
+    // most 253 reactors, the descriptors one message can carry
+    std::string handoffPath;
+};
+
+// per-connection protocol state, owned by (and destroyed with) the connection
+class ConnectionContext{
+    public:
+    virtual ~ConnectionContext() = default;
+};
+
+class TCPConnection;
+
+// The way back onto a reactor thread from any other thread (a worker pool).
+class CompletionQueue{
+    public:
+    // run `task` on the reactor that owns connection `id` if it is still
+    // open; the connection's output is flushed (EPOLLOUT armed if needed)
+    // and its pending input offered to onData() again afterwards
+    virtual void post(uint64_t id, std::function<void(TCPConnection &)> task) = 0;
+    virtual ~CompletionQueue() = default;
+};
+
+// What a protocol layer sees of one accepted connection. Only valid inside
+// the ConnectionHandler callbacks, on the connection's reactor thread.
+class TCPConnection{
+    public:
+    virtual int fd() const = 0;
+    // unlike the fd, never reused for a later connection
+    virtual uint64_t id() const = 0;
+    virtual CompletionQueue &completions() = 0;
+    // the client's IPv4 address in network byte order, 0 when unknown
+    virtual uint32_t peerAddress() = 0;
+    // queue bytes for the client; they are flushed when the callback returns
+    virtual void send(const char *data, size_t len) = 0;
+    virtual void send(std::string &&data) = 0;
+    // queue bytes shared with a cache, without copying them
+    virtual void send(const std::shared_ptr<const std::string> &data) = 0;
+    // serialize in place: room for up to `maxLen` bytes at the end of the
+    // queue, then commitSend() with the end of what was written
+    virtual char *prepareSend(size_t maxLen) = 0;
+    virtual void commitSend(char *end) = 0;
+    // queue a slice of an open file, written without a userspace copy
+    virtual void sendFile(const std::shared_ptr<FileHandle> &file, uint64_t offset, size_t length) = 0;
+    // close once everything queued has been written; stops reading
+    virtual void close() = 0;
+
+    ConnectionContext *context() const { return ctx.get(); }
+    void setContext(std::unique_ptr<ConnectionContext> context) { ctx = std::move(context); }
+
+    // Call before handing work for this connection to another thread that
+    // will post() the result: a peer EOF then leaves the connection open
+    // until the posted task has run, which releases the hold.
+    void hold() { holds++; }
+    void releaseHold() { if (holds) holds--; }
+    bool held() const { return holds != 0; }
+
+    // set by the server once it is stopping: finish the request at hand and
+    // close instead of keeping the connection alive
+    void drain() { drainRequested = true; }
+    bool draining() const { return drainRequested; }
+
+    // stop reading, and offering input to onData(), until everything queued
+    // so far has been written; the reactor then hands the unconsumed input
+    // back and reads on. It also pauses a connection by itself at
+    // ServerOptions::maxQueuedBytes
+    void pauseReading() { readPaused = true; }
+    bool readingPaused() const { return readPaused; }
+    void resumeReading() { readPaused = false; }
+
+    // ask for one ConnectionHandler::onWritable() call once everything
+    // queued so far has been written, so that a long body is made a window
+    // at a time rather than queued whole. Not after close()
+    void awaitWritable() { writableAwaited = true; }
+    bool awaitingWritable() const { return writableAwaited; }
+    void cancelAwaitWritable() { writableAwaited = false; }
+
+    virtual ~TCPConnection() = default;
+
+    private:
+    std::unique_ptr<ConnectionContext> ctx;
+    unsigned holds = 0;
+    bool drainRequested = false;
+    bool readPaused = false;
+    bool writableAwaited = false;
+};
+
+// Protocol hooks called by the server's event loops.
+class ConnectionHandler{
+    public:
+    virtual void onConnect(TCPConnection &conn) { (void)conn; }
+    // `data` holds every byte received and not yet consumed; return how many
+    // of them were used. The rest is handed back, with more, next time
+    virtual size_t onData(TCPConnection &conn, const char *data, size_t len) = 0;
+    // the output queue has drained after awaitWritable(); the pending input
+    // is offered to onData() again afterwards
+    virtual void onWritable(TCPConnection &conn) { (void)conn; }
+    virtual void onClose(TCPConnection &conn) { (void)conn; }
+    virtual ~ConnectionHandler() = default;
+};
+
 class TCPServer{
     public:
     virtual bool initialize(int port,const std::string &ipAddress = "127.0.0.1") = 0;
+    // serve until stop() has drained every connection
     virtual void start() = 0;
+    // Stop accepting, let open connections finish their in-flight requests
+    // for up to ServerOptions::drainTimeoutMs, close them, and return from
+    // start(). Only sets flags and writes eventfds, so it may be called from
+    // any thread, a signal handler included. Linux only for now
+    virtual void stop() {}
+    // total connections accepted so far; sample it to get the accept rate
+    virtual unsigned long long acceptedConnections() const { return 0; }
+    // set before start(); without one the server echoes. Linux only for now
+    virtual void setHandler(ConnectionHandler *handler) { this->handler = handler; }
     virtual ~TCPServer() = default;
 
+    protected:
+    ConnectionHandler *handler = nullptr;
+
 };
 
 TCPServer *createserver();
+TCPServer *createserver(const ServerOptions &options);
 
 
 
 #endif
-
@@ -0,0 +1,160 @@
+#include "timerwheel.h"
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static unsigned lowestBit(uint64_t word)
+{
+    unsigned long bit;
+    _BitScanForward64(&bit, word);
+    return bit;
+}
+#else
+static unsigned lowestBit(uint64_t word) { return (unsigned)__builtin_ctzll(word); }
+#endif
+
+TimerWheel::TimerWheel(uint64_t nowMs) : now(nowMs), count(0)
+{
+    for (Timer &head : heads) head.prev = head.next = &head;
+    std::memset(occupied, 0, sizeof(occupied));
+}
+
+void TimerWheel::schedule(Timer &timer, uint64_t expiresMs)
+{
+    if (timer.pending())
+        unlink(timer);
+    else
+        count++;
+    timer.expires = expiresMs;
+    link(timer, now + 1);
+}
+
+void TimerWheel::cancel(Timer &timer)
+{
+    if (!timer.pending()) return;
+    unlink(timer);
+    timer.prev = timer.next = nullptr;
+    count--;
+}
+
+// the level is picked by how far out the timer is; one due before
+// `earliest` goes in that tick's slot
+void TimerWheel::link(Timer &timer, uint64_t earliest)
+{
+    uint64_t expires = timer.expires > earliest ? timer.expires : earliest;
+    uint64_t delta = expires - now;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >= (uint64_t)width(level) << shift(level)) level++;
+    if (delta >= (uint64_t)width(level) << shift(level))
+        expires = now + ((uint64_t)width(level) << shift(level)) - 1;
+
+    unsigned index = slotOf(level, expires);
+    Timer &head = heads[index];
+    timer.slot = index;
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    occupied[index / 64] |= 1ull << (index % 64);
+}
+
+void TimerWheel::unlink(Timer &timer)
+{
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    Timer &head = heads[timer.slot];
+    if (head.next == &head)
+        occupied[timer.slot / 64] &= ~(1ull << (timer.slot % 64));
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    unsigned index = slotOf(level, now);
+    Timer &head = heads[index];
+    if (head.next == &head) return;
+
+    Timer list;
+    list.next = head.next;
+    list.prev = head.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head.prev = head.next = &head;
+    occupied[index / 64] &= ~(1ull << (index % 64));
+
+    while (list.next != &list)
+    {
+        Timer *timer = list.next;
+        list.next = timer->next;
+        timer->next->prev = &list;
+        // cascades run before the tick's own slot, which may take them
+        link(*timer, now);
+    }
+}
+
+void TimerWheel::tick(Timer &due)
+{
+    now++;
+    // a coarse slot comes into range when every wheel below it wraps
+    for (unsigned level = 1; level < LEVELS; level++)
+    {
+        if ((now & (((uint64_t)1 << shift(level)) - 1)) != 0) break;
+        cascade(level);
+    }
+
+    unsigned index = slotOf(0, now);
+    Timer &head = heads[index];
+    if (head.next == &head) return;
+
+    // append the whole slot to `due`
+    head.next->prev = due.prev;
+    due.prev->next = head.next;
+    head.prev->next = &due;
+    due.prev = head.prev;
+    head.prev = head.next = &head;
+    occupied[index / 64] &= ~(1ull << (index % 64));
+}
+
+int TimerWheel::nextOccupied(unsigned level, unsigned from) const
+{
+    unsigned slots = width(level);
+    for (unsigned scanned = 0; scanned < slots;)
+    {
+        unsigned position = (from + scanned) & (slots - 1);
+        unsigned index = base(level) + position;
+        // bits from `position` to the end of its word (or of the level)
+        uint64_t word = occupied[index / 64] >> (index % 64);
+        unsigned span = 64 - index % 64;
+        if (span > slots - position) span = slots - position;
+        if (span < 64) word &= (1ull << span) - 1;
+        if (word != 0)
+        {
+            unsigned distance = scanned + lowestBit(word);
+            return distance < slots ? (int)distance : -1;
+        }
+        scanned += span;
+    }
+    return -1;
+}
+
+int TimerWheel::nextTimeout(uint64_t nowMs) const
+{
+    if (count == 0) return -1;
+
+    // the first tick still to be processed whose slot holds timers, or that
+    // cascades a non-empty coarse slot
+    uint64_t next = UINT64_MAX;
+    int distance = nextOccupied(0, (unsigned)((now + 1) & (width(0) - 1)));
+    if (distance >= 0) next = now + 1 + (uint64_t)distance;
+    for (unsigned level = 1; level < LEVELS; level++)
+    {
+        uint64_t position = (now >> shift(level)) + 1;
+        distance = nextOccupied(level, (unsigned)(position & (width(level) - 1)));
+        if (distance < 0) continue;
+        uint64_t at = (position + (uint64_t)distance) << shift(level);
+        if (at < next) next = at;
+    }
+
+    if (next <= nowMs) return 0;
+    uint64_t wait = next - nowMs;
+    return wait > (uint64_t)INT32_MAX ? INT32_MAX : (int)wait;
+}
@@ -0,0 +1,99 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timing wheel with millisecond ticks, one per reactor thread.
+// Timers are intrusive list nodes, so schedule(), cancel() and rescheduling
+// a live timer are O(1) with no allocation. Advancing visits only the slots
+// that come due, plus one cascade of a coarser slot every 256 ticks, and
+// never scans every timer. Deadlines more than about 49 days out are
+// clamped.
+class TimerWheel
+{
+public:
+    struct Timer
+    {
+        Timer *prev = nullptr;
+        Timer *next = nullptr;
+        uint64_t expires = 0; // ms, on the clock passed to advance()
+        uint64_t id = 0;      // handed to the expiry callback
+        unsigned slot = 0;    // list it is on, while pending
+
+        bool pending() const { return next != nullptr; }
+    };
+
+    explicit TimerWheel(uint64_t nowMs = 0);
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // (re)arm `timer` to fire at `expiresMs`. A timer that is already due
+    // fires on the next advance()
+    void schedule(Timer &timer, uint64_t expiresMs);
+    void cancel(Timer &timer);
+
+    // fire every timer due by `nowMs`. Each one is unlinked before
+    // `fire(id)` runs, and the callback may schedule or cancel any timer
+    template <class F>
+    void advance(uint64_t nowMs, F fire);
+
+    // ms from `nowMs` until the next timer may fire, or -1 when none is
+    // scheduled. A cascade can wake the caller early
+    int nextTimeout(uint64_t nowMs) const;
+
+    size_t size() const { return count; }
+
+private:
+    static const unsigned LEVELS = 5;
+    static const unsigned ROOT_BITS = 8;  // level 0: 256 slots of 1 ms
+    static const unsigned LEVEL_BITS = 6; // above: 64 slots, each a whole lower wheel
+    static const unsigned SLOTS = (1u << ROOT_BITS) + (LEVELS - 1) * (1u << LEVEL_BITS);
+
+    Timer heads[SLOTS];          // list sentinels of every level, level 0 first
+    uint64_t occupied[SLOTS / 64]; // bit per non-empty slot
+    uint64_t now;                // the last tick processed
+    size_t count;
+
+    static unsigned shift(unsigned level) { return level == 0 ? 0 : ROOT_BITS + (level - 1) * LEVEL_BITS; }
+    static unsigned width(unsigned level) { return level == 0 ? 1u << ROOT_BITS : 1u << LEVEL_BITS; }
+    static unsigned base(unsigned level) { return level == 0 ? 0 : (1u << ROOT_BITS) + (level - 1) * (1u << LEVEL_BITS); }
+    static unsigned slotOf(unsigned level, uint64_t tick)
+    {
+        return base(level) + (unsigned)((tick >> shift(level)) & (width(level) - 1));
+    }
+
+    void link(Timer &timer, uint64_t earliest);
+    void unlink(Timer &timer);
+    // move the timers of a coarse slot that has come into range down a level
+    void cascade(unsigned level);
+    // process the next tick: cascade if a coarse slot came into range and
+    // move the tick's timers onto `due`
+    void tick(Timer &due);
+    // distance from slot `from` of `level` to its next non-empty slot,
+    // wrapping around; -1 when the level is empty
+    int nextOccupied(unsigned level, unsigned from) const;
+};
+
+template <class F>
+void TimerWheel::advance(uint64_t nowMs, F fire)
+{
+    Timer due;
+    due.prev = due.next = &due;
+    while (now < nowMs && count != 0)
+    {
+        tick(due);
+        while (due.next != &due)
+        {
+            Timer *timer = due.next;
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            timer->prev = timer->next = nullptr;
+            count--;
+            fire(timer->id);
+        }
+    }
+    if (nowMs > now) now = nowMs;
+}
+
+#endif
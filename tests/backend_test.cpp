@@ -0,0 +1,132 @@
+// ServerOptions::backend: the io_uring reactor serves what the epoll one
+// does, and a kernel without io_uring gets the epoll reactor instead.
+#include "check.h"
+#include "httptest.h"
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+
+namespace
+{
+
+const int PORT = 18521;
+
+HttpResponse echo(const HttpRequest &request)
+{
+    if (request.path() == "/big") return HttpResponse::Builder().body(std::string(1 << 20, 'b')).build();
+    std::string body = request.method.str() + " " + request.path().str() + " " + request.body.str();
+    return HttpResponse::Builder().body(body).build();
+}
+
+ServerOptions backend(IOBackend which)
+{
+    ServerOptions options;
+    options.reactors = 2;
+    options.pinThreads = false;
+    options.backend = which;
+    return options;
+}
+
+// pipelined requests with and without bodies, and a response larger than
+// one send takes, in order on one connection
+void serves(int port, IOBackend which, const HttpOptions &http = HttpOptions())
+{
+    TestServer server(echo, port, http, backend(which));
+    CHECK(server.ready);
+
+    std::string stream = roundTrip(port, "GET /a HTTP/1.1\r\n\r\n"
+                                         "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                                         "GET /big HTTP/1.1\r\n\r\n"
+                                         "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+                                         "3\r\nend\r\n0\r\n\r\n");
+    std::vector<TestResponse> responses = splitResponses(stream);
+    CHECK_EQ(responses.size(), 4u);
+    if (responses.size() != 4) return;
+    CHECK_EQ(responses[0].body, "GET /a ");
+    CHECK_EQ(responses[1].body, "POST /b hello");
+    CHECK_EQ(responses[2].body, std::string(1 << 20, 'b'));
+    CHECK_EQ(responses[3].body, "POST /c end");
+}
+
+// what the server logged while `run` ran (TestServer keeps warnings and
+// errors only)
+template <typename Run>
+std::string logged(Run run)
+{
+    FILE *log = std::tmpfile();
+    Logger::setOutput(log);
+    run();
+    Logger::flush();
+    Logger::setOutput(stderr);
+
+    std::string text;
+    char buffer[4096];
+    std::rewind(log);
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), log)) > 0;) text.append(buffer, n);
+    std::fclose(log);
+    return text;
+}
+
+// Fail io_uring_setup() with ENOSYS from here on, as a kernel without
+// io_uring (or one that disables it) would.
+bool denyIoUring()
+{
+#ifdef __NR_io_uring_setup
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (ENOSYS & SECCOMP_RET_DATA)),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    };
+    struct sock_fprog program = {(unsigned short)(sizeof(filter) / sizeof(filter[0])), filter};
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+#else
+    return true; // the build has no io_uring to deny
+#endif
+}
+
+// In a child process, so the filter stays there. Runs before anything else
+// starts a thread.
+void fallback()
+{
+    pid_t child = fork();
+    if (child == 0)
+    {
+        CHECK(denyIoUring());
+        std::string log = logged([] { serves(PORT, IOBackend::IoUring); });
+        CHECK(log.find("event=io_uring_unavailable fallback=epoll") != std::string::npos);
+        std::fflush(stderr);
+        _exit(checkResult());
+    }
+    int status = -1;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void ioUring()
+{
+    std::string log = logged([] { serves(PORT + 1, IOBackend::IoUring); });
+    if (log.find("event=io_uring_unavailable") != std::string::npos)
+        std::fprintf(stderr, "io_uring unavailable here: served by the epoll fallback\n");
+
+    // and with handlers on a worker pool, whose replies come back through
+    // the reactor's completion queue
+    HttpOptions http;
+    http.workers = 2;
+    serves(PORT + 2, IOBackend::IoUring, http);
+}
+
+} // namespace
+
+int main()
+{
+    fallback();
+    ioUring();
+    serves(PORT + 3, IOBackend::Epoll);
+    return checkResult();
+}
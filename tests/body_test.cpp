@@ -0,0 +1,187 @@
+// HttpBodyDecoder: Content-Length and chunked bodies fed whole or in
+// pieces, malformed chunk sizes and lines, trailers, and the limits; and a
+// chunked body through HttpRequestParser.
+#include "check.h"
+#include "httprequest.h"
+#include <string>
+
+namespace
+{
+
+struct Decoded
+{
+    std::string payload;
+    size_t used;
+};
+
+// feed `body` `piece` bytes at a time, as far as the decoder takes it
+Decoded decode(HttpBodyDecoder &decoder, const std::string &body, size_t piece = 0)
+{
+    Decoded out{std::string(), 0};
+    HttpBodyDecoder::Sink sink = [&out](const char *data, size_t len) {
+        out.payload.append(data, len);
+        return true;
+    };
+    while (out.used < body.size() && !decoder.done() && !decoder.failed())
+    {
+        size_t len = body.size() - out.used;
+        if (piece != 0 && len > piece) len = piece;
+        out.used += decoder.feed(body.data() + out.used, len, sink);
+    }
+    return out;
+}
+
+// the status a chunked body is refused with, 0 if it decodes
+int refusal(const std::string &body, uint64_t maxLength = 0)
+{
+    HttpBodyDecoder decoder;
+    decoder.reset(0, true, maxLength);
+    decode(decoder, body);
+    return decoder.failed() ? decoder.errorStatus() : 0;
+}
+
+void fixedLength()
+{
+    HttpBodyDecoder decoder;
+    decoder.reset(5, false, 0);
+    Decoded out = decode(decoder, "helloEXTRA", 2);
+    CHECK(decoder.done());
+    CHECK_EQ(out.payload, "hello");
+    CHECK_EQ(out.used, 5u);
+    CHECK_EQ(decoder.decoded(), 5u);
+
+    decoder.reset(0, false, 0);
+    CHECK(decoder.done());
+}
+
+void chunked()
+{
+    std::string body = "5\r\nhello\r\n"
+                       "1A;name=value;other\r\n" + std::string(26, 'x') + "\r\n"
+                       "0\r\n"
+                       "Trailer-One: 1\r\n"
+                       "Trailer-Two: 2\r\n"
+                       "\r\n"
+                       "NEXT";
+    for (size_t piece : {0, 1, 3, 7})
+    {
+        HttpBodyDecoder decoder;
+        decoder.reset(0, true, 0);
+        Decoded out = decode(decoder, body, piece);
+        CHECK(decoder.done());
+        CHECK_EQ(out.payload, "hello" + std::string(26, 'x'));
+        CHECK_EQ(out.used, body.size() - 4);
+        CHECK_EQ(decoder.decoded(), 31u);
+    }
+
+    // bare LFs, upper-case hex and whitespace before an extension
+    HttpBodyDecoder decoder;
+    decoder.reset(0, true, 0);
+    Decoded out = decode(decoder, "B \t;x\nhello world\n0\n\n");
+    CHECK(decoder.done());
+    CHECK_EQ(out.payload, "hello world");
+}
+
+void malformedSizes()
+{
+    CHECK_EQ(refusal("\r\nhello\r\n0\r\n\r\n"), 400);
+    CHECK_EQ(refusal(";ext\r\n"), 400);
+    CHECK_EQ(refusal("5x\r\nhello\r\n0\r\n\r\n"), 400);
+    CHECK_EQ(refusal("-5\r\nhello\r\n0\r\n\r\n"), 400);
+    CHECK_EQ(refusal("0x5\r\nhello\r\n0\r\n\r\n"), 400);
+    // more hex digits than 64 bits hold
+    CHECK_EQ(refusal("10000000000000000\r\n"), 413);
+    CHECK_EQ(refusal("FFFFFFFFFFFFFFFF\r\n", 1 << 20), 413);
+    CHECK_EQ(refusal("0000000000000000000005\r\nhello\r\n0\r\n\r\n"), 0);
+}
+
+void malformedLines()
+{
+    // data longer than its size, and a lone CR after it
+    CHECK_EQ(refusal("3\r\nhello\r\n0\r\n\r\n"), 400);
+    CHECK_EQ(refusal("5\r\nhello\r\r\n0\r\n\r\n"), 400);
+    CHECK_EQ(refusal("5\r\nhello"), 0);
+    // an extension without end
+    CHECK_EQ(refusal("5;" + std::string(5000, 'e') + "\r\nhello\r\n0\r\n\r\n"), 400);
+}
+
+void trailers()
+{
+    CHECK_EQ(refusal("0\r\n" + std::string(9000, 't') + "\r\n\r\n"), 431);
+    // many small fields add up to the same limit
+    std::string fields;
+    for (int i = 0; i < 1000; i++) fields += "T" + std::to_string(i) + ": v\r\n";
+    CHECK_EQ(refusal("0\r\n" + fields + "\r\n"), 431);
+    CHECK_EQ(refusal("0\r\nT: v\r\n\r\n"), 0);
+
+    // not done until the empty line
+    HttpBodyDecoder decoder;
+    decoder.reset(0, true, 0);
+    decode(decoder, "0\r\nT: v\r\n");
+    CHECK(!decoder.done());
+    CHECK(!decoder.failed());
+}
+
+void limits()
+{
+    CHECK_EQ(refusal("5\r\nhello\r\n0\r\n\r\n", 5), 0);
+    CHECK_EQ(refusal("5\r\nhello\r\n1\r\n!\r\n0\r\n\r\n", 5), 413);
+    CHECK_EQ(refusal("6\r\nhello!\r\n0\r\n\r\n", 5), 413);
+}
+
+void sinkStops()
+{
+    HttpBodyDecoder decoder;
+    decoder.reset(0, true, 0);
+    std::string body = "3\r\nabc\r\n3\r\ndef\r\n0\r\n\r\n";
+    std::string seen;
+    size_t used = decoder.feed(body.data(), body.size(), [&seen](const char *data, size_t len) {
+        seen.append(data, len);
+        return false;
+    });
+    CHECK(decoder.stopped());
+    CHECK_EQ(seen, "abc");
+    CHECK_EQ(used, 6u);
+}
+
+void throughParser()
+{
+    std::string text = "POST /up HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                       "4\r\nwiki\r\n5\r\npedia\r\n0\r\nExpires: never\r\n\r\n"
+                       "GET /next HTTP/1.1\r\n\r\n";
+    HttpRequestParser parser;
+    for (size_t len = 1; len < text.size() - 22; len++)
+        CHECK_EQ(parser.parse(text.data(), len), HttpRequestParser::Incomplete);
+    CHECK_EQ(parser.parse(text.data(), text.size()), HttpRequestParser::Complete);
+    CHECK_EQ(parser.request().body.str(), "wikipedia");
+    CHECK_EQ(parser.request().contentLength, 9u);
+    CHECK_EQ(parser.consumed(), text.size() - 22);
+
+    parser.reset();
+    std::string bad = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n";
+    CHECK_EQ(parser.parse(bad.data(), bad.size()), HttpRequestParser::Invalid);
+    CHECK_EQ(parser.errorStatus(), 400);
+
+    // framing out of all proportion to the payload
+    parser.reset();
+    parser.setLimits(256, 1 << 20);
+    std::string padded = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    for (int i = 0; i < 100; i++) padded += "1;" + std::string(40, 'p') + "\r\nx\r\n";
+    CHECK_EQ(parser.parse(padded.data(), padded.size()), HttpRequestParser::Invalid);
+    CHECK_EQ(parser.errorStatus(), 413);
+}
+
+} // namespace
+
+int main()
+{
+    fixedLength();
+    chunked();
+    malformedSizes();
+    malformedLines();
+    trailers();
+    limits();
+    sinkStops();
+    throughParser();
+    return checkResult();
+}
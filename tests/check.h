@@ -0,0 +1,54 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+#include <string>
+
+// Assertions for the behaviour tests: a failed check prints where it was
+// and what it saw, and the test goes on so one run shows every failure.
+// main() returns checkResult(), which ctest reads as pass or fail.
+
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void checkFailed(const char *file, int line, const char *expression, const std::string &detail)
+{
+    checkFailures()++;
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed%s%s\n", file, line, expression, detail.empty() ? "" : ": ",
+                 detail.c_str());
+}
+
+inline std::string checkText(const std::string &value) { return "\"" + value + "\""; }
+inline std::string checkText(const char *value) { return checkText(std::string(value)); }
+template <typename T>
+inline std::string checkText(const T &value)
+{
+    return std::to_string(value);
+}
+
+#define CHECK(condition)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(condition)) checkFailed(__FILE__, __LINE__, #condition, "");                                             \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        auto checkActual = (actual);                                                                                   \
+        auto checkExpected = (expected);                                                                               \
+        if (!(checkActual == checkExpected))                                                                           \
+            checkFailed(__FILE__, __LINE__, #actual " == " #expected,                                                  \
+                        checkText(checkActual) + " != " + checkText(checkExpected));                                   \
+    } while (0)
+
+inline int checkResult()
+{
+    if (checkFailures() != 0) std::fprintf(stderr, "%d check(s) failed\n", checkFailures());
+    return checkFailures() == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,164 @@
+// Compression: Accept-Encoding negotiation (q-values, ties, `*`,
+// identity), compressible types, and streamed encoders whose pieces
+// decode to the whole.
+#include "check.h"
+#include "compression.h"
+#include <algorithm>
+#include <string>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+
+ContentCoding negotiated(const char *acceptEncoding)
+{
+    return negotiateContentCoding(StringView(acceptEncoding));
+}
+
+unsigned coding(ContentCoding c)
+{
+    return (unsigned)c;
+}
+
+void qValues()
+{
+    if (!contentCodingAvailable(ContentCoding::Gzip)) return;
+    CHECK_EQ(coding(negotiated("")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip")), coding(ContentCoding::Gzip));
+    CHECK_EQ(coding(negotiated(" GZIP ; Q=1.0 ")), coding(ContentCoding::Gzip));
+    CHECK_EQ(coding(negotiated("x-gzip")), coding(ContentCoding::Gzip));
+    CHECK_EQ(coding(negotiated("compress, gzip")), coding(ContentCoding::Gzip));
+
+    // the highest q wins, to three decimals
+    CHECK_EQ(coding(negotiated("deflate;q=0.5, gzip;q=0.4")), coding(ContentCoding::Deflate));
+    CHECK_EQ(coding(negotiated("deflate;q=0.501, gzip;q=0.5")), coding(ContentCoding::Deflate));
+    CHECK_EQ(coding(negotiated("deflate;q=0.5009, gzip;q=0.5")), coding(ContentCoding::Gzip));
+    CHECK_EQ(coding(negotiated("gzip;q=0.001")), coding(ContentCoding::Gzip));
+
+    // q=0 and anything outside 0-1 refuse a coding
+    CHECK_EQ(coding(negotiated("gzip;q=0")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip;q=0.000")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip;q=0.0001")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip;q=2")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip;q=-1")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("gzip;q=")), coding(ContentCoding::Identity));
+    // 1.5 is read as far as 1
+    CHECK_EQ(coding(negotiated("gzip;q=1.5")), coding(ContentCoding::Gzip));
+    // other parameters are skipped
+    CHECK_EQ(coding(negotiated("gzip;level=9;q=0, deflate;x=1")), coding(ContentCoding::Deflate));
+}
+
+void ties()
+{
+    if (!contentCodingAvailable(ContentCoding::Gzip)) return;
+    ContentCoding first = contentCodingAvailable(ContentCoding::Brotli) ? ContentCoding::Brotli : ContentCoding::Gzip;
+    // br before gzip before deflate, whatever order they are listed in
+    CHECK_EQ(coding(negotiated("deflate, gzip, br")), coding(first));
+    CHECK_EQ(coding(negotiated("deflate;q=0.8, gzip;q=0.8")), coding(ContentCoding::Gzip));
+    // a later listing of the same coding replaces the earlier one
+    CHECK_EQ(coding(negotiated("gzip;q=0.1, deflate;q=0.5, gzip;q=0.9")), coding(ContentCoding::Gzip));
+}
+
+void wildcard()
+{
+    if (!contentCodingAvailable(ContentCoding::Gzip)) return;
+    ContentCoding first = contentCodingAvailable(ContentCoding::Brotli) ? ContentCoding::Brotli : ContentCoding::Gzip;
+    CHECK_EQ(coding(negotiated("*")), coding(first));
+    CHECK_EQ(coding(negotiated("*;q=0")), coding(ContentCoding::Identity));
+    // a coding listed by name is not the wildcard's
+    CHECK_EQ(coding(negotiated("*;q=0, deflate")), coding(ContentCoding::Deflate));
+    CHECK_EQ(coding(negotiated("br;q=0, gzip;q=0, *;q=0.5")), coding(ContentCoding::Deflate));
+    CHECK_EQ(coding(negotiated("gzip;q=0.9, *;q=0.1")), coding(ContentCoding::Gzip));
+}
+
+// identity is always acceptable, so listing it changes nothing, and it is
+// never answered with a coding
+void identity()
+{
+    CHECK_EQ(coding(negotiated("identity")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("identity;q=0")), coding(ContentCoding::Identity));
+    CHECK_EQ(coding(negotiated("identity, unknown")), coding(ContentCoding::Identity));
+    if (!contentCodingAvailable(ContentCoding::Gzip)) return;
+    CHECK_EQ(coding(negotiated("identity;q=1, gzip;q=0.5")), coding(ContentCoding::Gzip));
+    CHECK_EQ(coding(negotiated("identity;q=0, gzip")), coding(ContentCoding::Gzip));
+}
+
+void types()
+{
+    for (const char *type : {"text/html", "TEXT/plain; charset=utf-8", "application/json", "image/svg+xml",
+                             "application/ld+json", "application/atom+xml", "application/javascript"})
+        CHECK(compressibleType(type));
+    for (const char *type : {"image/png", "application/zip", "video/mp4", "application/octet-stream", "", "text"})
+        CHECK(!compressibleType(type));
+}
+
+#ifdef HAVE_ZLIB
+// gzip or deflate (zlib) data inflated whole; empty on an error
+std::string inflated(const std::string &data)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) return "";
+    std::string out;
+    char buffer[16384];
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = (uInt)data.size();
+    int rc = Z_OK;
+    while (rc == Z_OK)
+    {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return rc == Z_STREAM_END ? out : "";
+}
+
+// pieces of every size, some of which make no output yet
+void streamedEncoders()
+{
+    std::string body;
+    for (int i = 0; body.size() < 300000; i++) body += "line " + std::to_string(i) + " of the body\n";
+    for (ContentCoding c : {ContentCoding::Gzip, ContentCoding::Deflate})
+    {
+        std::unique_ptr<ContentEncoder> encoder = ContentEncoder::create(c, 6);
+        CHECK(encoder != nullptr);
+        if (!encoder) continue;
+        std::string packed;
+        size_t at = 0, piece = 1;
+        while (at < body.size())
+        {
+            size_t len = std::min(piece, body.size() - at);
+            CHECK(encoder->encode(body.data() + at, len, false, packed));
+            at += len;
+            piece *= 3;
+        }
+        CHECK(encoder->encode(nullptr, 0, true, packed));
+        CHECK(packed.size() < body.size() / 4);
+        CHECK(inflated(packed) == body);
+
+        std::string whole;
+        CHECK(encodeBody(c, 6, body, whole));
+        CHECK(inflated(whole) == body);
+    }
+    CHECK(ContentEncoder::create(ContentCoding::Identity, 6) == nullptr);
+}
+#endif
+
+} // namespace
+
+int main()
+{
+    qValues();
+    ties();
+    wildcard();
+    identity();
+    types();
+#ifdef HAVE_ZLIB
+    streamedEncoders();
+#endif
+    return checkResult();
+}
@@ -0,0 +1,150 @@
+#ifndef HTTPTEST_H
+#define HTTPTEST_H
+
+#include "httpserver.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An HttpServer on 127.0.0.1:`port`, served from a thread of its own for
+// as long as the object lives.
+class TestServer
+{
+public:
+    TestServer(HttpHandler handler, int port, const HttpOptions &http = HttpOptions(),
+               const ServerOptions &options = ServerOptions())
+        : server(std::move(handler), options, http)
+    {
+        Logger::setLevel(LogLevel::Warn);
+        ready = server.initialize(port, "127.0.0.1");
+        if (ready)
+            serving = std::thread([this] {
+                server.start();
+                finished = true;
+            });
+    }
+
+    ~TestServer() { stop(); }
+
+    // what HttpServer::stop() does, and wait for start() to return
+    void stop()
+    {
+        if (!serving.joinable()) return;
+        server.stop();
+        serving.join();
+    }
+
+    // whether start() has returned, for a server stopped by something else
+    bool done() const { return finished; }
+
+    bool ready;
+
+private:
+    HttpServer server;
+    std::atomic<bool> finished{false};
+    std::thread serving;
+};
+
+// Send `request` in one write and read until the server closes the
+// connection or `timeoutMs` passes without a byte.
+inline std::string roundTrip(int port, const std::string &request, int timeoutMs = 3000)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        if (fd >= 0) close(fd);
+        return "";
+    }
+
+    size_t sent = 0;
+    while (sent < request.size())
+    {
+        ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += (size_t)n;
+    }
+
+    std::string received;
+    char buffer[65536];
+    pollfd readable = {fd, POLLIN, 0};
+    while (poll(&readable, 1, timeoutMs) > 0)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        received.append(buffer, (size_t)n);
+    }
+    close(fd);
+    return received;
+}
+
+struct TestResponse
+{
+    int status;
+    std::string head; // status line and headers
+    std::string body;
+};
+
+// the responses in a stream read by roundTrip(), framed by Content-Length or
+// chunked; a response without either takes the rest. Not for answers to
+// HEAD, whose Content-Length has no body behind it
+inline std::vector<TestResponse> splitResponses(const std::string &stream)
+{
+    std::vector<TestResponse> responses;
+    size_t at = 0;
+    while (at < stream.size())
+    {
+        size_t end = stream.find("\r\n\r\n", at);
+        if (end == std::string::npos) break;
+        TestResponse response;
+        response.head = stream.substr(at, end + 4 - at);
+        response.status = std::atoi(response.head.c_str() + 9);
+        at = end + 4;
+
+        size_t length = response.head.find("Content-Length: ");
+        if (length != std::string::npos)
+        {
+            size_t size = std::strtoul(response.head.c_str() + length + 16, nullptr, 10);
+            response.body = stream.substr(at, size);
+            at += response.body.size();
+        }
+        else if (response.head.find("Transfer-Encoding: chunked") != std::string::npos)
+        {
+            for (;;)
+            {
+                size_t line = stream.find("\r\n", at);
+                if (line == std::string::npos) return responses;
+                size_t size = std::strtoul(stream.c_str() + at, nullptr, 16);
+                at = line + 2;
+                if (size == 0)
+                {
+                    at += 2;
+                    break;
+                }
+                response.body += stream.substr(at, size);
+                at += size + 2;
+            }
+        }
+        else
+        {
+            response.body = stream.substr(at);
+            at = stream.size();
+        }
+        responses.push_back(response);
+    }
+    return responses;
+}
+
+#endif
@@ -0,0 +1,233 @@
+// Server lifecycle: stop() drains the connections it has, and a hot
+// restart hands the listeners to a successor without refusing anyone.
+#include "check.h"
+#include "httptest.h"
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+
+const int PORT = 18511;
+
+typedef std::chrono::steady_clock Clock;
+
+long long millisSince(Clock::time_point start)
+{
+    return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+// a keep-alive client connection, read one response at a time
+class Client
+{
+public:
+    explicit Client(int port) : fd(socket(AF_INET, SOCK_STREAM, 0))
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    ~Client()
+    {
+        if (fd >= 0) close(fd);
+    }
+
+    bool connected() const { return fd >= 0; }
+
+    void send(const std::string &request) { ::send(fd, request.data(), request.size(), MSG_NOSIGNAL); }
+
+    // the next whole response, empty when the server closes or goes quiet
+    std::string response(int timeoutMs = 3000)
+    {
+        for (;;)
+        {
+            std::vector<TestResponse> responses = splitResponses(pending);
+            size_t end = pending.find("\r\n\r\n");
+            if (!responses.empty() && end != std::string::npos)
+            {
+                size_t length = end + 4 + responses[0].body.size();
+                if (responses[0].head.find("Content-Length: ") != std::string::npos && pending.size() >= length)
+                {
+                    std::string whole = pending.substr(0, length);
+                    pending.erase(0, length);
+                    return whole;
+                }
+            }
+            if (!read(timeoutMs)) return "";
+        }
+    }
+
+    // whether the server closes the connection within `timeoutMs`
+    bool closed(int timeoutMs)
+    {
+        while (read(timeoutMs)) {}
+        return eof;
+    }
+
+private:
+    int fd;
+    std::string pending;
+    bool eof = false;
+
+    bool read(int timeoutMs)
+    {
+        pollfd readable = {fd, POLLIN, 0};
+        if (eof || poll(&readable, 1, timeoutMs) <= 0) return false;
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+        {
+            eof = true;
+            return false;
+        }
+        pending.append(buffer, (size_t)n);
+        return true;
+    }
+};
+
+HttpHandler named(const std::string &name)
+{
+    return [name](const HttpRequest &request) {
+        if (request.path() == "/slow") std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return HttpResponse::Builder().body(name).build();
+    };
+}
+
+std::string bodyOf(const std::string &response)
+{
+    std::vector<TestResponse> responses = splitResponses(response);
+    return responses.empty() ? "" : responses[0].body;
+}
+
+// the body of the answer to GET / on a connection of its own
+std::string fetch(int port)
+{
+    return bodyOf(roundTrip(port, "GET / HTTP/1.1\r\nConnection: close\r\n\r\n"));
+}
+
+ServerOptions handoffOptions(const char *path, unsigned reactors)
+{
+    ServerOptions options;
+    options.reactors = reactors;
+    options.pinThreads = false;
+    options.handoffPath = path;
+    return options;
+}
+
+// start() takes the handoff path over once its reactors are up; a
+// successor started before that finds nobody to take over from
+void awaitHandoffPath(const char *path)
+{
+    Clock::time_point start = Clock::now();
+    struct stat info;
+    while ((stat(path, &info) != 0 || !S_ISSOCK(info.st_mode)) && millisSince(start) < 2000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // bound, and listening a moment later
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+// wait up to two seconds for `server` to stop on its own
+bool stopsSoon(const TestServer &server)
+{
+    Clock::time_point start = Clock::now();
+    while (!server.done() && millisSince(start) < 2000) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return server.done();
+}
+
+// the request in progress is answered, with Connection: close; idle
+// connections are closed at once rather than at the drain deadline
+void drain()
+{
+    ServerOptions options;
+    options.reactors = 2;
+    options.pinThreads = false;
+    options.drainTimeoutMs = 5000;
+    HttpOptions http;
+    http.workers = 2;
+    TestServer server(named("drained"), PORT, http, options);
+    CHECK(server.ready);
+
+    Client idle(PORT);
+    idle.send("GET / HTTP/1.1\r\n\r\n");
+    CHECK_EQ(bodyOf(idle.response()), "drained");
+    Client busy(PORT);
+    busy.send("GET /slow HTTP/1.1\r\n\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    Clock::time_point start = Clock::now();
+    server.stop();
+    CHECK(millisSince(start) < 2000);
+    CHECK(idle.closed(1000));
+
+    std::string answer = busy.response();
+    CHECK_EQ(bodyOf(answer), "drained");
+    CHECK(answer.find("Connection: close\r\n") != std::string::npos);
+    CHECK(busy.closed(1000));
+
+    // and nothing listens any more
+    CHECK(!Client(PORT).connected());
+}
+
+// The successor inherits the listening sockets, the predecessor stops once
+// the successor runs, and its open connections finish there.
+void handoff()
+{
+    const char *path = "/tmp/httpserver-lifecycle-test.sock";
+    unlink(path);
+    TestServer old(named("old"), PORT + 1, HttpOptions(), handoffOptions(path, 2));
+    CHECK(old.ready);
+    Client kept(PORT + 1);
+    kept.send("GET / HTTP/1.1\r\n\r\n");
+    CHECK_EQ(bodyOf(kept.response()), "old");
+
+    awaitHandoffPath(path);
+    TestServer next(named("new"), PORT + 1, HttpOptions(), handoffOptions(path, 1));
+    CHECK(next.ready);
+    CHECK(stopsSoon(old));
+    CHECK(kept.closed(1000));
+
+    for (int i = 0; i < 20; i++) CHECK_EQ(fetch(PORT + 1), "new");
+
+    // the next restart takes over from the successor in turn
+    awaitHandoffPath(path);
+    TestServer third(named("third"), PORT + 1, HttpOptions(), handoffOptions(path, 1));
+    CHECK(third.ready);
+    CHECK(stopsSoon(next));
+    CHECK_EQ(fetch(PORT + 1), "third");
+    unlink(path);
+}
+
+// more reactors than one SCM_RIGHTS message carries are clamped to what it
+// does, so every listener still reaches the successor
+void manyReactors()
+{
+    const char *path = "/tmp/httpserver-lifecycle-many.sock";
+    unlink(path);
+    TestServer old(named("old"), PORT + 2, HttpOptions(), handoffOptions(path, 300));
+    CHECK(old.ready);
+    CHECK_EQ(fetch(PORT + 2), "old");
+
+    awaitHandoffPath(path);
+    TestServer next(named("new"), PORT + 2, HttpOptions(), handoffOptions(path, 1));
+    CHECK(next.ready);
+    CHECK(stopsSoon(old));
+    for (int i = 0; i < 20; i++) CHECK_EQ(fetch(PORT + 2), "new");
+    unlink(path);
+}
+
+} // namespace
+
+int main()
+{
+    drain();
+    handoff();
+    manyReactors();
+    return checkResult();
+}
@@ -0,0 +1,59 @@
+// Metrics::render(): per-thread labels, and gauges moved from more than one
+// thread rendered as one sum.
+#include "check.h"
+#include "metrics.h"
+#include <thread>
+
+namespace
+{
+
+bool contains(const std::string &text, const std::string &line)
+{
+    return text.find(line) != std::string::npos;
+}
+
+void gauges()
+{
+    Metrics::nameThread("main");
+    Metrics::local().add(MetricGauge::OpenConnections, 2);
+    Metrics::local().add(MetricGauge::CacheBytes, 100);
+    Metrics::local().add(MetricGauge::HttpInFlight, 3);
+    std::thread other([] {
+        Metrics::nameThread("worker");
+        Metrics::local().add(MetricGauge::OpenConnections, 1);
+        Metrics::local().add(MetricGauge::CacheBytes, -40);
+        Metrics::local().add(MetricGauge::HttpInFlight, -3);
+    });
+    other.join();
+
+    std::string text = Metrics::render();
+    CHECK(contains(text, "tcp_open_connections{thread=\"main\"} 2\n"));
+    CHECK(contains(text, "tcp_open_connections{thread=\"worker\"} 1\n"));
+    CHECK(contains(text, "\nhttp_cache_bytes 60\n"));
+    CHECK(contains(text, "\nhttp_worker_requests 0\n"));
+    CHECK(!contains(text, "http_cache_bytes{"));
+}
+
+void counters()
+{
+    Metrics::local().add(MetricCounter::HttpRequests, 5);
+    std::thread other([] {
+        Metrics::nameThread("worker");
+        Metrics::local().add(MetricCounter::HttpRequests, 2);
+    });
+    other.join();
+
+    // a label shared by two threads is one series
+    std::string text = Metrics::render();
+    CHECK(contains(text, "http_requests_total{thread=\"main\"} 5\n"));
+    CHECK(contains(text, "http_requests_total{thread=\"worker\"} 2\n"));
+}
+
+} // namespace
+
+int main()
+{
+    gauges();
+    counters();
+    return checkResult();
+}
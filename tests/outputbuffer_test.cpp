@@ -0,0 +1,259 @@
+// OutputBuffer: coalescing small writes, moving large chunks in whole,
+// sharing cached ones, writing in place, file slices, sealed chunks, and
+// partial sends checked byte for byte against a plain string.
+#include "check.h"
+#include "outputbuffer.h"
+#include <string>
+
+namespace
+{
+
+// the memory bytes at the front, up to the first file slice
+std::string front(const OutputBuffer &buffer)
+{
+    struct iovec iov[64];
+    size_t bytes = 0;
+    size_t count = buffer.gather(iov, 64, bytes);
+    std::string out;
+    for (size_t i = 0; i < count; i++) out.append((const char *)iov[i].iov_base, iov[i].iov_len);
+    CHECK_EQ(out.size(), bytes);
+    return out;
+}
+
+size_t iovecs(const OutputBuffer &buffer)
+{
+    struct iovec iov[64];
+    size_t bytes = 0;
+    return buffer.gather(iov, 64, bytes);
+}
+
+void coalescing()
+{
+    OutputBuffer buffer;
+    CHECK(buffer.empty());
+    CHECK_EQ(iovecs(buffer), 0u);
+    buffer.append("HTTP/1.1 200 OK\r\n", 17);
+    buffer.append(std::string("Content-Length: 2\r\n\r\n"));
+    buffer.append(std::string("ok")); // small and owned: copied all the same
+    buffer.append("", 0);
+    CHECK_EQ(buffer.size(), 40u);
+    CHECK_EQ(iovecs(buffer), 1u);
+    CHECK_EQ(front(buffer), "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+
+    // writes fill a chunk up to CHUNK_SIZE, then start the next
+    std::string piece(1000, 'p');
+    for (int i = 0; i < 20; i++) buffer.append(piece);
+    CHECK_EQ(buffer.size(), 20040u);
+    CHECK_EQ(iovecs(buffer), 2u);
+}
+
+void movedChunks()
+{
+    OutputBuffer buffer;
+    buffer.append("head", 4);
+    std::string body(100000, 'b');
+    const char *storage = body.data();
+    buffer.append(std::move(body));
+    buffer.append("tail", 4);
+
+    struct iovec iov[8];
+    size_t bytes = 0;
+    CHECK_EQ(buffer.gather(iov, 8, bytes), 3u);
+    CHECK_EQ(bytes, 100008u);
+    // queued as it was, not copied
+    CHECK(iov[1].iov_base == storage);
+    CHECK_EQ(iov[1].iov_len, 100000u);
+    // and gather() stops at `max`
+    CHECK_EQ(buffer.gather(iov, 2, bytes), 2u);
+    CHECK_EQ(bytes, 100004u);
+}
+
+// bytes shared with a cache are queued as they are and held until sent
+void sharedChunks()
+{
+    std::shared_ptr<const std::string> body = std::make_shared<const std::string>(50000, 's');
+    OutputBuffer buffer;
+    buffer.append("head", 4);
+    buffer.append(body);
+    buffer.append("tail", 4);
+    CHECK_EQ(body.use_count(), 2);
+
+    struct iovec iov[8];
+    size_t bytes = 0;
+    CHECK_EQ(buffer.gather(iov, 8, bytes), 3u);
+    CHECK_EQ(bytes, 50008u);
+    CHECK(iov[1].iov_base == body->data());
+
+    // nothing is appended to it, and a partial send moves along it
+    buffer.consume(1004);
+    CHECK_EQ(front(buffer), std::string(49000, 's') + "tail");
+    buffer.consume(49000);
+    CHECK_EQ(body.use_count(), 1);
+    CHECK_EQ(*body, std::string(50000, 's'));
+
+    // a small one is copied like any small write
+    buffer.append(std::make_shared<const std::string>("tiny"));
+    CHECK_EQ(iovecs(buffer), 1u);
+    CHECK_EQ(front(buffer), "tailtiny");
+}
+
+void inPlace()
+{
+    OutputBuffer buffer;
+    buffer.append("a", 1);
+    char *out = buffer.prepare(100);
+    CHECK_EQ(buffer.size(), 101u);
+    out[0] = 'b';
+    out[1] = 'c';
+    buffer.commit(out + 2);
+    CHECK_EQ(buffer.size(), 3u);
+    CHECK_EQ(front(buffer), "abc");
+
+    // more than a chunk holds gets a chunk of its own
+    out = buffer.prepare(OutputBuffer::CHUNK_SIZE * 2);
+    std::string big(OutputBuffer::CHUNK_SIZE + 5, 'x');
+    big.copy(out, big.size());
+    buffer.commit(out + big.size());
+    CHECK_EQ(buffer.size(), 3 + big.size());
+    CHECK_EQ(front(buffer), "abc" + big);
+}
+
+void fileSlices()
+{
+    std::shared_ptr<FileHandle> file = std::make_shared<FileHandle>(-1);
+    OutputBuffer buffer;
+    buffer.append("head", 4);
+    buffer.appendFile(file, 100, 5000);
+    buffer.appendFile(file, 0, 0);
+    buffer.append("tail", 4);
+    CHECK_EQ(buffer.size(), 5008u);
+
+    uint64_t offset = 0;
+    size_t length = 0;
+    CHECK(buffer.frontFile(offset, length) == nullptr);
+    CHECK_EQ(front(buffer), "head");
+
+    buffer.consume(4);
+    CHECK(buffer.frontFile(offset, length) == file.get());
+    CHECK_EQ(offset, 100u);
+    CHECK_EQ(length, 5000u);
+    CHECK_EQ(iovecs(buffer), 0u);
+
+    // a partial sendfile() moves the slice along
+    buffer.consume(1000);
+    CHECK(buffer.frontFile(offset, length) == file.get());
+    CHECK_EQ(offset, 1100u);
+    CHECK_EQ(length, 4000u);
+    buffer.consume(4000);
+    CHECK(buffer.frontFile(offset, length) == nullptr);
+    CHECK_EQ(front(buffer), "tail");
+    CHECK_EQ(buffer.size(), 4u);
+    // the queue let go of the file
+    CHECK_EQ(file.use_count(), 1);
+}
+
+// a send in flight holds iovecs into the queued chunks: nothing is
+// appended to them until it completes
+void sealed()
+{
+    OutputBuffer buffer;
+    buffer.append("first", 5);
+    struct iovec iov[4];
+    size_t bytes = 0;
+    buffer.gather(iov, 4, bytes);
+    buffer.seal();
+    buffer.append("second", 6);
+    CHECK_EQ(iovecs(buffer), 2u);
+    CHECK_EQ(std::string((const char *)iov[0].iov_base, iov[0].iov_len), "first");
+
+    buffer.consume(5);
+    buffer.append("third", 5);
+    CHECK_EQ(iovecs(buffer), 1u);
+    CHECK_EQ(front(buffer), "secondthird");
+}
+
+// random appends of every kind and partial sends, against a string
+void randomized()
+{
+    OutputBuffer buffer;
+    std::string model;
+    uint64_t state = 12345;
+    auto next = [&state](uint64_t range) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return (size_t)((state >> 33) % range);
+    };
+    char letter = 'a';
+    for (int step = 0; step < 20000; step++)
+    {
+        std::string data(next(4) == 0 ? next(40000) : next(300), letter);
+        letter = letter == 'z' ? 'a' : (char)(letter + 1);
+        switch (next(4))
+        {
+        case 0:
+            buffer.append(data.data(), data.size());
+            break;
+        case 1:
+            buffer.append(std::string(data));
+            break;
+        case 2:
+        {
+            char *out = buffer.prepare(data.size() + next(100));
+            data.copy(out, data.size());
+            buffer.commit(out + data.size());
+            break;
+        }
+        default:
+        {
+            // send part of what gather() offers
+            std::string sendable = front(buffer);
+            bool same = model.compare(0, sendable.size(), sendable) == 0;
+            CHECK(same);
+            if (!same) return;
+            size_t sent = sendable.empty() ? 0 : next(sendable.size() + 1);
+            buffer.consume(sent);
+            model.erase(0, sent);
+            continue;
+        }
+        }
+        model += data;
+        CHECK_EQ(buffer.size(), model.size());
+    }
+    while (!buffer.empty())
+    {
+        std::string sendable = front(buffer);
+        CHECK(!sendable.empty());
+        if (sendable.empty()) break;
+        CHECK_EQ(model.compare(0, sendable.size(), sendable), 0);
+        buffer.consume(sendable.size());
+        model.erase(0, sendable.size());
+    }
+    CHECK(model.empty());
+}
+
+void clearing()
+{
+    OutputBuffer buffer;
+    buffer.append(std::string(50000, 'c'));
+    buffer.appendFile(std::make_shared<FileHandle>(-1), 0, 10);
+    buffer.consume(7);
+    buffer.clear();
+    CHECK(buffer.empty());
+    CHECK_EQ(iovecs(buffer), 0u);
+    buffer.append("again", 5);
+    CHECK_EQ(front(buffer), "again");
+}
+
+} // namespace
+
+int main()
+{
+    coalescing();
+    movedChunks();
+    sharedChunks();
+    inPlace();
+    fileSlices();
+    sealed();
+    randomized();
+    clearing();
+    return checkResult();
+}
@@ -0,0 +1,197 @@
+// HttpRequestParser: requests whole, in pieces and pipelined, the framing
+// rules, and the status each malformed or oversized request is refused with.
+#include "check.h"
+#include "httprequest.h"
+#include <string>
+
+namespace
+{
+
+// parse `text` in one call; the request views a copy kept until the next
+HttpRequestParser::Status parseAll(HttpRequestParser &parser, const std::string &text)
+{
+    static std::string kept;
+    kept = text;
+    parser.reset();
+    return parser.parse(kept.data(), kept.size());
+}
+
+// the status a malformed request is refused with, 0 if it is not
+int refusal(const std::string &text, size_t maxHead = HttpRequestParser::DEFAULT_MAX_HEAD_SIZE,
+            uint64_t maxBody = HttpRequestParser::DEFAULT_MAX_BODY_SIZE)
+{
+    HttpRequestParser parser;
+    parser.setLimits(maxHead, maxBody);
+    return parser.parse(text.data(), text.size()) == HttpRequestParser::Invalid ? parser.errorStatus() : 0;
+}
+
+void wholeRequest()
+{
+    HttpRequestParser parser;
+    std::string text = "POST /items/7?full=1&x HTTP/1.1\r\n"
+                       "Host: example.com\r\n"
+                       "X-Padded:   spaced value \t\r\n"
+                       "Content-Length: 5\r\n"
+                       "\r\n"
+                       "hello";
+    CHECK_EQ(parseAll(parser, text), HttpRequestParser::Complete);
+    const HttpRequest &request = parser.request();
+    CHECK_EQ(request.method.str(), "POST");
+    CHECK_EQ(request.target.str(), "/items/7?full=1&x");
+    CHECK_EQ(request.path().str(), "/items/7");
+    CHECK_EQ(request.query().str(), "full=1&x");
+    CHECK_EQ(request.versionMinor, 1);
+    CHECK_EQ(request.headerCount, 3u);
+    CHECK_EQ(request.header("host").str(), "example.com");
+    CHECK_EQ(request.header("X-PADDED").str(), "spaced value");
+    CHECK(!request.hasHeader("Accept"));
+    CHECK_EQ(request.body.str(), "hello");
+    CHECK_EQ(request.contentLength, 5u);
+    CHECK_EQ(parser.consumed(), text.size());
+    CHECK(request.keepAlive());
+}
+
+// fed a byte more at a time, as reads trickle in
+void pieceByPiece()
+{
+    std::string text = "GET /a HTTP/1.1\r\nHost: h\r\nContent-Length: 3\r\n\r\nabc";
+    HttpRequestParser parser;
+    for (size_t len = 1; len < text.size(); len++)
+        CHECK_EQ(parser.parse(text.data(), len), HttpRequestParser::Incomplete);
+    CHECK_EQ(parser.parse(text.data(), text.size()), HttpRequestParser::Complete);
+    CHECK_EQ(parser.request().body.str(), "abc");
+    CHECK_EQ(parser.request().header("Host").str(), "h");
+    // parsing again after Complete changes nothing
+    CHECK_EQ(parser.parse(text.data(), text.size()), HttpRequestParser::Complete);
+}
+
+void pipelined()
+{
+    std::string text = "GET /one HTTP/1.1\r\n\r\n"
+                       "\r\n" // stray CRLF between requests is tolerated
+                       "GET /two HTTP/1.1\n"
+                       "Host: bare-lf\n"
+                       "\n"
+                       "GET /three HTTP/1.1\r\n";
+    HttpRequestParser parser;
+    size_t at = 0;
+    CHECK_EQ(parser.parse(text.data() + at, text.size() - at), HttpRequestParser::Complete);
+    CHECK_EQ(parser.request().target.str(), "/one");
+    at += parser.consumed();
+    parser.reset();
+    CHECK_EQ(parser.parse(text.data() + at, text.size() - at), HttpRequestParser::Complete);
+    CHECK_EQ(parser.request().target.str(), "/two");
+    CHECK_EQ(parser.request().header("Host").str(), "bare-lf");
+    at += parser.consumed();
+    parser.reset();
+    CHECK_EQ(parser.parse(text.data() + at, text.size() - at), HttpRequestParser::Incomplete);
+}
+
+void keepAlive()
+{
+    HttpRequestParser parser;
+    parseAll(parser, "GET / HTTP/1.1\r\nConnection: Close\r\n\r\n");
+    CHECK(!parser.request().keepAlive());
+    parseAll(parser, "GET / HTTP/1.1\r\nConnection: upgrade, close\r\n\r\n");
+    CHECK(!parser.request().keepAlive());
+    parseAll(parser, "GET / HTTP/1.0\r\n\r\n");
+    CHECK_EQ(parser.request().versionMinor, 0);
+    CHECK(!parser.request().keepAlive());
+    parseAll(parser, "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    CHECK(parser.request().keepAlive());
+}
+
+void malformed()
+{
+    CHECK_EQ(refusal("GET /\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET  / HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(refusal("G(T / HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/1.12\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/1.x\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET /a\x01 HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/2.0\r\n\r\n"), 505);
+    CHECK_EQ(refusal("GET / HTTP/1.1\r\nNo-Colon\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/1.1\r\n: empty-name\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/1.1\r\nBad Name: x\r\n\r\n"), 400);
+    CHECK_EQ(refusal("GET / HTTP/1.1\r\nA: b\x7f\r\n\r\n"), 400);
+    // obsolete line folding
+    CHECK_EQ(refusal("GET / HTTP/1.1\r\nA: b\r\n  folded\r\n\r\n"), 400);
+}
+
+void framing()
+{
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length:\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n"), 413);
+    // request smuggling: both framings, or chunked twice
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"), 501);
+    CHECK_EQ(refusal("POST / HTTP/1.0\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+
+    // agreeing copies are one length
+    HttpRequestParser parser;
+    CHECK_EQ(parseAll(parser, "POST / HTTP/1.1\r\nContent-Length: 2\r\ncontent-length: 2\r\n\r\nok"),
+             HttpRequestParser::Complete);
+    CHECK_EQ(parser.request().body.str(), "ok");
+}
+
+void limits()
+{
+    std::string longTarget = "GET /" + std::string(200, 'a') + " HTTP/1.1\r\n\r\n";
+    CHECK_EQ(refusal(longTarget, 128), 414);
+    // over the limit before the line ends
+    CHECK_EQ(refusal(longTarget.substr(0, 150), 128), 414);
+    CHECK_EQ(refusal(longTarget, 256), 0);
+
+    std::string bigHeaders = "GET / HTTP/1.1\r\nX-Big: " + std::string(200, 'b') + "\r\n\r\n";
+    CHECK_EQ(refusal(bigHeaders, 128), 431);
+    CHECK_EQ(refusal(bigHeaders.substr(0, 150), 128), 431);
+
+    std::string many = "GET / HTTP/1.1\r\n";
+    for (size_t i = 0; i < HttpRequest::MAX_HEADERS; i++) many += "H" + std::to_string(i) + ": v\r\n";
+    CHECK_EQ(refusal(many + "\r\n"), 0);
+    CHECK_EQ(refusal(many + "One-Too-Many: v\r\n\r\n"), 431);
+
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\n", 8192, 10), 413);
+    CHECK_EQ(refusal("POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n", 8192, 10), 0);
+}
+
+void headFirst()
+{
+    HttpRequestParser parser;
+    parser.pauseAfterHead(true);
+    std::string text = "PUT /f HTTP/1.1\r\nContent-Length: 4\r\n\r\n";
+    CHECK_EQ(parser.parse(text.data(), text.size()), HttpRequestParser::HeadComplete);
+    CHECK_EQ(parser.headSize(), text.size());
+    CHECK(!parser.chunkedBody());
+    CHECK_EQ(parser.request().target.str(), "/f");
+    CHECK(parser.request().body.empty());
+
+    // parsing again buffers the body as usual
+    text += "data";
+    CHECK_EQ(parser.parse(text.data(), text.size()), HttpRequestParser::Complete);
+    CHECK(parser.reportedHead());
+    CHECK_EQ(parser.request().body.str(), "data");
+
+    // nothing to pause for without a body
+    CHECK_EQ(parseAll(parser, "GET / HTTP/1.1\r\n\r\n"), HttpRequestParser::Complete);
+    CHECK(!parser.reportedHead());
+}
+
+} // namespace
+
+int main()
+{
+    wholeRequest();
+    pieceByPiece();
+    pipelined();
+    keepAlive();
+    malformed();
+    framing();
+    limits();
+    headFirst();
+    return checkResult();
+}
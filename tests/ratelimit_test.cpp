@@ -0,0 +1,162 @@
+// RateLimiter: bursts, refill at the configured rate, per-client and
+// per-route buckets, a full table, the canned 429, and many threads
+// charging one bucket.
+#include "check.h"
+#include "ratelimit.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const uint64_t MS = 1000000;
+const uint64_t START = 1000000 * MS; // any clock reading will do
+
+// requests from `address` for `path` at `now` that get through out of `n`
+unsigned allowed(RateLimiter &limiter, uint32_t address, const char *path, uint64_t now, unsigned n)
+{
+    unsigned passed = 0;
+    for (unsigned i = 0; i < n; i++) passed += limiter.allow(address, path, now);
+    return passed;
+}
+
+void burstAndRefill()
+{
+    // 10 a second: a token every 100 ms, 5 at most
+    RateLimiter limiter(10, 5);
+    CHECK_EQ(allowed(limiter, 1, "/", START, 10), 5u);
+
+    // one token back per interval, none before
+    CHECK_EQ(allowed(limiter, 1, "/", START + 99 * MS, 1), 0u);
+    CHECK_EQ(allowed(limiter, 1, "/", START + 100 * MS, 3), 1u);
+    CHECK_EQ(allowed(limiter, 1, "/", START + 350 * MS, 5), 2u);
+
+    // a long idle spell refills up to the burst and no further
+    CHECK_EQ(allowed(limiter, 1, "/", START + 60000 * MS, 10), 5u);
+}
+
+// a client keeping exactly to the rate is never refused, one just above it
+// runs out once its burst is spent
+void steadyRate()
+{
+    RateLimiter limiter(100, 2);
+    unsigned passed = 0;
+    for (unsigned i = 0; i < 1000; i++) passed += limiter.allow(1, "/", START + i * 10 * MS);
+    CHECK_EQ(passed, 1000u);
+
+    passed = 0;
+    for (unsigned i = 0; i < 1000; i++) passed += limiter.allow(2, "/", START + i * 9 * MS);
+    // 9 s at 100 a second, plus the burst
+    CHECK(passed >= 899 && passed <= 902);
+}
+
+void clients()
+{
+    RateLimiter limiter(1, 3);
+    CHECK_EQ(allowed(limiter, 0x0100007f, "/", START, 5), 3u);
+    CHECK_EQ(allowed(limiter, 0x0200007f, "/", START, 5), 3u);
+    CHECK_EQ(allowed(limiter, 0x0100007f, "/", START, 1), 0u);
+
+    // a burst of 0 is one
+    RateLimiter single(1, 0);
+    CHECK_EQ(allowed(single, 1, "/", START, 3), 1u);
+    CHECK_EQ(allowed(single, 1, "/", START + 1000 * MS, 3), 1u);
+
+    // rate 0: no limit
+    RateLimiter open(0, 0);
+    CHECK_EQ(allowed(open, 1, "/", START, 1000), 1000u);
+}
+
+void routes()
+{
+    std::vector<RateLimitRule> rules = {
+        {"/api/login", 1, 2, true},   // per client
+        {"/api/", 10, 4, false},      // shared by every client
+        {"/static/", 0, 0, true},     // unlimited, past the client limit
+    };
+    RateLimiter limiter(1000, 100, rules);
+
+    CHECK_EQ(allowed(limiter, 1, "/api/login", START, 5), 2u);
+    CHECK_EQ(allowed(limiter, 2, "/api/login", START, 5), 2u);
+
+    // the first matching rule is the only one charged
+    CHECK_EQ(allowed(limiter, 1, "/api/items", START, 3), 3u);
+    CHECK_EQ(allowed(limiter, 2, "/api/items", START, 3), 1u);
+    CHECK_EQ(allowed(limiter, 3, "/api/items", START + 100 * MS, 3), 1u);
+
+    // off every route, only the client bucket counts
+    CHECK_EQ(allowed(limiter, 1, "/other", START, 50), 50u);
+    // a route without a limit still passes through the client's bucket
+    CHECK_EQ(allowed(limiter, 1, "/static/a.css", START, 100), 100u - 50 - 5 - 3);
+
+    // no client limit: only routes
+    RateLimiter routesOnly(0, 0, rules);
+    CHECK_EQ(allowed(routesOnly, 9, "/anything", START, 500), 500u);
+    CHECK_EQ(allowed(routesOnly, 9, "/api/login", START, 5), 2u);
+}
+
+// with every probe slot held by a live bucket a new client goes through
+// uncounted; a slot whose bucket has refilled is taken over
+void fullTable()
+{
+    RateLimiter limiter(1, 1, std::vector<RateLimitRule>(), RateLimiter::PROBE);
+    for (uint32_t client = 1; client <= RateLimiter::PROBE; client++)
+        CHECK_EQ(allowed(limiter, client, "/", START, 2), 1u);
+
+    CHECK_EQ(allowed(limiter, 100, "/", START, 5), 5u);
+    CHECK_EQ(allowed(limiter, 1, "/", START, 1), 0u);
+
+    // a second later every bucket is full again, and the new client is
+    // counted in one of their slots
+    CHECK_EQ(allowed(limiter, 100, "/", START + 1000 * MS, 5), 1u);
+}
+
+void rejection()
+{
+    for (int keepAlive = 0; keepAlive < 2; keepAlive++)
+    {
+        for (int head = 0; head < 2; head++)
+        {
+            size_t length = 0;
+            std::string response(RateLimiter::rejection(keepAlive != 0, head != 0, length));
+            CHECK_EQ(response.size(), length);
+            CHECK_EQ(response.compare(0, 32, "HTTP/1.1 429 Too Many Requests\r\n"), 0);
+            CHECK(response.find("Retry-After: 1\r\n") != std::string::npos);
+            CHECK(response.find(keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") !=
+                  std::string::npos);
+            size_t end = response.find("\r\n\r\n");
+            std::string body = response.substr(end + 4);
+            CHECK_EQ(body, head ? "" : "Too Many Requests\n");
+            CHECK(response.find("Content-Length: 18\r\n") != std::string::npos);
+        }
+    }
+}
+
+// threads racing on one bucket at one instant take exactly its burst
+void concurrent()
+{
+    const unsigned THREADS = 4, BURST = 1000;
+    RateLimiter limiter(1, BURST);
+    std::atomic<unsigned> passed(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < THREADS; t++)
+        threads.emplace_back([&] { passed += allowed(limiter, 42, "/", START, BURST); });
+    for (std::thread &thread : threads) thread.join();
+    CHECK_EQ(passed.load(), BURST);
+}
+
+} // namespace
+
+int main()
+{
+    burstAndRefill();
+    steadyRate();
+    clients();
+    routes();
+    fullTable();
+    rejection();
+    concurrent();
+    return checkResult();
+}
@@ -0,0 +1,299 @@
+// ResponseCache: what is stored and served, HEAD and Connection handling,
+// Vary keys, expiry, Cache-Control directives, CLOCK eviction within the
+// budget, and lookups racing stores and evictions.
+#include "check.h"
+#include "responsecache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// keeps what a hit queues
+class RecordingConnection : public TCPConnection
+{
+public:
+    std::string sent;
+
+    int fd() const override { return -1; }
+    uint64_t id() const override { return 1; }
+    CompletionQueue &completions() override { std::abort(); }
+    uint32_t peerAddress() override { return 0; }
+    void send(const char *data, size_t len) override { sent.append(data, len); }
+    void send(std::string &&data) override { sent += data; }
+    void send(const std::shared_ptr<const std::string> &data) override { sent += *data; }
+    char *prepareSend(size_t maxLen) override
+    {
+        start = sent.size();
+        sent.resize(start + maxLen);
+        return &sent[start];
+    }
+    void commitSend(char *end) override { sent.resize(start + (end - &sent[start])); }
+    void sendFile(const std::shared_ptr<FileHandle> &, uint64_t, size_t) override { std::abort(); }
+    void close() override {}
+
+private:
+    size_t start = 0;
+};
+
+struct Request
+{
+    std::string method;
+    std::string target;
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    // views into this, valid while it is
+    HttpRequest view() const
+    {
+        HttpRequest request;
+        request.method = StringView(method);
+        request.target = StringView(target);
+        for (const auto &h : headers)
+        {
+            request.headers[request.headerCount].name = StringView(h.first);
+            request.headers[request.headerCount].value = StringView(h.second);
+            request.headerCount++;
+        }
+        return request;
+    }
+};
+
+Request get(const std::string &target, std::vector<std::pair<std::string, std::string>> headers = {})
+{
+    return Request{"GET", target, std::move(headers)};
+}
+
+HttpResponse ok(const std::string &body, const char *name = nullptr, const char *value = nullptr)
+{
+    HttpResponse::Builder builder;
+    builder.body(body);
+    if (name != nullptr) builder.header(name, value);
+    return builder.build();
+}
+
+void store(ResponseCache &cache, const Request &request, const HttpResponse &response)
+{
+    cache.store(request.view(), response);
+}
+
+// the whole cached answer, empty on a miss
+std::string serve(ResponseCache &cache, const Request &request, bool keepAlive = true)
+{
+    RecordingConnection conn;
+    bool hit = cache.serve(conn, request.view(), keepAlive);
+    CHECK_EQ(hit, !conn.sent.empty());
+    return conn.sent;
+}
+
+std::string bodyOf(const std::string &answer)
+{
+    size_t end = answer.find("\r\n\r\n");
+    return end == std::string::npos ? "" : answer.substr(end + 4);
+}
+
+bool contains(const std::string &text, const std::string &part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+void hits()
+{
+    ResponseCache cache(1 << 20, 10000);
+    Request request = get("/page?x=1");
+    CHECK_EQ(serve(cache, request), "");
+    store(cache, request, ok("cached body", "X-Custom", "1"));
+    CHECK(cache.size() > 0);
+
+    std::string answer = serve(cache, request);
+    CHECK_EQ(answer.compare(0, 17, "HTTP/1.1 200 OK\r\n"), 0);
+    CHECK(contains(answer, "X-Custom: 1\r\n"));
+    CHECK(contains(answer, "\r\nDate: "));
+    CHECK(contains(answer, "Content-Length: 11\r\n"));
+    CHECK(contains(answer, "Connection: keep-alive\r\n\r\n"));
+    CHECK_EQ(bodyOf(answer), "cached body");
+
+    answer = serve(cache, request, false);
+    CHECK(contains(answer, "Connection: close\r\n\r\n"));
+
+    // HEAD from the GET entry, without the body
+    answer = serve(cache, Request{"HEAD", "/page?x=1", {}});
+    CHECK(contains(answer, "Content-Length: 11\r\n"));
+    CHECK_EQ(bodyOf(answer), "");
+
+    // the query is part of the key; other methods are neither served nor stored
+    CHECK_EQ(serve(cache, get("/page?x=2")), "");
+    CHECK_EQ(serve(cache, Request{"POST", "/page?x=1", {}}), "");
+    store(cache, Request{"POST", "/posted", {}}, ok("no"));
+    CHECK_EQ(serve(cache, get("/posted")), "");
+
+    // a later store replaces the entry
+    size_t before = cache.size();
+    store(cache, request, ok("fresh body!", "X-Custom", "1"));
+    CHECK_EQ(bodyOf(serve(cache, request)), "fresh body!");
+    CHECK_EQ(cache.size(), before);
+}
+
+void bypassed()
+{
+    ResponseCache cache(1 << 20, 10000);
+    store(cache, get("/a"), ok("a"));
+    for (const char *header : {"Authorization", "Cookie", "Range", "If-None-Match", "If-Modified-Since"})
+    {
+        CHECK_EQ(serve(cache, get("/a", {{header, "x"}})), "");
+        store(cache, get("/b", {{header, "x"}}), ok("b"));
+        CHECK_EQ(serve(cache, get("/b")), "");
+    }
+
+    // a Cookie the key varies on is fine
+    ResponseCache keyed(1 << 20, 10000, {"Cookie"});
+    store(keyed, get("/c", {{"Cookie", "id=1"}}), ok("one"));
+    CHECK_EQ(bodyOf(serve(keyed, get("/c", {{"Cookie", "id=1"}}))), "one");
+    CHECK_EQ(serve(keyed, get("/c", {{"Cookie", "id=2"}})), "");
+}
+
+void notStored()
+{
+    ResponseCache cache(1 << 20, 10000, {"Accept-Encoding"});
+    HttpResponse missing = HttpResponse::Builder().status(404).body("gone").build();
+    store(cache, get("/404"), missing);
+    store(cache, get("/cookie"), ok("x", "Set-Cookie", "a=b"));
+    store(cache, get("/no-store"), ok("x", "Cache-Control", "No-Store"));
+    store(cache, get("/no-cache"), ok("x", "cache-control", "public, no-cache"));
+    store(cache, get("/private"), ok("x", "Cache-Control", "private, max-age=60"));
+    store(cache, get("/max-age-0"), ok("x", "Cache-Control", "max-age=0"));
+    store(cache, get("/vary-other"), ok("x", "Vary", "Accept-Encoding, User-Agent"));
+    store(cache, get("/vary-star"), ok("x", "Vary", "*"));
+    store(cache, get("/too-big"), ok(std::string((1 << 20) / 8, 'z')));
+    HttpResponse block = ok("x");
+    block.headerBlock = std::make_shared<const std::string>("Vary: Origin\r\n");
+    store(cache, get("/vary-block"), block);
+    CHECK_EQ(cache.size(), 0u);
+
+    for (const char *target : {"/404", "/cookie", "/no-store", "/no-cache", "/private", "/max-age-0", "/vary-other",
+                               "/vary-star", "/too-big", "/vary-block"})
+        CHECK_EQ(serve(cache, get(target)), "");
+}
+
+void varyKeys()
+{
+    ResponseCache cache(1 << 20, 10000, {"Accept-Encoding"});
+    store(cache, get("/v", {{"Accept-Encoding", "gzip"}}), ok("zipped", "Vary", "accept-encoding"));
+    store(cache, get("/v"), ok("plain", "Vary", "Accept-Encoding"));
+    CHECK_EQ(bodyOf(serve(cache, get("/v", {{"Accept-Encoding", "gzip"}}))), "zipped");
+    CHECK_EQ(bodyOf(serve(cache, get("/v"))), "plain");
+    CHECK_EQ(serve(cache, get("/v", {{"Accept-Encoding", "br"}})), "");
+}
+
+void expiry()
+{
+    ResponseCache cache(1 << 20, 20);
+    store(cache, get("/short"), ok("soon gone"));
+    store(cache, get("/long"), ok("kept", "Cache-Control", "max-age=60"));
+    CHECK(!serve(cache, get("/short")).empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    CHECK_EQ(serve(cache, get("/short")), "");
+    CHECK_EQ(bodyOf(serve(cache, get("/long"))), "kept");
+}
+
+// directives are whole tokens: s-maxage is not max-age, and an extension
+// merely containing a forbidding name does not forbid anything
+void directives()
+{
+    ResponseCache cache(1 << 20, 20);
+    store(cache, get("/s-maxage"), ok("x", "Cache-Control", "s-maxage=0"));
+    store(cache, get("/extension"), ok("x", "Cache-Control", "x-not-private, public"));
+    store(cache, get("/spaced"), ok("x", "Cache-Control", "public , MAX-AGE = 60"));
+    // 2^64 / 10^9 seconds and more would wrap to an arbitrary lifetime
+    store(cache, get("/huge"), ok("x", "Cache-Control", "max-age=18446744074"));
+    store(cache, get("/huger"), ok("x", "Cache-Control", "max-age=99999999999999999999999999"));
+    store(cache, get("/bad"), ok("x", "Cache-Control", "max-age=6O"));
+    store(cache, get("/empty"), ok("x", "Cache-Control", "max-age="));
+    store(cache, get("/quoted"), ok("x", "Cache-Control", "no-cache=\"Set-Cookie\""));
+
+    // stored for the default lifetime
+    CHECK_EQ(bodyOf(serve(cache, get("/s-maxage"))), "x");
+    CHECK_EQ(bodyOf(serve(cache, get("/extension"))), "x");
+    for (const char *target : {"/bad", "/empty", "/quoted"}) CHECK_EQ(serve(cache, get(target)), "");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    CHECK_EQ(serve(cache, get("/s-maxage")), "");
+    for (const char *target : {"/spaced", "/huge", "/huger"}) CHECK_EQ(bodyOf(serve(cache, get(target))), "x");
+}
+
+// CLOCK keeps the cache within budget, and an entry hit since the hand last
+// passed outlives ones that were not
+void eviction()
+{
+    const size_t BUDGET = 64 * 1024;
+    ResponseCache cache(BUDGET, 10000);
+    std::string body(4000, 'e');
+    store(cache, get("/hot"), ok(body));
+    for (int i = 0; i < 100; i++)
+    {
+        CHECK(!serve(cache, get("/hot")).empty());
+        store(cache, get("/cold/" + std::to_string(i)), ok(body));
+        CHECK(cache.size() <= BUDGET);
+    }
+    CHECK(cache.size() > BUDGET / 2);
+    CHECK_EQ(serve(cache, get("/cold/0")), "");
+    CHECK_EQ(bodyOf(serve(cache, get("/cold/99"))), body);
+    CHECK_EQ(bodyOf(serve(cache, get("/hot"))), body);
+}
+
+// readers on several threads while a writer replaces and evicts: every hit
+// is whole, and freed entries are never read (run under ASan to be sure)
+void concurrent()
+{
+    ResponseCache cache(32 * 1024, 10000);
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned> torn(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&] {
+            while (!stop.load())
+            {
+                for (int k = 0; k < 16; k++)
+                {
+                    RecordingConnection conn;
+                    Request request = get("/k" + std::to_string(k));
+                    HttpRequest view = request.view();
+                    if (!cache.serve(conn, view, true)) continue;
+                    // a body is one repeated letter of its version's length
+                    std::string body = bodyOf(conn.sent);
+                    if (body.empty() || body.size() != (size_t)(body[0] - 'a' + 1) * 100 ||
+                        body.find_first_not_of(body[0]) != std::string::npos)
+                        torn++;
+                }
+            }
+        });
+    }
+    for (int round = 0; round < 2000; round++)
+    {
+        char letter = (char)('a' + round % 20);
+        store(cache, get("/k" + std::to_string(round % 16)), ok(std::string((letter - 'a' + 1) * 100, letter)));
+    }
+    stop = true;
+    for (std::thread &reader : readers) reader.join();
+    CHECK_EQ(torn.load(), 0u);
+    CHECK(cache.size() <= 32 * 1024);
+}
+
+} // namespace
+
+int main()
+{
+    hits();
+    bypassed();
+    notStored();
+    varyKeys();
+    expiry();
+    directives();
+    eviction();
+    concurrent();
+    return checkResult();
+}
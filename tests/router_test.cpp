@@ -0,0 +1,228 @@
+// Router: method parsing, literal over parameter over wildcard, backtracking
+// out of a dead end or a pattern without the method, 404 and 405, and the
+// patterns add() refuses.
+#include "check.h"
+#include "router.h"
+#include <string>
+
+namespace
+{
+
+// a handler answering with its name and the parameters it was given
+RouteHandler tagged(const std::string &name)
+{
+    return [name](const HttpRequest &, const RouteParams &params) {
+        std::string body = name;
+        for (size_t i = 0; i < params.size(); i++) body += " " + params.name(i).str() + "=" + params.value(i).str();
+        return HttpResponse::Builder().body(body).build();
+    };
+}
+
+HttpResponse get(const Router &router, const std::string &target, const char *method = "GET")
+{
+    HttpRequest request;
+    request.method = StringView(method);
+    request.target = StringView(target);
+    return router.route(request);
+}
+
+// the body of the response to GET `target`, or its status when not 200
+std::string answer(const Router &router, const std::string &target, const char *method = "GET")
+{
+    HttpResponse response = get(router, target, method);
+    return response.statusCode == 200 ? response.body : std::to_string(response.statusCode);
+}
+
+HttpResponse staticRoute(const HttpRequest &, const RouteParams &params)
+{
+    return HttpResponse::Builder().body("static " + params["path"].str()).build();
+}
+
+void methods()
+{
+    for (unsigned m = 0; m < (unsigned)HttpMethod::Count; m++)
+        CHECK(parseHttpMethod(httpMethodName((HttpMethod)m)) == (HttpMethod)m);
+    CHECK(parseHttpMethod("get") == HttpMethod::Count);
+    CHECK(parseHttpMethod("GETS") == HttpMethod::Count);
+    CHECK(parseHttpMethod("PUSH") == HttpMethod::Count);
+    CHECK(parseHttpMethod("") == HttpMethod::Count);
+    CHECK_EQ(std::string(httpMethodName(HttpMethod::Count)), "");
+}
+
+void precedence()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/users/*rest", tagged("rest")));
+    CHECK(router.add(HttpMethod::Get, "/users/:id", tagged("user")));
+    CHECK(router.add(HttpMethod::Get, "/users/me", tagged("me")));
+    CHECK(router.add(HttpMethod::Get, "/users/:id/posts", tagged("posts")));
+    CHECK(router.add(HttpMethod::Get, "/users/:id/posts/:post", tagged("post")));
+
+    CHECK_EQ(answer(router, "/users/me"), "me");
+    CHECK_EQ(answer(router, "/users/42"), "user id=42");
+    CHECK_EQ(answer(router, "/users/mega"), "user id=mega");
+    CHECK_EQ(answer(router, "/users/42/posts"), "posts id=42");
+    CHECK_EQ(answer(router, "/users/me/posts/7"), "post id=me post=7");
+    CHECK_EQ(answer(router, "/users/42/likes"), "rest rest=42/likes");
+    CHECK_EQ(answer(router, "/users/"), "rest rest=");
+    CHECK_EQ(answer(router, "/users//x"), "rest rest=/x");
+    CHECK_EQ(answer(router, "/users"), "404");
+    CHECK_EQ(answer(router, "/user"), "404");
+    // the query is not part of the path
+    CHECK_EQ(answer(router, "/users/42?tab=posts"), "user id=42");
+}
+
+// a preferred branch that dead-ends gives way to the next one
+void backtracking()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/files/new/edit", tagged("edit")));
+    CHECK(router.add(HttpMethod::Get, "/files/:id/view", tagged("view")));
+    CHECK(router.add(HttpMethod::Get, "/files/:id/:action/*rest", tagged("deep")));
+
+    CHECK_EQ(answer(router, "/files/new/edit"), "edit");
+    CHECK_EQ(answer(router, "/files/new/view"), "view id=new");
+    CHECK_EQ(answer(router, "/files/newer/view"), "view id=newer");
+    CHECK_EQ(answer(router, "/files/new/edit/x"), "deep id=new action=edit rest=x");
+    CHECK_EQ(answer(router, "/files/new"), "404");
+}
+
+// literal edges split where patterns part ways
+void sharedPrefixes()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/apple", tagged("apple")));
+    CHECK(router.add(HttpMethod::Get, "/app", tagged("app")));
+    CHECK(router.add(HttpMethod::Get, "/api/v1", tagged("v1")));
+    CHECK(router.add(HttpMethod::Get, "/api/v2", tagged("v2")));
+    CHECK(router.add(HttpMethod::Get, "/", tagged("root")));
+
+    CHECK_EQ(answer(router, "/apple"), "apple");
+    CHECK_EQ(answer(router, "/app"), "app");
+    CHECK_EQ(answer(router, "/api/v1"), "v1");
+    CHECK_EQ(answer(router, "/api/v2"), "v2");
+    CHECK_EQ(answer(router, "/"), "root");
+    CHECK_EQ(answer(router, "/ap"), "404");
+    CHECK_EQ(answer(router, "/api/v3"), "404");
+    CHECK_EQ(answer(router, "/apples"), "404");
+}
+
+void catchAll()
+{
+    Router router;
+    static const Route ROUTES[] = {
+        {HttpMethod::Get, "/*path", staticRoute},
+        {HttpMethod::Get, "/health", staticRoute},
+    };
+    CHECK(router.add(ROUTES));
+    CHECK_EQ(answer(router, "/health"), "static ");
+    CHECK_EQ(answer(router, "/healthz"), "static healthz");
+    CHECK_EQ(answer(router, "/css/site.css"), "static css/site.css");
+    CHECK_EQ(answer(router, "/"), "static ");
+}
+
+void methodNotAllowed()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/items/:id", tagged("get")));
+    CHECK(router.add("DELETE", "/items/:id", tagged("delete")));
+    CHECK(router.add(HttpMethod::Head, "/only-head", tagged("head")));
+
+    // HEAD falls back to GET
+    CHECK_EQ(answer(router, "/items/1", "HEAD"), "get id=1");
+    CHECK_EQ(answer(router, "/items/1", "DELETE"), "delete id=1");
+    CHECK_EQ(answer(router, "/only-head", "HEAD"), "head");
+    CHECK_EQ(answer(router, "/only-head"), "405");
+
+    HttpResponse response = get(router, "/items/1", "POST");
+    CHECK_EQ(response.statusCode, 405);
+    CHECK_EQ(response.headers.size(), 1u);
+    if (!response.headers.empty()) CHECK_EQ(response.headers[0].second, "GET, HEAD, DELETE");
+    CHECK_EQ(get(router, "/items/1", "BREW").statusCode, 405);
+    CHECK_EQ(get(router, "/nothing", "POST").statusCode, 404);
+
+    RouteParams params;
+    CHECK(router.find(HttpMethod::Get, "/items/9", params) != nullptr);
+    CHECK_EQ(params["id"].str(), "9");
+    CHECK(router.find(HttpMethod::Put, "/items/9", params) == nullptr);
+    CHECK(router.find(HttpMethod::Get, "/items", params) == nullptr);
+}
+
+// a pattern without a handler for the method is a dead end too, and 405
+// is only for a path no pattern takes with it
+void methodBacktracking()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/users/:id", tagged("user")));
+    CHECK(router.add(HttpMethod::Post, "/users/new", tagged("create")));
+    CHECK(router.add(HttpMethod::Delete, "/users/*rest", tagged("purge")));
+
+    CHECK_EQ(answer(router, "/users/new"), "user id=new");
+    CHECK_EQ(answer(router, "/users/new", "HEAD"), "user id=new");
+    CHECK_EQ(answer(router, "/users/new", "POST"), "create");
+    CHECK_EQ(answer(router, "/users/new", "DELETE"), "purge rest=new");
+    CHECK_EQ(answer(router, "/users/7/x", "DELETE"), "purge rest=7/x");
+    RouteParams params;
+    CHECK(router.find(HttpMethod::Get, "/users/new", params) != nullptr);
+    CHECK_EQ(params.size(), 1u);
+    CHECK_EQ(params["id"].str(), "new");
+    // the parameters of a branch given up on are not kept
+    CHECK(router.find(HttpMethod::Delete, "/users/new", params) != nullptr);
+    CHECK_EQ(params.size(), 1u);
+    CHECK_EQ(params["rest"].str(), "new");
+
+    // Allow names what any of the matching patterns take
+    HttpResponse response = get(router, "/users/new", "PUT");
+    CHECK_EQ(response.statusCode, 405);
+    if (!response.headers.empty()) CHECK_EQ(response.headers[0].second, "GET, HEAD, POST, DELETE");
+    response = get(router, "/users/7/x", "GET");
+    CHECK_EQ(response.statusCode, 405);
+    if (!response.headers.empty()) CHECK_EQ(response.headers[0].second, "DELETE");
+    CHECK_EQ(answer(router, "/accounts"), "404");
+}
+
+void refusedPatterns()
+{
+    Router router;
+    CHECK(router.add(HttpMethod::Get, "/users/:id", tagged("user")));
+    CHECK(!router.add(HttpMethod::Get, "/users/:id", tagged("again")));
+    CHECK(router.add(HttpMethod::Post, "/users/:id", tagged("post")));
+    // another name at the same position
+    CHECK(!router.add(HttpMethod::Put, "/users/:uid", tagged("put")));
+    CHECK(!router.add(HttpMethod::Get, "users", tagged("relative")));
+    CHECK(!router.add(HttpMethod::Get, "", tagged("empty")));
+    CHECK(!router.add(HttpMethod::Get, "/a:b", tagged("mid-segment")));
+    CHECK(!router.add(HttpMethod::Get, "/a/:", tagged("unnamed")));
+    CHECK(!router.add(HttpMethod::Get, "/a/*", tagged("unnamed")));
+    CHECK(!router.add(HttpMethod::Get, "/a/:b:c", tagged("two marks")));
+    CHECK(!router.add(HttpMethod::Get, "/a/*rest/more", tagged("not last")));
+    CHECK(!router.add(HttpMethod::Count, "/a", tagged("no method")));
+    CHECK(!router.add("BREW", "/a", tagged("unknown method")));
+    CHECK(!router.add(HttpMethod::Get, "/a", RouteHandler()));
+
+    std::string many;
+    for (size_t i = 0; i <= RouteParams::MAX; i++) many += "/:p" + std::to_string(i);
+    CHECK(!router.add(HttpMethod::Get, many, tagged("too many")));
+    many.erase(many.rfind('/'));
+    CHECK(router.add(HttpMethod::Get, many, tagged("most")));
+    CHECK_EQ(answer(router, "/1/2/3/4/5/6/7/8"), "most p0=1 p1=2 p2=3 p3=4 p4=5 p5=6 p6=7 p7=8");
+
+    // what was refused left nothing behind
+    CHECK_EQ(answer(router, "/users/5"), "user id=5");
+    CHECK_EQ(answer(router, "/users/5", "PUT"), "405");
+}
+
+} // namespace
+
+int main()
+{
+    methods();
+    precedence();
+    backtracking();
+    sharedPrefixes();
+    catchAll();
+    methodNotAllowed();
+    methodBacktracking();
+    refusedPatterns();
+    return checkResult();
+}
@@ -0,0 +1,246 @@
+// StaticFiles: paths that could leave the root, single byte ranges and
+// 416, and files changed or removed behind the cache, also while other
+// threads are serving them.
+#include "check.h"
+#include "staticfiles.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const std::string ALPHABET = "abcdefghijklmnopqrstuvwxyz";
+
+// a scratch root, removed again at the end
+class Root
+{
+public:
+    Root()
+    {
+        char pattern[] = "/tmp/staticfiles-test-XXXXXX";
+        const char *made = mkdtemp(pattern);
+        path = made != nullptr ? made : "";
+        mkdir((path + "/sub").c_str(), 0700);
+    }
+    ~Root()
+    {
+        for (const std::string &name : written) unlink((path + name).c_str());
+        rmdir((path + "/sub").c_str());
+        rmdir(path.c_str());
+    }
+
+    void write(const std::string &name, const std::string &contents)
+    {
+        // a new inode, as editors and deploys replace files
+        std::string temporary = path + "/.next";
+        FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) return;
+        std::fwrite(contents.data(), 1, contents.size(), file);
+        std::fclose(file);
+        std::rename(temporary.c_str(), (path + name).c_str());
+        written.push_back(name);
+    }
+
+    void remove(const std::string &name) { unlink((path + name).c_str()); }
+
+    std::string path;
+
+private:
+    std::vector<std::string> written;
+};
+
+struct Request
+{
+    std::string target;
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    // views into this, valid while it is
+    HttpRequest view() const
+    {
+        HttpRequest request;
+        request.method = StringView("GET");
+        request.target = StringView(target);
+        for (const auto &h : headers)
+        {
+            request.headers[request.headerCount].name = StringView(h.first);
+            request.headers[request.headerCount].value = StringView(h.second);
+            request.headerCount++;
+        }
+        return request;
+    }
+};
+
+HttpResponse get(StaticFiles &files, const std::string &target, const char *range = nullptr)
+{
+    Request request{target, {}};
+    if (range != nullptr) request.headers.emplace_back("Range", range);
+    return files.serve(request.view());
+}
+
+std::string header(const HttpResponse &response, const char *name)
+{
+    for (const auto &h : response.headers)
+    {
+        if (h.first == name) return h.second;
+    }
+    return "";
+}
+
+void paths()
+{
+    Root root;
+    root.write("/a.txt", ALPHABET);
+    root.write("/sub/index.html", "<p>index</p>");
+    StaticFiles files(root.path);
+
+    CHECK_EQ(get(files, "/a.txt").statusCode, 200);
+    CHECK_EQ(get(files, "/a.txt").fileLength, 26u);
+    CHECK_EQ(get(files, "//sub///../a.txt").statusCode, 404);
+    // empty segments collapse, and a directory gets its index
+    CHECK_EQ(get(files, "//a.txt").statusCode, 200);
+    CHECK_EQ(get(files, "/sub/").fileLength, 12u);
+    CHECK_EQ(get(files, "/%61.txt").statusCode, 200);
+
+    for (const char *escape : {"/../a.txt", "/sub/../a.txt", "/sub/..", "/./a.txt", "/%2e%2e/a.txt", "/%2E%2e/a.txt",
+                               "/sub/%2e%2e/a.txt", "/.%2e/a.txt", "/sub%2f..%2fa.txt", "/sub/%2e/../a.txt",
+                               "/..%5ca.txt", "/a.txt%00.png", "/a.txt%00", "/%", "/%2", "/%zz", "a.txt", ""})
+    {
+        HttpResponse response = get(files, escape);
+        CHECK_EQ(response.statusCode, 404);
+        if (response.statusCode != 404) std::fprintf(stderr, "  served %s\n", escape);
+    }
+    CHECK_EQ(get(files, "/missing.txt").statusCode, 404);
+    CHECK_EQ(get(files, "/sub").statusCode, 404);
+}
+
+void ranges()
+{
+    Root root;
+    root.write("/a.txt", ALPHABET);
+    root.write("/empty.txt", "");
+    StaticFiles files(root.path);
+
+    struct Case
+    {
+        const char *range;
+        int status;
+        uint64_t offset, length;
+    };
+    const Case cases[] = {
+        {"bytes=0-4", 206, 0, 5},
+        {"bytes=10-", 206, 10, 16},
+        {"bytes=25-25", 206, 25, 1},
+        {"bytes=20-999", 206, 20, 6},
+        // suffix ranges: the last n bytes, all of them when n is larger
+        {"bytes=-5", 206, 21, 5},
+        {"bytes=-26", 206, 0, 26},
+        {"bytes=-100", 206, 0, 26},
+        // not understood, or several: the whole file
+        {"bytes=5-2", 200, 0, 26},
+        {"bytes=0-1,3-4", 200, 0, 26},
+        {"items=0-1", 200, 0, 26},
+        {"bytes=x-1", 200, 0, 26},
+        {"bytes=-", 200, 0, 26},
+        {"bytes=1", 200, 0, 26},
+        {"bytes=-99999999999999999999", 200, 0, 26},
+    };
+    for (const Case &c : cases)
+    {
+        HttpResponse response = get(files, "/a.txt", c.range);
+        CHECK_EQ(response.statusCode, c.status);
+        CHECK_EQ(response.fileOffset, c.offset);
+        CHECK_EQ(response.fileLength, c.length);
+        if (c.status == 206)
+        {
+            std::string expected = "bytes " + std::to_string(c.offset) + "-" + std::to_string(c.offset + c.length - 1) +
+                                   "/26";
+            CHECK_EQ(header(response, "Content-Range"), expected);
+        }
+    }
+
+    // past the end, or nothing to take
+    for (const char *range : {"bytes=26-", "bytes=26-30", "bytes=-0"})
+    {
+        HttpResponse response = get(files, "/a.txt", range);
+        CHECK_EQ(response.statusCode, 416);
+        CHECK_EQ(header(response, "Content-Range"), "bytes */26");
+        CHECK(!response.file);
+    }
+    CHECK_EQ(get(files, "/empty.txt", "bytes=-1").statusCode, 416);
+    CHECK_EQ(get(files, "/empty.txt", "bytes=0-").statusCode, 416);
+
+    // an If-Range for another version gets the whole file
+    Request request{"/a.txt", {{"Range", "bytes=0-4"}, {"If-Range", "\"other\""}}};
+    HttpResponse response = files.serve(request.view());
+    CHECK_EQ(response.statusCode, 200);
+    CHECK_EQ(response.fileLength, 26u);
+}
+
+// with no revalidation period every request stat()s: an edit is served at
+// once, and a removed file is gone
+void revalidation()
+{
+    Root root;
+    root.write("/a.txt", ALPHABET);
+    StaticFiles files(root.path, 16, std::chrono::milliseconds(0));
+    CHECK_EQ(get(files, "/a.txt").fileLength, 26u);
+    root.write("/a.txt", "short");
+    CHECK_EQ(get(files, "/a.txt").fileLength, 5u);
+    root.remove("/a.txt");
+    CHECK_EQ(get(files, "/a.txt").statusCode, 404);
+
+    // within the period the cached entry stands
+    StaticFiles cached(root.path, 16, std::chrono::milliseconds(60000));
+    root.write("/b.txt", ALPHABET);
+    CHECK_EQ(get(cached, "/b.txt").fileLength, 26u);
+    root.write("/b.txt", "short");
+    CHECK_EQ(get(cached, "/b.txt").fileLength, 26u);
+}
+
+// threads serving while the file is replaced over and over: every answer
+// is one whole version (run under ASan or TSan to be sure)
+void concurrent()
+{
+    Root root;
+    root.write("/a.txt", ALPHABET);
+    root.write("/b.txt", ALPHABET);
+    StaticFiles files(root.path, 1, std::chrono::milliseconds(0));
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned> wrong(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&] {
+            while (!stop.load())
+            {
+                for (const char *target : {"/a.txt", "/b.txt"})
+                {
+                    HttpResponse response = get(files, target);
+                    if (response.statusCode != 200 || (response.fileLength != 26 && response.fileLength != 5))
+                        wrong++;
+                }
+            }
+        });
+    }
+    for (int round = 0; round < 300; round++) root.write("/a.txt", round % 2 ? "short" : ALPHABET);
+    stop = true;
+    for (std::thread &reader : readers) reader.join();
+    CHECK_EQ(wrong.load(), 0u);
+}
+
+} // namespace
+
+int main()
+{
+    paths();
+    ranges();
+    revalidation();
+    concurrent();
+    return checkResult();
+}
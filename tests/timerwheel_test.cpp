@@ -0,0 +1,201 @@
+// TimerWheel: timers fire in the advance() that reaches their deadline,
+// never before and never a tick late, on every level and across cascades;
+// cancel and reschedule, callbacks that rearm, and nextTimeout().
+#include "check.h"
+#include "timerwheel.h"
+#include <vector>
+
+namespace
+{
+
+// a small deterministic generator, so a failure repeats
+struct Random
+{
+    uint64_t state;
+    uint64_t next()
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return state >> 33;
+    }
+};
+
+void basic()
+{
+    TimerWheel wheel(1000);
+    TimerWheel::Timer timer;
+    timer.id = 7;
+    CHECK_EQ(wheel.nextTimeout(1000), -1);
+
+    wheel.schedule(timer, 1010);
+    CHECK(timer.pending());
+    CHECK_EQ(wheel.size(), 1u);
+    CHECK_EQ(wheel.nextTimeout(1000), 10);
+    CHECK_EQ(wheel.nextTimeout(1004), 6);
+
+    std::vector<uint64_t> fired;
+    auto fire = [&fired](uint64_t id) { fired.push_back(id); };
+    wheel.advance(1009, fire);
+    CHECK(fired.empty());
+    wheel.advance(1010, fire);
+    CHECK_EQ(fired.size(), 1u);
+    if (!fired.empty()) CHECK_EQ(fired[0], 7u);
+    CHECK(!timer.pending());
+    CHECK_EQ(wheel.size(), 0u);
+    CHECK_EQ(wheel.nextTimeout(1010), -1);
+
+    // one already due fires on the next tick
+    wheel.schedule(timer, 5);
+    CHECK_EQ(wheel.nextTimeout(1010), 1);
+    wheel.advance(1011, fire);
+    CHECK_EQ(fired.size(), 2u);
+}
+
+void cancelAndReschedule()
+{
+    TimerWheel wheel;
+    TimerWheel::Timer a, b, c;
+    a.id = 1;
+    b.id = 2;
+    c.id = 3;
+    wheel.schedule(a, 100);
+    wheel.schedule(b, 100);
+    wheel.schedule(c, 5000);
+    wheel.cancel(b);
+    wheel.cancel(b);
+    CHECK(!b.pending());
+    CHECK_EQ(wheel.size(), 2u);
+
+    // a live timer moves, earlier and later, without counting twice
+    wheel.schedule(c, 50);
+    wheel.schedule(a, 70000);
+    CHECK_EQ(wheel.size(), 2u);
+
+    std::vector<uint64_t> fired;
+    auto fire = [&fired](uint64_t id) { fired.push_back(id); };
+    wheel.advance(100, fire);
+    CHECK_EQ(fired.size(), 1u);
+    if (!fired.empty()) CHECK_EQ(fired[0], 3u);
+    wheel.advance(69999, fire);
+    CHECK_EQ(fired.size(), 1u);
+    wheel.advance(70000, fire);
+    CHECK_EQ(fired.size(), 2u);
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+// the callback may cancel a timer due in the same tick and rearm its own
+void callbacks()
+{
+    TimerWheel wheel;
+    TimerWheel::Timer periodic, victim;
+    periodic.id = 1;
+    victim.id = 2;
+    wheel.schedule(periodic, 10);
+    wheel.schedule(victim, 10);
+
+    std::vector<uint64_t> times;
+    uint64_t now = 0;
+    auto fire = [&](uint64_t id) {
+        CHECK_EQ(id, 1u);
+        times.push_back(now);
+        wheel.cancel(victim);
+        if (times.size() < 5) wheel.schedule(periodic, now + 300);
+    };
+    for (now = 1; now <= 2000; now++) wheel.advance(now, fire);
+    CHECK_EQ(times.size(), 5u);
+    for (size_t i = 0; i < times.size(); i++) CHECK_EQ(times[i], 10 + 300 * i);
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+// many timers on every level, the clock moved in uneven steps
+void everyLevel()
+{
+    const size_t N = 20000;
+    const uint64_t START = 1000000123;
+    TimerWheel wheel(START);
+    std::vector<TimerWheel::Timer> timers(N);
+    std::vector<uint64_t> firedAt(N, 0);
+    Random random{42};
+    for (size_t i = 0; i < N; i++)
+    {
+        // spread over 1 ms to about 4.6 hours, log-uniformly
+        uint64_t delay = 1 + (random.next() % (1ull << (1 + random.next() % 24)));
+        timers[i].id = i;
+        wheel.schedule(timers[i], START + delay);
+    }
+
+    uint64_t now = START, last = START;
+    bool early = false, late = false;
+    auto fire = [&](uint64_t id) {
+        firedAt[id] = now;
+        early = early || timers[id].expires > now;
+        late = late || timers[id].expires <= last;
+    };
+    while (wheel.size() != 0 && now < START + (1ull << 25))
+    {
+        last = now;
+        now += 1 + random.next() % 5000;
+        wheel.advance(now, fire);
+    }
+    CHECK(!early);
+    CHECK(!late);
+    CHECK_EQ(wheel.size(), 0u);
+    size_t unfired = 0;
+    for (uint64_t at : firedAt) unfired += at == 0;
+    CHECK_EQ(unfired, 0u);
+}
+
+// sleeping for nextTimeout() at a time never overshoots a deadline
+void drivenByTimeout()
+{
+    const size_t N = 500;
+    TimerWheel wheel(77);
+    std::vector<TimerWheel::Timer> timers(N);
+    Random random{7};
+    for (size_t i = 0; i < N; i++)
+    {
+        timers[i].id = i;
+        wheel.schedule(timers[i], 77 + 1 + random.next() % 3000000);
+    }
+
+    uint64_t now = 77;
+    size_t exact = 0, wakeups = 0;
+    while (wheel.size() != 0 && wakeups < 100000)
+    {
+        int timeout = wheel.nextTimeout(now);
+        CHECK(timeout > 0);
+        if (timeout <= 0) break;
+        now += (uint64_t)timeout;
+        wakeups++;
+        wheel.advance(now, [&](uint64_t id) { exact += timers[id].expires == now; });
+    }
+    CHECK_EQ(wheel.size(), 0u);
+    CHECK_EQ(exact, N);
+    // cascades wake early, but far fewer times than there are ticks
+    CHECK(wakeups < 5 * N);
+}
+
+void farFuture()
+{
+    TimerWheel wheel;
+    TimerWheel::Timer timer;
+    wheel.schedule(timer, 100ull * 24 * 3600 * 1000);
+    int timeout = wheel.nextTimeout(0);
+    CHECK(timeout > 0);
+    // clamped to the top level's span
+    CHECK((uint64_t)timeout <= (1ull << 32));
+    wheel.cancel(timer);
+    CHECK_EQ(wheel.nextTimeout(0), -1);
+}
+
+} // namespace
+
+int main()
+{
+    basic();
+    cancelAndReschedule();
+    callbacks();
+    everyLevel();
+    drivenByTimeout();
+    farFuture();
+    return checkResult();
+}
@@ -0,0 +1,209 @@
+// HttpServer with a worker pool: requests handed to the pool keep their
+// bodies, replies go out in request order, and streamed bodies are
+// compressed there.
+#include "check.h"
+#include "compression.h"
+#include "httptest.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+
+const int PORT = 18501;
+
+HttpResponse echo(const HttpRequest &request)
+{
+    // finishes after requests sent behind it
+    if (request.path() == "/slow") std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return HttpResponse::Builder().body(request.method.str() + " " + request.path().str() + " " + request.body.str()).build();
+}
+
+HttpOptions pool()
+{
+    HttpOptions http;
+    http.workers = 4;
+    return http;
+}
+
+// a chunked body lives in the parser, not in the bytes the pool copies
+void chunkedBodies()
+{
+    TestServer server(echo, PORT, pool());
+    CHECK(server.ready);
+
+    std::string stream = roundTrip(PORT, "POST /up HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                         "5\r\nhello\r\n7;ext=1\r\n, world\r\n0\r\nX-Trailer: 1\r\n\r\n"
+                                         "POST /fixed HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                                         "POST /last HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+                                         "3\r\nend\r\n0\r\n\r\n");
+    std::vector<TestResponse> responses = splitResponses(stream);
+    CHECK_EQ(responses.size(), 3u);
+    if (responses.size() != 3) return;
+    CHECK_EQ(responses[0].body, "POST /up hello, world");
+    CHECK_EQ(responses[1].body, "POST /fixed abc");
+    CHECK_EQ(responses[2].body, "POST /last end");
+}
+
+// replies leave in request order, whichever worker finishes first
+void pipelinedOrder()
+{
+    TestServer server(echo, PORT + 1, pool());
+    CHECK(server.ready);
+
+    std::string stream = roundTrip(PORT + 1, "GET /slow HTTP/1.1\r\n\r\n"
+                                             "GET /a HTTP/1.1\r\n\r\n"
+                                             "POST /b HTTP/1.1\r\nContent-Length: 1\r\n\r\nx"
+                                             "GET /c HTTP/1.1\r\nConnection: close\r\n\r\n"
+                                             "GET /unread HTTP/1.1\r\n\r\n");
+    std::vector<TestResponse> responses = splitResponses(stream);
+    CHECK_EQ(responses.size(), 4u);
+    if (responses.size() != 4) return;
+    CHECK_EQ(responses[0].body, "GET /slow ");
+    CHECK_EQ(responses[1].body, "GET /a ");
+    CHECK_EQ(responses[2].body, "POST /b x");
+    CHECK_EQ(responses[3].body, "GET /c ");
+    CHECK(responses[3].head.find("Connection: close") != std::string::npos);
+}
+
+// a malformed request is answered after the replies ahead of it
+void errorAfterPending()
+{
+    TestServer server(echo, PORT + 2, pool());
+    CHECK(server.ready);
+
+    std::string stream = roundTrip(PORT + 2, "GET /slow HTTP/1.1\r\n\r\n"
+                                             "GET /a HTTP/1.1\r\n\r\n"
+                                             "GET /bad HTTP/9.9\r\n\r\n");
+    std::vector<TestResponse> responses = splitResponses(stream);
+    CHECK_EQ(responses.size(), 3u);
+    if (responses.size() != 3) return;
+    CHECK_EQ(responses[0].body, "GET /slow ");
+    CHECK_EQ(responses[1].body, "GET /a ");
+    CHECK_EQ(responses[2].status, 505);
+    CHECK(responses[2].head.find("Connection: close") != std::string::npos);
+}
+
+// a request shed for load is answered after the replies ahead of it
+void shedAfterPending()
+{
+    HttpOptions http = pool();
+    http.maxInFlight = 1;
+    TestServer server(echo, PORT + 3, http);
+    CHECK(server.ready);
+
+    std::string stream = roundTrip(PORT + 3, "GET /slow HTTP/1.1\r\n\r\n"
+                                             "GET /a HTTP/1.1\r\n\r\n"
+                                             "GET /unread HTTP/1.1\r\n\r\n");
+    std::vector<TestResponse> responses = splitResponses(stream);
+    CHECK_EQ(responses.size(), 2u);
+    if (responses.size() != 2) return;
+    CHECK_EQ(responses[0].body, "GET /slow ");
+    CHECK_EQ(responses[1].status, 503);
+    CHECK(responses[1].head.find("Connection: close") != std::string::npos);
+}
+
+// a request still on the pool when its connection is closed leaves the
+// worker gauge where it was
+void inFlightAfterClose()
+{
+    std::string stream;
+    std::thread client;
+    {
+        ServerOptions options;
+        options.drainTimeoutMs = 10;
+        TestServer server(echo, PORT + 4, pool(), options);
+        CHECK(server.ready);
+        client = std::thread([&stream] { stream = roundTrip(PORT + 4, "GET /slow HTTP/1.1\r\n\r\n"); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+    client.join();
+    // closed by the drain before the handler returned
+    CHECK_EQ(stream, "");
+    CHECK(Metrics::render().find("\nhttp_worker_requests 0\n") != std::string::npos);
+}
+
+#ifdef HAVE_ZLIB
+// gzip data inflated whole; empty on an error
+std::string inflated(const std::string &data)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) return "";
+    std::string out;
+    char buffer[16384];
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = (uInt)data.size();
+    int rc = Z_OK;
+    while (rc == Z_OK)
+    {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return rc == Z_STREAM_END ? out : "";
+}
+
+// many windows of a streamed body, each encoded on the pool (or on the
+// reactor without one), arrive whole and in order
+void compressedStream()
+{
+    std::string body;
+    for (int i = 0; body.size() < 1000000; i++) body += "line " + std::to_string(i) + "\n";
+    HttpHandler streamed = [&body](const HttpRequest &) {
+        std::shared_ptr<size_t> at = std::make_shared<size_t>(0);
+        return HttpResponse::Builder()
+            .stream([&body, at](HttpBodyWriter &out) {
+                size_t len = std::min<size_t>(10000, body.size() - *at);
+                out.write(body.data() + *at, len);
+                *at += len;
+                return *at < body.size();
+            })
+            .build();
+    };
+
+    for (unsigned workers : {4u, 0u})
+    {
+        HttpOptions http;
+        http.workers = workers;
+        http.compress = true;
+        http.streamWindow = 16 * 1024;
+        int port = PORT + (workers != 0 ? 5 : 6);
+        TestServer server(streamed, port, http);
+        CHECK(server.ready);
+
+        std::string stream = roundTrip(port, "GET /a HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n"
+                                             "GET /b HTTP/1.1\r\nConnection: close\r\n\r\n");
+        std::vector<TestResponse> responses = splitResponses(stream);
+        CHECK_EQ(responses.size(), 2u);
+        if (responses.size() != 2) continue;
+        CHECK(responses[0].head.find("Content-Encoding: gzip\r\n") != std::string::npos);
+        CHECK(responses[0].body.size() < body.size() / 4);
+        CHECK(inflated(responses[0].body) == body);
+        CHECK(responses[1].head.find("Content-Encoding") == std::string::npos);
+        CHECK(responses[1].body == body);
+    }
+}
+#endif
+
+} // namespace
+
+int main()
+{
+    chunkedBodies();
+    pipelinedOrder();
+    errorAfterPending();
+    shedAfterPending();
+    inFlightAfterClose();
+#ifdef HAVE_ZLIB
+    if (contentCodingAvailable(ContentCoding::Gzip)) compressedStream();
+#endif
+    return checkResult();
+}